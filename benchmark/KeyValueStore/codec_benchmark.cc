@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "block_codec.h"
+#include "compressed_persistence.h"
+#include "partitioned_persistence.h"
+#include "persistence_abstraction.h"
+
+DEFINE_int32(users, 100000, "Number of synthetic Warble users.");
+DEFINE_int32(warbles_per_user, 10, "Warbles posted by each user.");
+DEFINE_string(block_sizes, "16384,65536,262144",
+              "Comma separated raw bytes per compressed block.");
+DEFINE_int32(threads, 0,
+             "Threads of the compressed format, 0 for one per hardware "
+             "thread.");
+DEFINE_string(file, "codec_benchmark_data",
+              "Store file in the working directory, removed after each run.");
+
+namespace cs499_fei {
+// Helper function: seconds elapsed since start.
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Helper function: generate the keys and values the Warble service stores
+// for its users and their warbles: prefixed keys, random decimal warble ids,
+// id lists and serialized Warble protos with short texts.
+StringKVMap WarbleDataset() {
+  static const std::vector<std::string> kWords = {
+      "the",   "warble", "today", "great", "news", "#cs499", "follow",
+      "thanks", "reply",  "what",  "about", "this", "really", "love"};
+  StringKVMap data;
+  std::mt19937 engine(42);
+  std::uniform_int_distribution<uint32_t> id_dist;
+  std::uniform_int_distribution<int> word_count(3, 24);
+  std::uniform_int_distribution<size_t> word_dist(0, kWords.size() - 1);
+  std::uniform_int_distribution<int> user_dist(0, FLAGS_users - 1);
+  for (int u = 0; u < FLAGS_users; ++u) {
+    std::string user = "user_" + std::to_string(u);
+    std::string warble_ids;
+    for (int w = 0; w < FLAGS_warbles_per_user; ++w) {
+      std::string id = std::to_string(id_dist(engine));
+      std::string text;
+      for (int k = word_count(engine); k > 0; --k) {
+        text += kWords[word_dist(engine)] + " ";
+      }
+      // a serialized Warble: tagged username, text, id and timestamp.
+      std::string warble = "\x0a" + std::string(1, char(user.size())) + user +
+                           "\x12" + std::string(1, char(text.size())) + text +
+                           "\x1a" + std::string(1, char(id.size())) + id +
+                           "\x2a\x0c\x08" + std::to_string(1600000000 + w);
+      data["warble_" + id] = std::move(warble);
+      warble_ids += (warble_ids.empty() ? "" : ",") + id;
+    }
+    data["user_warbles_user_" + user] = warble_ids;
+    data["user_followers_user_" + user] =
+        "user_" + std::to_string(user_dist(engine));
+    data["user_followings_user_" + user] = "INIT";
+  }
+  return data;
+}
+
+// Helper function: the pairs laid out as the raw body of a snapshot.
+std::string RawBody(const StringKVMap &data) {
+  std::string body;
+  for (const auto &p : data) {
+    uint32_t sizes[2] = {static_cast<uint32_t>(p.first.size()),
+                         static_cast<uint32_t>(p.second.size())};
+    body.append(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+    body.append(p.first);
+    body.append(p.second);
+  }
+  return body;
+}
+
+// Helper function: size of the file in bytes.
+size_t FileSize(const std::string &file_name) {
+  std::ifstream infile(file_name, std::ios::binary | std::ios::ate);
+  return infile.tellg();
+}
+
+// Helper function: compress and decompress the body in blocks of the size
+// on one thread, and print the ratio and the throughput of both.
+void RunCodec(const std::string &body, size_t block_size) {
+  std::vector<std::string> blocks;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t offset = 0; offset < body.size(); offset += block_size) {
+    blocks.emplace_back();
+    CompressBlock(std::string_view(body).substr(offset, block_size),
+                  &blocks.back());
+  }
+  double compress_seconds = SecondsSince(start);
+
+  size_t compressed = 0;
+  std::string raw;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    size_t raw_size = std::min(block_size, body.size() - i * block_size);
+    if (!DecompressBlock(blocks[i], raw_size, &raw)) {
+      std::cerr << "block " << i << " does not decompress" << std::endl;
+    }
+    compressed += blocks[i].size();
+  }
+  double decompress_seconds = SecondsSince(start);
+
+  double mb = body.size() / 1048576.0;
+  std::cout << std::setw(10) << block_size / 1024 << std::setw(10)
+            << std::fixed << std::setprecision(2)
+            << static_cast<double>(body.size()) / compressed << std::setw(16)
+            << std::setprecision(0) << mb / compress_seconds << std::setw(18)
+            << mb / decompress_seconds << std::endl;
+}
+
+// Helper function: store the data with the format, time a load, and print
+// the file size and both times.
+void RunFormat(const std::string &name, PersistenceAbstraction &persistence,
+               const StringKVMap &data) {
+  auto start = std::chrono::steady_clock::now();
+  persistence.serialize(data, FLAGS_file);
+  double store_seconds = SecondsSince(start);
+  size_t size = FileSize(FLAGS_file);
+  if (auto manifest = PartitionedPersistence::ReadManifest(FLAGS_file)) {
+    for (const auto &partition : manifest->partitions) {
+      size += FileSize(partition.file_name);
+    }
+  }
+
+  size_t pairs = 0;
+  start = std::chrono::steady_clock::now();
+  persistence.load(FLAGS_file,
+                   [&pairs](std::string_view, std::string_view) { ++pairs; });
+  double load_seconds = SecondsSince(start);
+  if (pairs != data.size()) {
+    std::cerr << name << ": loaded " << pairs << " of " << data.size()
+              << " pairs" << std::endl;
+  }
+
+  std::cout << std::left << std::setw(12) << name << std::right
+            << std::setw(10) << std::fixed << std::setprecision(1)
+            << size / 1048576.0 << std::setw(10) << std::setprecision(2)
+            << store_seconds << std::setw(10) << load_seconds << std::endl;
+  if (auto manifest = PartitionedPersistence::ReadManifest(FLAGS_file)) {
+    for (const auto &partition : manifest->partitions) {
+      std::remove(partition.file_name.c_str());
+    }
+  }
+  std::remove(FLAGS_file.c_str());
+}
+}  // namespace cs499_fei
+
+// Measure the snapshot block codec on a synthetic Warble dataset: the
+// compression ratio and single-thread MB/s per block size, then the size and
+// times of the compressed format against the uncompressed partitioned one.
+// The page cache holds the files, so the times measure CPU, not the disk.
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  cs499_fei::StringKVMap data = cs499_fei::WarbleDataset();
+  std::string body = cs499_fei::RawBody(data);
+  std::cout << data.size() << " pairs, " << std::fixed << std::setprecision(1)
+            << body.size() / 1048576.0 << " MB raw" << std::endl;
+
+  std::cout << "  block KB     ratio   compress MB/s   decompress MB/s"
+            << std::endl;
+  std::istringstream sizes(FLAGS_block_sizes);
+  std::string size;
+  while (std::getline(sizes, size, ',')) {
+    cs499_fei::RunCodec(body, std::stoul(size));
+  }
+
+  std::cout << "format       file MB   store s    load s" << std::endl;
+  cs499_fei::PartitionedPersistence partitioned(FLAGS_threads);
+  cs499_fei::RunFormat("partitioned", partitioned, data);
+  cs499_fei::CompressedPersistence compressed(FLAGS_threads);
+  cs499_fei::RunFormat("compressed", compressed, data);
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <grpcpp/grpcpp.h>
+
+#include "KeyValueStore.grpc.pb.h"
+
+DEFINE_string(target, "localhost:50000", "Address of the kvstore_server.");
+DEFINE_int32(streams, 1000, "Number of get streams open at once.");
+DEFINE_int32(seconds, 10, "Seconds every stream keeps sending requests.");
+DEFINE_int32(keys, 10000, "Number of distinct keys, put before the run.");
+DEFINE_int32(value_size, 100, "Bytes of every value.");
+DEFINE_int32(client_threads, 4,
+             "Number of client threads, each with its own channel and "
+             "completion queue.");
+
+namespace cs499_fei {
+using Clock = std::chrono::steady_clock;
+
+// One get stream, which sends a request once the reply of the previous one
+// arrived, and records the latency of every round trip.
+struct Stream {
+  // Operations the stream waits for; the stream is the tag of them all.
+  enum class State { kStarting, kWriting, kReading, kClosing, kFinishing };
+
+  grpc::ClientContext context;
+  std::unique_ptr<
+      grpc::ClientAsyncReaderWriter<kvstore::GetRequest, kvstore::GetReply>>
+      stream;
+  kvstore::GetRequest request;
+  kvstore::GetReply reply;
+  grpc::Status status;
+  State state = State::kStarting;
+  Clock::time_point sent;
+  std::mt19937 engine;
+};
+
+// Helper function: send the next request of the stream.
+void WriteNext(Stream *stream) {
+  std::uniform_int_distribution<int> key_dist(0, FLAGS_keys - 1);
+  stream->request.set_key("warble_" +
+                          std::to_string(key_dist(stream->engine)));
+  stream->state = Stream::State::kWriting;
+  stream->sent = Clock::now();
+  stream->stream->Write(stream->request, stream);
+}
+
+// Helper function: open streams streams on a channel of their own and drive
+// them from one completion queue until the deadline. Append the latency of
+// every request in nanoseconds to latencies, and count the failed streams.
+void RunStreams(int streams, Clock::time_point deadline,
+                std::vector<int64_t> *latencies, std::atomic<int> *failed) {
+  auto channel =
+      grpc::CreateChannel(FLAGS_target, grpc::InsecureChannelCredentials());
+  auto stub = kvstore::KeyValueStore::NewStub(channel);
+  grpc::CompletionQueue cq;
+  std::vector<std::unique_ptr<Stream>> all;
+  for (int i = 0; i < streams; ++i) {
+    all.push_back(std::make_unique<Stream>());
+    Stream *stream = all.back().get();
+    stream->engine.seed(i);
+    stream->stream = stub->Asyncget(&stream->context, &cq, stream);
+  }
+
+  int open = streams;
+  void *tag;
+  bool ok;
+  while (open > 0 && cq.Next(&tag, &ok)) {
+    auto *stream = static_cast<Stream *>(tag);
+    switch (stream->state) {
+      case Stream::State::kStarting:
+        if (!ok) {
+          ++*failed;
+          stream->state = Stream::State::kFinishing;
+          stream->stream->Finish(&stream->status, stream);
+          break;
+        }
+        WriteNext(stream);
+        break;
+      case Stream::State::kWriting:
+        stream->state = Stream::State::kReading;
+        stream->stream->Read(&stream->reply, stream);
+        break;
+      case Stream::State::kReading: {
+        Clock::time_point now = Clock::now();
+        if (ok) {
+          latencies->push_back(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  now - stream->sent)
+                  .count());
+        }
+        if (ok && now < deadline) {
+          WriteNext(stream);
+        } else {
+          stream->state = Stream::State::kClosing;
+          stream->stream->WritesDone(stream);
+        }
+        break;
+      }
+      case Stream::State::kClosing:
+        stream->state = Stream::State::kFinishing;
+        stream->stream->Finish(&stream->status, stream);
+        break;
+      case Stream::State::kFinishing:
+        if (!stream->status.ok()) {
+          ++*failed;
+        }
+        --open;
+        break;
+    }
+  }
+}
+}  // namespace cs499_fei
+
+// Load test of a running kvstore_server: open many get streams at once,
+// each sending its next request as soon as its reply arrived, and print the
+// throughput and the latency percentiles. Run it against the synchronous
+// server and against the server started with --async_server to compare
+// them.
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  int threads = std::max(FLAGS_client_threads, 1);
+
+  auto stub = kvstore::KeyValueStore::NewStub(
+      grpc::CreateChannel(FLAGS_target, grpc::InsecureChannelCredentials()));
+  const std::string value(FLAGS_value_size, 'v');
+  for (int i = 0; i < FLAGS_keys; ++i) {
+    grpc::ClientContext context;
+    kvstore::PutRequest request;
+    kvstore::PutReply reply;
+    request.set_key("warble_" + std::to_string(i));
+    request.set_value(value);
+    grpc::Status status = stub->put(&context, request, &reply);
+    if (!status.ok()) {
+      std::cerr << "Cannot put to " << FLAGS_target << ": "
+                << status.error_message() << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<std::vector<int64_t>> latencies(threads);
+  std::atomic<int> failed{0};
+  auto start = cs499_fei::Clock::now();
+  auto deadline = start + std::chrono::seconds(FLAGS_seconds);
+  std::vector<std::thread> clients;
+  for (int t = 0; t < threads; ++t) {
+    int streams = FLAGS_streams / threads + (t < FLAGS_streams % threads);
+    clients.emplace_back([streams, deadline, &latencies, &failed, t] {
+      cs499_fei::RunStreams(streams, deadline, &latencies[t], &failed);
+    });
+  }
+  for (auto &client : clients) {
+    client.join();
+  }
+  double seconds =
+      std::chrono::duration<double>(cs499_fei::Clock::now() - start).count();
+
+  std::vector<int64_t> all;
+  for (const auto &thread_latencies : latencies) {
+    all.insert(all.end(), thread_latencies.begin(), thread_latencies.end());
+  }
+  if (all.empty()) {
+    std::cerr << "No request completed, failed streams: " << failed
+              << std::endl;
+    return 1;
+  }
+  std::sort(all.begin(), all.end());
+  auto percentile_us = [&all](double p) {
+    return all[static_cast<size_t>(p * (all.size() - 1))] / 1000.0;
+  };
+  std::cout << FLAGS_streams << " get streams over " << threads
+            << " client threads for " << FLAGS_seconds << "s against "
+            << FLAGS_target << std::endl;
+  std::cout << "  requests/s   p50 us   p99 us p99.9 us   max us  failed"
+            << std::endl;
+  std::cout << std::fixed << std::setprecision(0) << std::setw(12)
+            << all.size() / seconds << std::setprecision(1) << std::setw(9)
+            << percentile_us(0.5) << std::setw(9) << percentile_us(0.99)
+            << std::setw(9) << percentile_us(0.999) << std::setw(9)
+            << all.back() / 1000.0 << std::setw(8) << failed << std::endl;
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "lockfree_map.h"
+#include "threadsafe_map.h"
+
+DEFINE_int32(threads, 4 * std::max(1u, std::thread::hardware_concurrency()),
+             "Number of writer threads. More threads than cores makes the "
+             "scheduler deschedule writers in the middle of a Put.");
+DEFINE_int32(ops, 100000, "Put operations executed by each writer thread.");
+DEFINE_int32(keys, 100000, "Number of distinct keys in the key space.");
+
+namespace cs499_fei {
+// Helper function: run the writers against the map and return the latency of
+// every Put in nanoseconds, sorted.
+std::vector<int64_t> RunPutLatency(KVMapAbstraction &map) {
+  std::vector<std::vector<int64_t>> latencies(FLAGS_threads);
+  std::vector<std::thread> writers;
+  for (int t = 0; t < FLAGS_threads; ++t) {
+    writers.emplace_back([&map, &latencies, t] {
+      std::mt19937 engine(t);
+      std::uniform_int_distribution<int> key_dist(0, FLAGS_keys - 1);
+      const std::string value(64, 'v');
+      latencies[t].reserve(FLAGS_ops);
+      for (int i = 0; i < FLAGS_ops; ++i) {
+        std::string key = "warble_" + std::to_string(key_dist(engine));
+        auto start = std::chrono::steady_clock::now();
+        map.Put(key, value);
+        auto end = std::chrono::steady_clock::now();
+        latencies[t].push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                .count());
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+
+  std::vector<int64_t> all;
+  for (const auto &l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  std::sort(all.begin(), all.end());
+  return all;
+}
+
+// Helper function: print the percentiles of the sorted latencies.
+void PrintLatency(const std::string &name, const std::vector<int64_t> &sorted) {
+  auto percentile = [&sorted](double p) {
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+  };
+  std::cout << std::left << std::setw(24) << name << std::right
+            << std::setw(10) << percentile(0.5) << std::setw(10)
+            << percentile(0.99) << std::setw(10) << percentile(0.999)
+            << std::setw(12) << sorted.back() << std::endl;
+}
+}  // namespace cs499_fei
+
+// Compare the Put latency tail of the storage engines when writers are
+// oversubscribed.
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  std::cout << FLAGS_threads << " writer threads, " << FLAGS_ops
+            << " Puts each" << std::endl;
+  std::cout << "engine                   p50 ns    p99 ns  p99.9 ns      max ns"
+            << std::endl;
+
+  cs499_fei::ThreadsafeMap single(1);
+  cs499_fei::PrintLatency("threadsafe_map 1 shard",
+                          cs499_fei::RunPutLatency(single));
+
+  cs499_fei::ThreadsafeMap sharded;
+  cs499_fei::PrintLatency(
+      "threadsafe_map " + std::to_string(sharded.ShardCount()) + " shards",
+      cs499_fei::RunPutLatency(sharded));
+
+  cs499_fei::LockFreeMap lockfree(2 * FLAGS_keys);
+  cs499_fei::PrintLatency("lockfree_map", cs499_fei::RunPutLatency(lockfree));
+
+  // Starting from a small table, the writers rebuild it as the keys arrive,
+  // so the tail shows the pause of a rebuild.
+  cs499_fei::LockFreeMap growing(1024);
+  cs499_fei::PrintLatency("lockfree_map growing",
+                          cs499_fei::RunPutLatency(growing));
+  return 0;
+}
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <chrono>
+#include <experimental/filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "lsm_map.h"
+#include "threadsafe_map.h"
+
+DEFINE_int32(ops, 200000, "Put operations, then Get operations.");
+DEFINE_int32(keys, 100000, "Number of distinct keys in the key space.");
+DEFINE_int32(value_size, 100, "Bytes of every value.");
+DEFINE_string(directory, "lsm_benchmark_data",
+              "Directory of the LSM engine, removed after the run.");
+DEFINE_uint64(memtable_bytes, 4 << 20, "Bytes of the LSM memtable.");
+DEFINE_uint64(cache_bytes, 8 << 20, "Bytes of the LSM block cache.");
+
+namespace cs499_fei {
+namespace fs = std::experimental::filesystem;
+
+// Helper function: time fn for every op on keys with the suffix in
+// nanoseconds, sorted.
+template <typename Fn>
+std::vector<int64_t> MeasureLatency(const std::string &suffix, Fn fn) {
+  std::mt19937 engine(42);
+  std::uniform_int_distribution<int> key_dist(0, FLAGS_keys - 1);
+  std::vector<int64_t> latencies;
+  latencies.reserve(FLAGS_ops);
+  for (int i = 0; i < FLAGS_ops; ++i) {
+    std::string key = "warble_" + std::to_string(key_dist(engine)) + suffix;
+    auto start = std::chrono::steady_clock::now();
+    fn(key);
+    auto end = std::chrono::steady_clock::now();
+    latencies.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  return latencies;
+}
+
+// Helper function: put and then get random keys, get keys which were never
+// put, and print the percentiles of all three.
+void RunEngine(const std::string &name, KVMapAbstraction &map) {
+  const std::string value(FLAGS_value_size, 'v');
+  auto puts = MeasureLatency(
+      "", [&map, &value](const std::string &key) { map.Put(key, value); });
+  auto get = [&map](const std::string &key) { map.Get(key); };
+  auto gets = MeasureLatency("", get);
+  auto misses = MeasureLatency("_absent", get);
+  auto percentile = [](const std::vector<int64_t> &sorted, double p) {
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+  };
+  std::cout << std::left << std::setw(16) << name << std::right
+            << std::setw(12) << percentile(puts, 0.5) << std::setw(12)
+            << percentile(puts, 0.99) << std::setw(12) << percentile(gets, 0.5)
+            << std::setw(12) << percentile(gets, 0.99) << std::setw(12)
+            << percentile(misses, 0.5) << std::setw(12)
+            << percentile(misses, 0.99) << std::endl;
+}
+}  // namespace cs499_fei
+
+// Compare the in-memory engine with the LSM engine: Put and Get latency, and
+// for the LSM engine the bytes it writes and reads per byte and lookup, and
+// the false-positive rate of the Bloom filters of both.
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  std::cout << FLAGS_ops << " Puts then " << FLAGS_ops << " Gets over "
+            << FLAGS_keys << " keys of " << FLAGS_value_size << " bytes"
+            << std::endl;
+  std::cout << "engine           put p50 ns  put p99 ns  get p50 ns  get p99 ns"
+               " miss p50 ns miss p99 ns"
+            << std::endl;
+
+  cs499_fei::ThreadsafeMap threadsafe;
+  cs499_fei::RunEngine("threadsafe_map", threadsafe);
+  cs499_fei::ThreadsafeMap::FilterStats filters = threadsafe.GetFilterStats();
+
+  cs499_fei::fs::remove_all(FLAGS_directory);
+  cs499_fei::LsmMap::Stats stats;
+  {
+    cs499_fei::LsmMap::Options options;
+    options.memtable_bytes = FLAGS_memtable_bytes;
+    options.cache_bytes = FLAGS_cache_bytes;
+    cs499_fei::LsmMap lsm(FLAGS_directory, options);
+    cs499_fei::RunEngine("lsm_map", lsm);
+    lsm.WaitForCompactions();
+    stats = lsm.GetStats();
+  }
+  cs499_fei::fs::remove_all(FLAGS_directory);
+
+  std::cout << std::fixed << std::setprecision(2)
+            << "lsm_map write amplification: " << stats.WriteAmplification()
+            << ", read bytes per lookup: " << stats.ReadBytesPerLookup()
+            << ", cache hits: " << stats.cache.hits
+            << ", cache misses: " << stats.cache.misses << std::endl;
+  std::cout << std::setprecision(4)
+            << "threadsafe_map filter false positive rate: "
+            << filters.FalsePositiveRate() << ", filter bytes: "
+            << filters.bytes << std::endl;
+  std::cout << "lsm_map filter false positive rate: "
+            << stats.FilterFalsePositiveRate()
+            << ", filter bytes: " << stats.filter_bytes << std::endl;
+  for (size_t level = 0; level < stats.level_runs.size(); ++level) {
+    if (stats.level_runs[level] > 0) {
+      std::cout << "level " << level << ": " << stats.level_runs[level]
+                << " runs, " << stats.level_bytes[level] << " bytes"
+                << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,179 @@
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "threadsafe_map.h"
+
+DEFINE_int32(users, 100000, "Number of synthetic Warble users.");
+DEFINE_int32(warbles_per_user, 10, "Warbles posted by each user.");
+DEFINE_int32(keep_percent, 20,
+             "Percentage of the warbles kept in the churn phase.");
+
+namespace cs499_fei {
+// Resident set size of this process, in bytes.
+size_t ResidentBytes() {
+  // give freed heap memory back first, so both maps are measured alike.
+  malloc_trim(0);
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0;
+  size_t resident = 0;
+  statm >> pages >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// A key-value pair of the synthetic Warble dataset.
+struct Pair {
+  std::string key;
+  std::string value;
+};
+
+// Helper function: generate the keys and values the Warble service stores for
+// its users and their warbles, with similar sizes.
+std::vector<Pair> WarbleDataset() {
+  std::vector<Pair> pairs;
+  std::mt19937 engine(42);
+  std::uniform_int_distribution<int> text_length(20, 140);
+  std::uniform_int_distribution<int> user_dist(0, FLAGS_users - 1);
+  for (int u = 0; u < FLAGS_users; ++u) {
+    std::string user = "user_" + std::to_string(u);
+    std::string warble_ids;
+    for (int w = 0; w < FLAGS_warbles_per_user; ++w) {
+      std::string id = std::to_string(u * FLAGS_warbles_per_user + w);
+      // a serialized Warble: username, text, id and timestamp fields.
+      std::string warble = user + std::string(text_length(engine), 't') + id +
+                           std::string(16, '0');
+      pairs.push_back({"warble_" + id, std::move(warble)});
+      warble_ids += (warble_ids.empty() ? "" : ",") + id;
+    }
+    pairs.push_back({"user_warbles_" + user, warble_ids});
+    pairs.push_back({"user_followers_" + user,
+                     "user_" + std::to_string(user_dist(engine))});
+    pairs.push_back({"user_followings_" + user, "INIT"});
+  }
+  return pairs;
+}
+
+// Resident bytes of one map after each phase.
+struct Footprint {
+  size_t empty = 0;
+  size_t loaded = 0;
+  size_t churned = 0;
+  size_t compacted = 0;
+};
+
+// Helper function: load the dataset into the map, remove most of the
+// warbles, then compact when the map supports it.
+template <typename Map>
+Footprint Measure(Map &map, const std::vector<Pair> &pairs,
+                  const std::function<void(Map &, const Pair &)> &put,
+                  const std::function<void(Map &, const std::string &)> &remove,
+                  const std::function<void(Map &)> &compact) {
+  Footprint footprint;
+  footprint.empty = ResidentBytes();
+  for (const auto &pair : pairs) {
+    put(map, pair);
+  }
+  footprint.loaded = ResidentBytes();
+  for (size_t i = 0; i < pairs.size(); ++i) {
+    if (pairs[i].key.rfind("warble_", 0) == 0 &&
+        static_cast<int>(i % 100) >= FLAGS_keep_percent) {
+      remove(map, pairs[i].key);
+    }
+  }
+  footprint.churned = ResidentBytes();
+  compact(map);
+  footprint.compacted = ResidentBytes();
+  return footprint;
+}
+
+// Helper function: run measure in a child process, so every map starts from
+// a fresh heap, and return its footprint.
+Footprint InChild(const std::function<Footprint()> &measure) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return Footprint();
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    Footprint footprint = measure();
+    ssize_t written = write(fds[1], &footprint, sizeof(footprint));
+    _exit(written == sizeof(footprint) ? 0 : 1);
+  }
+  close(fds[1]);
+  Footprint footprint;
+  if (read(fds[0], &footprint, sizeof(footprint)) != sizeof(footprint)) {
+    footprint = Footprint();
+  }
+  close(fds[0]);
+  waitpid(pid, nullptr, 0);
+  return footprint;
+}
+
+// Helper function: print one row of the result table, in MiB over the empty
+// map.
+void PrintFootprint(const std::string &name, const Footprint &footprint,
+                    size_t keys) {
+  auto mib = [&](size_t bytes) {
+    return (static_cast<double>(bytes) - footprint.empty) / (1 << 20);
+  };
+  std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(10) << mib(footprint.loaded)
+            << std::setw(10) << mib(footprint.churned) << std::setw(11)
+            << mib(footprint.compacted) << std::setw(14)
+            << (static_cast<double>(footprint.loaded) - footprint.empty) / keys
+            << std::endl;
+}
+}  // namespace cs499_fei
+
+// Compare the resident memory of the Warble dataset in a plain hashmap with
+// heap-allocated keys and values (the layout before the slab arenas) and in
+// the ThreadsafeMap, after loading, after removing most warbles, and after
+// compacting.
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  using cs499_fei::Footprint;
+  using cs499_fei::Pair;
+  using cs499_fei::SharedKVMap;
+  using cs499_fei::ThreadsafeMap;
+
+  const std::vector<Pair> pairs = cs499_fei::WarbleDataset();
+
+  Footprint heap = cs499_fei::InChild([&] {
+    SharedKVMap map;
+    return cs499_fei::Measure<SharedKVMap>(
+        map, pairs,
+        [](SharedKVMap &m, const Pair &p) {
+          m[p.key] = cs499_fei::MakeValue(p.value);
+        },
+        [](SharedKVMap &m, const std::string &key) { m.erase(key); },
+        [](SharedKVMap &) {});
+  });
+
+  Footprint arena = cs499_fei::InChild([&] {
+    ThreadsafeMap map;
+    return cs499_fei::Measure<ThreadsafeMap>(
+        map, pairs,
+        [](ThreadsafeMap &m, const Pair &p) { m.Put(p.key, p.value); },
+        [](ThreadsafeMap &m, const std::string &key) { m.Remove(key); },
+        [](ThreadsafeMap &m) { m.Compact(); });
+  });
+
+  std::cout << pairs.size() << " keys, RSS in MiB" << std::endl;
+  std::cout << "map                         loaded   churned  compacted"
+            << "  loaded B/key" << std::endl;
+  cs499_fei::PrintFootprint("heap hashmap", heap, pairs.size());
+  cs499_fei::PrintFootprint("threadsafe_map (arena)", arena, pairs.size());
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "binary_persistence.h"
+#include "compressed_persistence.h"
+#include "partitioned_persistence.h"
+#include "persistence.h"
+#include "threadsafe_map.h"
+
+DEFINE_string(key_counts, "1000000,10000000",
+              "Comma separated numbers of keys to store and restart with.");
+DEFINE_int32(value_size, 64, "Bytes of every value.");
+DEFINE_string(file, "persistence_benchmark_data",
+              "Store file in the working directory, removed after each run.");
+
+namespace cs499_fei {
+// Helper function: seconds elapsed since start.
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Helper function: the files of the store, with the partitions its
+// manifest names if it has one.
+std::vector<std::string> StoreFiles(const std::string &file_name) {
+  std::vector<std::string> files = {file_name};
+  if (auto manifest = PartitionedPersistence::ReadManifest(file_name)) {
+    for (const auto &partition : manifest->partitions) {
+      files.push_back(partition.file_name);
+    }
+  }
+  return files;
+}
+
+// Helper function: size of the files in bytes.
+size_t FileSize(const std::vector<std::string> &files) {
+  size_t size = 0;
+  for (const auto &file_name : files) {
+    std::ifstream infile(file_name, std::ios::binary | std::ios::ate);
+    size += infile.tellg();
+  }
+  return size;
+}
+
+// Helper function: store the data with the format, then time a restart of
+// the server's map from the file, and print both.
+void RunFormat(const std::string &name, const PersistPtr &persist_ptr,
+               const StringKVMap &data) {
+  auto start = std::chrono::steady_clock::now();
+  persist_ptr->serialize(data, FLAGS_file);
+  double store_seconds = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  ThreadsafeMap restored(persist_ptr, FLAGS_file);
+  double restart_seconds = SecondsSince(start);
+  std::vector<std::string> files = StoreFiles(FLAGS_file);
+  if (restored.Get(data.begin()->first) != data.begin()->second) {
+    std::cerr << name << ": restored map differs" << std::endl;
+  }
+
+  std::cout << std::left << std::setw(8) << name << std::right
+            << std::setw(12) << data.size() << std::setw(12) << std::fixed
+            << std::setprecision(1) << FileSize(files) / 1048576.0
+            << std::setw(12) << std::setprecision(2) << store_seconds
+            << std::setw(12) << restart_seconds << std::endl;
+  for (const auto &file_name : files) {
+    std::remove(file_name.c_str());
+  }
+}
+}  // namespace cs499_fei
+
+// Compare the store and restart time of the text, binary, partitioned and
+// compressed formats. The partitioned format uses one partition per hardware
+// thread, the compressed one a codec thread per hardware thread.
+// The page cache holds the file, so the restart measures parsing, not the
+// disk.
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  std::cout << "format          keys     file MB   store s   restart s"
+            << std::endl;
+  std::istringstream counts(FLAGS_key_counts);
+  std::string count;
+  while (std::getline(counts, count, ',')) {
+    cs499_fei::StringKVMap data;
+    size_t keys = std::stoul(count);
+    data.reserve(keys);
+    for (size_t i = 0; i < keys; ++i) {
+      data["warble_" + std::to_string(i)] =
+          std::string(FLAGS_value_size, 'a' + i % 26);
+    }
+    cs499_fei::RunFormat("text", std::make_shared<cs499_fei::Persistence>(),
+                         data);
+    cs499_fei::RunFormat("binary",
+                         std::make_shared<cs499_fei::BinaryPersistence>(),
+                         data);
+    cs499_fei::RunFormat(
+        "parted", std::make_shared<cs499_fei::PartitionedPersistence>(), data);
+    cs499_fei::RunFormat(
+        "lz", std::make_shared<cs499_fei::CompressedPersistence>(), data);
+  }
+  return 0;
+}
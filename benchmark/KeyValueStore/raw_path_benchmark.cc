@@ -0,0 +1,146 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/impl/codegen/proto_utils.h>
+
+#include "KeyValueStore.pb.h"
+#include "threadsafe_map.h"
+#include "wire_format.h"
+
+DEFINE_int32(ops, 1000000, "Puts and gets of every value size and path.");
+DEFINE_int32(keys, 10000, "Number of distinct keys.");
+DEFINE_string(value_sizes, "64,1024,16384",
+              "Comma separated bytes of the values.");
+
+namespace cs499_fei {
+using Clock = std::chrono::steady_clock;
+
+// Helper function: the message serialized into a buffer of one slice, as
+// gRPC hands a received message to the server.
+grpc::ByteBuffer Received(const google::protobuf::Message &message) {
+  grpc::Slice slice(message.SerializeAsString());
+  return grpc::ByteBuffer(&slice, 1);
+}
+
+// Helper function: run op(i) for every i below FLAGS_ops on this thread and
+// print a row of the table with the nanoseconds per operation and the
+// message bytes handled per second.
+template <typename Op>
+void Measure(const std::string &name, size_t value_size,
+             size_t bytes_per_op, Op op) {
+  auto start = Clock::now();
+  for (int i = 0; i < FLAGS_ops; ++i) {
+    op(i);
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  std::cout << std::left << std::setw(14) << name << std::right
+            << std::setw(8) << value_size << std::fixed << std::setprecision(1)
+            << std::setw(10) << seconds * 1e9 / FLAGS_ops << std::setw(12)
+            << bytes_per_op * FLAGS_ops / seconds / (1 << 20) << std::endl;
+}
+
+// Helper function: measure the put and get paths of the messages and of the
+// raw bytes with values of value_size bytes.
+void RunValueSize(size_t value_size) {
+  std::vector<grpc::ByteBuffer> puts;
+  std::vector<grpc::ByteBuffer> gets;
+  for (int k = 0; k < FLAGS_keys; ++k) {
+    kvstore::PutRequest put;
+    put.set_key("warble_" + std::to_string(k));
+    put.set_value(std::string(value_size, 'v'));
+    puts.push_back(Received(put));
+    kvstore::GetRequest get;
+    get.set_key(put.key());
+    gets.push_back(Received(get));
+  }
+  size_t put_bytes = puts[0].Length();
+  kvstore::GetReply sample;
+  sample.set_value(std::string(value_size, 'v'));
+  sample.set_version(1);
+  size_t get_bytes = sample.ByteSizeLong();
+
+  // the typed path: gRPC parses a message, copying the bytes fields, and
+  // serializes the reply, copying the value again.
+  {
+    ThreadsafeMap kv_map;
+    kvstore::PutRequest put;
+    Measure("put messages", value_size, put_bytes, [&](int i) {
+      grpc::ByteBuffer buffer(puts[i % FLAGS_keys]);
+      grpc::SerializationTraits<kvstore::PutRequest>::Deserialize(&buffer,
+                                                                  &put);
+      kv_map.Put(put.key(), put.value());
+    });
+    kvstore::GetRequest get;
+    kvstore::GetReply reply;
+    Measure("get messages", value_size, get_bytes, [&](int i) {
+      grpc::ByteBuffer buffer(gets[i % FLAGS_keys]);
+      grpc::SerializationTraits<kvstore::GetRequest>::Deserialize(&buffer,
+                                                                  &get);
+      uint64_t version;
+      ValuePtr value = kv_map.GetVersioned(get.key(), &version);
+      reply.Clear();
+      if (value) {
+        reply.set_value(value->data(), value->size());
+        reply.set_version(version);
+      }
+      grpc::ByteBuffer sent;
+      bool own_buffer;
+      grpc::SerializationTraits<kvstore::GetReply>::Serialize(reply, &sent,
+                                                              &own_buffer);
+    });
+  }
+
+  // the raw path of the asynchronous server: the fields are read in place
+  // and the store takes the only copy of a value.
+  {
+    ThreadsafeMap kv_map;
+    grpc::Slice slice;
+    std::string scratch;
+    std::string key;
+    Measure("put raw", value_size, put_bytes, [&](int i) {
+      grpc::ByteBuffer buffer(puts[i % FLAGS_keys]);
+      std::string_view bytes;
+      PutRequestView put;
+      MessageBytes(buffer, &slice, &scratch, &bytes);
+      ParsePutRequest(bytes, &put);
+      key.assign(put.key.data(), put.key.size());
+      kv_map.Put(key, put.value);
+    });
+    Measure("get raw", value_size, get_bytes, [&](int i) {
+      grpc::ByteBuffer buffer(gets[i % FLAGS_keys]);
+      std::string_view bytes;
+      std::string_view get;
+      MessageBytes(buffer, &slice, &scratch, &bytes);
+      ParseGetRequest(bytes, &get);
+      key.assign(get.data(), get.size());
+      uint64_t version;
+      ValuePtr value = kv_map.GetVersioned(key, &version);
+      grpc::ByteBuffer sent = GetReplyBuffer(value, version);
+    });
+  }
+}
+}  // namespace cs499_fei
+
+// Per-core cost of the put and get paths of the server over messages
+// against the raw path of the asynchronous server, which reads the fields
+// of a request in place and replies long values without a copy. Every
+// operation decodes a request from a received buffer, runs it against the
+// in-memory engine and, for gets, encodes the reply, all on one thread.
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  grpc_init();
+  std::cout << "path          value B     ns/op    MB/s/core" << std::endl;
+  std::stringstream sizes(FLAGS_value_sizes);
+  std::string size;
+  while (std::getline(sizes, size, ',')) {
+    cs499_fei::RunValueSize(std::stoul(size));
+  }
+  grpc_shutdown();
+  return 0;
+}
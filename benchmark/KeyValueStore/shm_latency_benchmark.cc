@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <grpcpp/grpcpp.h>
+
+#include "keyvaluestore_client.h"
+#include "shm_storage.h"
+
+DEFINE_string(target, "localhost:50000", "Address of the kvstore_server.");
+DEFINE_string(shm, "kvstore",
+              "Shared-memory segment of the kvstore_server, as given to its "
+              "--shm.");
+DEFINE_int32(ops, 100000, "Single-key gets over every transport.");
+DEFINE_int32(keys, 10000, "Number of distinct keys, put before the run.");
+DEFINE_int32(value_size, 100, "Bytes of every value.");
+
+namespace cs499_fei {
+using Clock = std::chrono::steady_clock;
+
+// Helper function: get one random key at a time through storage, as a
+// Warble handler does, and print a row of the table with the latency
+// percentiles of the gets.
+void Measure(const std::string &name, StorageAbstraction *storage) {
+  std::mt19937 engine(1);
+  std::uniform_int_distribution<int> key_dist(0, FLAGS_keys - 1);
+  std::vector<int64_t> latencies;
+  latencies.reserve(FLAGS_ops);
+  int missing = 0;
+  for (int i = 0; i < FLAGS_ops; ++i) {
+    StringVector keys{"warble_" + std::to_string(key_dist(engine))};
+    auto start = Clock::now();
+    StringOptionalVector values = storage->Get(keys);
+    latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            Clock::now() - start)
+                            .count());
+    if (!values[0].has_value() ||
+        values[0]->size() != static_cast<size_t>(FLAGS_value_size)) {
+      ++missing;
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile_us = [&latencies](double p) {
+    return latencies[static_cast<size_t>(p * (latencies.size() - 1))] /
+           1000.0;
+  };
+  std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(9) << percentile_us(0.5)
+            << std::setw(9) << percentile_us(0.99) << std::setw(9)
+            << percentile_us(0.999) << std::setw(9)
+            << latencies.back() / 1000.0 << std::setw(9) << missing
+            << std::endl;
+}
+}  // namespace cs499_fei
+
+// Latency of single-key gets from a running kvstore_server started with
+// --shm, through the gRPC client the Func server uses by default and through
+// the shared-memory client, one get at a time from one thread.
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_ops <= 0) {
+    return 0;
+  }
+
+  cs499_fei::KeyValueStoreClient grpc_storage(
+      grpc::CreateChannel(FLAGS_target, grpc::InsecureChannelCredentials()));
+  cs499_fei::ShmStorage shm_storage(FLAGS_shm);
+  const std::string value(FLAGS_value_size, 'v');
+  for (int i = 0; i < FLAGS_keys; ++i) {
+    shm_storage.Put("warble_" + std::to_string(i), value);
+  }
+  if (!shm_storage.Get({"warble_0"})[0].has_value()) {
+    std::cerr << "No kvstore_server serves shared-memory segment "
+              << FLAGS_shm << std::endl;
+    return 1;
+  }
+
+  std::cout << FLAGS_ops << " single-key gets of " << FLAGS_value_size
+            << " byte values" << std::endl;
+  std::cout << "transport        p50 us   p99 us p99.9 us   max us  missing"
+            << std::endl;
+  cs499_fei::Measure("grpc", &grpc_storage);
+  cs499_fei::Measure("shared memory", &shm_storage);
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "threadsafe_map.h"
+
+DEFINE_int32(threads, 8, "Maximum number of worker threads.");
+DEFINE_int32(ops, 200000, "Operations executed by each worker thread.");
+DEFINE_int32(keys, 100000, "Number of distinct keys in the key space.");
+DEFINE_int32(get_percent, 80, "Percentage of operations which are Get.");
+DEFINE_int32(shards, cs499_fei::ThreadsafeMap::kDefaultShardCount,
+             "Number of shards of the sharded map.");
+
+namespace cs499_fei {
+// Helper function: run `threads` workers issuing a random mix of Get, Put and
+// Remove against the map, and return the throughput in operations/second.
+double RunContention(ThreadsafeMap &map, int threads) {
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&map, t] {
+      std::mt19937 engine(t);
+      std::uniform_int_distribution<int> key_dist(0, FLAGS_keys - 1);
+      std::uniform_int_distribution<int> op_dist(0, 99);
+      const std::string value(64, 'v');
+      for (int i = 0; i < FLAGS_ops; ++i) {
+        std::string key = "user_warbles_user_" + std::to_string(key_dist(engine));
+        int op = op_dist(engine);
+        if (op < FLAGS_get_percent) {
+          map.Get(key);
+        } else if (op < FLAGS_get_percent + (100 - FLAGS_get_percent) / 2) {
+          map.Put(key, value);
+        } else {
+          map.Remove(key);
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return static_cast<double>(threads) * FLAGS_ops / elapsed.count();
+}
+
+// Helper function: run `readers` workers issuing only Get against the map, and
+// return the throughput in operations/second.
+double RunReadScaling(const ThreadsafeMap &map, int readers) {
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < readers; ++t) {
+    workers.emplace_back([&map, t] {
+      std::mt19937 engine(t);
+      std::uniform_int_distribution<int> key_dist(0, FLAGS_keys - 1);
+      for (int i = 0; i < FLAGS_ops; ++i) {
+        map.Get("user_warbles_user_" + std::to_string(key_dist(engine)));
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return static_cast<double>(readers) * FLAGS_ops / elapsed.count();
+}
+
+// Helper function: pre-load every key so Get hits as often as it misses.
+void Populate(ThreadsafeMap &map) {
+  const std::string value(64, 'v');
+  for (int i = 0; i < FLAGS_keys; i += 2) {
+    map.Put("user_warbles_user_" + std::to_string(i), value);
+  }
+}
+}  // namespace cs499_fei
+
+// 1. Compare the single-mutex map (1 shard) with the sharded map under a
+//    growing number of contending threads.
+// 2. Show how read-only throughput grows as reader threads are added. The
+//    single-shard map puts every reader on the same lock.
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  std::cout << "threads  single-mutex ops/s  " << FLAGS_shards
+            << "-shard ops/s  speedup" << std::endl;
+  for (int threads = 1; threads <= FLAGS_threads; threads *= 2) {
+    cs499_fei::ThreadsafeMap single(1);
+    cs499_fei::ThreadsafeMap sharded(FLAGS_shards);
+    cs499_fei::Populate(single);
+    cs499_fei::Populate(sharded);
+
+    double single_ops = cs499_fei::RunContention(single, threads);
+    double sharded_ops = cs499_fei::RunContention(sharded, threads);
+    std::cout << std::setw(7) << threads << std::setw(21) << std::fixed
+              << std::setprecision(0) << single_ops << std::setw(16)
+              << sharded_ops << std::setw(9) << std::setprecision(2)
+              << sharded_ops / single_ops << std::endl;
+  }
+
+  std::cout << std::endl
+            << "readers  1-shard Get/s  " << FLAGS_shards << "-shard Get/s"
+            << std::endl;
+  cs499_fei::ThreadsafeMap single(1);
+  cs499_fei::ThreadsafeMap sharded(FLAGS_shards);
+  cs499_fei::Populate(single);
+  cs499_fei::Populate(sharded);
+  for (int readers = 1; readers <= FLAGS_threads; readers *= 2) {
+    std::cout << std::setw(7) << readers << std::setw(15) << std::fixed
+              << std::setprecision(0)
+              << cs499_fei::RunReadScaling(single, readers) << std::setw(15)
+              << cs499_fei::RunReadScaling(sharded, readers) << std::endl;
+  }
+  return 0;
+}
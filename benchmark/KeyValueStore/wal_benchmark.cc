@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "write_ahead_log.h"
+
+DEFINE_int32(threads, 16, "Number of writer threads committing at once.");
+DEFINE_int32(commits, 2000, "Commits executed by each writer thread.");
+DEFINE_int32(value_size, 64, "Bytes of the value of every record.");
+DEFINE_string(file, "wal_benchmark_log", "Log file, removed after each run.");
+
+namespace cs499_fei {
+// Helper function: commit from every writer thread to a fresh log and print
+// the throughput and the group commit counters.
+void RunCommits(std::chrono::microseconds flush_interval, size_t batch_size) {
+  std::remove(FLAGS_file.c_str());
+  WriteAheadLog::Stats stats;
+  auto start = std::chrono::steady_clock::now();
+  {
+    WriteAheadLog wal(FLAGS_file, flush_interval, batch_size);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < FLAGS_threads; ++t) {
+      writers.emplace_back([&wal, t] {
+        const std::string value(FLAGS_value_size, 'v');
+        for (int i = 0; i < FLAGS_commits; ++i) {
+          std::string key = "warble_" + std::to_string(t) + "_" +
+                            std::to_string(i);
+          wal.Commit({WriteAheadLog::RecordType::kPut, key, value});
+        }
+      });
+    }
+    for (auto &writer : writers) {
+      writer.join();
+    }
+    stats = wal.GetStats();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::remove(FLAGS_file.c_str());
+
+  std::cout << std::setw(12) << flush_interval.count() << std::setw(8)
+            << batch_size << std::setw(14) << std::fixed
+            << std::setprecision(0) << stats.records / seconds
+            << std::setw(10) << stats.syncs << std::setw(14)
+            << std::setprecision(1) << stats.RecordsPerSync() << std::setw(12)
+            << std::setprecision(0) << stats.AverageCommitUs()
+            << std::setw(12) << stats.max_commit_us << std::endl;
+}
+}  // namespace cs499_fei
+
+// Compare the commit throughput and latency of the write-ahead log for
+// several group commit settings. Batch size 1 syncs every record on its own.
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  std::cout << FLAGS_threads << " writer threads, " << FLAGS_commits
+            << " commits each" << std::endl;
+  std::cout << " interval us   batch   commits/s     syncs   records/sync"
+               "      avg us      max us"
+            << std::endl;
+  cs499_fei::RunCommits(std::chrono::microseconds(0), 1);
+  for (int interval : {0, 200, 1000}) {
+    for (size_t batch : {16, 64, 256}) {
+      cs499_fei::RunCommits(std::chrono::microseconds(interval), batch);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include "embedded_storage.h"
+
+#include <chrono>
+
+#include <glog/logging.h>
+
+namespace cs499_fei {
+EmbeddedStorage::EmbeddedStorage(size_t shard_count)
+    : kv_map_(std::make_shared<ThreadsafeMap>(shard_count)) {}
+
+EmbeddedStorage::EmbeddedStorage(const PersistPtr &persist_ptr,
+                                  const std::string &file_name,
+                                  size_t shard_count)
+    : kv_map_(std::make_shared<ThreadsafeMap>(persist_ptr, file_name,
+                                              shard_count)),
+      file_name_(file_name) {}
+
+void EmbeddedStorage::Put(const std::string &key, const std::string &value) {
+  if (!kv_map_->Put(key, value)) {
+    LOG(ERROR) << "No room left for Key: " << key;
+  }
+}
+
+StringOptionalVector EmbeddedStorage::Get(const StringVector &key_vector) {
+  StringOptionalVector value_vector;
+  value_vector.reserve(key_vector.size());
+  for (const auto &key : key_vector) {
+    ValuePtr value = kv_map_->GetShared(key);
+    value_vector.push_back(value ? std::string(*value) : std::string());
+  }
+  return value_vector;
+}
+
+void EmbeddedStorage::Remove(const std::string &key) { kv_map_->Remove(key); }
+
+VersionedValue EmbeddedStorage::GetVersioned(const std::string &key) {
+  VersionedValue versioned;
+  ValuePtr value = kv_map_->GetVersioned(key, &versioned.version);
+  if (value) {
+    versioned.value = *value;
+  }
+  return versioned;
+}
+
+bool EmbeddedStorage::ConditionalPut(const std::string &key,
+                                     const std::string &value,
+                                     uint64_t expected_version) {
+  uint64_t version;
+  return kv_map_->ConditionalPut(key, value, expected_version, &version) ==
+         KVMapAbstraction::PutStatus::kStored;
+}
+
+StringOptionalVector EmbeddedStorage::Batch(const OperationVector &operations) {
+  StringOptionalVector results(operations.size());
+  for (size_t i = 0; i < operations.size(); ++i) {
+    const Operation &operation = operations[i];
+    switch (operation.type) {
+      case Operation::Type::kGet:
+        if (ValuePtr value = kv_map_->GetShared(operation.key)) {
+          results[i] = *value;
+        }
+        break;
+      case Operation::Type::kPut:
+        if (kv_map_->Put(operation.key, operation.value)) {
+          results[i] = "";
+        }
+        break;
+      case Operation::Type::kRemove:
+        kv_map_->Remove(operation.key);
+        results[i] = "";
+        break;
+      case Operation::Type::kAppend:
+        if (kv_map_->Append(operation.key, operation.value,
+                            operation.separator)) {
+          results[i] = "";
+        }
+        break;
+    }
+  }
+  return results;
+}
+
+void EmbeddedStorage::Append(const std::string &key,
+                             const std::string &suffix,
+                             const std::string &separator) {
+  if (!kv_map_->Append(key, suffix, separator)) {
+    LOG(ERROR) << "No room left for Key: " << key;
+  }
+}
+
+void EmbeddedStorage::Store() {
+  if (file_name_.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(store_locker_);
+  auto start = std::chrono::steady_clock::now();
+  kv_map_->Snapshot(file_name_)();
+  LOG(INFO) << "Snapshot stored in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - start)
+                   .count()
+            << "ms" << std::endl;
+}
+}  // namespace cs499_fei
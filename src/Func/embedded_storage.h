@@ -0,0 +1,71 @@
+#ifndef CSCI499_FEI_SRC_FUNC_EMBEDDED_STORAGE_H_
+#define CSCI499_FEI_SRC_FUNC_EMBEDDED_STORAGE_H_
+
+#include "storage_abstraction.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "../KeyValueStore/threadsafe_map.h"
+
+namespace cs499_fei {
+// The in-process implementation of key-value storage abstraction, for a
+// single-node deployment without a kvstore_server.
+// The calls go straight to a ThreadsafeMap owned by the Func server, with no
+// network hop or serialization. With persistence it loads and stores the
+// same files as kvstore_server --engine threadsafe_map does with the same
+// store format, so a deployment can switch between the two.
+class EmbeddedStorage : public StorageAbstraction {
+ public:
+  // Keep the data in memory only.
+  explicit EmbeddedStorage(
+      size_t shard_count = ThreadsafeMap::kDefaultShardCount);
+
+  // Load the data from the file with the persistence strategy, and store it
+  // there on Store.
+  EmbeddedStorage(const PersistPtr &persist_ptr, const std::string &file_name,
+                  size_t shard_count = ThreadsafeMap::kDefaultShardCount);
+
+  // Put a key-value pair into the storage
+  void Put(const std::string &, const std::string &) override;
+
+  // Get values based on keys. As over gRPC, a key that does not exist reads
+  // as an empty value.
+  StringOptionalVector Get(const StringVector &) override;
+
+  // Remove a value based on a key
+  void Remove(const std::string &) override;
+
+  // Get a value with its version based on a key
+  VersionedValue GetVersioned(const std::string &key) override;
+
+  // Put a key-value pair if the key is at expected_version
+  bool ConditionalPut(const std::string &key, const std::string &value,
+                      uint64_t expected_version) override;
+
+  // Run the operations in order
+  StringOptionalVector Batch(const OperationVector &) override;
+
+  // Append a suffix, after a separator, to the value of a key
+  void Append(const std::string &key, const std::string &suffix,
+              const std::string &separator) override;
+
+  // Store a point-in-time snapshot of the data into the file, while the
+  // storage keeps serving writes. Does nothing in memory only.
+  void Store();
+
+  // The storage engine.
+  const std::shared_ptr<ThreadsafeMap> &kv_map() const { return kv_map_; }
+
+ private:
+  std::shared_ptr<ThreadsafeMap> kv_map_;
+
+  // File of the snapshots, empty in memory only.
+  std::string file_name_;
+
+  // Serialize the snapshots.
+  std::mutex store_locker_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_FUNC_EMBEDDED_STORAGE_H_
@@ -1,7 +1,38 @@
 #include "func_service.h"
 
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "../KeyValueStore/binary_persistence.h"
+#include "../KeyValueStore/compressed_persistence.h"
+#include "../KeyValueStore/partitioned_persistence.h"
+#include "../KeyValueStore/persistence.h"
+
+using cs499_fei::BinaryPersistence;
+using cs499_fei::CompressedPersistence;
+using cs499_fei::EmbeddedStorage;
+using cs499_fei::FLAGS_kvstore_embedded;
+using cs499_fei::FLAGS_kvstore_max_staleness_ms;
+using cs499_fei::FLAGS_kvstore_replicas;
+using cs499_fei::FLAGS_kvstore_shards;
+using cs499_fei::FLAGS_kvstore_shards_file;
+using cs499_fei::FLAGS_kvstore_shm;
+using cs499_fei::FLAGS_kvstore_store;
+using cs499_fei::FLAGS_kvstore_store_format;
+using cs499_fei::FLAGS_kvstore_virtual_nodes;
 using cs499_fei::FuncServiceImpl;
 using cs499_fei::KeyValueStoreClient;
+using cs499_fei::PartitionedPersistence;
+using cs499_fei::Persistence;
+using cs499_fei::PersistPtr;
+using cs499_fei::ShardedStorage;
+using cs499_fei::ShmStorage;
 using cs499_fei::StoragePtr;
 using cs499_fei::WarblePtr;
 using cs499_fei::WarbleService;
@@ -44,14 +75,131 @@ Status FuncServiceImpl::event(ServerContext *context,
   }
 }
 
+// Use unnamed namespace to make static functions in it.
+// Define two methods to bridge signal handler to the customized function
+namespace {
+std::function<void(int)> shutdownHandler;
+void signalHandler(int signal) { shutdownHandler(signal); }
+
+// Helper function: the persistence strategy of the store format, in the
+// formats of kvstore_server --store_format.
+PersistPtr MakePersistence(const std::string &format) {
+  if (format == "text") {
+    return std::make_shared<Persistence>();
+  }
+  if (format == "binary") {
+    return std::make_shared<BinaryPersistence>();
+  }
+  if (format == "compressed") {
+    return std::make_shared<CompressedPersistence>();
+  }
+  if (format != "partitioned") {
+    LOG(WARNING) << "Unknown store format " << format
+                 << ", use partitioned" << std::endl;
+  }
+  return std::make_shared<PartitionedPersistence>();
+}
+
+// Seconds between two reads of --kvstore_shards_file.
+constexpr std::chrono::seconds kShardsReloadInterval(5);
+
+// Helper function: the addresses in the text, separated by commas or
+// whitespace.
+std::vector<std::string> SplitAddresses(std::string text) {
+  std::replace(text.begin(), text.end(), ',', ' ');
+  std::stringstream addresses(text);
+  std::vector<std::string> address_vector;
+  std::string address;
+  while (addresses >> address) {
+    address_vector.push_back(address);
+  }
+  return address_vector;
+}
+
+// Helper function: the shard addresses in --kvstore_shards_file, or the
+// ones of --kvstore_shards.
+std::vector<std::string> ReadShards() {
+  if (FLAGS_kvstore_shards_file.empty()) {
+    return SplitAddresses(FLAGS_kvstore_shards);
+  }
+  std::ifstream file(FLAGS_kvstore_shards_file);
+  if (!file) {
+    LOG(ERROR) << "Cannot read the shards file " << FLAGS_kvstore_shards_file;
+    return {};
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  return SplitAddresses(text.str());
+}
+
+// Helper function: read the shards file every kShardsReloadInterval, and
+// change the shards when its addresses change. A file that cannot be read
+// or lists no address leaves the shards as they are.
+void ReloadShards(const std::shared_ptr<ShardedStorage> &sharded) {
+  while (true) {
+    std::this_thread::sleep_for(kShardsReloadInterval);
+    std::vector<std::string> addresses = ReadShards();
+    if (!addresses.empty() &&
+        cs499_fei::HashRing(addresses).nodes() != sharded->Shards()) {
+      LOG(INFO) << "Shards file " << FLAGS_kvstore_shards_file << " changed";
+      sharded->SetShards(addresses);
+    }
+  }
+}
+}  // namespace
+
 // Helper function:
 // 1. Run the func service grPCC server.
-// 2. Create gRPC client to access KeyValue storage.
+// 2. Create gRPC, sharded or shared-memory client to access KeyValue storage,
+//    or host it in this process.
 void RunServer() {
-  auto channel = grpc::CreateChannel("localhost:50000",
-                                     grpc::InsecureChannelCredentials());
-  StoragePtr storage_ptr =
-      std::shared_ptr<KeyValueStoreClient>(new KeyValueStoreClient(channel));
+  StoragePtr storage_ptr;
+  std::shared_ptr<EmbeddedStorage> embedded;
+  if (FLAGS_kvstore_embedded) {
+    if (FLAGS_kvstore_store.empty()) {
+      LOG(INFO) << "Embedded KeyValue storage, in-memory model.";
+      embedded = std::make_shared<EmbeddedStorage>();
+    } else {
+      LOG(INFO) << "Embedded KeyValue storage, persistence location: "
+                << FLAGS_kvstore_store
+                << ", format: " << FLAGS_kvstore_store_format;
+      embedded = std::make_shared<EmbeddedStorage>(
+          MakePersistence(FLAGS_kvstore_store_format), FLAGS_kvstore_store);
+    }
+    storage_ptr = embedded;
+  } else if (!FLAGS_kvstore_shards.empty() ||
+             !FLAGS_kvstore_shards_file.empty()) {
+    auto sharded = std::make_shared<ShardedStorage>(
+        ReadShards(),
+        [](const std::string &address) {
+          return std::make_shared<KeyValueStoreClient>(grpc::CreateChannel(
+              address, grpc::InsecureChannelCredentials()));
+        },
+        std::max(FLAGS_kvstore_virtual_nodes, 1));
+    if (!FLAGS_kvstore_shards_file.empty()) {
+      std::thread(ReloadShards, sharded).detach();
+    }
+    storage_ptr = sharded;
+  } else if (FLAGS_kvstore_shm.empty()) {
+    auto channel = grpc::CreateChannel("localhost:50000",
+                                       grpc::InsecureChannelCredentials());
+    std::vector<std::shared_ptr<grpc::Channel>> replicas;
+    std::stringstream addresses(FLAGS_kvstore_replicas);
+    std::string address;
+    while (std::getline(addresses, address, ',')) {
+      if (!address.empty()) {
+        LOG(INFO) << "KeyValue storage replica: " << address;
+        replicas.push_back(grpc::CreateChannel(
+            address, grpc::InsecureChannelCredentials()));
+      }
+    }
+    storage_ptr = std::make_shared<KeyValueStoreClient>(
+        channel, replicas,
+        std::chrono::milliseconds(std::max(FLAGS_kvstore_max_staleness_ms, 0)));
+  } else {
+    LOG(INFO) << "KeyValue storage over shared memory: " << FLAGS_kvstore_shm;
+    storage_ptr = std::make_shared<ShmStorage>(FLAGS_kvstore_shm);
+  }
   WarblePtr warble_ptr = std::shared_ptr<WarbleService>(new WarbleService());
 
   std::string server_address("0.0.0.0:50001");
@@ -65,6 +213,16 @@ void RunServer() {
 
   LOG(INFO) << "Server listening on " << server_address;
 
+  // register signal SIGINT and signal handler
+  signal(SIGINT, signalHandler);
+  shutdownHandler = [&](int signal) {
+    std::cout << "Server shutdown... " << std::endl;
+    if (embedded) {
+      embedded->Store();
+    }
+    exit(signal);
+  };
+
   server->Wait();
 }
 
@@ -8,9 +8,12 @@
 #include <glog/logging.h>
 #include <grpcpp/grpcpp.h>
 
+#include "embedded_storage.h"
 #include "keyvaluestore_client.h"
+#include "sharded_storage.h"
 #include "Func.grpc.pb.h"
 #include "func_platform.h"
+#include "shm_storage.h"
 
 using func::EventReply;
 using func::EventRequest;
@@ -29,6 +32,46 @@ using grpc::Status;
 
 namespace cs499_fei {
 
+// Define the flag for the shared-memory transport to the KeyValue storage
+DEFINE_string(kvstore_shm, "",
+              "Reach the kvstore_server on this host through the specified "
+              "shared-memory segment, as given to its --shm, instead of "
+              "gRPC. Empty uses gRPC.");
+
+// Define the flags for the replicas of the KeyValue storage
+DEFINE_string(kvstore_replicas, "",
+              "Comma separated addresses of read-only kvstore_server "
+              "replicas of the one on localhost:50000, which the gets are "
+              "spread over. Empty sends every call to the primary.");
+DEFINE_int32(kvstore_max_staleness_ms, 1000,
+             "Milliseconds a replica may be behind the primary for a get to "
+             "be served from it, 0 for any staleness.");
+
+// Define the flags for the shards of the KeyValue storage
+DEFINE_string(kvstore_shards, "",
+              "Comma separated addresses of kvstore_server instances, each "
+              "holding the keys a consistent-hash ring gives it, instead of "
+              "the one on localhost:50000.");
+DEFINE_string(kvstore_shards_file, "",
+              "File of the kvstore_server shard addresses, separated by "
+              "commas or new lines. It is read again every few seconds, and "
+              "a change of its addresses changes the shards at runtime. "
+              "Used instead of --kvstore_shards when set.");
+DEFINE_int32(kvstore_virtual_nodes, 128,
+             "Points of every shard on the consistent-hash ring.");
+
+// Define the flags for the embedded KeyValue storage
+DEFINE_bool(kvstore_embedded, false,
+            "Host the KeyValue storage in this process instead of reaching a "
+            "kvstore_server.");
+DEFINE_string(kvstore_store, "",
+              "Load the embedded storage from the specified file and store it "
+              "there on shutdown, as kvstore_server --store does. Empty keeps "
+              "the data in memory only.");
+DEFINE_string(kvstore_store_format, "partitioned",
+              "File format of the embedded store, as kvstore_server "
+              "--store_format: compressed, partitioned, binary or text.");
+
 // The implementation of gRPC service FuncService.
 // Run as the server to handle gRPC requests for Func.
 class FuncServiceImpl final : public FuncService::Service {
@@ -0,0 +1,57 @@
+#include "hash_ring.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace cs499_fei {
+constexpr size_t HashRing::kDefaultVirtualNodes;
+
+HashRing::HashRing(const std::vector<std::string> &nodes,
+                   size_t virtual_nodes) {
+  virtual_nodes = std::max<size_t>(virtual_nodes, 1);
+  std::unordered_set<std::string> seen;
+  for (const auto &node : nodes) {
+    if (seen.insert(node).second) {
+      nodes_.push_back(node);
+    }
+  }
+  points_.reserve(nodes_.size() * virtual_nodes);
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    for (size_t v = 0; v < virtual_nodes; ++v) {
+      points_.emplace_back(Hash(nodes_[i] + "#" + std::to_string(v)), i);
+    }
+  }
+  // ties between nodes are broken by their index, so the ring does not
+  // depend on the sort.
+  std::sort(points_.begin(), points_.end());
+}
+
+size_t HashRing::Owner(std::string_view key) const {
+  uint64_t hash = Hash(key);
+  auto point = std::lower_bound(
+      points_.begin(), points_.end(), hash,
+      [](const std::pair<uint64_t, size_t> &p, uint64_t h) {
+        return p.first < h;
+      });
+  if (point == points_.end()) {
+    point = points_.begin();
+  }
+  return point->second;
+}
+
+uint64_t HashRing::Hash(std::string_view bytes) {
+  // FNV-1a, then the finalizer of SplitMix64 so close keys, such as
+  // warble ids, land far apart.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : bytes) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111ebULL;
+  hash ^= hash >> 31;
+  return hash;
+}
+}  // namespace cs499_fei
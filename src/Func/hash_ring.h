@@ -0,0 +1,48 @@
+#ifndef CSCI499_FEI_SRC_FUNC_HASH_RING_H_
+#define CSCI499_FEI_SRC_FUNC_HASH_RING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cs499_fei {
+// Consistent-hash ring which maps keys to nodes.
+// Every node is placed on the ring at virtual_nodes points, and a key
+// belongs to the node of the first point at or after its hash, wrapping
+// around. Adding or removing a node only moves the keys of its own points,
+// about 1/n of them, and the virtual nodes spread the keys evenly.
+// The hash is fixed, so every client of the same nodes agrees on the owner
+// of a key.
+class HashRing {
+ public:
+  // Points of every node on the ring by default.
+  static constexpr size_t kDefaultVirtualNodes = 128;
+
+  // Place the nodes, without duplicates, at virtual_nodes points each, at
+  // least one.
+  explicit HashRing(const std::vector<std::string> &nodes,
+                    size_t virtual_nodes = kDefaultVirtualNodes);
+
+  // Index in nodes() of the node owning the key. The ring must not be
+  // empty.
+  size_t Owner(std::string_view key) const;
+
+  // The nodes, in the order they were given.
+  const std::vector<std::string> &nodes() const { return nodes_; }
+
+  bool empty() const { return nodes_.empty(); }
+
+  // 64-bit hash of the bytes, the same on every host.
+  static uint64_t Hash(std::string_view bytes);
+
+ private:
+  std::vector<std::string> nodes_;
+
+  // Hash of every point and the index of its node, in hash order.
+  std::vector<std::pair<uint64_t, size_t>> points_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_FUNC_HASH_RING_H_
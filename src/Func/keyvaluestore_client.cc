@@ -1,5 +1,6 @@
 #include "keyvaluestore_client.h"
 
+#include <algorithm>
 #include <iostream>
 #include <optional>
 
@@ -7,6 +8,12 @@
 #include <grpcpp/grpcpp.h>
 
 using grpc::Status;
+using kvstore::AppendRequest;
+using kvstore::AppendReply;
+using kvstore::BatchRequest;
+using kvstore::BatchReply;
+using kvstore::ConditionalPutRequest;
+using kvstore::ConditionalPutReply;
 using kvstore::PutRequest;
 using kvstore::PutReply;
 using kvstore::GetRequest;
@@ -20,6 +27,16 @@ namespace cs499_fei {
 KeyValueStoreClient::KeyValueStoreClient(std::shared_ptr<grpc::Channel> channel)
     : stub_(KeyValueStore::NewStub(channel)) {}
 
+KeyValueStoreClient::KeyValueStoreClient(
+    std::shared_ptr<grpc::Channel> primary,
+    const std::vector<std::shared_ptr<grpc::Channel>> &replicas,
+    std::chrono::milliseconds max_staleness)
+    : stub_(KeyValueStore::NewStub(primary)), max_staleness_(max_staleness) {
+  for (const auto &replica : replicas) {
+    replica_stubs_.push_back(KeyValueStore::NewStub(replica));
+  }
+}
+
 void KeyValueStoreClient::Put(const std::string &key,
                               const std::string &value) {
   PutRequest request;
@@ -44,34 +61,162 @@ void KeyValueStoreClient::Put(const std::string &key,
 /// Given a series of keys, request their values from server.
 StringOptionalVector KeyValueStoreClient::Get(const StringVector &key_vector) {
   StringOptionalVector value_vector;
+  if (!replica_stubs_.empty()) {
+    KeyValueStore::Stub *replica =
+        replica_stubs_[next_replica_++ % replica_stubs_.size()].get();
+    Status status = GetFrom(replica, key_vector, &value_vector);
+    if (status.ok()) {
+      LOG(INFO) << "GetRequest RPC to a replica succeed";
+      return value_vector;
+    }
+    // a replica which is down, loading or too stale leaves the get to the
+    // primary.
+    LOG(WARNING) << "GetRequest RPC to a replica failed, retry on the primary"
+                 << "Error: " << status.error_code() << ", "
+                 << status.error_message();
+    value_vector.clear();
+  }
+
+  Status status = GetFrom(stub_.get(), key_vector, &value_vector);
+  if (status.ok()) {
+    LOG(INFO) << "GetRequest RPC succeed";
+  } else {
+    LOG(ERROR) << "GetRequest RPC failed"
+               << "Error: " << status.error_code() << ", "
+               << status.error_message();
+  }
+  return value_vector;
+}
+
+Status KeyValueStoreClient::GetFrom(KeyValueStore::Stub *stub,
+                                    const StringVector &key_vector,
+                                    StringOptionalVector *value_vector) {
   grpc::ClientContext context;
 
-  auto stream = stub_->get(&context);
+  auto stream = stub->get(&context);
+  // Send every key before reading the first reply, so the keys share one
+  // round trip instead of one each.
+  size_t written = 0;
   for (const auto &key : key_vector) {
     GetRequest request;
     request.set_key(key);
-    if (stream->Write(request)) {
-      GetReply reply;
-      stream->Read(&reply);
-      auto value = reply.value();
-      value_vector.push_back(StringOptional{value});
+    request.set_max_staleness_ms(max_staleness_.count());
+    if (!stream->Write(request)) {
+      break;
+    }
+    ++written;
+  }
+  stream->WritesDone();
+
+  for (size_t i = 0; i < key_vector.size(); ++i) {
+    GetReply reply;
+    if (i < written && stream->Read(&reply)) {
+      value_vector->push_back(
+          StringOptional{std::move(*reply.mutable_value())});
     } else {
-      // stream write failed.
-      value_vector.push_back(StringOptional());
+      // stream write or read failed.
+      value_vector->push_back(StringOptional());
     }
   }
 
+  return stream->Finish();
+}
+
+VersionedValue KeyValueStoreClient::GetVersioned(const std::string &key) {
+  VersionedValue versioned;
+  grpc::ClientContext context;
+
+  auto stream = stub_->get(&context);
+  GetRequest request;
+  request.set_key(key);
+  GetReply reply;
+  // the server replies version 0 for a key that does not exist.
+  if (stream->Write(request) && stream->Read(&reply) &&
+      reply.version() != kNoVersion) {
+    versioned.value = std::move(*reply.mutable_value());
+    versioned.version = reply.version();
+  }
   stream->WritesDone();
 
   Status status = stream->Finish();
   if (status.ok()) {
-    LOG(INFO) << "GetRequest RPC succeed";
+    LOG(INFO) << "GetRequest RPC succeed, Key: " << key;
   } else {
-    LOG(ERROR) << "GetRequest RPC failed"
+    LOG(ERROR) << "GetRequest RPC failed, Key: " << key << std::endl
+               << "Error: " << status.error_code() << ": "
+               << status.error_message();
+  }
+  return versioned;
+}
+
+bool KeyValueStoreClient::ConditionalPut(const std::string &key,
+                                         const std::string &value,
+                                         uint64_t expected_version) {
+  ConditionalPutRequest request;
+  request.set_key(key);
+  request.set_value(value);
+  request.set_expected_version(expected_version);
+
+  ConditionalPutReply reply;
+  grpc::ClientContext context;
+  Status status = stub_->conditional_put(&context, request, &reply);
+
+  if (!status.ok()) {
+    LOG(ERROR) << "ConditionalPutRequest RPC failed, Key: " << key << std::endl
+               << "Error: " << status.error_code() << ": "
+               << status.error_message();
+    return false;
+  }
+  LOG(INFO) << "ConditionalPutRequest RPC succeed, Key: " << key
+            << ", stored: " << reply.stored() << ", version: "
+            << reply.version();
+  return reply.stored();
+}
+
+StringOptionalVector KeyValueStoreClient::Batch(
+    const OperationVector &operations) {
+  BatchRequest request;
+  for (const auto &operation : operations) {
+    auto *op = request.add_operations();
+    switch (operation.type) {
+      case Operation::Type::kGet:
+        op->set_type(kvstore::Operation::GET);
+        break;
+      case Operation::Type::kPut:
+        op->set_type(kvstore::Operation::PUT);
+        break;
+      case Operation::Type::kRemove:
+        op->set_type(kvstore::Operation::REMOVE);
+        break;
+      case Operation::Type::kAppend:
+        op->set_type(kvstore::Operation::APPEND);
+        break;
+    }
+    op->set_key(operation.key);
+    op->set_value(operation.value);
+    op->set_separator(operation.separator);
+  }
+
+  BatchReply reply;
+  grpc::ClientContext context;
+  Status status = stub_->batch(&context, request, &reply);
+
+  StringOptionalVector results(operations.size());
+  if (!status.ok()) {
+    LOG(ERROR) << "BatchRequest RPC failed"
                << "Error: " << status.error_code() << ", "
                << status.error_message();
+    return results;
   }
-  return value_vector;
+  LOG(INFO) << "BatchRequest RPC succeed, operations: " << operations.size();
+  size_t count = std::min<size_t>(reply.results_size(), results.size());
+  for (size_t i = 0; i < count; ++i) {
+    auto *result = reply.mutable_results(i);
+    if (result->ok()) {
+      results[i] = std::move(*result->mutable_value());
+    }
+  }
+  return results;
 }
 
 void KeyValueStoreClient::Remove(const std::string &key) {
@@ -90,4 +235,25 @@ void KeyValueStoreClient::Remove(const std::string &key) {
                << status.error_message();
   }
 }
+
+void KeyValueStoreClient::Append(const std::string &key,
+                                 const std::string &suffix,
+                                 const std::string &separator) {
+  AppendRequest request;
+  request.set_key(key);
+  request.set_suffix(suffix);
+  request.set_separator(separator);
+
+  AppendReply reply;
+  grpc::ClientContext context;
+  Status status = stub_->append(&context, request, &reply);
+
+  if (status.ok()) {
+    LOG(INFO) << "AppendRequest RPC succeed, Key: " << key;
+  } else {
+    LOG(ERROR) << "AppendRequest RPC failed, Key: " << key << std::endl
+               << "Error: " << status.error_code() << ": "
+               << status.error_message();
+  }
+}
 }  // namespace cs499_fei
\ No newline at end of file
@@ -3,6 +3,11 @@
 
 #include "storage_abstraction.h"
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
 #include <grpcpp/grpcpp.h>
 #include <grpcpp/channel.h>
 
@@ -18,17 +23,54 @@ class KeyValueStoreClient : public StorageAbstraction {
  public:
   explicit KeyValueStoreClient(std::shared_ptr<grpc::Channel>);
 
+  // Send the writes, the versioned gets and the batches to the primary, and
+  // spread the gets over the replicas in turn, each allowed to be up to
+  // max_staleness behind the primary, 0 for any staleness. A get a replica
+  // fails is sent to the primary.
+  KeyValueStoreClient(
+      std::shared_ptr<grpc::Channel> primary,
+      const std::vector<std::shared_ptr<grpc::Channel>> &replicas,
+      std::chrono::milliseconds max_staleness);
+
   // Put a key-value pair into the storage
   void Put(const std::string &, const std::string &) override;
 
-  // Get values based on keys
+  // Get values based on keys, from a replica if there are any
   StringOptionalVector Get(const StringVector &) override;
 
   // Remove a value based on a key
   void Remove(const std::string &) override;
 
+  // Get a value with its version based on a key
+  VersionedValue GetVersioned(const std::string &key) override;
+
+  // Put a key-value pair if the key is at expected_version on the server
+  bool ConditionalPut(const std::string &key, const std::string &value,
+                      uint64_t expected_version) override;
+
+  // Run the operations in order with one batch RPC
+  StringOptionalVector Batch(const OperationVector &) override;
+
+  // Append a suffix, after a separator, to the value of a key on the server
+  void Append(const std::string &key, const std::string &suffix,
+              const std::string &separator) override;
+
  private:
+  // Get the values of the keys from the server of the stub into
+  // value_vector, with std::nullopt for the keys the stream failed on.
+  grpc::Status GetFrom(KeyValueStore::Stub *stub,
+                       const StringVector &key_vector,
+                       StringOptionalVector *value_vector);
+
+  // Stub of the primary.
   std::unique_ptr<KeyValueStore::Stub> stub_;
+
+  // Stubs of the replicas, and the one the next get goes to.
+  std::vector<std::unique_ptr<KeyValueStore::Stub>> replica_stubs_;
+  std::atomic<size_t> next_replica_{0};
+
+  // Staleness of a replica the gets accept.
+  std::chrono::milliseconds max_staleness_{0};
 };
 }  // namespace cs499_fei
 #endif  // FAAS_SRC_FUNC_KEYVALUESTORE_CLIENT_H_
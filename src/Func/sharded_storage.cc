@@ -0,0 +1,261 @@
+#include "sharded_storage.h"
+
+#include <algorithm>
+#include <future>
+#include <unordered_map>
+#include <utility>
+
+#include <glog/logging.h>
+
+namespace cs499_fei {
+constexpr size_t ShardedStorage::kDefaultFanoutThreads;
+
+ShardedStorage::ShardedStorage(const std::vector<std::string> &addresses,
+                               ShardFactory factory, size_t virtual_nodes,
+                               size_t fanout_threads)
+    : factory_(std::move(factory)),
+      virtual_nodes_(virtual_nodes),
+      fanout_pool_(std::max<size_t>(fanout_threads, 1)) {
+  SetShards(addresses);
+}
+
+void ShardedStorage::Put(const std::string &key, const std::string &value) {
+  if (auto storage = Route(*Current(), key)) {
+    storage->Put(key, value);
+  }
+}
+
+StringOptionalVector ShardedStorage::Get(const StringVector &key_vector) {
+  ShardMapPtr shard_map = Current();
+  StringOptionalVector value_vector(key_vector.size());
+  if (shard_map->ring.empty()) {
+    LOG(ERROR) << "No KeyValue storage shard to get from";
+    return value_vector;
+  }
+  std::vector<std::vector<size_t>> indexes(shard_map->storages.size());
+  for (size_t i = 0; i < key_vector.size(); ++i) {
+    indexes[shard_map->ring.Owner(key_vector[i])].push_back(i);
+  }
+  FanOut(indexes, [&](size_t shard, const std::vector<size_t> &positions) {
+    StringVector keys;
+    keys.reserve(positions.size());
+    for (size_t position : positions) {
+      keys.push_back(key_vector[position]);
+    }
+    StorageAbstraction &storage = *shard_map->storages[shard];
+    StringOptionalVector values = storage.Get(keys);
+    // a failed get returns fewer values, the rest stay std::nullopt.
+    for (size_t i = 0; i < positions.size() && i < values.size(); ++i) {
+      // a missing key reads as empty, and may still be on the shard which
+      // owned it before.
+      if (values[i] && values[i]->empty() &&
+          Migrate(*shard_map, storage, keys[i])) {
+        StringOptionalVector moved = storage.Get({keys[i]});
+        values[i] = moved.empty() ? std::nullopt : std::move(moved[0]);
+      }
+      value_vector[positions[i]] = std::move(values[i]);
+    }
+  });
+  return value_vector;
+}
+
+void ShardedStorage::Remove(const std::string &key) {
+  ShardMapPtr shard_map = Current();
+  if (auto storage = Route(*shard_map, key)) {
+    // the earlier copies go first, so a read of the key in between cannot
+    // move one of them back.
+    RemoveMoved(*shard_map, *storage, key);
+    storage->Remove(key);
+  }
+}
+
+VersionedValue ShardedStorage::GetVersioned(const std::string &key) {
+  ShardMapPtr shard_map = Current();
+  auto storage = Route(*shard_map, key);
+  if (!storage) {
+    return VersionedValue();
+  }
+  VersionedValue versioned = storage->GetVersioned(key);
+  // the version is the one of the new owner, which a ConditionalPut checks.
+  if (!versioned.value && Migrate(*shard_map, *storage, key)) {
+    versioned = storage->GetVersioned(key);
+  }
+  return versioned;
+}
+
+bool ShardedStorage::ConditionalPut(const std::string &key,
+                                    const std::string &value,
+                                    uint64_t expected_version) {
+  ShardMapPtr shard_map = Current();
+  auto storage = Route(*shard_map, key);
+  if (!storage) {
+    return false;
+  }
+  // a key not moved yet still exists.
+  if (expected_version == kNoVersion) {
+    Migrate(*shard_map, *storage, key);
+  }
+  return storage->ConditionalPut(key, value, expected_version);
+}
+
+StringOptionalVector ShardedStorage::Batch(const OperationVector &operations) {
+  ShardMapPtr shard_map = Current();
+  StringOptionalVector results(operations.size());
+  if (shard_map->ring.empty()) {
+    LOG(ERROR) << "No KeyValue storage shard to run a batch on";
+    return results;
+  }
+  std::vector<std::vector<size_t>> indexes(shard_map->storages.size());
+  for (size_t i = 0; i < operations.size(); ++i) {
+    indexes[shard_map->ring.Owner(operations[i].key)].push_back(i);
+  }
+  FanOut(indexes, [&](size_t shard, const std::vector<size_t> &positions) {
+    StorageAbstraction &storage = *shard_map->storages[shard];
+    OperationVector part;
+    part.reserve(positions.size());
+    for (size_t position : positions) {
+      part.push_back(operations[position]);
+    }
+    // the keys read or appended to are moved before the batch runs, and the
+    // earlier copies of the removed ones are removed.
+    if (shard_map->previous) {
+      for (const auto &operation : part) {
+        if (operation.type == Operation::Type::kRemove) {
+          RemoveMoved(*shard_map, storage, operation.key);
+        } else if (operation.type != Operation::Type::kPut) {
+          Migrate(*shard_map, storage, operation.key);
+        }
+      }
+    }
+    StringOptionalVector part_results = storage.Batch(part);
+    for (size_t i = 0; i < positions.size() && i < part_results.size(); ++i) {
+      results[positions[i]] = std::move(part_results[i]);
+    }
+  });
+  return results;
+}
+
+void ShardedStorage::Append(const std::string &key, const std::string &suffix,
+                            const std::string &separator) {
+  ShardMapPtr shard_map = Current();
+  if (auto storage = Route(*shard_map, key)) {
+    // the suffix goes after the value the key had before it was moved.
+    Migrate(*shard_map, *storage, key);
+    storage->Append(key, suffix, separator);
+  }
+}
+
+void ShardedStorage::SetShards(const std::vector<std::string> &addresses) {
+  std::lock_guard<std::mutex> reconfigure(reconfigure_locker_);
+  ShardMapPtr current = Current();
+  std::unordered_map<std::string, std::shared_ptr<StorageAbstraction>> kept;
+  if (current) {
+    for (size_t i = 0; i < current->storages.size(); ++i) {
+      kept[current->ring.nodes()[i]] = current->storages[i];
+    }
+  }
+
+  auto shard_map = std::make_shared<ShardMap>(
+      ShardMap{HashRing(addresses, virtual_nodes_), {}, current});
+  for (const auto &address : shard_map->ring.nodes()) {
+    auto storage = kept.find(address);
+    if (storage != kept.end()) {
+      shard_map->storages.push_back(storage->second);
+    } else {
+      LOG(INFO) << "KeyValue storage shard: " << address;
+      shard_map->storages.push_back(factory_(address));
+    }
+  }
+  LOG(INFO) << "Spreading the keys over " << shard_map->storages.size()
+            << " KeyValue storage shards";
+
+  std::lock_guard<std::mutex> lock(shard_locker_);
+  shard_map_ = std::move(shard_map);
+}
+
+std::vector<std::string> ShardedStorage::Shards() const {
+  return Current()->ring.nodes();
+}
+
+ShardedStorage::ShardMapPtr ShardedStorage::Current() const {
+  std::lock_guard<std::mutex> lock(shard_locker_);
+  return shard_map_;
+}
+
+std::shared_ptr<StorageAbstraction> ShardedStorage::Route(
+    const ShardMap &shard_map, const std::string &key) {
+  if (shard_map.ring.empty()) {
+    LOG(ERROR) << "No KeyValue storage shard for Key: " << key;
+    return nullptr;
+  }
+  return shard_map.storages[shard_map.ring.Owner(key)];
+}
+
+bool ShardedStorage::Migrate(const ShardMap &shard_map,
+                             StorageAbstraction &owner,
+                             const std::string &key) {
+  std::vector<const StorageAbstraction *> visited{&owner};
+  for (const ShardMap *earlier = shard_map.previous.get(); earlier != nullptr;
+       earlier = earlier->previous.get()) {
+    if (earlier->ring.empty()) {
+      continue;
+    }
+    StorageAbstraction &storage = *earlier->storages[earlier->ring.Owner(key)];
+    if (std::find(visited.begin(), visited.end(), &storage) != visited.end()) {
+      continue;
+    }
+    visited.push_back(&storage);
+    VersionedValue moved = storage.GetVersioned(key);
+    if (moved.value) {
+      // a write which reached the owner first is newer than the copy.
+      owner.ConditionalPut(key, *moved.value, kNoVersion);
+      storage.Remove(key);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ShardedStorage::RemoveMoved(const ShardMap &shard_map,
+                                 const StorageAbstraction &owner,
+                                 const std::string &key) {
+  std::vector<const StorageAbstraction *> visited{&owner};
+  for (const ShardMap *earlier = shard_map.previous.get(); earlier != nullptr;
+       earlier = earlier->previous.get()) {
+    if (earlier->ring.empty()) {
+      continue;
+    }
+    StorageAbstraction &storage = *earlier->storages[earlier->ring.Owner(key)];
+    if (std::find(visited.begin(), visited.end(), &storage) == visited.end()) {
+      visited.push_back(&storage);
+      storage.Remove(key);
+    }
+  }
+}
+
+void ShardedStorage::FanOut(
+    const std::vector<std::vector<size_t>> &indexes,
+    const std::function<void(size_t, const std::vector<size_t> &)> &part) {
+  std::vector<size_t> shards;
+  for (size_t shard = 0; shard < indexes.size(); ++shard) {
+    if (!indexes[shard].empty()) {
+      shards.push_back(shard);
+    }
+  }
+  if (shards.empty()) {
+    return;
+  }
+  // the calling thread sends the first part itself, so a call owned by one
+  // shard never waits on the pool.
+  std::vector<std::future<void>> others;
+  for (size_t i = 1; i < shards.size(); ++i) {
+    size_t shard = shards[i];
+    others.push_back(fanout_pool_.Submit(
+        [&part, &indexes, shard] { part(shard, indexes[shard]); }));
+  }
+  part(shards[0], indexes[shards[0]]);
+  for (auto &other : others) {
+    other.get();
+  }
+}
+}  // namespace cs499_fei
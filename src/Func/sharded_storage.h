@@ -0,0 +1,129 @@
+#ifndef CSCI499_FEI_SRC_FUNC_SHARDED_STORAGE_H_
+#define CSCI499_FEI_SRC_FUNC_SHARDED_STORAGE_H_
+
+#include "storage_abstraction.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../KeyValueStore/thread_pool.h"
+#include "hash_ring.h"
+
+namespace cs499_fei {
+// The implementation of key-value storage abstraction over several
+// kvstore_server instances, each holding the keys a consistent-hash ring
+// gives it.
+// A single-key call goes to the shard owning the key. A multi-key get or a
+// batch is split per shard, the parts are sent in parallel, and the results
+// are put back in the order of the keys. The operations of one key keep
+// their order, as they all go to its shard, but a batch over several shards
+// is no longer one atomic step.
+// The shards can be changed at runtime. The rings from before a change are
+// kept, and a key is moved to its new owner from the shard which held it
+// before when a read misses it, and before an append or a put which expects
+// it not to exist. A remove also removes the key from the shards which held
+// it before, so it never comes back from them.
+class ShardedStorage : public StorageAbstraction {
+ public:
+  // Create the storage of a shard from its address.
+  using ShardFactory =
+      std::function<std::shared_ptr<StorageAbstraction>(const std::string &)>;
+
+  // Threads sending the parts of a call in parallel by default.
+  static constexpr size_t kDefaultFanoutThreads = 8;
+
+  // Spread the keys over the shards at the addresses, each placed on the
+  // ring at virtual_nodes points.
+  ShardedStorage(const std::vector<std::string> &addresses,
+                 ShardFactory factory,
+                 size_t virtual_nodes = HashRing::kDefaultVirtualNodes,
+                 size_t fanout_threads = kDefaultFanoutThreads);
+
+  // Put a key-value pair into the storage
+  void Put(const std::string &, const std::string &) override;
+
+  // Get values based on keys, from every shard owning some of them at once
+  StringOptionalVector Get(const StringVector &) override;
+
+  // Remove a value based on a key
+  void Remove(const std::string &) override;
+
+  // Get a value with its version based on a key
+  VersionedValue GetVersioned(const std::string &key) override;
+
+  // Put a key-value pair if the key is at expected_version
+  bool ConditionalPut(const std::string &key, const std::string &value,
+                      uint64_t expected_version) override;
+
+  // Run the operations in order per key, one batch per shard at once
+  StringOptionalVector Batch(const OperationVector &) override;
+
+  // Append a suffix, after a separator, to the value of a key
+  void Append(const std::string &key, const std::string &suffix,
+              const std::string &separator) override;
+
+  // Replace the shards with the ones at the addresses. The storage of a
+  // shard kept from before is reused, and the calls already started finish
+  // on the shards they began with. The keys stay where they are until they
+  // are moved as they are used.
+  void SetShards(const std::vector<std::string> &addresses);
+
+  // The addresses of the shards.
+  std::vector<std::string> Shards() const;
+
+ private:
+  // The ring and the storage of each of its nodes, in the same order.
+  // Never changed once shared, so a call holds on to the one it started
+  // with.
+  struct ShardMap {
+    HashRing ring;
+    std::vector<std::shared_ptr<StorageAbstraction>> storages;
+    // The shards before the last change, whose keys may not be moved yet.
+    std::shared_ptr<const ShardMap> previous;
+  };
+  using ShardMapPtr = std::shared_ptr<const ShardMap>;
+
+  // Helper function: the current shards.
+  ShardMapPtr Current() const;
+
+  // Helper function: the storage of the shard owning the key, nullptr if
+  // there are no shards.
+  static std::shared_ptr<StorageAbstraction> Route(const ShardMap &shard_map,
+                                                   const std::string &key);
+
+  // Helper function: move the key from the newest earlier shard holding it
+  // to owner, its shard in shard_map. A value owner holds already is kept.
+  // Return whether an earlier shard held the key.
+  static bool Migrate(const ShardMap &shard_map, StorageAbstraction &owner,
+                      const std::string &key);
+
+  // Helper function: remove the key from the shards which owned it before
+  // shard_map, but owner.
+  static void RemoveMoved(const ShardMap &shard_map,
+                          const StorageAbstraction &owner,
+                          const std::string &key);
+
+  // Helper function: run part(shard, indexes) for every shard with indexes,
+  // at the same time, and wait for all of them. indexes[shard] holds the
+  // positions of the keys of the shard, in order.
+  void FanOut(const std::vector<std::vector<size_t>> &indexes,
+              const std::function<void(size_t, const std::vector<size_t> &)>
+                  &part);
+
+  ShardFactory factory_;
+  size_t virtual_nodes_;
+
+  // Serializes SetShards.
+  std::mutex reconfigure_locker_;
+
+  // Guards shard_map_.
+  mutable std::mutex shard_locker_;
+  ShardMapPtr shard_map_;
+
+  ThreadPool fanout_pool_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_FUNC_SHARDED_STORAGE_H_
@@ -0,0 +1,283 @@
+#include "shm_storage.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "KeyValueStore.pb.h"
+
+using grpc::Status;
+using kvstore::AppendReply;
+using kvstore::AppendRequest;
+using kvstore::BatchReply;
+using kvstore::BatchRequest;
+using kvstore::ConditionalPutReply;
+using kvstore::ConditionalPutRequest;
+using kvstore::GetReply;
+using kvstore::GetRequest;
+using kvstore::PutReply;
+using kvstore::PutRequest;
+using kvstore::RemoveReply;
+using kvstore::RemoveRequest;
+
+namespace cs499_fei {
+constexpr std::chrono::milliseconds ShmStorage::kDefaultTimeout;
+
+namespace {
+// Helper function: log the outcome of a request of the type for the key.
+void LogCall(const char *type, const std::string &key, const Status &status) {
+  if (status.ok()) {
+    LOG(INFO) << type << " over shared memory succeed, Key: " << key;
+  } else {
+    LOG(ERROR) << type << " over shared memory failed, Key: " << key
+               << std::endl
+               << "Error: " << status.error_code() << ": "
+               << status.error_message();
+  }
+}
+}  // namespace
+
+ShmStorage::ShmStorage(const std::string &name,
+                       std::chrono::milliseconds timeout)
+    : name_(name), timeout_(timeout) {}
+
+ShmStorage::~ShmStorage() {
+  for (auto &channel : idle_) {
+    channel->slot->owner.store(0);
+  }
+}
+
+void ShmStorage::Put(const std::string &key, const std::string &value) {
+  PutRequest request;
+  request.set_key(key);
+  request.set_value(value);
+  PutReply reply;
+  LogCall("PutRequest", key, Call(ShmMethod::kPut, request, &reply));
+}
+
+StringOptionalVector ShmStorage::Get(const StringVector &key_vector) {
+  StringOptionalVector value_vector(key_vector.size());
+  // as over gRPC, a key that does not exist reads as an empty value.
+  if (key_vector.size() == 1) {
+    GetRequest request;
+    request.set_key(key_vector[0]);
+    GetReply reply;
+    Status status = Call(ShmMethod::kGet, request, &reply);
+    LogCall("GetRequest", key_vector[0], status);
+    if (status.ok()) {
+      value_vector[0] = std::move(*reply.mutable_value());
+    }
+    return value_vector;
+  }
+
+  BatchRequest request;
+  for (const auto &key : key_vector) {
+    auto *op = request.add_operations();
+    op->set_type(kvstore::Operation::GET);
+    op->set_key(key);
+  }
+  BatchReply reply;
+  Status status = Call(ShmMethod::kBatch, request, &reply);
+  if (!status.ok()) {
+    LOG(ERROR) << "GetRequest over shared memory failed"
+               << "Error: " << status.error_code() << ", "
+               << status.error_message();
+    return value_vector;
+  }
+  LOG(INFO) << "GetRequest over shared memory succeed";
+  size_t count = std::min<size_t>(reply.results_size(), value_vector.size());
+  for (size_t i = 0; i < count; ++i) {
+    value_vector[i] = std::move(*reply.mutable_results(i)->mutable_value());
+  }
+  return value_vector;
+}
+
+VersionedValue ShmStorage::GetVersioned(const std::string &key) {
+  VersionedValue versioned;
+  GetRequest request;
+  request.set_key(key);
+  GetReply reply;
+  Status status = Call(ShmMethod::kGet, request, &reply);
+  LogCall("GetRequest", key, status);
+  // the server replies version 0 for a key that does not exist.
+  if (status.ok() && reply.version() != kNoVersion) {
+    versioned.value = std::move(*reply.mutable_value());
+    versioned.version = reply.version();
+  }
+  return versioned;
+}
+
+bool ShmStorage::ConditionalPut(const std::string &key,
+                                const std::string &value,
+                                uint64_t expected_version) {
+  ConditionalPutRequest request;
+  request.set_key(key);
+  request.set_value(value);
+  request.set_expected_version(expected_version);
+  ConditionalPutReply reply;
+  Status status = Call(ShmMethod::kConditionalPut, request, &reply);
+  LogCall("ConditionalPutRequest", key, status);
+  return status.ok() && reply.stored();
+}
+
+StringOptionalVector ShmStorage::Batch(const OperationVector &operations) {
+  BatchRequest request;
+  for (const auto &operation : operations) {
+    auto *op = request.add_operations();
+    switch (operation.type) {
+      case Operation::Type::kGet:
+        op->set_type(kvstore::Operation::GET);
+        break;
+      case Operation::Type::kPut:
+        op->set_type(kvstore::Operation::PUT);
+        break;
+      case Operation::Type::kRemove:
+        op->set_type(kvstore::Operation::REMOVE);
+        break;
+      case Operation::Type::kAppend:
+        op->set_type(kvstore::Operation::APPEND);
+        break;
+    }
+    op->set_key(operation.key);
+    op->set_value(operation.value);
+    op->set_separator(operation.separator);
+  }
+
+  BatchReply reply;
+  Status status = Call(ShmMethod::kBatch, request, &reply);
+  StringOptionalVector results(operations.size());
+  if (!status.ok()) {
+    LOG(ERROR) << "BatchRequest over shared memory failed"
+               << "Error: " << status.error_code() << ", "
+               << status.error_message();
+    return results;
+  }
+  LOG(INFO) << "BatchRequest over shared memory succeed, operations: "
+            << operations.size();
+  size_t count = std::min<size_t>(reply.results_size(), results.size());
+  for (size_t i = 0; i < count; ++i) {
+    auto *result = reply.mutable_results(i);
+    if (result->ok()) {
+      results[i] = std::move(*result->mutable_value());
+    }
+  }
+  return results;
+}
+
+void ShmStorage::Remove(const std::string &key) {
+  RemoveRequest request;
+  request.set_key(key);
+  RemoveReply reply;
+  LogCall("RemoveRequest", key, Call(ShmMethod::kRemove, request, &reply));
+}
+
+void ShmStorage::Append(const std::string &key, const std::string &suffix,
+                        const std::string &separator) {
+  AppendRequest request;
+  request.set_key(key);
+  request.set_suffix(suffix);
+  request.set_separator(separator);
+  AppendReply reply;
+  LogCall("AppendRequest", key, Call(ShmMethod::kAppend, request, &reply));
+}
+
+Status ShmStorage::Call(ShmMethod method,
+                        const google::protobuf::Message &request,
+                        google::protobuf::Message *reply) {
+  std::unique_ptr<Channel> channel = Acquire();
+  if (!channel) {
+    return Status(grpc::StatusCode::UNAVAILABLE,
+                  "No kvstore_server serves shared-memory segment " + name_);
+  }
+  ShmDeadline deadline = ShmClock::now() + timeout_;
+  request.SerializeToString(&channel->request);
+  ShmFrameHeader header{static_cast<uint32_t>(channel->request.size()),
+                        static_cast<uint32_t>(method)};
+  ShmSlot *slot = channel->slot;
+  bool ok = slot->requests.Write({header.bytes(), channel->request},
+                                 deadline) &&
+            slot->replies.Read(reinterpret_cast<char *>(&header),
+                               sizeof(header), deadline);
+  if (ok) {
+    channel->reply.resize(header.size);
+    ok = slot->replies.Read(channel->reply.data(), header.size, deadline);
+  }
+  if (!ok) {
+    Release(std::move(channel), false);
+    return Status(grpc::StatusCode::DEADLINE_EXCEEDED,
+                  "No reply over shared-memory segment " + name_);
+  }
+
+  Status status;
+  if (header.code != grpc::StatusCode::OK) {
+    status = Status(static_cast<grpc::StatusCode>(header.code),
+                    channel->reply);
+  } else if (!reply->ParseFromString(channel->reply)) {
+    status = Status(grpc::StatusCode::INTERNAL, "Cannot parse the reply.");
+  }
+  Release(std::move(channel), true);
+  return status;
+}
+
+std::unique_ptr<ShmStorage::Channel> ShmStorage::Acquire() {
+  std::unique_lock<std::mutex> lock(locker_);
+  ShmDeadline deadline = ShmClock::now() + timeout_;
+  while (true) {
+    if (segment_ && segment_->closed()) {
+      idle_.clear();
+      segment_.reset();
+    }
+    if (!idle_.empty()) {
+      std::unique_ptr<Channel> channel = std::move(idle_.back());
+      idle_.pop_back();
+      ++busy_;
+      return channel;
+    }
+    if (!segment_) {
+      segment_ = ShmSegment::Open(name_);
+      if (!segment_) {
+        return nullptr;
+      }
+    }
+    for (size_t i = 0; i < segment_->slots(); ++i) {
+      ShmSlot &slot = segment_->slot(i);
+      int32_t free = 0;
+      if (slot.owner.compare_exchange_strong(free, getpid())) {
+        ++busy_;
+        auto channel = std::make_unique<Channel>();
+        channel->segment = segment_;
+        channel->slot = &slot;
+        return channel;
+      }
+    }
+    // every slot is taken: wait for a call of this client to finish, if
+    // there is one.
+    if (busy_ == 0 ||
+        released_.wait_until(lock, deadline) == std::cv_status::timeout) {
+      return nullptr;
+    }
+  }
+}
+
+void ShmStorage::Release(std::unique_ptr<Channel> channel, bool ok) {
+  std::lock_guard<std::mutex> lock(locker_);
+  --busy_;
+  if (!ok) {
+    // a late reply may still come, so only the server frees the slot.
+    channel->slot->owner.store(-getpid());
+  }
+  if (channel->segment == segment_) {
+    if (ok) {
+      idle_.push_back(std::move(channel));
+    } else if (segment_->closed() ||
+               !ProcessAlive(segment_->server_pid())) {
+      // the idle channels went with their server.
+      idle_.clear();
+      segment_.reset();
+    }
+  }
+  released_.notify_one();
+}
+}  // namespace cs499_fei
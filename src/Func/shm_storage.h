@@ -0,0 +1,96 @@
+#ifndef CSCI499_FEI_SRC_FUNC_SHM_STORAGE_H_
+#define CSCI499_FEI_SRC_FUNC_SHM_STORAGE_H_
+
+#include "storage_abstraction.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/message.h>
+#include <grpcpp/grpcpp.h>
+
+#include "../KeyValueStore/shm_transport.h"
+
+namespace cs499_fei {
+// The shared-memory implementation of key-value storage abstraction, for a
+// kvstore_server on the same host started with --shm.
+// Every call takes a slot of the segment of the server for itself, so
+// concurrent calls never share a pipe. The slots are claimed as concurrent
+// calls need them and kept for the next calls. A call which times out
+// abandons its slot to the server, and the segment is mapped again at the
+// next call if its server has gone, so the client follows a restarted
+// server.
+class ShmStorage : public StorageAbstraction {
+ public:
+  // How long a call waits for its reply by default.
+  static constexpr std::chrono::milliseconds kDefaultTimeout{5000};
+
+  // Reach the server through the segment of the name.
+  explicit ShmStorage(const std::string &name,
+                      std::chrono::milliseconds timeout = kDefaultTimeout);
+
+  // Free the slots this client holds.
+  ~ShmStorage() override;
+
+  // Put a key-value pair into the storage
+  void Put(const std::string &, const std::string &) override;
+
+  // Get values based on keys, in one round trip
+  StringOptionalVector Get(const StringVector &) override;
+
+  // Remove a value based on a key
+  void Remove(const std::string &) override;
+
+  // Get a value with its version based on a key
+  VersionedValue GetVersioned(const std::string &key) override;
+
+  // Put a key-value pair if the key is at expected_version on the server
+  bool ConditionalPut(const std::string &key, const std::string &value,
+                      uint64_t expected_version) override;
+
+  // Run the operations in order in one round trip
+  StringOptionalVector Batch(const OperationVector &) override;
+
+  // Append a suffix, after a separator, to the value of a key on the server
+  void Append(const std::string &key, const std::string &suffix,
+              const std::string &separator) override;
+
+ private:
+  // A slot this client claimed, with the buffers of its frames.
+  struct Channel {
+    std::shared_ptr<ShmSegment> segment;
+    ShmSlot *slot;
+    std::string request;
+    std::string reply;
+  };
+
+  // Send the request of the method and read its reply, on a channel of
+  // its own.
+  grpc::Status Call(ShmMethod method, const google::protobuf::Message &request,
+                    google::protobuf::Message *reply);
+
+  // Take an idle channel, or claim a slot for a new one, waiting for a
+  // channel of another call if every slot is taken.
+  // Return nullptr if the server cannot be reached.
+  std::unique_ptr<Channel> Acquire();
+
+  // Keep the channel for the next call if its call went through, else
+  // abandon it, and the segment if its server has gone.
+  void Release(std::unique_ptr<Channel> channel, bool ok);
+
+  std::string name_;
+  std::chrono::milliseconds timeout_;
+
+  std::mutex locker_;
+  std::condition_variable released_;
+  std::shared_ptr<ShmSegment> segment_;
+  std::vector<std::unique_ptr<Channel>> idle_;
+  // Channels of the current segment out with calls.
+  size_t busy_ = 0;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_FUNC_SHM_STORAGE_H_
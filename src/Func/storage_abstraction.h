@@ -1,6 +1,7 @@
 #ifndef CSCI499_FEI_SRC_FUNC_STORAGE_ABSTRACTION_H_
 #define CSCI499_FEI_SRC_FUNC_STORAGE_ABSTRACTION_H_
 
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <vector>
@@ -10,6 +11,48 @@ using StringVector = std::vector<std::string>;
 using StringOptional = std::optional<std::string>;
 using StringOptionalVector = std::vector<StringOptional>;
 
+// Version of a key that does not exist.
+constexpr uint64_t kNoVersion = 0;
+
+// A value with the version it was read at.
+struct VersionedValue {
+  StringOptional value;
+  uint64_t version = kNoVersion;
+};
+
+// One operation of a batch.
+struct Operation {
+  enum class Type { kGet, kPut, kRemove, kAppend };
+
+  // Helper functions: create an operation of each type.
+  static Operation Get(const std::string &key) {
+    return Operation{Type::kGet, key, "", ""};
+  }
+  static Operation Put(const std::string &key, const std::string &value) {
+    return Operation{Type::kPut, key, value, ""};
+  }
+  static Operation Remove(const std::string &key) {
+    return Operation{Type::kRemove, key, "", ""};
+  }
+  static Operation Append(const std::string &key, const std::string &suffix,
+                          const std::string &separator) {
+    return Operation{Type::kAppend, key, suffix, separator};
+  }
+
+  bool operator==(const Operation &other) const {
+    return type == other.type && key == other.key && value == other.value &&
+           separator == other.separator;
+  }
+
+  Type type;
+  std::string key;
+  // The value of a put, or the suffix of an append.
+  std::string value;
+  // The separator of an append.
+  std::string separator;
+};
+using OperationVector = std::vector<Operation>;
+
 // A key-value storage abstraction that can enable storage and retrieval of
 // data. The callers do not know the implementation of storage.
 class StorageAbstraction {
@@ -25,6 +68,25 @@ class StorageAbstraction {
 
   // Remove a value based on a key
   virtual void Remove(const std::string &) = 0;
+
+  // Get a value with its version based on a key
+  virtual VersionedValue GetVersioned(const std::string &key) = 0;
+
+  // Put a key-value pair only if the key is still at expected_version, or
+  // does not exist for kNoVersion, in one atomic step.
+  // Return whether the pair was put.
+  virtual bool ConditionalPut(const std::string &key, const std::string &value,
+                              uint64_t expected_version) = 0;
+
+  // Run the operations in order, in one round trip. Return one result per
+  // operation: the value of a get, std::nullopt if its key does not exist;
+  // an empty string for any other operation, std::nullopt if it failed.
+  virtual StringOptionalVector Batch(const OperationVector &) = 0;
+
+  // Append a suffix, after a separator, to the value of a key in one atomic
+  // step. Put the suffix if the key does not exist.
+  virtual void Append(const std::string &key, const std::string &suffix,
+                      const std::string &separator) = 0;
 };
 }  // namespace cs499_fei
 #endif  // KVSTORE_SRC_FUNC_STORAGE_ABSTRACTION_H_
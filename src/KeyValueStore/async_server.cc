@@ -0,0 +1,511 @@
+#include "async_server.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+
+#include <glog/logging.h>
+
+#include "scan_cursor.h"
+#include "wire_format.h"
+
+namespace cs499_fei {
+constexpr size_t AsyncKeyValueStoreServer::kBlockingThreadsPerQueue;
+
+// A call of one method, whose address is the tag of its operations on the
+// completion queue.
+class AsyncKeyValueStoreServer::Call {
+ public:
+  Call(AsyncKeyValueStoreServer *server, Poller *poller, Method method)
+      : server_(server), poller_(poller), method_(method) {}
+  virtual ~Call() = default;
+
+  // Reset the call and ask the completion queue for the next call of the
+  // method.
+  virtual void Listen() = 0;
+
+  // Advance the call once the operation it waited for completed. ok is
+  // false if the operation failed, or the server is shutting down.
+  virtual void Proceed(bool ok) = 0;
+
+  Method method() const { return method_; }
+
+ protected:
+  AsyncKeyValueStoreServer *server_;
+  Poller *poller_;
+  Method method_;
+};
+
+// A unary call, run by the method of the synchronous service.
+template <typename Request, typename Reply>
+class AsyncKeyValueStoreServer::UnaryCall : public Call {
+ public:
+  // The method of the async service which listens for a call.
+  using RequestMethod = void (RawService::*)(
+      grpc::ServerContext *, Request *,
+      grpc::ServerAsyncResponseWriter<Reply> *, grpc::CompletionQueue *,
+      grpc::ServerCompletionQueue *, void *);
+
+  // The method of the synchronous service which runs the call.
+  using Handler = grpc::Status (kvstore::KeyValueStore::Service::*)(
+      grpc::ServerContext *, const Request *, Reply *);
+
+  UnaryCall(AsyncKeyValueStoreServer *server, Poller *poller, Method method,
+            RequestMethod request_method, Handler handler, bool blocking)
+      : Call(server, poller, method),
+        request_method_(request_method),
+        handler_(handler),
+        blocking_(blocking) {}
+
+  void Listen() override {
+    context_.emplace();
+    responder_.emplace(&*context_);
+    request_.Clear();
+    reply_.Clear();
+    finishing_ = false;
+    (server_->async_service_.*request_method_)(
+        &*context_, &request_, &*responder_, poller_->cq.get(),
+        poller_->cq.get(), this);
+  }
+
+  void Proceed(bool ok) override {
+    if (finishing_) {
+      server_->Recycle(poller_, this);
+      return;
+    }
+    if (!ok) {
+      // the server is shutting down.
+      return;
+    }
+    server_->NextCall(poller_, method_);
+    // the reply may complete on another thread before Handle returns.
+    finishing_ = true;
+    if (blocking_) {
+      server_->blocking_pool_->Submit([this] { Handle(); });
+    } else {
+      Handle();
+    }
+  }
+
+ private:
+  // Run the call and send its reply.
+  void Handle() {
+    grpc::Status status =
+        (server_->service_->*handler_)(&*context_, &request_, &reply_);
+    responder_->Finish(reply_, status, this);
+  }
+
+  RequestMethod request_method_;
+  Handler handler_;
+  bool blocking_;
+
+  std::optional<grpc::ServerContext> context_;
+  std::optional<grpc::ServerAsyncResponseWriter<Reply>> responder_;
+  Request request_;
+  Reply reply_;
+  bool finishing_ = false;
+};
+
+// A put, read in place from the bytes of its request and run by the put
+// function of the server.
+class AsyncKeyValueStoreServer::PutCall : public Call {
+ public:
+  PutCall(AsyncKeyValueStoreServer *server, Poller *poller)
+      : Call(server, poller, kPut) {}
+
+  void Listen() override {
+    context_.emplace();
+    responder_.emplace(&*context_);
+    request_.Clear();
+    finishing_ = false;
+    server_->async_service_.RequestRawput(&*context_, &request_, &*responder_,
+                                          poller_->cq.get(),
+                                          poller_->cq.get(), this);
+  }
+
+  void Proceed(bool ok) override {
+    if (finishing_) {
+      server_->Recycle(poller_, this);
+      return;
+    }
+    if (!ok) {
+      // the server is shutting down.
+      return;
+    }
+    server_->NextCall(poller_, method_);
+    // the reply may complete on another thread before Handle returns.
+    finishing_ = true;
+    if (server_->durable_writes_) {
+      server_->blocking_pool_->Submit([this] { Handle(); });
+    } else {
+      Handle();
+    }
+  }
+
+ private:
+  // Run the put and send its empty reply. The key is copied into a buffer
+  // the call keeps, so it allocates only for a longer key than before.
+  void Handle() {
+    std::string_view bytes;
+    PutRequestView request;
+    grpc::Status status;
+    if (!MessageBytes(request_, &slice_, &scratch_, &bytes) ||
+        !ParsePutRequest(bytes, &request)) {
+      status = grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                            "Cannot parse the PutRequest.");
+    } else {
+      key_.assign(request.key.data(), request.key.size());
+      status = server_->put_(key_, request.value, request.ttl_ms);
+    }
+    // the bytes of the request are not needed any more.
+    slice_ = grpc::Slice();
+    grpc::Slice empty;
+    responder_->Finish(grpc::ByteBuffer(&empty, 1), status, this);
+  }
+
+  std::optional<grpc::ServerContext> context_;
+  std::optional<grpc::ServerAsyncResponseWriter<grpc::ByteBuffer>> responder_;
+  grpc::ByteBuffer request_;
+  grpc::Slice slice_;
+  std::string scratch_;
+  std::string key_;
+  bool finishing_ = false;
+};
+
+// A get stream, which reads a request, replies with the value of its key
+// and reads the next one until the client closes the stream.
+class AsyncKeyValueStoreServer::GetCall : public Call {
+ public:
+  GetCall(AsyncKeyValueStoreServer *server, Poller *poller)
+      : Call(server, poller, kGet) {}
+
+  void Listen() override {
+    context_.emplace();
+    stream_.emplace(&*context_);
+    request_.Clear();
+    state_ = State::kListening;
+    server_->async_service_.RequestRawget(&*context_, &*stream_,
+                                          poller_->cq.get(),
+                                          poller_->cq.get(), this);
+  }
+
+  void Proceed(bool ok) override {
+    switch (state_) {
+      case State::kListening:
+        if (!ok) {
+          return;
+        }
+        server_->NextCall(poller_, method_);
+        Read();
+        break;
+      case State::kReading:
+        if (!ok) {
+          // the client closed its side of the stream.
+          Finish(grpc::Status::OK);
+          break;
+        }
+        Respond();
+        break;
+      case State::kWriting:
+        if (!ok) {
+          Finish(grpc::Status::OK);
+          break;
+        }
+        Read();
+        break;
+      case State::kFinishing:
+        server_->Recycle(poller_, this);
+        break;
+    }
+  }
+
+ private:
+  enum class State { kListening, kReading, kWriting, kFinishing };
+
+  void Read() {
+    state_ = State::kReading;
+    stream_->Read(&request_, this);
+  }
+
+  // The key is read in place from the request, and only a reference to the
+  // value is taken inside the store.
+  void Respond() {
+    std::string_view bytes;
+    std::string_view key;
+    if (!MessageBytes(request_, &slice_, &scratch_, &bytes) ||
+        !ParseGetRequest(bytes, &key)) {
+      Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                          "Cannot parse the GetRequest."));
+      return;
+    }
+    key_.assign(key.data(), key.size());
+    slice_ = grpc::Slice();
+    uint64_t version = 0;
+    ValuePtr value = server_->kv_map_->GetVersioned(key_, &version);
+    LOG(INFO) << "Received GetRequest. "
+              << " Key: " << key_;
+    reply_ = GetReplyBuffer(value, version);
+    state_ = State::kWriting;
+    stream_->Write(reply_, this);
+  }
+
+  void Finish(const grpc::Status &status) {
+    state_ = State::kFinishing;
+    reply_.Clear();
+    stream_->Finish(status, this);
+  }
+
+  std::optional<grpc::ServerContext> context_;
+  std::optional<
+      grpc::ServerAsyncReaderWriter<grpc::ByteBuffer, grpc::ByteBuffer>>
+      stream_;
+  grpc::ByteBuffer request_;
+  grpc::ByteBuffer reply_;
+  grpc::Slice slice_;
+  std::string scratch_;
+  std::string key_;
+  State state_ = State::kListening;
+};
+
+// A scan, which writes the pairs of one chunk of the storage at a time.
+class AsyncKeyValueStoreServer::ScanCall : public Call {
+ public:
+  ScanCall(AsyncKeyValueStoreServer *server, Poller *poller)
+      : Call(server, poller, kScan) {}
+
+  void Listen() override {
+    context_.emplace();
+    writer_.emplace(&*context_);
+    request_.Clear();
+    cursor_.reset();
+    pairs_.clear();
+    next_ = 0;
+    state_ = State::kListening;
+    server_->async_service_.Requestscan(&*context_, &request_, &*writer_,
+                                        poller_->cq.get(), poller_->cq.get(),
+                                        this);
+  }
+
+  void Proceed(bool ok) override {
+    switch (state_) {
+      case State::kListening:
+        if (!ok) {
+          return;
+        }
+        server_->NextCall(poller_, method_);
+        LOG(INFO) << "Received ScanRequest. "
+                  << " Start: " << request_.start()
+                  << " End: " << request_.end()
+                  << " Prefix: " << request_.prefix()
+                  << " Cursor: " << request_.cursor();
+        if (!server_->kv_map_->SupportsScan()) {
+          Finish(grpc::Status(grpc::StatusCode::UNIMPLEMENTED,
+                              "The storage engine does not support scans."));
+          break;
+        }
+        cursor_.emplace(request_);
+        WriteNext();
+        break;
+      case State::kWriting:
+        if (!ok) {
+          Finish(grpc::Status::OK);
+          break;
+        }
+        WriteNext();
+        break;
+      case State::kFinishing:
+        server_->Recycle(poller_, this);
+        break;
+    }
+  }
+
+ private:
+  enum class State { kListening, kWriting, kFinishing };
+
+  // Write the next pair, reading the next chunk once the current one is
+  // written, or finish the scan. A cancelled scan fails its next write.
+  void WriteNext() {
+    if (next_ == pairs_.size()) {
+      if (!cursor_->Next(*server_->kv_map_, &pairs_)) {
+        Finish(grpc::Status::OK);
+        return;
+      }
+      next_ = 0;
+    }
+    reply_.set_key(pairs_[next_].first);
+    const ValuePtr &value = pairs_[next_].second;
+    reply_.set_value(value->data(), value->size());
+    ++next_;
+    state_ = State::kWriting;
+    writer_->Write(reply_, this);
+  }
+
+  void Finish(const grpc::Status &status) {
+    state_ = State::kFinishing;
+    // the pairs are not needed any more, so their values are released.
+    pairs_.clear();
+    writer_->Finish(status, this);
+  }
+
+  std::optional<grpc::ServerContext> context_;
+  std::optional<grpc::ServerAsyncWriter<kvstore::ScanReply>> writer_;
+  kvstore::ScanRequest request_;
+  kvstore::ScanReply reply_;
+  std::optional<ScanCursor> cursor_;
+  ScanPairs pairs_;
+  size_t next_ = 0;
+  State state_ = State::kListening;
+};
+
+AsyncKeyValueStoreServer::AsyncKeyValueStoreServer(
+    kvstore::KeyValueStore::Service *service, PutFunction put, KVMapPtr kv_map,
+    size_t threads, bool durable_writes)
+    : service_(service),
+      put_(std::move(put)),
+      kv_map_(std::move(kv_map)),
+      durable_writes_(durable_writes),
+      async_service_(service) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    pollers_.push_back(std::make_unique<Poller>());
+  }
+  blocking_pool_ =
+      std::make_unique<ThreadPool>(threads * kBlockingThreadsPerQueue);
+}
+
+AsyncKeyValueStoreServer::~AsyncKeyValueStoreServer() { Shutdown(); }
+
+void AsyncKeyValueStoreServer::Register(grpc::ServerBuilder *builder) {
+  builder->RegisterService(&async_service_);
+  for (auto &poller : pollers_) {
+    poller->cq = builder->AddCompletionQueue();
+  }
+}
+
+void AsyncKeyValueStoreServer::Start() {
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < pollers_.size(); ++i) {
+    Poller *poller = pollers_[i].get();
+    for (int method = 0; method < kMethods; ++method) {
+      NextCall(poller, static_cast<Method>(method));
+    }
+    poller->thread = std::thread([this, poller] { Poll(poller); });
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(i % cores, &cpus);
+    int error = pthread_setaffinity_np(poller->thread.native_handle(),
+                                       sizeof(cpus), &cpus);
+    if (error != 0) {
+      LOG(WARNING) << "Cannot pin poller " << i << " to core " << i % cores
+                   << ", error: " << error;
+    }
+  }
+}
+
+void AsyncKeyValueStoreServer::Shutdown() {
+  if (stopped_) {
+    return;
+  }
+  stopped_ = true;
+  // the calls still running on the blocking pool send their replies while
+  // the queues accept them.
+  blocking_pool_.reset();
+  for (auto &poller : pollers_) {
+    if (poller->thread.joinable()) {
+      poller->shutdown_alarm.Set(poller->cq.get(),
+                                 std::chrono::system_clock::now(),
+                                 poller.get());
+    } else if (poller->cq) {
+      // never started, so no call is listening.
+      poller->cq->Shutdown();
+      Poll(poller.get());
+    }
+  }
+  for (auto &poller : pollers_) {
+    if (poller->thread.joinable()) {
+      poller->thread.join();
+    }
+  }
+}
+
+void AsyncKeyValueStoreServer::NextCall(Poller *poller, Method method) {
+  Call *call;
+  auto &idle = poller->idle[method];
+  if (idle.empty()) {
+    poller->calls.push_back(NewCall(poller, method));
+    call = poller->calls.back().get();
+  } else {
+    call = idle.back();
+    idle.pop_back();
+  }
+  call->Listen();
+}
+
+void AsyncKeyValueStoreServer::Recycle(Poller *poller, Call *call) {
+  poller->idle[call->method()].push_back(call);
+}
+
+std::unique_ptr<AsyncKeyValueStoreServer::Call>
+AsyncKeyValueStoreServer::NewCall(Poller *poller, Method method) {
+  using kvstore::AppendReply;
+  using kvstore::AppendRequest;
+  using kvstore::BatchReply;
+  using kvstore::BatchRequest;
+  using kvstore::ConditionalPutReply;
+  using kvstore::ConditionalPutRequest;
+  using kvstore::RemoveReply;
+  using kvstore::RemoveRequest;
+  using kvstore::SnapshotReply;
+  using kvstore::SnapshotRequest;
+  using Async = RawService;
+  using Sync = kvstore::KeyValueStore::Service;
+  switch (method) {
+    case kPut:
+      return std::make_unique<PutCall>(this, poller);
+    case kGet:
+      return std::make_unique<GetCall>(this, poller);
+    case kRemove:
+      return std::make_unique<UnaryCall<RemoveRequest, RemoveReply>>(
+          this, poller, method, &Async::Requestremove, &Sync::remove,
+          durable_writes_);
+    case kAppend:
+      return std::make_unique<UnaryCall<AppendRequest, AppendReply>>(
+          this, poller, method, &Async::Requestappend, &Sync::append,
+          durable_writes_);
+    case kConditionalPut:
+      return std::make_unique<
+          UnaryCall<ConditionalPutRequest, ConditionalPutReply>>(
+          this, poller, method, &Async::Requestconditional_put,
+          &Sync::conditional_put, durable_writes_);
+    case kBatch:
+      return std::make_unique<UnaryCall<BatchRequest, BatchReply>>(
+          this, poller, method, &Async::Requestbatch, &Sync::batch,
+          durable_writes_);
+    case kScan:
+      return std::make_unique<ScanCall>(this, poller);
+    case kSnapshot:
+    default:
+      // a snapshot stores the whole storage, so it always blocks.
+      return std::make_unique<UnaryCall<SnapshotRequest, SnapshotReply>>(
+          this, poller, kSnapshot, &Async::Requestsnapshot, &Sync::snapshot,
+          true);
+  }
+}
+
+void AsyncKeyValueStoreServer::Poll(Poller *poller) {
+  void *tag;
+  bool ok;
+  while (poller->cq->Next(&tag, &ok)) {
+    if (tag == poller) {
+      poller->shutting_down = true;
+      poller->cq->Shutdown();
+    } else if (!poller->shutting_down) {
+      static_cast<Call *>(tag)->Proceed(ok);
+    }
+  }
+}
+}  // namespace cs499_fei
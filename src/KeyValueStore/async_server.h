@@ -0,0 +1,174 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_ASYNC_SERVER_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_ASYNC_SERVER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <grpcpp/alarm.h>
+#include <grpcpp/grpcpp.h>
+
+#include "KeyValueStore.grpc.pb.h"
+#include "kvmap_abstraction.h"
+#include "thread_pool.h"
+
+namespace cs499_fei {
+// Asynchronous server of the KeyValueStore service, serving every method
+// but replicate from completion queues instead of a thread per call.
+// Every completion queue is polled by its own thread, pinned to its own
+// core, and a call stays on the queue it arrived on, so its state is only
+// touched by one thread. An open get stream holds no thread while it waits
+// for the next request: a poller reads it, looks the key up and writes the
+// reply, then moves on to the next event.
+// The calls of a queue are pooled per method. A finished call is reset and
+// listens for the next call of its method, so the messages keep their
+// buffers and a call in steady state allocates only its gRPC context.
+// The unary calls run the methods of the synchronous service. Those which
+// may block, the snapshot and the writes waiting for the write-ahead log,
+// run on a separate pool of threads so they never stall a poller.
+// put and get, the hot methods, are registered raw: their requests are read
+// in place from the bytes gRPC received instead of parsed into messages, so
+// a value is copied once, into the store, and a long value is replied from
+// the store without a copy.
+class AsyncKeyValueStoreServer {
+ public:
+  // Put a copy of the value for the key, expiring after ttl_ms unless it is
+  // 0, as the put method of the service does.
+  using PutFunction = std::function<grpc::Status(
+      const std::string &key, std::string_view value, uint64_t ttl_ms)>;
+
+  // Threads per completion queue of the pool running the blocking calls.
+  // They mostly wait for the log to sync, so more of them than cores let
+  // the group commit batch their writes.
+  static constexpr size_t kBlockingThreadsPerQueue = 4;
+
+  // Serve the unary calls with the methods of service, the puts with put,
+  // and the streaming calls from kv_map, with threads completion queues, 0
+  // for one per hardware thread. With durable_writes the writes run on the
+  // blocking pool.
+  AsyncKeyValueStoreServer(kvstore::KeyValueStore::Service *service,
+                           PutFunction put, KVMapPtr kv_map, size_t threads,
+                           bool durable_writes);
+
+  // Shut down the completion queues if they are still running.
+  ~AsyncKeyValueStoreServer();
+
+  AsyncKeyValueStoreServer(const AsyncKeyValueStoreServer &) = delete;
+  AsyncKeyValueStoreServer &operator=(const AsyncKeyValueStoreServer &) =
+      delete;
+
+  // Register the service and add the completion queues to the builder,
+  // before it builds the server.
+  void Register(grpc::ServerBuilder *builder);
+
+  // Listen for calls and start the pollers, once the server is built.
+  void Start();
+
+  // Shut down the completion queues and join the pollers, once the server
+  // is shut down. Events of calls the shutdown cancelled are dropped.
+  void Shutdown();
+
+  // Number of completion queues and pollers.
+  size_t threads() const { return pollers_.size(); }
+
+ private:
+  // Methods of the service, indexing the pools of calls.
+  enum Method {
+    kPut,
+    kGet,
+    kRemove,
+    kAppend,
+    kConditionalPut,
+    kBatch,
+    kScan,
+    kSnapshot,
+    kMethods,
+  };
+
+  // The service with put and get over raw bytes and the other methods
+  // asynchronous, but for replicate: a replication stream lasts as long as
+  // its replica, so it runs the method of the synchronous service on a
+  // thread of its own.
+  class RawService
+      : public kvstore::KeyValueStore::WithRawMethod_put<
+            kvstore::KeyValueStore::WithRawMethod_get<
+                kvstore::KeyValueStore::WithAsyncMethod_remove<
+                    kvstore::KeyValueStore::WithAsyncMethod_append<
+                        kvstore::KeyValueStore::WithAsyncMethod_conditional_put<
+                            kvstore::KeyValueStore::WithAsyncMethod_batch<
+                                kvstore::KeyValueStore::WithAsyncMethod_scan<
+                                    kvstore::KeyValueStore::
+                                        WithAsyncMethod_snapshot<
+                                            kvstore::KeyValueStore::
+                                                Service>>>>>>>> {
+   public:
+    explicit RawService(kvstore::KeyValueStore::Service *service)
+        : service_(service) {}
+
+    grpc::Status replicate(
+        grpc::ServerContext *context,
+        const kvstore::ReplicateRequest *request,
+        grpc::ServerWriter<kvstore::ReplicateReply> *writer) override {
+      return service_->replicate(context, request, writer);
+    }
+
+   private:
+    kvstore::KeyValueStore::Service *service_;
+  };
+
+  class Call;
+  template <typename Request, typename Reply>
+  class UnaryCall;
+  class PutCall;
+  class GetCall;
+  class ScanCall;
+
+  // A completion queue, its thread and its calls.
+  struct Poller {
+    std::unique_ptr<grpc::ServerCompletionQueue> cq;
+    std::thread thread;
+
+    // Fires with the poller as its tag once the server is shut down, so the
+    // poller shuts the queue down itself and no call starts an operation on
+    // it afterwards.
+    grpc::Alarm shutdown_alarm;
+    bool shutting_down = false;
+
+    // Every call created for the queue, listening, in progress or idle.
+    std::vector<std::unique_ptr<Call>> calls;
+
+    // The idle calls of every method.
+    std::array<std::vector<Call *>, kMethods> idle;
+  };
+
+  // Take an idle call of the method from the pool of the poller, or create
+  // one, and listen for the next call of the method with it.
+  void NextCall(Poller *poller, Method method);
+
+  // Return the finished call to the pool of its poller.
+  void Recycle(Poller *poller, Call *call);
+
+  // Create a call of the method on the poller.
+  std::unique_ptr<Call> NewCall(Poller *poller, Method method);
+
+  // Run the events of the completion queue of the poller until it is shut
+  // down and drained.
+  void Poll(Poller *poller);
+
+  kvstore::KeyValueStore::Service *service_;
+  PutFunction put_;
+  KVMapPtr kv_map_;
+  bool durable_writes_;
+  RawService async_service_;
+  std::vector<std::unique_ptr<Poller>> pollers_;
+  std::unique_ptr<ThreadPool> blocking_pool_;
+  bool stopped_ = false;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_ASYNC_SERVER_H_
@@ -0,0 +1,213 @@
+#include "binary_persistence.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <glog/logging.h>
+
+#include "checksum.h"
+#include "persistence.h"
+
+namespace cs499_fei {
+constexpr char BinaryPersistence::kMagic[];
+constexpr size_t BinaryPersistence::kHeaderSize;
+
+namespace {
+// Bytes buffered before each write of the body.
+constexpr size_t kWriteBufferSize = 4 << 20;
+
+// Bytes of the magic, without its terminating zero.
+constexpr size_t kMagicSize = sizeof(BinaryPersistence::kMagic) - 1;
+
+// Header of a binary file.
+struct Header {
+  char magic[kMagicSize];
+  uint64_t count;
+  uint64_t body_size;
+  uint32_t crc;
+  uint32_t reserved;
+};
+static_assert(sizeof(Header) == BinaryPersistence::kHeaderSize,
+              "The header has a fixed layout.");
+
+// Helper function: write all the bytes at the offset.
+void WriteAt(int fd, const std::string &file_name, const char *data,
+             size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t n = pwrite(fd, data, size, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      LOG(FATAL) << "Cannot write " << file_name << ": "
+                 << std::strerror(errno);
+    }
+    data += n;
+    size -= n;
+    offset += n;
+  }
+}
+
+// Helper function: append a 32-bit number to the buffer.
+void PutUint32(std::string *buffer, uint32_t n) {
+  buffer->append(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+// Read-only mapping of a whole file, unmapped when it goes out of scope.
+class MappedFile {
+ public:
+  // Map the file. data() is null if it cannot be opened.
+  explicit MappedFile(const std::string &file_name) {
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      size_ = st.st_size;
+      void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        data_ = static_cast<const char *>(data);
+        // the pairs are read once, front to back.
+        madvise(data, size_, MADV_SEQUENTIAL);
+        madvise(data, size_, MADV_WILLNEED);
+      }
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+};
+}  // namespace
+
+BinaryPersistence::FileSummary BinaryPersistence::WriteFile(
+    const std::string &to_file,
+    const std::function<void(const PairVisitor &emit)> &produce) {
+  std::string tmp_file = to_file + ".tmp";
+  int fd = open(tmp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    LOG(FATAL) << "Cannot open " << tmp_file << ": " << std::strerror(errno);
+  }
+
+  // The body goes after the room of the header, which is written last, once
+  // the checksum is known.
+  Header header{};
+  std::memcpy(header.magic, kMagic, kMagicSize);
+  off_t offset = kHeaderSize;
+  std::string buffer;
+  buffer.reserve(kWriteBufferSize);
+  auto flush = [&] {
+    header.crc = Crc32(buffer.data(), buffer.size(), header.crc);
+    WriteAt(fd, tmp_file, buffer.data(), buffer.size(), offset);
+    offset += buffer.size();
+    buffer.clear();
+  };
+  produce([&](std::string_view key, std::string_view value) {
+    PutUint32(&buffer, static_cast<uint32_t>(key.size()));
+    PutUint32(&buffer, static_cast<uint32_t>(value.size()));
+    buffer.append(key);
+    buffer.append(value);
+    ++header.count;
+    if (buffer.size() >= kWriteBufferSize) {
+      flush();
+    }
+  });
+  flush();
+  header.body_size = offset - kHeaderSize;
+  WriteAt(fd, tmp_file, reinterpret_cast<const char *>(&header),
+          sizeof(header), 0);
+
+  if (fdatasync(fd) != 0 || close(fd) != 0 ||
+      std::rename(tmp_file.c_str(), to_file.c_str()) != 0) {
+    LOG(FATAL) << "Cannot store " << to_file << ": " << std::strerror(errno);
+  }
+  return {header.count, header.body_size, header.crc};
+}
+
+std::optional<BinaryPersistence::FileSummary> BinaryPersistence::ReadFile(
+    const std::string &from_file, const PairVisitor &visit) {
+  MappedFile file(from_file);
+  if (file.data() == nullptr || file.size() < kHeaderSize ||
+      std::memcmp(file.data(), kMagic, kMagicSize) != 0) {
+    return std::nullopt;
+  }
+
+  Header header;
+  std::memcpy(&header, file.data(), sizeof(header));
+  const char *body = file.data() + kHeaderSize;
+  if (header.body_size != file.size() - kHeaderSize ||
+      Crc32(body, header.body_size) != header.crc) {
+    LOG(FATAL) << "Corrupt binary store " << from_file;
+  }
+
+  const char *end = body + header.body_size;
+  const char *p = body;
+  uint64_t count = 0;
+  while (p != end) {
+    uint32_t sizes[2];
+    if (end - p < static_cast<ptrdiff_t>(sizeof(sizes))) {
+      break;
+    }
+    std::memcpy(sizes, p, sizeof(sizes));
+    p += sizeof(sizes);
+    if (static_cast<uint64_t>(end - p) <
+        static_cast<uint64_t>(sizes[0]) + sizes[1]) {
+      break;
+    }
+    visit(std::string_view(p, sizes[0]),
+          std::string_view(p + sizes[0], sizes[1]));
+    p += sizes[0] + sizes[1];
+    ++count;
+  }
+  if (p != end || count != header.count) {
+    LOG(FATAL) << "Corrupt binary store " << from_file << ": read " << count
+               << " of " << header.count << " pairs";
+  }
+  return FileSummary{header.count, header.body_size, header.crc};
+}
+
+void BinaryPersistence::serialize(const StringKVMap &kv_data,
+                                  const std::string &to_file) {
+  WriteFile(to_file, [&kv_data](const PairVisitor &emit) {
+    for (const auto &p : kv_data) {
+      emit(p.first, p.second);
+    }
+  });
+}
+
+StringKVMap BinaryPersistence::deserialize(const std::string &from_file) {
+  StringKVMap ret;
+  load(from_file, [&ret](std::string_view key, std::string_view value) {
+    ret.emplace(key, value);
+  });
+  return ret;
+}
+
+void BinaryPersistence::load(const std::string &from_file,
+                             const PairVisitor &visit) {
+  if (!ReadFile(from_file, visit)) {
+    // a missing file reads as empty.
+    Persistence().load(from_file, visit);
+  }
+}
+}  // namespace cs499_fei
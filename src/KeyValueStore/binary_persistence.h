@@ -0,0 +1,63 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_BINARY_PERSISTENCE_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_BINARY_PERSISTENCE_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "persistence_abstraction.h"
+
+namespace cs499_fei {
+// Persistence strategy:
+// Serialize the key-value data to a binary, length-prefixed and checksummed
+// file, which is mmap-ed at startup and read in place with large sequential
+// reads instead of one parsed field at a time.
+//
+// File layout, in host (little-endian) byte order:
+//   header: magic "KVSBIN01", u64 pair count, u64 body bytes, u32 CRC-32 of
+//           the body, u32 reserved
+//   body:   per pair, u32 key size, u32 value size, key bytes, value bytes
+//
+// The file is written next to the target and renamed over it, so a crash
+// while storing leaves the previous file intact. A file without the magic is
+// read as the text format of Persistence, so existing stores upgrade on
+// their next store. A corrupt binary file is fatal rather than read as empty
+// and overwritten.
+class BinaryPersistence : public PersistenceAbstraction {
+ public:
+  // Identifies the binary format at the start of the file.
+  static constexpr char kMagic[] = "KVSBIN01";
+
+  // Bytes of the header.
+  static constexpr size_t kHeaderSize = 32;
+
+  // Number, bytes and checksum of the pairs of a binary file.
+  struct FileSummary {
+    uint64_t count = 0;
+    uint64_t body_size = 0;
+    uint32_t crc = 0;
+  };
+
+  // Write the pairs which produce passes to emit into a binary file, and
+  // return its summary.
+  static FileSummary WriteFile(
+      const std::string &to_file,
+      const std::function<void(const PairVisitor &emit)> &produce);
+
+  // Visit every pair of a binary file, in place in its mapping, and return
+  // its summary. Return nullopt without visiting anything if the file does
+  // not exist or is not in the binary format.
+  static std::optional<FileSummary> ReadFile(const std::string &from_file,
+                                             const PairVisitor &visit);
+
+  // Write the in-memory key-value data into the file.
+  void serialize(const StringKVMap &kv_data, const std::string &to_file) override;
+
+  // Read the key-value data from the file to the memory.
+  StringKVMap deserialize(const std::string &from_file) override;
+
+  // Visit every key-value pair of the file, in place in its mapping.
+  void load(const std::string &from_file, const PairVisitor &visit) override;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_BINARY_PERSISTENCE_H_
@@ -0,0 +1,82 @@
+#include "block_cache.h"
+
+namespace cs499_fei {
+BlockCache::BlockCache(size_t capacity)
+    : shard_capacity_(capacity / kShardCount) {
+  for (size_t i = 0; i < kShardCount; ++i) {
+    shards_.push_back(std::make_unique<Shard>());
+  }
+}
+
+BlockCache::Shard &BlockCache::ShardFor(const BlockKey &key) {
+  return *shards_[BlockKeyHash{}(key) % shards_.size()];
+}
+
+BlockCache::BlockPtr BlockCache::Lookup(uint64_t file_number,
+                                        uint64_t offset) {
+  BlockKey key{file_number, offset};
+  Shard &shard = ShardFor(key);
+  std::lock_guard<std::mutex> lock(shard.locker);
+  auto it = shard.blocks.find(key);
+  if (it == shard.blocks.end()) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  return it->second->second;
+}
+
+void BlockCache::Insert(uint64_t file_number, uint64_t offset,
+                        BlockPtr block) {
+  if (block->size() > shard_capacity_) {
+    return;
+  }
+  BlockKey key{file_number, offset};
+  Shard &shard = ShardFor(key);
+  // The evicted blocks are released after unlocking.
+  std::vector<BlockPtr> evicted;
+  std::lock_guard<std::mutex> lock(shard.locker);
+  auto it = shard.blocks.find(key);
+  if (it != shard.blocks.end()) {
+    // another reader cached the block first.
+    return;
+  }
+  shard.bytes += block->size();
+  shard.lru.emplace_front(key, std::move(block));
+  shard.blocks.emplace(key, shard.lru.begin());
+  while (shard.bytes > shard_capacity_) {
+    auto &victim = shard.lru.back();
+    shard.bytes -= victim.second->size();
+    shard.blocks.erase(victim.first);
+    evicted.push_back(std::move(victim.second));
+    shard.lru.pop_back();
+  }
+}
+
+void BlockCache::EraseFile(uint64_t file_number) {
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->locker);
+    for (auto it = shard->lru.begin(); it != shard->lru.end();) {
+      if (it->first.file_number != file_number) {
+        ++it;
+        continue;
+      }
+      shard->bytes -= it->second->size();
+      shard->blocks.erase(it->first);
+      it = shard->lru.erase(it);
+    }
+  }
+}
+
+BlockCache::Stats BlockCache::GetStats() const {
+  Stats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  for (const auto &shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->locker);
+    stats.bytes += shard->bytes;
+  }
+  return stats;
+}
+}  // namespace cs499_fei
@@ -0,0 +1,95 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_BLOCK_CACHE_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_BLOCK_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cs499_fei {
+// Least-recently-used cache of the data blocks read from sorted run files,
+// bounded in bytes. The cache is split into shards by block, each guarded by
+// its own mutex, so readers of different blocks rarely contend. A block is
+// shared with the readers holding it, so evicting it never invalidates a
+// lookup in progress.
+class BlockCache {
+ public:
+  // Number of shards of the cache.
+  static constexpr size_t kShardCount = 16;
+
+  // A cached block.
+  using BlockPtr = std::shared_ptr<const std::string>;
+
+  // Counters of the cache.
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t bytes = 0;
+  };
+
+  // Keep up to capacity bytes of blocks, split evenly between the shards.
+  explicit BlockCache(size_t capacity);
+
+  BlockCache(const BlockCache &) = delete;
+  BlockCache &operator=(const BlockCache &) = delete;
+
+  // Return the block at offset of the run file, or nullptr if it is not
+  // cached.
+  BlockPtr Lookup(uint64_t file_number, uint64_t offset);
+
+  // Cache the block at offset of the run file, evicting the least recently
+  // used blocks of its shard.
+  void Insert(uint64_t file_number, uint64_t offset, BlockPtr block);
+
+  // Drop every block of the run file, once it is deleted.
+  void EraseFile(uint64_t file_number);
+
+  // Current counters of all shards.
+  Stats GetStats() const;
+
+ private:
+  // Identifies a block: the number of its run file and its offset.
+  struct BlockKey {
+    uint64_t file_number;
+    uint64_t offset;
+    bool operator==(const BlockKey &other) const {
+      return file_number == other.file_number && offset == other.offset;
+    }
+  };
+  struct BlockKeyHash {
+    size_t operator()(const BlockKey &key) const {
+      return std::hash<uint64_t>{}(key.file_number * 0x9e3779b97f4a7c15ULL ^
+                                   key.offset);
+    }
+  };
+
+  // One independently locked part of the cache.
+  struct Shard {
+    // Blocks from the most to the least recently used.
+    std::list<std::pair<BlockKey, BlockPtr>> lru;
+    std::unordered_map<BlockKey,
+                       std::list<std::pair<BlockKey, BlockPtr>>::iterator,
+                       BlockKeyHash>
+        blocks;
+    size_t bytes = 0;
+    std::mutex locker;
+  };
+
+  // Return the shard which owns the block.
+  Shard &ShardFor(const BlockKey &key);
+
+  // Bytes each shard keeps.
+  size_t shard_capacity_;
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  // Lookup counters, updated without the locks.
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_BLOCK_CACHE_H_
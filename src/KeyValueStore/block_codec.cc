@@ -0,0 +1,171 @@
+#include "block_codec.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace cs499_fei {
+namespace {
+// Shortest match worth a sequence.
+constexpr size_t kMinMatch = 4;
+
+// Farthest a match can be behind its copy.
+constexpr size_t kMaxOffset = 65535;
+
+// Bits of the hash of four bytes, which indexes the match table.
+constexpr int kHashBits = 14;
+
+// After this many misses in a row, the search skips ahead faster through
+// data which does not compress.
+constexpr int kSkipTrigger = 6;
+
+// Helper function: load four bytes.
+uint32_t Load32(const char *p) {
+  uint32_t n;
+  std::memcpy(&n, p, sizeof(n));
+  return n;
+}
+
+// Helper function: hash of four bytes.
+uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+// Helper function: append the rest of a length which did not fit in its
+// nibble.
+void PutLength(std::string *out, size_t length) {
+  for (; length >= 255; length -= 255) {
+    out->push_back(static_cast<char>(255));
+  }
+  out->push_back(static_cast<char>(length));
+}
+
+// Helper function: append a sequence of literals and a match. A match length
+// of 0 ends the block.
+void PutSequence(std::string *out, std::string_view literals, size_t offset,
+                 size_t match_length) {
+  size_t match_code = match_length == 0 ? 0 : match_length - kMinMatch;
+  out->push_back(static_cast<char>(
+      (std::min<size_t>(literals.size(), 15) << 4) |
+      std::min<size_t>(match_code, 15)));
+  if (literals.size() >= 15) {
+    PutLength(out, literals.size() - 15);
+  }
+  out->append(literals);
+  if (match_length == 0) {
+    return;
+  }
+  out->push_back(static_cast<char>(offset & 0xff));
+  out->push_back(static_cast<char>(offset >> 8));
+  if (match_code >= 15) {
+    PutLength(out, match_code - 15);
+  }
+}
+
+// Helper function: read the rest of a length which did not fit in its nibble
+// at *p and move past it. Return false if the block ends first.
+bool GetLength(const char **p, const char *end, size_t *length) {
+  uint8_t byte;
+  do {
+    if (*p == end) {
+      return false;
+    }
+    byte = static_cast<uint8_t>(*(*p)++);
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+}  // namespace
+
+size_t CompressBound(size_t size) {
+  // incompressible input is one run of literals with its length bytes.
+  return size + size / 255 + 16;
+}
+
+void CompressBlock(std::string_view input, std::string *out) {
+  out->reserve(out->size() + CompressBound(input.size()));
+  const char *base = input.data();
+  size_t size = input.size();
+  size_t anchor = 0;
+  // Positions + 1 of the last four bytes with each hash, 0 for none.
+  std::vector<uint32_t> table(size_t(1) << kHashBits, 0);
+
+  size_t i = 0;
+  int misses = 0;
+  while (i + kMinMatch <= size) {
+    uint32_t sequence = Load32(base + i);
+    uint32_t &slot = table[Hash(sequence)];
+    size_t candidate = slot;
+    slot = static_cast<uint32_t>(i + 1);
+    if (candidate == 0 || i - (candidate - 1) > kMaxOffset ||
+        Load32(base + candidate - 1) != sequence) {
+      i += 1 + (misses++ >> kSkipTrigger);
+      continue;
+    }
+    misses = 0;
+    size_t match = candidate - 1;
+    size_t length = kMinMatch;
+    while (i + length < size && base[match + length] == base[i + length]) {
+      ++length;
+    }
+    PutSequence(out, input.substr(anchor, i - anchor), i - match, length);
+    i += length;
+    anchor = i;
+  }
+  PutSequence(out, input.substr(anchor), 0, 0);
+}
+
+bool DecompressBlock(std::string_view block, size_t raw_size,
+                     std::string *out) {
+  out->resize(raw_size);
+  char *dest = &(*out)[0];
+  size_t written = 0;
+  const char *p = block.data();
+  const char *end = p + block.size();
+  while (p < end) {
+    uint8_t token = static_cast<uint8_t>(*p++);
+    size_t literals = token >> 4;
+    if (literals == 15 && !GetLength(&p, end, &literals)) {
+      return false;
+    }
+    if (static_cast<size_t>(end - p) < literals ||
+        raw_size - written < literals) {
+      return false;
+    }
+    std::memcpy(dest + written, p, literals);
+    p += literals;
+    written += literals;
+    // the last sequence has no match.
+    if (p == end) {
+      break;
+    }
+
+    if (end - p < 2) {
+      return false;
+    }
+    size_t offset = static_cast<uint8_t>(p[0]) |
+                    (static_cast<size_t>(static_cast<uint8_t>(p[1])) << 8);
+    p += 2;
+    size_t length = token & 0x0f;
+    if (length == 15 && !GetLength(&p, end, &length)) {
+      return false;
+    }
+    length += kMinMatch;
+    if (offset == 0 || offset > written || raw_size - written < length) {
+      return false;
+    }
+    const char *match = dest + written - offset;
+    if (offset >= length) {
+      std::memcpy(dest + written, match, length);
+    } else {
+      // the match overlaps its copy, as in a run of one repeated byte.
+      for (size_t k = 0; k < length; ++k) {
+        dest[written + k] = match[k];
+      }
+    }
+    written += length;
+  }
+  return written == raw_size;
+}
+}  // namespace cs499_fei
@@ -0,0 +1,29 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_BLOCK_CODEC_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_BLOCK_CODEC_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace cs499_fei {
+// LZ77 block codec in the style of LZ4, built for speed over ratio: it finds
+// repeats through a hash of the next four bytes and never looks back more
+// than 64 KiB.
+//
+// A compressed block is a list of sequences. Each one is a token byte (high
+// nibble: literal count, low nibble: match length - 4, 15 continuing in bytes
+// of 255 and a last byte below it), the literal bytes, and a u16 offset back
+// to the match. The last sequence holds only literals and ends the block.
+
+// Most bytes CompressBlock writes for size input bytes.
+size_t CompressBound(size_t size);
+
+// Append the compressed input to out.
+void CompressBlock(std::string_view input, std::string *out);
+
+// Decompress the block, which holds raw_size bytes, into out.
+// Return false if the block is corrupt or does not hold raw_size bytes.
+bool DecompressBlock(std::string_view block, size_t raw_size,
+                     std::string *out);
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_BLOCK_CODEC_H_
@@ -0,0 +1,123 @@
+#include "bloom_filter.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cs499_fei {
+constexpr size_t BloomFilter::kLanes;
+constexpr size_t BloomFilter::kBlockBytes;
+constexpr size_t BloomFilter::kDefaultBitsPerKey;
+
+namespace {
+// Odd multipliers which pick the bit of every lane from the low 32 bits of
+// the hash.
+constexpr uint32_t kSalts[BloomFilter::kLanes] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+// Helper function: the finalizer of SplitMix64, which spreads every input
+// bit over the whole word.
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Helper function: the bit every lane of the block sets for the hash.
+void LaneMasks(uint64_t hash, uint32_t masks[BloomFilter::kLanes]) {
+  uint32_t key = static_cast<uint32_t>(hash);
+  for (size_t i = 0; i < BloomFilter::kLanes; ++i) {
+    masks[i] = 1U << ((key * kSalts[i]) >> 27);
+  }
+}
+}  // namespace
+
+BloomFilter::BloomFilter(size_t block_count)
+    : block_count_(std::max<size_t>(block_count, 1)),
+      blocks_(new Block[block_count_]) {
+  for (size_t b = 0; b < block_count_; ++b) {
+    for (auto &lane : blocks_[b].lanes) {
+      lane.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+BloomFilter::BloomFilter(size_t keys, size_t bits_per_key)
+    : BloomFilter((keys * bits_per_key + kBlockBytes * 8 - 1) /
+                  (kBlockBytes * 8)) {
+  capacity_ = keys;
+}
+
+std::unique_ptr<BloomFilter> BloomFilter::Deserialize(std::string_view data) {
+  if (data.empty() || data.size() % kBlockBytes != 0) {
+    return nullptr;
+  }
+  std::unique_ptr<BloomFilter> filter(
+      new BloomFilter(data.size() / kBlockBytes));
+  for (size_t b = 0; b < filter->block_count_; ++b) {
+    for (size_t i = 0; i < kLanes; ++i) {
+      uint32_t lane;
+      std::memcpy(&lane, data.data() + b * kBlockBytes + i * sizeof(lane),
+                  sizeof(lane));
+      filter->blocks_[b].lanes[i].store(lane, std::memory_order_relaxed);
+    }
+  }
+  return filter;
+}
+
+uint64_t BloomFilter::Hash(std::string_view key) {
+  uint64_t hash = Mix(0x9e3779b97f4a7c15ULL ^ key.size());
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= key.size(); i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, key.data() + i, sizeof(word));
+    hash = Mix(hash ^ word);
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, key.data() + i, key.size() - i);
+  return Mix(hash ^ tail);
+}
+
+size_t BloomFilter::BlockIndex(uint64_t hash) const {
+  // the high half picks the block, the low half the bits inside it.
+  return ((hash >> 32) * block_count_) >> 32;
+}
+
+void BloomFilter::Add(uint64_t hash) {
+  uint32_t masks[kLanes];
+  LaneMasks(hash, masks);
+  Block &block = blocks_[BlockIndex(hash)];
+  for (size_t i = 0; i < kLanes; ++i) {
+    // a lane which has the bit already is not written, so filled blocks
+    // stay shared in the caches of the readers.
+    if ((block.lanes[i].load(std::memory_order_relaxed) & masks[i]) == 0) {
+      block.lanes[i].fetch_or(masks[i], std::memory_order_relaxed);
+    }
+  }
+}
+
+bool BloomFilter::MayContain(uint64_t hash) const {
+  uint32_t masks[kLanes];
+  LaneMasks(hash, masks);
+  const Block &block = blocks_[BlockIndex(hash)];
+  uint32_t missing = 0;
+  for (size_t i = 0; i < kLanes; ++i) {
+    missing |= ~block.lanes[i].load(std::memory_order_relaxed) & masks[i];
+  }
+  return missing == 0;
+}
+
+std::string BloomFilter::Serialize() const {
+  std::string data;
+  data.reserve(bytes());
+  for (size_t b = 0; b < block_count_; ++b) {
+    for (const auto &lane : blocks_[b].lanes) {
+      uint32_t bits = lane.load(std::memory_order_relaxed);
+      data.append(reinterpret_cast<const char *>(&bits), sizeof(bits));
+    }
+  }
+  return data;
+}
+}  // namespace cs499_fei
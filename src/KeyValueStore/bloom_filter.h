@@ -0,0 +1,79 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_BLOOM_FILTER_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_BLOOM_FILTER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace cs499_fei {
+// Split-block Bloom filter, which answers that a key is definitely absent
+// without a lookup of the table or the file holding the keys.
+// A key hashes to one block of 8 32-bit lanes, aligned inside a cache line,
+// and sets one bit in every lane, so a probe touches one cache line. The bits
+// of the 8 lanes come from one multiply and shift per lane in a loop without
+// branches, which the compiler turns into vector instructions.
+// Add and MayContain may run concurrently: the bits are set atomically, and
+// a key is reported once the Add which set its bits happened before the
+// probe. Keys are never removed; a filter whose keys went away is rebuilt.
+class BloomFilter {
+ public:
+  // Number of 32-bit lanes of a block, and bits set per key.
+  static constexpr size_t kLanes = 8;
+
+  // Bytes of a block.
+  static constexpr size_t kBlockBytes = kLanes * sizeof(uint32_t);
+
+  // Bits per key used when the caller does not specify them, about a 1%
+  // false-positive rate.
+  static constexpr size_t kDefaultBitsPerKey = 10;
+
+  // Create an empty filter sized for keys keys at bits_per_key bits each.
+  BloomFilter(size_t keys, size_t bits_per_key);
+
+  // Read back a filter written by Serialize. Return nullptr if data is not
+  // a whole number of blocks.
+  static std::unique_ptr<BloomFilter> Deserialize(std::string_view data);
+
+  BloomFilter(const BloomFilter &) = delete;
+  BloomFilter &operator=(const BloomFilter &) = delete;
+
+  // Hash of the key the filter is probed with. Stable across processes, so
+  // a stored filter is probed with the hashes it was built from.
+  static uint64_t Hash(std::string_view key);
+
+  // Add the key with the hash.
+  void Add(uint64_t hash);
+
+  // Whether the key with the hash may have been added. False means it was
+  // not.
+  bool MayContain(uint64_t hash) const;
+
+  // The blocks of the filter, in host byte order.
+  std::string Serialize() const;
+
+  // Number of keys the filter was sized for.
+  size_t capacity() const { return capacity_; }
+
+  // Bytes of the blocks.
+  size_t bytes() const { return block_count_ * kBlockBytes; }
+
+ private:
+  struct alignas(kBlockBytes) Block {
+    std::atomic<uint32_t> lanes[kLanes];
+  };
+
+  // Create a filter of block_count zeroed blocks.
+  explicit BloomFilter(size_t block_count);
+
+  // Index of the block of the hash.
+  size_t BlockIndex(uint64_t hash) const;
+
+  size_t block_count_;
+  size_t capacity_ = 0;
+  std::unique_ptr<Block[]> blocks_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_BLOOM_FILTER_H_
@@ -0,0 +1,54 @@
+#include "checksum.h"
+
+#include <array>
+#include <cstring>
+
+namespace cs499_fei {
+namespace {
+using Crc32Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+// Helper function: the lookup tables of the slicing-by-8 CRC-32. Table k
+// holds the CRC of a byte followed by k zero bytes.
+Crc32Tables MakeCrc32Tables() {
+  Crc32Tables tables{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; ++k) {
+      c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    }
+    tables[0][i] = c;
+  }
+  for (uint32_t i = 0; i < 256; ++i) {
+    for (size_t k = 1; k < tables.size(); ++k) {
+      uint32_t c = tables[k - 1][i];
+      tables[k][i] = tables[0][c & 0xff] ^ (c >> 8);
+    }
+  }
+  return tables;
+}
+}  // namespace
+
+uint32_t Crc32(const char *data, size_t size, uint32_t crc) {
+  static const Crc32Tables tables = MakeCrc32Tables();
+  const auto *p = reinterpret_cast<const unsigned char *>(data);
+  crc = ~crc;
+  // Assumes a little-endian host, like the file formats which use it.
+  while (size >= 8) {
+    uint32_t low;
+    uint32_t high;
+    std::memcpy(&low, p, sizeof(low));
+    std::memcpy(&high, p + 4, sizeof(high));
+    low ^= crc;
+    crc = tables[7][low & 0xff] ^ tables[6][(low >> 8) & 0xff] ^
+          tables[5][(low >> 16) & 0xff] ^ tables[4][low >> 24] ^
+          tables[3][high & 0xff] ^ tables[2][(high >> 8) & 0xff] ^
+          tables[1][(high >> 16) & 0xff] ^ tables[0][high >> 24];
+    p += 8;
+    size -= 8;
+  }
+  while (size-- > 0) {
+    crc = tables[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+}  // namespace cs499_fei
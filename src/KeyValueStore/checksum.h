@@ -0,0 +1,14 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_CHECKSUM_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_CHECKSUM_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cs499_fei {
+// CRC-32 (IEEE) of the bytes. Pass the CRC of the previous bytes to
+// checksum data which is read or written in parts.
+// Computed eight bytes at a time, so a multi-GB snapshot is checked at
+// memory speed rather than a byte per table lookup.
+uint32_t Crc32(const char *data, size_t size, uint32_t crc = 0);
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_CHECKSUM_H_
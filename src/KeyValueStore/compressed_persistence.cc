@@ -0,0 +1,262 @@
+#include "compressed_persistence.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <optional>
+
+#include <glog/logging.h>
+
+#include "block_codec.h"
+#include "checksum.h"
+#include "partitioned_persistence.h"
+
+namespace cs499_fei {
+constexpr char CompressedPersistence::kMagic[];
+constexpr size_t CompressedPersistence::kHeaderSize;
+constexpr size_t CompressedPersistence::kBlockHeaderSize;
+constexpr size_t CompressedPersistence::kBlockSize;
+constexpr uint32_t CompressedPersistence::kStoredRaw;
+
+namespace {
+// Blocks in the pool at once, per thread, so the caller never waits for a
+// block while the others idle, and memory stays bounded.
+constexpr size_t kBlocksPerThread = 4;
+
+// Bytes of the magic, without its terminating zero.
+constexpr size_t kMagicSize = sizeof(CompressedPersistence::kMagic) - 1;
+
+// Header of a compressed file.
+struct Header {
+  char magic[kMagicSize];
+  uint64_t count;
+  uint64_t raw_size;
+  uint32_t blocks;
+  uint32_t reserved;
+};
+static_assert(sizeof(Header) == CompressedPersistence::kHeaderSize,
+              "The header has a fixed layout.");
+
+// Header of a block.
+struct BlockHeader {
+  uint32_t raw_size;
+  uint32_t stored_size;
+  uint32_t crc;
+  uint32_t flags;
+};
+static_assert(sizeof(BlockHeader) == CompressedPersistence::kBlockHeaderSize,
+              "The block header has a fixed layout.");
+
+// A block as it is stored.
+struct Block {
+  BlockHeader header;
+  std::string data;
+};
+
+// Helper function: append a 32-bit number to the buffer.
+void PutUint32(std::string *buffer, uint32_t n) {
+  buffer->append(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+// Helper function: compress the raw pairs into a block, or keep them raw if
+// they do not compress.
+Block EncodeBlock(const std::string &raw) {
+  Block block;
+  CompressBlock(raw, &block.data);
+  block.header.flags = 0;
+  if (block.data.size() >= raw.size()) {
+    block.data = raw;
+    block.header.flags = CompressedPersistence::kStoredRaw;
+  }
+  block.header.raw_size = static_cast<uint32_t>(raw.size());
+  block.header.stored_size = static_cast<uint32_t>(block.data.size());
+  block.header.crc = Crc32(block.data.data(), block.data.size());
+  return block;
+}
+
+// Helper function: check and decompress a stored block.
+// Return nullopt if it is corrupt.
+std::optional<std::string> DecodeBlock(const BlockHeader &header,
+                                       std::string_view stored) {
+  if (Crc32(stored.data(), stored.size()) != header.crc) {
+    return std::nullopt;
+  }
+  if (header.flags & CompressedPersistence::kStoredRaw) {
+    if (stored.size() != header.raw_size) {
+      return std::nullopt;
+    }
+    return std::string(stored);
+  }
+  std::string raw;
+  if (!DecompressBlock(stored, header.raw_size, &raw)) {
+    return std::nullopt;
+  }
+  return raw;
+}
+
+// Helper function: write all the bytes to the file.
+void WriteAll(FILE *file, const std::string &file_name, const void *data,
+              size_t size) {
+  if (std::fwrite(data, 1, size, file) != size) {
+    LOG(FATAL) << "Cannot write " << file_name << ": " << std::strerror(errno);
+  }
+}
+}  // namespace
+
+CompressedPersistence::CompressedPersistence(size_t threads)
+    : pool_(threads) {}
+
+void CompressedPersistence::serialize(const StringKVMap &kv_data,
+                                      const std::string &to_file) {
+  std::string tmp_file = to_file + ".tmp";
+  FILE *file = std::fopen(tmp_file.c_str(), "wb");
+  if (file == nullptr) {
+    LOG(FATAL) << "Cannot open " << tmp_file << ": " << std::strerror(errno);
+  }
+  // The header is written last, once the counts are known.
+  Header header{};
+  std::memcpy(header.magic, kMagic, kMagicSize);
+  header.count = kv_data.size();
+  WriteAll(file, tmp_file, &header, sizeof(header));
+
+  // The blocks are written in order as they come back from the pool.
+  std::deque<std::future<Block>> pending;
+  auto write_front = [&] {
+    Block block = pending.front().get();
+    pending.pop_front();
+    WriteAll(file, tmp_file, &block.header, sizeof(block.header));
+    WriteAll(file, tmp_file, block.data.data(), block.data.size());
+  };
+  std::string raw;
+  auto submit = [&] {
+    header.raw_size += raw.size();
+    ++header.blocks;
+    pending.push_back(pool_.Submit(
+        [raw = std::move(raw)] { return EncodeBlock(raw); }));
+    raw = std::string();
+    raw.reserve(kBlockSize);
+    if (pending.size() >= kBlocksPerThread * pool_.Size()) {
+      write_front();
+    }
+  };
+  raw.reserve(kBlockSize);
+  for (const auto &p : kv_data) {
+    PutUint32(&raw, static_cast<uint32_t>(p.first.size()));
+    PutUint32(&raw, static_cast<uint32_t>(p.second.size()));
+    raw.append(p.first);
+    raw.append(p.second);
+    if (raw.size() >= kBlockSize) {
+      submit();
+    }
+  }
+  if (!raw.empty()) {
+    submit();
+  }
+  while (!pending.empty()) {
+    write_front();
+  }
+
+  if (std::fseek(file, 0, SEEK_SET) != 0) {
+    LOG(FATAL) << "Cannot write " << tmp_file << ": " << std::strerror(errno);
+  }
+  WriteAll(file, tmp_file, &header, sizeof(header));
+  if (std::fflush(file) != 0 || fdatasync(fileno(file)) != 0 ||
+      std::fclose(file) != 0 ||
+      std::rename(tmp_file.c_str(), to_file.c_str()) != 0) {
+    LOG(FATAL) << "Cannot store " << to_file << ": " << std::strerror(errno);
+  }
+}
+
+StringKVMap CompressedPersistence::deserialize(const std::string &from_file) {
+  StringKVMap ret;
+  load(from_file, [&ret](std::string_view key, std::string_view value) {
+    ret.emplace(key, value);
+  });
+  return ret;
+}
+
+void CompressedPersistence::load(const std::string &from_file,
+                                 const PairVisitor &visit) {
+  std::ifstream infile(from_file, std::ios::binary | std::ios::ate);
+  Header header;
+  if (!infile || infile.tellg() < static_cast<std::streamoff>(kHeaderSize)) {
+    PartitionedPersistence().load(from_file, visit);
+    return;
+  }
+  std::string data(static_cast<size_t>(infile.tellg()), '\0');
+  infile.seekg(0);
+  infile.read(&data[0], data.size());
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (!infile || std::memcmp(header.magic, kMagic, kMagicSize) != 0) {
+    LOG(INFO) << from_file << " is not a compressed store, read it as "
+              << "partitioned";
+    PartitionedPersistence().load(from_file, visit);
+    return;
+  }
+
+  uint64_t count = 0;
+  auto visit_block = [&](std::optional<std::string> raw) {
+    if (!raw) {
+      LOG(FATAL) << "Corrupt compressed store " << from_file
+                 << ": a block fails its checksum";
+    }
+    std::string_view body(*raw);
+    size_t offset = 0;
+    while (offset < body.size()) {
+      uint32_t sizes[2];
+      if (body.size() - offset < sizeof(sizes)) {
+        break;
+      }
+      std::memcpy(sizes, body.data() + offset, sizeof(sizes));
+      offset += sizeof(sizes);
+      if (body.size() - offset < uint64_t(sizes[0]) + sizes[1]) {
+        break;
+      }
+      visit(body.substr(offset, sizes[0]),
+            body.substr(offset + sizes[0], sizes[1]));
+      offset += sizes[0] + sizes[1];
+      ++count;
+    }
+    if (offset != body.size()) {
+      LOG(FATAL) << "Corrupt compressed store " << from_file
+                 << ": a block ends inside a pair";
+    }
+  };
+
+  // The pool decompresses the next blocks while the caller visits one.
+  std::deque<std::future<std::optional<std::string>>> pending;
+  size_t offset = kHeaderSize;
+  for (uint32_t b = 0; b < header.blocks; ++b) {
+    BlockHeader block;
+    if (data.size() - offset < sizeof(block)) {
+      break;
+    }
+    std::memcpy(&block, data.data() + offset, sizeof(block));
+    offset += sizeof(block);
+    if (data.size() - offset < block.stored_size) {
+      break;
+    }
+    std::string_view stored(data.data() + offset, block.stored_size);
+    offset += block.stored_size;
+    pending.push_back(
+        pool_.Submit([block, stored] { return DecodeBlock(block, stored); }));
+    if (pending.size() >= kBlocksPerThread * pool_.Size()) {
+      visit_block(pending.front().get());
+      pending.pop_front();
+    }
+  }
+  while (!pending.empty()) {
+    visit_block(pending.front().get());
+    pending.pop_front();
+  }
+  if (offset != data.size() || count != header.count) {
+    LOG(FATAL) << "Corrupt compressed store " << from_file << ": read "
+               << count << " of " << header.count << " pairs";
+  }
+}
+}  // namespace cs499_fei
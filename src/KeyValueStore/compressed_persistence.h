@@ -0,0 +1,66 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_COMPRESSED_PERSISTENCE_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_COMPRESSED_PERSISTENCE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "persistence_abstraction.h"
+#include "thread_pool.h"
+
+namespace cs499_fei {
+// Persistence strategy:
+// Serialize the key-value data into blocks compressed with the built-in LZ
+// block codec, so a snapshot of repetitive keys and values takes less disk
+// and restores faster from a slow volume. The blocks are compressed and
+// decompressed on a thread pool of its own, never on the serving threads,
+// while the caller emits and visits the pairs in order.
+//
+// File layout, in host (little-endian) byte order:
+//   header: magic "KVSLZ001", u64 pair count, u64 raw body bytes, u32 block
+//           count, u32 reserved
+//   blocks: per block, u32 raw bytes, u32 stored bytes, u32 CRC-32 of the
+//           stored bytes, u32 flags, stored bytes
+// The raw body is laid out as in the binary format: per pair, u32 key size,
+// u32 value size, key bytes, value bytes. A block holds whole pairs. A block
+// which does not compress is stored raw and flagged so.
+//
+// The file is written next to the target and renamed over it. A file without
+// the magic is read as the partitioned, binary or text format, so existing
+// stores upgrade on their next store. A corrupt file is fatal.
+class CompressedPersistence : public PersistenceAbstraction {
+ public:
+  // Identifies the compressed format at the start of the file.
+  static constexpr char kMagic[] = "KVSLZ001";
+
+  // Bytes of the header, and of the header of every block.
+  static constexpr size_t kHeaderSize = 32;
+  static constexpr size_t kBlockHeaderSize = 16;
+
+  // Raw bytes of pairs after which a block is cut.
+  static constexpr size_t kBlockSize = 256 << 10;
+
+  // Flag of a block stored without compression.
+  static constexpr uint32_t kStoredRaw = 1;
+
+  // Compress on threads workers, 0 for one per hardware thread.
+  explicit CompressedPersistence(size_t threads = 0);
+
+  // Write the in-memory key-value data into the compressed file.
+  void serialize(const StringKVMap &kv_data, const std::string &to_file) override;
+
+  // Read the key-value data from the file to the memory.
+  StringKVMap deserialize(const std::string &from_file) override;
+
+  // Visit every key-value pair of the file, in order, while the pool
+  // decompresses the blocks ahead.
+  void load(const std::string &from_file, const PairVisitor &visit) override;
+
+  // Number of threads compressing the blocks.
+  size_t threads() const { return pool_.Size(); }
+
+ private:
+  // Compresses and decompresses the blocks.
+  ThreadPool pool_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_COMPRESSED_PERSISTENCE_H_
@@ -0,0 +1,353 @@
+#include "delta_persistence.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <unordered_map>
+
+#include <glog/logging.h>
+
+#include "checksum.h"
+
+namespace cs499_fei {
+constexpr char DeltaPersistence::kMagic[];
+constexpr size_t DeltaPersistence::kHeaderSize;
+constexpr uint32_t DeltaPersistence::kFull;
+constexpr uint8_t DeltaPersistence::kPut;
+constexpr uint8_t DeltaPersistence::kRemove;
+
+namespace {
+namespace fs = std::experimental::filesystem;
+
+// Bytes buffered before each write of the body.
+constexpr size_t kWriteBufferSize = 4 << 20;
+
+// Bytes of the magic, without its terminating zero.
+constexpr size_t kMagicSize = sizeof(DeltaPersistence::kMagic) - 1;
+
+// Bytes of the type and sizes in front of every record.
+constexpr size_t kRecordHeaderSize = 1 + 2 * sizeof(uint32_t);
+
+// Header of a delta file.
+struct Header {
+  char magic[kMagicSize];
+  uint64_t count;
+  uint64_t body_size;
+  uint32_t crc;
+  uint32_t flags;
+};
+static_assert(sizeof(Header) == DeltaPersistence::kHeaderSize,
+              "The header has a fixed layout.");
+
+// The state of the keys the deltas changed: the value of a put, nullopt for
+// a removal.
+using Changes = std::unordered_map<std::string, std::optional<std::string>>;
+
+// Helper function: the infix between the store and the number of a delta.
+std::string DeltaPrefix(const std::string &file_name) {
+  return fs::path(file_name).filename().string() + ".delta.";
+}
+
+// Helper function: write all the bytes at the offset.
+void WriteAt(int fd, const std::string &file_name, const char *data,
+             size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t n = pwrite(fd, data, size, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      LOG(FATAL) << "Cannot write " << file_name << ": "
+                 << std::strerror(errno);
+    }
+    data += n;
+    size -= n;
+    offset += n;
+  }
+}
+
+// Helper function: apply the records of a delta to the changes, and return
+// whether it is a full delta.
+bool ReadDelta(const std::string &file_name, Changes *changes) {
+  std::ifstream infile(file_name, std::ios::binary);
+  std::string bytes((std::istreambuf_iterator<char>(infile)),
+                    std::istreambuf_iterator<char>());
+  if (bytes.size() < DeltaPersistence::kHeaderSize ||
+      std::memcmp(bytes.data(), DeltaPersistence::kMagic, kMagicSize) != 0) {
+    LOG(FATAL) << "Corrupt delta " << file_name;
+  }
+  Header header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  const char *body = bytes.data() + DeltaPersistence::kHeaderSize;
+  if (header.body_size != bytes.size() - DeltaPersistence::kHeaderSize ||
+      Crc32(body, header.body_size) != header.crc) {
+    LOG(FATAL) << "Corrupt delta " << file_name;
+  }
+
+  // a full delta starts over from nothing.
+  bool full = (header.flags & DeltaPersistence::kFull) != 0;
+  if (full) {
+    changes->clear();
+  }
+  const char *end = body + header.body_size;
+  const char *p = body;
+  uint64_t count = 0;
+  while (static_cast<size_t>(end - p) >= kRecordHeaderSize) {
+    uint8_t type = static_cast<uint8_t>(*p);
+    uint32_t sizes[2];
+    std::memcpy(sizes, p + 1, sizeof(sizes));
+    p += kRecordHeaderSize;
+    if (static_cast<uint64_t>(end - p) <
+        static_cast<uint64_t>(sizes[0]) + sizes[1]) {
+      break;
+    }
+    std::string key(p, sizes[0]);
+    if (type == DeltaPersistence::kPut) {
+      (*changes)[std::move(key)] = std::string(p + sizes[0], sizes[1]);
+    } else {
+      (*changes)[std::move(key)] = std::nullopt;
+    }
+    p += sizes[0] + sizes[1];
+    ++count;
+  }
+  if (p != end || count != header.count) {
+    LOG(FATAL) << "Corrupt delta " << file_name << ": read " << count
+               << " of " << header.count << " records";
+  }
+  return full;
+}
+
+// Helper function: apply the deltas in order, and return whether one of them
+// is full, so the base is not read.
+bool ReadDeltas(const std::vector<DeltaPersistence::DeltaFile> &deltas,
+                Changes *changes) {
+  bool full = false;
+  for (const auto &delta : deltas) {
+    full = ReadDelta(delta.file_name, changes) || full;
+  }
+  return full;
+}
+}  // namespace
+
+DeltaPersistence::DeltaPersistence(
+    std::shared_ptr<PersistenceAbstraction> base)
+    : base_(std::move(base)) {}
+
+DeltaPersistence::~DeltaPersistence() {
+  {
+    std::lock_guard<std::mutex> lock(folding_locker_);
+    stop_folding_ = true;
+  }
+  folding_cv_.notify_all();
+  if (fold_thread_.joinable()) {
+    fold_thread_.join();
+  }
+}
+
+std::vector<DeltaPersistence::DeltaFile> DeltaPersistence::ListDeltas(
+    const std::string &file_name) {
+  std::vector<DeltaFile> deltas;
+  fs::path directory = fs::path(file_name).parent_path();
+  if (directory.empty()) {
+    directory = ".";
+  }
+  std::error_code error;
+  if (!fs::is_directory(directory, error)) {
+    return deltas;
+  }
+  std::string prefix = DeltaPrefix(file_name);
+  for (const auto &entry : fs::directory_iterator(directory, error)) {
+    std::string name = entry.path().filename().string();
+    if (name.size() <= prefix.size() ||
+        name.compare(0, prefix.size(), prefix) != 0) {
+      continue;
+    }
+    // the temporary file of a delta being written has a suffix.
+    std::string number = name.substr(prefix.size());
+    if (!std::all_of(number.begin(), number.end(), ::isdigit)) {
+      continue;
+    }
+    deltas.push_back({std::stoull(number), entry.path().string()});
+  }
+  std::sort(deltas.begin(), deltas.end(),
+            [](const DeltaFile &a, const DeltaFile &b) {
+              return a.sequence < b.sequence;
+            });
+  return deltas;
+}
+
+void DeltaPersistence::WriteDelta(
+    const std::string &to_file, uint32_t flags,
+    const std::function<void(
+        const std::function<void(uint8_t type, std::string_view key,
+                                 std::string_view value)> &emit)> &produce) {
+  // The lock is held until the rename, so the deltas appear in the order of
+  // their numbers.
+  std::lock_guard<std::mutex> lock(sequence_locker_);
+  if (!sequence_known_) {
+    auto deltas = ListDeltas(to_file);
+    last_sequence_ = deltas.empty() ? 0 : deltas.back().sequence;
+    sequence_known_ = true;
+  }
+  std::string delta_file =
+      to_file + ".delta." + std::to_string(last_sequence_ + 1);
+  std::string tmp_file = delta_file + ".tmp";
+  int fd = open(tmp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    LOG(FATAL) << "Cannot open " << tmp_file << ": " << std::strerror(errno);
+  }
+
+  // The header is written last, once the checksum is known.
+  Header header{};
+  std::memcpy(header.magic, kMagic, kMagicSize);
+  header.flags = flags;
+  off_t offset = kHeaderSize;
+  std::string buffer;
+  auto flush = [&] {
+    header.crc = Crc32(buffer.data(), buffer.size(), header.crc);
+    WriteAt(fd, tmp_file, buffer.data(), buffer.size(), offset);
+    offset += buffer.size();
+    buffer.clear();
+  };
+  produce([&](uint8_t type, std::string_view key, std::string_view value) {
+    uint32_t sizes[2] = {static_cast<uint32_t>(key.size()),
+                         static_cast<uint32_t>(value.size())};
+    buffer.push_back(static_cast<char>(type));
+    buffer.append(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+    buffer.append(key);
+    buffer.append(value);
+    ++header.count;
+    if (buffer.size() >= kWriteBufferSize) {
+      flush();
+    }
+  });
+  flush();
+  header.body_size = offset - kHeaderSize;
+  WriteAt(fd, tmp_file, reinterpret_cast<const char *>(&header),
+          sizeof(header), 0);
+
+  if (fdatasync(fd) != 0 || close(fd) != 0 ||
+      std::rename(tmp_file.c_str(), delta_file.c_str()) != 0) {
+    LOG(FATAL) << "Cannot store " << delta_file << ": "
+               << std::strerror(errno);
+  }
+  ++last_sequence_;
+}
+
+void DeltaPersistence::serialize(const StringKVMap &kv_data,
+                                 const std::string &to_file) {
+  WriteDelta(to_file, kFull, [&kv_data](const auto &emit) {
+    for (const auto &p : kv_data) {
+      emit(kPut, p.first, p.second);
+    }
+  });
+}
+
+void DeltaPersistence::serialize_delta(const StringKVMap &puts,
+                                       const std::vector<std::string> &removed,
+                                       const std::string &to_file) {
+  WriteDelta(to_file, 0, [&puts, &removed](const auto &emit) {
+    for (const auto &p : puts) {
+      emit(kPut, p.first, p.second);
+    }
+    for (const auto &key : removed) {
+      emit(kRemove, key, std::string_view());
+    }
+  });
+}
+
+StringKVMap DeltaPersistence::deserialize(const std::string &from_file) {
+  StringKVMap ret;
+  std::mutex ret_locker;
+  load(from_file, [&](std::string_view key, std::string_view value) {
+    std::lock_guard<std::mutex> lock(ret_locker);
+    ret.emplace(key, value);
+  });
+  return ret;
+}
+
+void DeltaPersistence::load(const std::string &from_file,
+                            const PairVisitor &visit) {
+  Changes changes;
+  bool full = ReadDeltas(ListDeltas(from_file), &changes);
+  if (!full) {
+    // The base strategy may visit from several threads, which only read
+    // the changes.
+    base_->load(from_file, [&changes, &visit](std::string_view key,
+                                              std::string_view value) {
+      if (changes.empty() || changes.count(std::string(key)) == 0) {
+        visit(key, value);
+      }
+    });
+  }
+  for (const auto &p : changes) {
+    if (p.second) {
+      visit(p.first, *p.second);
+    }
+  }
+}
+
+size_t DeltaPersistence::Fold(const std::string &file_name) {
+  std::lock_guard<std::mutex> fold_lock(fold_locker_);
+  // Only the deltas listed now are folded. Later ones stay on top of the new
+  // base.
+  auto deltas = ListDeltas(file_name);
+  if (deltas.empty()) {
+    return 0;
+  }
+  Changes changes;
+  bool full = ReadDeltas(deltas, &changes);
+  StringKVMap data;
+  if (!full) {
+    std::mutex data_locker;
+    base_->load(file_name, [&](std::string_view key, std::string_view value) {
+      std::lock_guard<std::mutex> lock(data_locker);
+      data.emplace(key, value);
+    });
+  }
+  for (auto &p : changes) {
+    if (p.second) {
+      data[p.first] = std::move(*p.second);
+    } else {
+      data.erase(p.first);
+    }
+  }
+  base_->serialize(data, file_name);
+  for (const auto &delta : deltas) {
+    std::remove(delta.file_name.c_str());
+  }
+  return deltas.size();
+}
+
+void DeltaPersistence::StartFolding(const std::string &file_name,
+                                    std::chrono::seconds interval,
+                                    size_t min_deltas) {
+  fold_thread_ = std::thread([this, file_name, interval, min_deltas] {
+    std::unique_lock<std::mutex> lock(folding_locker_);
+    while (!folding_cv_.wait_for(lock, interval,
+                                 [this] { return stop_folding_; })) {
+      lock.unlock();
+      size_t waiting = ListDeltas(file_name).size();
+      if (waiting > 0 && waiting >= min_deltas) {
+        auto start = std::chrono::steady_clock::now();
+        size_t folded = Fold(file_name);
+        LOG(INFO) << "Folded " << folded << " deltas into " << file_name
+                  << " in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count()
+                  << "ms";
+      }
+      lock.lock();
+    }
+  });
+}
+}  // namespace cs499_fei
@@ -0,0 +1,122 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_DELTA_PERSISTENCE_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_DELTA_PERSISTENCE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "persistence_abstraction.h"
+
+namespace cs499_fei {
+// Persistence strategy:
+// Store only the keys put or removed since the last store, as a small delta
+// file on top of a base file of another strategy, so the cost of a store
+// follows the write rate rather than the size of the data. A fold, run in the
+// background, merges the deltas into a new base and removes them.
+//
+// Files of the store F:
+//   F             the base, in the format of the base strategy
+//   F.delta.<n>   delta number n, applied on top of the base in order of n
+// Delta layout, in host (little-endian) byte order:
+//   header: magic "KVSDLT01", u64 record count, u64 body bytes, u32 CRC-32 of
+//           the body, u32 flags
+//   body:   per record, u8 type (put or remove), u32 key size, u32 value
+//           size, key bytes, value bytes
+//
+// serialize stores the whole data as a delta flagged full, which replaces the
+// base and every delta before it, so each store is one rename of a new file.
+// A fold writes the new base before it removes the deltas it folded, oldest
+// first. Replaying some of them again on the new base gives the same data,
+// since the base holds exactly their result, so a crash at any point loads
+// the last store. A corrupt delta is fatal.
+class DeltaPersistence : public PersistenceAbstraction {
+ public:
+  // Identifies a delta at the start of the file.
+  static constexpr char kMagic[] = "KVSDLT01";
+
+  // Bytes of the header.
+  static constexpr size_t kHeaderSize = 32;
+
+  // Flag of a delta holding the whole data.
+  static constexpr uint32_t kFull = 1;
+
+  // Types of the records of a delta.
+  static constexpr uint8_t kPut = 1;
+  static constexpr uint8_t kRemove = 2;
+
+  // A delta file of a store.
+  struct DeltaFile {
+    uint64_t sequence = 0;
+    std::string file_name;
+  };
+
+  // Keep the base in the format of base.
+  explicit DeltaPersistence(std::shared_ptr<PersistenceAbstraction> base);
+
+  // Stop the background fold.
+  ~DeltaPersistence() override;
+
+  // Write the in-memory key-value data into a full delta.
+  void serialize(const StringKVMap &kv_data, const std::string &to_file) override;
+
+  // Read the key-value data of the base and the deltas to the memory.
+  StringKVMap deserialize(const std::string &from_file) override;
+
+  // Visit every key-value pair of the base which no delta changes, then the
+  // pairs the deltas put.
+  void load(const std::string &from_file, const PairVisitor &visit) override;
+
+  // Deltas are supported.
+  bool SupportsDeltas() const override { return true; }
+
+  // Write the pairs put and the keys removed into the next delta.
+  void serialize_delta(const StringKVMap &puts,
+                       const std::vector<std::string> &removed,
+                       const std::string &to_file) override;
+
+  // Merge the deltas of the store into a new base, then remove them. Return
+  // the number of folded deltas. Deltas written meanwhile are kept.
+  size_t Fold(const std::string &file_name);
+
+  // Run Fold in a background thread every interval, once at least
+  // min_deltas deltas wait, until destruction.
+  void StartFolding(const std::string &file_name,
+                    std::chrono::seconds interval, size_t min_deltas);
+
+  // The delta files of the store, in order.
+  static std::vector<DeltaFile> ListDeltas(const std::string &file_name);
+
+ private:
+  // Write the records which produce passes to emit into the next delta of
+  // the store.
+  void WriteDelta(
+      const std::string &to_file, uint32_t flags,
+      const std::function<void(
+          const std::function<void(uint8_t type, std::string_view key,
+                                   std::string_view value)> &emit)> &produce);
+
+  // Strategy of the base file.
+  std::shared_ptr<PersistenceAbstraction> base_;
+
+  // Number of the last delta written, read from the directory before the
+  // first write.
+  uint64_t last_sequence_ = 0;
+  bool sequence_known_ = false;
+  std::mutex sequence_locker_;
+
+  // Held for the length of a fold, so folds never overlap.
+  std::mutex fold_locker_;
+
+  // Background fold thread, stopped through stop_folding_.
+  std::thread fold_thread_;
+  bool stop_folding_ = false;
+  std::mutex folding_locker_;
+  std::condition_variable folding_cv_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_DELTA_PERSISTENCE_H_
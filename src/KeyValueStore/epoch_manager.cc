@@ -0,0 +1,179 @@
+#include "epoch_manager.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace cs499_fei {
+namespace {
+// Source of the unique EpochManager ids.
+std::atomic<uint64_t> next_manager_id{1};
+
+// Helper function: the lock guarding the ids of the live managers. Never
+// destroyed, since threads exiting after main still use it.
+std::mutex &LiveManagersLocker() {
+  static auto *locker = new std::mutex;
+  return *locker;
+}
+
+// Helper function: the ids of the managers which are not destroyed yet.
+std::unordered_set<uint64_t> &LiveManagers() {
+  static auto *managers = new std::unordered_set<uint64_t>;
+  return *managers;
+}
+}  // namespace
+
+struct EpochManager::Registration {
+  // The last manager the thread used, since a thread mostly works with a
+  // single one.
+  uint64_t last_id = 0;
+  ThreadRecord *last_record = nullptr;
+
+  // The record of every manager the thread has used.
+  std::unordered_map<uint64_t, ThreadRecord *> records;
+
+  // Give back the records of the managers still alive. The objects the
+  // thread retired stay in the record, and its next owner reclaims them.
+  ~Registration() {
+    std::lock_guard<std::mutex> lock(LiveManagersLocker());
+    for (const auto &entry : records) {
+      if (LiveManagers().count(entry.first) > 0) {
+        entry.second->in_use.store(false, std::memory_order_release);
+      }
+    }
+  }
+};
+
+EpochManager::Guard::Guard(EpochManager &manager)
+    : record_(&manager.LocalRecord()) {
+  if (record_->depth++ == 0) {
+    uint64_t epoch = manager.global_epoch_.load();
+    record_->state.store((epoch << 1) | 1);
+    // Publish the epoch before any shared pointer is loaded.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+EpochManager::Guard::~Guard() {
+  if (--record_->depth == 0) {
+    record_->state.store(0, std::memory_order_release);
+  }
+}
+
+// The global epoch starts at 2 so "retired epoch + 2" never underflows.
+EpochManager::EpochManager()
+    : id_(next_manager_id++), global_epoch_(2), segments_(new Segment) {
+  std::lock_guard<std::mutex> lock(LiveManagersLocker());
+  LiveManagers().insert(id_);
+}
+
+EpochManager::~EpochManager() {
+  {
+    std::lock_guard<std::mutex> lock(LiveManagersLocker());
+    LiveManagers().erase(id_);
+  }
+  Segment *segment = segments_.get();
+  while (segment != nullptr) {
+    for (auto &record : segment->records) {
+      for (auto &retired : record.retired) {
+        retired.deleter(retired.object, retired.context);
+      }
+    }
+    Segment *next = segment->next.load();
+    if (segment != segments_.get()) {
+      delete segment;
+    }
+    segment = next;
+  }
+}
+
+void EpochManager::Retire(void *object, Deleter deleter, void *context) {
+  ThreadRecord &record = LocalRecord();
+  record.retired.push_back({global_epoch_.load(), object, deleter, context});
+  if (record.retired.size() >= kReclaimThreshold) {
+    TryAdvance();
+    Reclaim(record);
+  }
+}
+
+EpochManager::ThreadRecord &EpochManager::LocalRecord() {
+  thread_local Registration registration;
+  if (registration.last_id == id_) {
+    return *registration.last_record;
+  }
+  auto it = registration.records.find(id_);
+  ThreadRecord *record;
+  if (it != registration.records.end()) {
+    record = it->second;
+  } else {
+    record = &AcquireRecord();
+    registration.records[id_] = record;
+  }
+  registration.last_id = id_;
+  registration.last_record = record;
+  return *record;
+}
+
+EpochManager::ThreadRecord &EpochManager::AcquireRecord() {
+  Segment *segment = segments_.get();
+  while (true) {
+    for (int i = 0; i < kSegmentRecords; ++i) {
+      ThreadRecord &record = segment->records[i];
+      bool expected = false;
+      if (!record.in_use.load(std::memory_order_relaxed) &&
+          record.in_use.compare_exchange_strong(expected, true)) {
+        int count = segment->count.load();
+        while (count < i + 1 &&
+               !segment->count.compare_exchange_weak(count, i + 1)) {
+        }
+        return record;
+      }
+    }
+    Segment *next = segment->next.load();
+    if (next == nullptr) {
+      // another thread may append a segment at the same time, the loser
+      // uses the winner's.
+      auto *appended = new Segment;
+      if (segment->next.compare_exchange_strong(next, appended)) {
+        next = appended;
+      } else {
+        delete appended;
+      }
+    }
+    segment = next;
+  }
+}
+
+void EpochManager::TryAdvance() {
+  uint64_t epoch = global_epoch_.load();
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for (Segment *segment = segments_.get(); segment != nullptr;
+       segment = segment->next.load()) {
+    int count = segment->count.load();
+    for (int i = 0; i < count; ++i) {
+      uint64_t state = segment->records[i].state.load();
+      // An active thread is still in an older epoch.
+      if ((state & 1) && (state >> 1) != epoch) {
+        return;
+      }
+    }
+  }
+  global_epoch_.compare_exchange_strong(epoch, epoch + 1);
+}
+
+void EpochManager::Reclaim(ThreadRecord &record) {
+  // Readers which could reach an object retired in epoch e were all in
+  // epoch e or earlier, so it is safe to delete it from epoch e + 2 on.
+  uint64_t epoch = global_epoch_.load();
+  auto &retired = record.retired;
+  size_t kept = 0;
+  for (size_t i = 0; i < retired.size(); ++i) {
+    if (retired[i].epoch + 2 <= epoch) {
+      retired[i].deleter(retired[i].object, retired[i].context);
+    } else {
+      retired[kept++] = std::move(retired[i]);
+    }
+  }
+  retired.resize(kept);
+}
+}  // namespace cs499_fei
@@ -0,0 +1,126 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_EPOCH_MANAGER_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_EPOCH_MANAGER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cs499_fei {
+// Epoch-based memory reclamation for lock-free data structures.
+// A reader enters a critical section with an EpochManager::Guard before it
+// loads shared pointers. A writer which unlinks an object hands it to Retire
+// instead of deleting it. The object is deleted once every thread that may
+// still hold a pointer to it has left its critical section.
+class EpochManager {
+  struct ThreadRecord;
+
+ public:
+  // Number of thread records allocated at a time, once all records are
+  // owned by running threads.
+  static constexpr int kSegmentRecords = 512;
+
+  // Number of retired objects a thread collects before reclaiming.
+  static constexpr size_t kReclaimThreshold = 64;
+
+  // Keeps the calling thread inside a critical section while alive.
+  // Guards of the same thread may nest.
+  class Guard {
+   public:
+    // Enter a critical section of the manager.
+    explicit Guard(EpochManager &manager);
+
+    // Leave the critical section.
+    ~Guard();
+
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+
+   private:
+    // Record of the thread which owns this guard.
+    ThreadRecord *record_;
+  };
+
+  EpochManager();
+
+  // Delete every object which is still waiting to be reclaimed.
+  // No thread may be inside a critical section.
+  ~EpochManager();
+
+  EpochManager(const EpochManager &) = delete;
+  EpochManager &operator=(const EpochManager &) = delete;
+
+  // Function which deletes a retired object.
+  using Deleter = void (*)(void *object, void *context);
+
+  // Delete the object with deleter(object, context) once no reader can reach
+  // it.
+  void Retire(void *object, Deleter deleter, void *context = nullptr);
+
+  // Retire an object allocated with new.
+  template <typename T>
+  void Retire(T *object) {
+    Retire(object, [](void *p, void *) { delete static_cast<T *>(p); });
+  }
+
+ private:
+  // An object waiting for reclamation, stamped with the epoch it was retired.
+  struct Retired {
+    uint64_t epoch;
+    void *object;
+    Deleter deleter;
+    void *context;
+  };
+
+  // State of one registered thread.
+  // Aligned to a cache line so threads do not false-share their records.
+  struct alignas(64) ThreadRecord {
+    // (epoch << 1) | 1 while the thread is in a critical section, 0 otherwise.
+    std::atomic<uint64_t> state{0};
+
+    // Whether a thread owns this record.
+    std::atomic<bool> in_use{false};
+
+    // Nesting depth of the owner's guards. Only the owner touches it.
+    int depth = 0;
+
+    // Objects retired by the owning thread. Only the owner touches it.
+    std::vector<Retired> retired;
+  };
+
+  // A block of records. Segments are only appended, so records never move.
+  struct Segment {
+    ThreadRecord records[kSegmentRecords];
+
+    // Number of records ever handed out, so scans skip the unused tail.
+    std::atomic<int> count{0};
+
+    std::atomic<Segment *> next{nullptr};
+  };
+
+  // The records the calling thread owns, given back when it exits.
+  struct Registration;
+
+  // Return the record of the calling thread, registering it on first use.
+  ThreadRecord &LocalRecord();
+
+  // Take a free record, appending a segment if every record is owned.
+  ThreadRecord &AcquireRecord();
+
+  // Advance the global epoch if every active thread has observed it.
+  void TryAdvance();
+
+  // Delete the objects of the record which no reader can reach any more.
+  void Reclaim(ThreadRecord &record);
+
+  // Unique id of this manager, used to find the calling thread's record.
+  const uint64_t id_;
+
+  // The global epoch.
+  std::atomic<uint64_t> global_epoch_;
+
+  // First segment of the records of the registered threads.
+  std::unique_ptr<Segment> segments_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_EPOCH_MANAGER_H_
@@ -1,36 +1,457 @@
 #include "keyvaluestore_server.h"
 
+#include <algorithm>
+#include <chrono>
+
+using cs499_fei::AsyncKeyValueStoreServer;
 using cs499_fei::KeyValueStoreServiceImpl;
+using cs499_fei::KVMapAbstraction;
+using cs499_fei::BinaryPersistence;
+using cs499_fei::BloomFilter;
+using cs499_fei::CompressedPersistence;
+using cs499_fei::DeltaPersistence;
+using cs499_fei::PartitionedPersistence;
 using cs499_fei::Persistence;
 using cs499_fei::PersistenceAbstraction;
 using cs499_fei::PersistPtr;
 
+using cs499_fei::FLAGS_address;
+using cs499_fei::FLAGS_async_server;
+using cs499_fei::FLAGS_async_threads;
+using cs499_fei::FLAGS_bloom_bits_per_key;
+using cs499_fei::FLAGS_codec_threads;
+using cs499_fei::FLAGS_compact_interval;
+using cs499_fei::FLAGS_engine;
+using cs499_fei::FLAGS_fold_interval;
+using cs499_fei::FLAGS_fold_min_deltas;
+using cs499_fei::FLAGS_lockfree_capacity;
+using cs499_fei::FLAGS_lsm_cache_bytes;
+using cs499_fei::FLAGS_lsm_directory;
+using cs499_fei::FLAGS_lsm_memtable_bytes;
+using cs499_fei::FLAGS_max_memory;
+using cs499_fei::FLAGS_replica_of;
+using cs499_fei::FLAGS_replication_heartbeat_ms;
+using cs499_fei::FLAGS_replication_log_records;
+using cs499_fei::FLAGS_shards;
+using cs499_fei::FLAGS_shm;
+using cs499_fei::FLAGS_shm_slots;
+using cs499_fei::FLAGS_snapshot_interval;
+using cs499_fei::FLAGS_stats_interval;
 using cs499_fei::FLAGS_store;
+using cs499_fei::FLAGS_store_deltas;
+using cs499_fei::FLAGS_store_format;
+using cs499_fei::FLAGS_store_partitions;
+using cs499_fei::FLAGS_wal;
+using cs499_fei::FLAGS_wal_batch_size;
+using cs499_fei::FLAGS_wal_flush_interval_us;
+using cs499_fei::kEngineLockFreeMap;
+using cs499_fei::kEngineLsm;
+using cs499_fei::kEngineThreadsafeMap;
+using cs499_fei::kStoreFormatBinary;
+using cs499_fei::kStoreFormatCompressed;
+using cs499_fei::kStoreFormatPartitioned;
+using cs499_fei::kStoreFormatText;
+using cs499_fei::LockFreeMap;
+using cs499_fei::LsmMap;
+using cs499_fei::ReplicaFollower;
+using cs499_fei::ReplicationLog;
+using cs499_fei::ReplicationSource;
+using cs499_fei::ThreadsafeMap;
+using cs499_fei::ScanCursor;
+using cs499_fei::ScanPairs;
+using cs499_fei::ShmListener;
+using cs499_fei::SnapshotWriter;
+using cs499_fei::ValuePtr;
+using cs499_fei::WriteAheadLog;
+
+namespace {
+// Helper function: Unix time in milliseconds now, for the deadlines of the
+// write-ahead log, which outlive the process.
+uint64_t UnixNowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+}  // namespace
 
 KeyValueStoreServiceImpl::KeyValueStoreServiceImpl() {
   bool flag_store_not_set =
       gflags::GetCommandLineFlagInfoOrDie("store").is_default;
 
+  PersistPtr persist_ptr;
   if (flag_store_not_set) {
     LOG(INFO) << "In-memory model." << std::endl;
   } else {
     LOG(INFO) << "Persistence model." << std::endl;
     LOG(INFO) << "Persistence location: " << FLAGS_store << std::endl;
-    PersistPtr persist_ptr = std::shared_ptr<Persistence>(new Persistence());
-    threadsafe_map_ = ThreadsafeMap(persist_ptr, FLAGS_store);
+    if (FLAGS_store_format == kStoreFormatText) {
+      persist_ptr = std::shared_ptr<Persistence>(new Persistence());
+    } else if (FLAGS_store_format == kStoreFormatBinary) {
+      persist_ptr = std::make_shared<BinaryPersistence>();
+    } else if (FLAGS_store_format == kStoreFormatCompressed) {
+      size_t threads = std::max(FLAGS_codec_threads, 0);
+      if (threads == 0) {
+        // the other half of the hardware threads keeps serving.
+        threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+      }
+      auto compressed = std::make_shared<CompressedPersistence>(threads);
+      LOG(INFO) << "Codec threads: " << compressed->threads() << std::endl;
+      persist_ptr = compressed;
+    } else {
+      if (FLAGS_store_format != kStoreFormatPartitioned) {
+        LOG(WARNING) << "Unknown store format " << FLAGS_store_format
+                     << ", use " << kStoreFormatPartitioned << std::endl;
+      }
+      auto partitioned =
+          std::make_shared<PartitionedPersistence>(FLAGS_store_partitions);
+      LOG(INFO) << "Store partitions: " << partitioned->partitions()
+                << std::endl;
+      persist_ptr = partitioned;
+    }
+    LOG(INFO) << "Persistence format: " << FLAGS_store_format << std::endl;
+    if (FLAGS_store_deltas) {
+      auto deltas = std::make_shared<DeltaPersistence>(persist_ptr);
+      if (FLAGS_fold_interval > 0) {
+        LOG(INFO) << "Delta snapshots, fold interval: " << FLAGS_fold_interval
+                  << "s, min deltas: " << FLAGS_fold_min_deltas << std::endl;
+        deltas->StartFolding(FLAGS_store,
+                             std::chrono::seconds(FLAGS_fold_interval),
+                             std::max(FLAGS_fold_min_deltas, 1));
+      }
+      persist_ptr = deltas;
+    }
+    persistent_ = true;
+  }
+
+  if (FLAGS_engine == kEngineLockFreeMap) {
+    LOG(INFO) << "Engine: " << FLAGS_engine
+              << ", capacity: " << FLAGS_lockfree_capacity << std::endl;
+    if (persist_ptr) {
+      kv_map_ = std::make_shared<LockFreeMap>(persist_ptr, FLAGS_store,
+                                              FLAGS_lockfree_capacity);
+    } else {
+      kv_map_ = std::make_shared<LockFreeMap>(FLAGS_lockfree_capacity);
+    }
+  } else if (FLAGS_engine == kEngineLsm) {
+    LOG(INFO) << "Engine: " << FLAGS_engine
+              << ", directory: " << FLAGS_lsm_directory
+              << ", memtable: " << FLAGS_lsm_memtable_bytes
+              << " bytes, block cache: " << FLAGS_lsm_cache_bytes << " bytes"
+              << std::endl;
+    LsmMap::Options options;
+    options.memtable_bytes = std::max<int64_t>(FLAGS_lsm_memtable_bytes, 1);
+    options.cache_bytes = std::max<int64_t>(FLAGS_lsm_cache_bytes, 0);
+    options.bits_per_key = std::max(FLAGS_bloom_bits_per_key, 0);
+    if (persist_ptr) {
+      lsm_map_ = std::make_shared<LsmMap>(persist_ptr, FLAGS_store,
+                                          FLAGS_lsm_directory, options);
+    } else {
+      lsm_map_ = std::make_shared<LsmMap>(FLAGS_lsm_directory, options);
+    }
+    kv_map_ = lsm_map_;
+    // The runs are stored data, so snapshots flush the memtable even without
+    // a store file.
+    persistent_ = true;
+  } else {
+    if (FLAGS_engine != kEngineThreadsafeMap) {
+      LOG(WARNING) << "Unknown engine " << FLAGS_engine << ", use "
+                   << kEngineThreadsafeMap << std::endl;
+    }
+    // a negative count would wrap around to a huge size_t.
+    size_t shards = std::max(FLAGS_shards, 1);
+    LOG(INFO) << "Engine: " << kEngineThreadsafeMap << ", shards: " << shards
+              << std::endl;
+    std::shared_ptr<ThreadsafeMap> threadsafe_map;
+    if (persist_ptr) {
+      threadsafe_map =
+          std::make_shared<ThreadsafeMap>(persist_ptr, FLAGS_store, shards);
+    } else {
+      threadsafe_map = std::make_shared<ThreadsafeMap>(shards);
+    }
+    if (FLAGS_bloom_bits_per_key != BloomFilter::kDefaultBitsPerKey) {
+      LOG(INFO) << "Bloom filter bits per key: " << FLAGS_bloom_bits_per_key
+                << std::endl;
+      threadsafe_map->SetFilterBitsPerKey(
+          std::max(FLAGS_bloom_bits_per_key, 0));
+    }
+    if (FLAGS_max_memory > 0) {
+      LOG(INFO) << "Cache mode, max memory: " << FLAGS_max_memory << " bytes"
+                << std::endl;
+      threadsafe_map->SetMaxMemory(FLAGS_max_memory);
+    }
+    if (FLAGS_compact_interval > 0) {
+      LOG(INFO) << "Compaction interval: " << FLAGS_compact_interval << "s"
+                << std::endl;
+      threadsafe_map->StartCompaction(
+          std::chrono::seconds(FLAGS_compact_interval));
+    }
+    kv_map_ = threadsafe_map;
+    threadsafe_map_ = threadsafe_map;
+  }
+
+  if (!FLAGS_wal.empty()) {
+    LOG(INFO) << "Write-ahead log: " << FLAGS_wal
+              << ", flush interval: " << FLAGS_wal_flush_interval_us
+              << "us, batch size: " << FLAGS_wal_batch_size << std::endl;
+    wal_ = std::make_unique<WriteAheadLog>(
+        FLAGS_wal, std::chrono::microseconds(FLAGS_wal_flush_interval_us),
+        FLAGS_wal_batch_size);
+    // The log holds the writes after the last stored file, so it is replayed
+    // on top of it.
+    size_t replayed = wal_->Replay([this](const WriteAheadLog::Record &record) {
+      std::string key(record.key);
+      switch (record.type) {
+        case WriteAheadLog::RecordType::kPut: {
+          if (record.expires_at_ms == 0) {
+            kv_map_->Put(key, record.value);
+            break;
+          }
+          // a key whose TTL passed while the server was down, or which the
+          // engine cannot expire, is dropped along with an older value.
+          uint64_t now_ms = UnixNowMs();
+          if (kv_map_->SupportsTtl() && record.expires_at_ms > now_ms) {
+            kv_map_->PutWithTtl(
+                key, record.value,
+                std::chrono::milliseconds(record.expires_at_ms - now_ms));
+          } else {
+            kv_map_->Remove(key);
+          }
+          break;
+        }
+        case WriteAheadLog::RecordType::kRemove:
+          kv_map_->Remove(key);
+          break;
+        case WriteAheadLog::RecordType::kAppend:
+          // only in logs written before appends were logged as puts.
+          kv_map_->Append(key, std::string(record.value),
+                          std::string(record.separator));
+          break;
+      }
+    });
+    LOG(INFO) << "Replayed " << replayed << " writes from the write-ahead log"
+              << std::endl;
+  }
+
+  if (!FLAGS_replica_of.empty()) {
+    if (!kv_map_->SupportsScan()) {
+      LOG(FATAL) << "A replica needs a storage engine with scans, not "
+                 << FLAGS_engine;
+    }
+    LOG(INFO) << "Read-only replica of " << FLAGS_replica_of << std::endl;
+    follower_ = std::make_unique<ReplicaFollower>(
+        grpc::CreateChannel(FLAGS_replica_of,
+                            grpc::InsecureChannelCredentials()),
+        kv_map_);
+    follower_->Start();
+  } else if (FLAGS_replication_log_records > 0) {
+    LOG(INFO) << "Replication log records: " << FLAGS_replication_log_records
+              << ", heartbeat: " << FLAGS_replication_heartbeat_ms << "ms"
+              << std::endl;
+    if (!kv_map_->SupportsScan()) {
+      LOG(WARNING) << "The " << FLAGS_engine
+                   << " engine cannot snapshot a new replica" << std::endl;
+    }
+    replication_log_ =
+        std::make_shared<ReplicationLog>(FLAGS_replication_log_records);
+    replication_source_ = std::make_unique<ReplicationSource>(
+        kv_map_, replication_log_,
+        std::chrono::milliseconds(
+            std::max(FLAGS_replication_heartbeat_ms, 1)));
+  }
+
+  if (persistent_ && FLAGS_snapshot_interval > 0) {
+    LOG(INFO) << "Snapshot interval: " << FLAGS_snapshot_interval << "s"
+              << std::endl;
+    std::chrono::seconds interval(FLAGS_snapshot_interval);
+    snapshot_thread_ = std::thread([this, interval] {
+      std::unique_lock<std::mutex> lock(snapshot_locker_);
+      while (!snapshot_cv_.wait_for(lock, interval,
+                                    [this] { return stop_snapshots_; })) {
+        lock.unlock();
+        store();
+        lock.lock();
+      }
+    });
+  }
+
+  if ((threadsafe_map_ || lsm_map_) && FLAGS_stats_interval > 0) {
+    std::chrono::seconds interval(FLAGS_stats_interval);
+    stats_thread_ = std::thread([this, interval] {
+      std::unique_lock<std::mutex> lock(stats_locker_);
+      while (!stats_cv_.wait_for(lock, interval,
+                                 [this] { return stop_stats_; })) {
+        LogStats();
+      }
+    });
+  }
+}
+
+KeyValueStoreServiceImpl::~KeyValueStoreServiceImpl() {
+  StopReplication();
+  {
+    std::lock_guard<std::mutex> lock(snapshot_locker_);
+    stop_snapshots_ = true;
   }
+  snapshot_cv_.notify_all();
+  if (snapshot_thread_.joinable()) {
+    snapshot_thread_.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(stats_locker_);
+    stop_stats_ = true;
+  }
+  stats_cv_.notify_all();
+  if (stats_thread_.joinable()) {
+    stats_thread_.join();
+  }
+}
+
+void KeyValueStoreServiceImpl::LogStats() const {
+  if (threadsafe_map_) {
+    ThreadsafeMap::CacheStats cache = threadsafe_map_->GetCacheStats();
+    uint64_t gets = cache.hits + cache.misses;
+    LOG(INFO) << "Cache: " << cache.hits << " hits, " << cache.misses
+              << " misses, hit rate "
+              << (gets == 0 ? 0 : 100.0 * cache.hits / gets) << "%, "
+              << cache.evictions << " evictions, " << cache.expirations
+              << " expirations, " << cache.bytes << " bytes";
+    ThreadsafeMap::FilterStats filter = threadsafe_map_->GetFilterStats();
+    LOG(INFO) << "Bloom filters: " << filter.negatives << " negatives, "
+              << filter.false_positives << " false positives, "
+              << "false positive rate " << 100 * filter.FalsePositiveRate()
+              << "%, " << filter.bytes << " bytes";
+  }
+  if (lsm_map_) {
+    LsmMap::Stats stats = lsm_map_->GetStats();
+    uint64_t absent = stats.filter_negatives + stats.filter_false_positives;
+    LOG(INFO) << "Bloom filters: " << stats.filter_negatives
+              << " negatives, " << stats.filter_false_positives
+              << " false positives, false positive rate "
+              << (absent == 0 ? 0
+                              : 100.0 * stats.filter_false_positives / absent)
+              << "%, " << stats.filter_bytes << " bytes";
+  }
+}
+
+bool KeyValueStoreServiceImpl::WriteLogged(const WriteAheadLog::Record &record,
+                                           const std::function<bool()> &write,
+                                           uint64_t *sequence) {
+  if (!wal_ && !replication_log_) {
+    return write();
+  }
+  std::shared_lock<std::shared_mutex> checkpoint_lock(checkpoint_locker_);
+  std::lock_guard<std::mutex> key_lock(
+      key_lockers_[std::hash<std::string_view>()(record.key) % kKeyStripes]);
+  if (!write()) {
+    return false;
+  }
+  bool append = record.type == WriteAheadLog::RecordType::kAppend;
+  // The value the write left is shared with the store, not copied, and read
+  // along with the TTL it has left.
+  std::string key(record.key);
+  ValuePtr value;
+  std::chrono::milliseconds ttl = std::chrono::milliseconds::zero();
+  if (record.type != WriteAheadLog::RecordType::kRemove &&
+      (replication_log_ || append)) {
+    value = kv_map_->GetWithTtl(key, &ttl);
+  }
+  if (wal_ && append) {
+    // An append is logged as a put of the value it produced, so replaying
+    // it on top of a snapshot which already holds it leaves the same value.
+    WriteAheadLog::Record put{WriteAheadLog::RecordType::kRemove, key};
+    if (value) {
+      put.type = WriteAheadLog::RecordType::kPut;
+      put.value = *value;
+      if (ttl > std::chrono::milliseconds::zero()) {
+        put.expires_at_ms = UnixNowMs() + ttl.count();
+      }
+    }
+    *sequence = wal_->Append(put);
+  } else if (wal_) {
+    *sequence = wal_->Append(record);
+  }
+  if (replication_log_) {
+    replication_log_->Append(key, std::move(value), ttl);
+  }
+  return true;
+}
+
+void KeyValueStoreServiceImpl::WaitDurable(uint64_t sequence) {
+  if (wal_ && sequence > 0) {
+    wal_->WaitDurable(sequence);
+  }
+}
+
+Status KeyValueStoreServiceImpl::CheckWritable() const {
+  if (follower_) {
+    return Status(grpc::StatusCode::FAILED_PRECONDITION,
+                  "The key-value store is a read-only replica of " +
+                      FLAGS_replica_of + ".");
+  }
+  return Status::OK;
+}
+
+Status KeyValueStoreServiceImpl::CheckReadable(
+    uint64_t max_staleness_ms) const {
+  if (!follower_) {
+    return Status::OK;
+  }
+  if (!follower_->ready()) {
+    return Status(grpc::StatusCode::UNAVAILABLE,
+                  "The replica is loading a snapshot of the primary.");
+  }
+  if (max_staleness_ms > 0 &&
+      follower_->Staleness() > std::chrono::milliseconds(max_staleness_ms)) {
+    return Status(grpc::StatusCode::UNAVAILABLE,
+                  "The replica is staler than requested.");
+  }
+  return Status::OK;
 }
 
 Status KeyValueStoreServiceImpl::put(ServerContext *context,
                                      const PutRequest *request,
                                      PutReply *reply) {
-  auto key = request->key();
-  auto value = request->value();
+  return Put(request->key(), request->value(), request->ttl_ms());
+}
 
+Status KeyValueStoreServiceImpl::Put(const std::string &key,
+                                     std::string_view value, uint64_t ttl_ms) {
   LOG(INFO) << "Received PutRequest. "
             << " Key: " << key;
-  threadsafe_map_.Put(key, value);
+  Status writable = CheckWritable();
+  if (!writable.ok()) {
+    return writable;
+  }
+  // The only copy of the value, allocated by the engine. The store shares it
+  // from here on.
+  bool stored;
+  uint64_t sequence = 0;
+  if (ttl_ms > 0) {
+    if (!kv_map_->SupportsTtl()) {
+      return Status(grpc::StatusCode::UNIMPLEMENTED,
+                    "The storage engine does not support TTLs.");
+    }
+    // The log holds when the key expires, so a replay after a restart keeps
+    // it only for the time it has left.
+    stored = WriteLogged(
+        {WriteAheadLog::RecordType::kPut, key, value, {},
+         UnixNowMs() + ttl_ms},
+        [&] {
+          return kv_map_->PutWithTtl(key, value,
+                                     std::chrono::milliseconds(ttl_ms));
+        },
+        &sequence);
+  } else {
+    stored = WriteLogged({WriteAheadLog::RecordType::kPut, key, value},
+                         [&] { return kv_map_->Put(key, value); }, &sequence);
+  }
+  if (!stored) {
+    LOG(ERROR) << "No room left for Key: " << key;
+    return Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                  "The key-value store is full.");
+  }
 
+  WaitDurable(sequence);
   return Status::OK;
 }
 
@@ -38,13 +459,21 @@ Status KeyValueStoreServiceImpl::get(
     ServerContext *context, ServerReaderWriter<GetReply, GetRequest> *stream) {
   GetRequest request;
   while (stream->Read(&request)) {
-    auto key = request.key();
-    auto value = threadsafe_map_.Get(key);
+    const std::string &key = request.key();
+    Status readable = CheckReadable(request.max_staleness_ms());
+    if (!readable.ok()) {
+      return readable;
+    }
+    // Only a reference is taken inside the store. The value is copied once,
+    // into the reply, outside of any lock.
+    uint64_t version;
+    ValuePtr value = kv_map_->GetVersioned(key, &version);
     LOG(INFO) << "Received GetRequest. "
               << " Key: " << key;
     GetReply reply;
-    if (value.has_value()) {
-      reply.set_value(value.value());
+    if (value) {
+      reply.set_value(value->data(), value->size());
+      reply.set_version(version);
     }
     stream->Write(reply);
   }
@@ -57,42 +486,317 @@ Status KeyValueStoreServiceImpl::remove(ServerContext *context,
   auto key = request->key();
   LOG(INFO) << "Received RemoveRequest. "
             << " Key: " << key;
-  threadsafe_map_.Remove(key);
+  Status writable = CheckWritable();
+  if (!writable.ok()) {
+    return writable;
+  }
+  uint64_t sequence = 0;
+  WriteLogged({WriteAheadLog::RecordType::kRemove, key},
+              [&] {
+                kv_map_->Remove(key);
+                return true;
+              },
+              &sequence);
+  WaitDurable(sequence);
   return Status::OK;
 }
 
-void KeyValueStoreServiceImpl::store() { threadsafe_map_.Store(FLAGS_store); }
+Status KeyValueStoreServiceImpl::append(ServerContext *context,
+                                        const AppendRequest *request,
+                                        AppendReply *reply) {
+  const std::string &key = request->key();
+  LOG(INFO) << "Received AppendRequest. "
+            << " Key: " << key;
+  Status writable = CheckWritable();
+  if (!writable.ok()) {
+    return writable;
+  }
+  uint64_t sequence = 0;
+  if (!WriteLogged({WriteAheadLog::RecordType::kAppend, key, request->suffix(),
+                    request->separator()},
+                   [&] {
+                     return kv_map_->Append(key, request->suffix(),
+                                            request->separator());
+                   },
+                   &sequence)) {
+    LOG(ERROR) << "No room left for Key: " << key;
+    return Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                  "The key-value store is full.");
+  }
+  WaitDurable(sequence);
+  return Status::OK;
+}
 
-// Use unnamed namespace to make static functions in it.
-// Define two methods to bridge signal handler to the customized function
-namespace {
-std::function<void(int)> shutdownHandler;
-void signalHandler(int signal) { shutdownHandler(signal); }
-}  // namespace
+Status KeyValueStoreServiceImpl::conditional_put(
+    ServerContext *context, const ConditionalPutRequest *request,
+    ConditionalPutReply *reply) {
+  const std::string &key = request->key();
+  LOG(INFO) << "Received ConditionalPutRequest. "
+            << " Key: " << key
+            << " Expected version: " << request->expected_version();
+  Status writable = CheckWritable();
+  if (!writable.ok()) {
+    return writable;
+  }
+  uint64_t version;
+  uint64_t sequence = 0;
+  KVMapAbstraction::PutStatus status;
+  WriteLogged({WriteAheadLog::RecordType::kPut, key, request->value()},
+              [&] {
+                status = kv_map_->ConditionalPut(key, request->value(),
+                                                 request->expected_version(),
+                                                 &version);
+                return status == KVMapAbstraction::PutStatus::kStored;
+              },
+              &sequence);
+  if (status == KVMapAbstraction::PutStatus::kFull) {
+    LOG(ERROR) << "No room left for Key: " << key;
+    return Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                  "The key-value store is full.");
+  }
+  WaitDurable(sequence);
+  reply->set_stored(status == KVMapAbstraction::PutStatus::kStored);
+  reply->set_version(version);
+  return Status::OK;
+}
+
+Status KeyValueStoreServiceImpl::batch(ServerContext *context,
+                                       const BatchRequest *request,
+                                       BatchReply *reply) {
+  LOG(INFO) << "Received BatchRequest. "
+            << " Operations: " << request->operations_size();
+  // A replica serves the batches of gets only, under the same conditions as
+  // single gets.
+  for (const auto &operation : request->operations()) {
+    if (operation.type() != kvstore::Operation::GET) {
+      Status writable = CheckWritable();
+      if (!writable.ok()) {
+        return writable;
+      }
+      break;
+    }
+  }
+  if (request->operations_size() > 0) {
+    Status readable = CheckReadable(request->max_staleness_ms());
+    if (!readable.ok()) {
+      return readable;
+    }
+  }
+  // The batch waits once for its last logged write, so its writes share a
+  // sync.
+  uint64_t sequence = 0;
+  for (const auto &operation : request->operations()) {
+    const std::string &key = operation.key();
+    auto *result = reply->add_results();
+    switch (operation.type()) {
+      case kvstore::Operation::GET: {
+        ValuePtr value = kv_map_->GetShared(key);
+        if (value) {
+          result->set_ok(true);
+          result->set_value(value->data(), value->size());
+        }
+        break;
+      }
+      case kvstore::Operation::PUT:
+        result->set_ok(WriteLogged(
+            {WriteAheadLog::RecordType::kPut, key, operation.value()},
+            [&] { return kv_map_->Put(key, operation.value()); }, &sequence));
+        break;
+      case kvstore::Operation::REMOVE:
+        WriteLogged({WriteAheadLog::RecordType::kRemove, key},
+                    [&] {
+                      kv_map_->Remove(key);
+                      return true;
+                    },
+                    &sequence);
+        result->set_ok(true);
+        break;
+      case kvstore::Operation::APPEND:
+        result->set_ok(WriteLogged(
+            {WriteAheadLog::RecordType::kAppend, key, operation.value(),
+             operation.separator()},
+            [&] {
+              return kv_map_->Append(key, operation.value(),
+                                     operation.separator());
+            },
+            &sequence));
+        break;
+      default:
+        LOG(ERROR) << "Unknown operation type: " << operation.type();
+        WaitDurable(sequence);
+        return Status(grpc::StatusCode::INVALID_ARGUMENT,
+                      "Unknown operation type.");
+    }
+  }
+  WaitDurable(sequence);
+  return Status::OK;
+}
+
+Status KeyValueStoreServiceImpl::scan(ServerContext *context,
+                                      const ScanRequest *request,
+                                      ServerWriter<ScanReply> *writer) {
+  LOG(INFO) << "Received ScanRequest. "
+            << " Start: " << request->start() << " End: " << request->end()
+            << " Prefix: " << request->prefix()
+            << " Cursor: " << request->cursor();
+  if (!kv_map_->SupportsScan()) {
+    return Status(grpc::StatusCode::UNIMPLEMENTED,
+                  "The storage engine does not support scans.");
+  }
+
+  ScanCursor cursor(*request);
+  ScanPairs pairs;
+  ScanReply reply;
+  while (!context->IsCancelled() && cursor.Next(*kv_map_, &pairs)) {
+    for (const auto &pair : pairs) {
+      reply.set_key(pair.first);
+      reply.set_value(pair.second->data(), pair.second->size());
+      if (!writer->Write(reply)) {
+        return Status::OK;
+      }
+    }
+  }
+  return Status::OK;
+}
+
+Status KeyValueStoreServiceImpl::snapshot(ServerContext *context,
+                                          const SnapshotRequest *request,
+                                          SnapshotReply *reply) {
+  LOG(INFO) << "Received SnapshotRequest.";
+  if (!persistent_) {
+    return Status(grpc::StatusCode::FAILED_PRECONDITION,
+                  "The key-value store runs in the in-memory model.");
+  }
+  store();
+  return Status::OK;
+}
+
+void KeyValueStoreServiceImpl::store() {
+  std::lock_guard<std::mutex> store_lock(store_locker_);
+  auto start = std::chrono::steady_clock::now();
+  SnapshotWriter write_snapshot;
+  uint64_t mark = 0;
+  {
+    // Writers only wait while the snapshot is taken, not while it is stored.
+    std::unique_lock<std::shared_mutex> checkpoint_lock(checkpoint_locker_);
+    write_snapshot = kv_map_->Snapshot(FLAGS_store);
+    if (wal_) {
+      mark = wal_->Mark();
+    }
+  }
+  write_snapshot();
+  LOG(INFO) << "Snapshot stored in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - start)
+                   .count()
+            << "ms" << std::endl;
+  if (wal_ && persistent_) {
+    wal_->DropBefore(mark);
+    WriteAheadLog::Stats stats = wal_->GetStats();
+    LOG(INFO) << "Write-ahead log cut at the snapshot after " << stats.records
+              << " records in " << stats.syncs << " syncs" << std::endl;
+  }
+}
+
+Status KeyValueStoreServiceImpl::replicate(ServerContext *context,
+                                           const ReplicateRequest *request,
+                                           ServerWriter<ReplicateReply> *writer) {
+  LOG(INFO) << "Received ReplicateRequest. "
+            << " Peer: " << context->peer()
+            << " After sequence: " << request->after_sequence();
+  if (!replication_source_) {
+    return Status(grpc::StatusCode::FAILED_PRECONDITION,
+                  "Replication is disabled on this key-value store.");
+  }
+  return replication_source_->Serve(context, *request, writer);
+}
+
+void KeyValueStoreServiceImpl::StopReplication() {
+  if (replication_log_) {
+    replication_log_->Close();
+  }
+  if (follower_) {
+    follower_->Stop();
+  }
+}
 
 // Helper function: to run the gRPC server.
 void RunServer() {
-  std::string server_address("0.0.0.0:50000");
+  std::string server_address(FLAGS_address);
+
+  // SIGINT is blocked before any thread starts, so every thread inherits the
+  // mask and only the shutdown thread below takes the signal. The shutdown
+  // itself then runs in normal thread context rather than in a handler,
+  // which could interrupt a thread holding the locks it needs.
+  sigset_t shutdown_signals;
+  sigemptyset(&shutdown_signals);
+  sigaddset(&shutdown_signals, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &shutdown_signals, nullptr);
 
   KeyValueStoreServiceImpl service;
 
   ServerBuilder builder;
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
-  builder.RegisterService(&service);
+  // Declared before the server, which uses its service until it is
+  // destroyed.
+  std::unique_ptr<AsyncKeyValueStoreServer> async_server;
+  bool use_async_server = FLAGS_async_server;
+  // the gets of the asynchronous server do not check the staleness of a
+  // replica.
+  if (use_async_server && !FLAGS_replica_of.empty()) {
+    LOG(WARNING) << "A replica serves calls with the synchronous server, "
+                 << "--async_server is ignored";
+    use_async_server = false;
+  }
+  if (use_async_server) {
+    async_server = std::make_unique<AsyncKeyValueStoreServer>(
+        &service,
+        [&service](const std::string &key, std::string_view value,
+                   uint64_t ttl_ms) { return service.Put(key, value, ttl_ms); },
+        service.kv_map(), std::max(FLAGS_async_threads, 0),
+        service.durable_writes());
+    async_server->Register(&builder);
+  } else {
+    builder.RegisterService(&service);
+  }
 
   std::unique_ptr<Server> server(builder.BuildAndStart());
+  if (async_server) {
+    async_server->Start();
+    LOG(INFO) << "Asynchronous server, completion queues: "
+              << async_server->threads();
+  }
 
   LOG(INFO) << "Server listening on " << server_address;
 
-  // register signal SIGINT and signal handler
-  signal(SIGINT, signalHandler);
-  shutdownHandler = [&](int signal) {
-    std::cout << "Server shutdown... " <<std::endl;
-    service.store();
-    exit(signal);
-  };
+  std::unique_ptr<ShmListener> shm_listener;
+  if (!FLAGS_shm.empty()) {
+    shm_listener = std::make_unique<ShmListener>(
+        FLAGS_shm, std::max(FLAGS_shm_slots, 1), &service, service.kv_map());
+    if (!shm_listener->Start()) {
+      LOG(FATAL) << "Cannot create the shared-memory segment " << FLAGS_shm;
+    }
+    LOG(INFO) << "Shared-memory segment " << FLAGS_shm
+              << ", slots: " << std::max(FLAGS_shm_slots, 1);
+  }
+
+  std::thread shutdown_thread([&shutdown_signals, &server] {
+    int signal;
+    sigwait(&shutdown_signals, &signal);
+    std::cout << "Server shutdown... " << std::endl;
+    server->Shutdown();
+  });
 
   server->Wait();
+  shutdown_thread.join();
+  if (shm_listener) {
+    shm_listener->Shutdown();
+  }
+  if (async_server) {
+    async_server->Shutdown();
+  }
+  service.StopReplication();
+  service.store();
 }
 
 int main(int argc, char **argv) {
@@ -1,9 +1,17 @@
 #ifndef CSCI499_FEI_SRC_KEYVALUESTORE_KEYVALUESTORE_SERVER_H_
 #define CSCI499_FEI_SRC_KEYVALUESTORE_KEYVALUESTORE_SERVER_H_
 
+#include <array>
+#include <condition_variable>
 #include <csignal>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
@@ -11,9 +19,23 @@
 #include <grpcpp/grpcpp.h>
 
 #include "KeyValueStore.grpc.pb.h"
+#include "async_server.h"
+#include "binary_persistence.h"
+#include "bloom_filter.h"
+#include "compressed_persistence.h"
+#include "delta_persistence.h"
+#include "partitioned_persistence.h"
+#include "kvmap_abstraction.h"
+#include "lockfree_map.h"
+#include "lsm_map.h"
 #include "persistence_abstraction.h"
 #include "persistence.h"
+#include "replication.h"
+#include "replication_log.h"
+#include "scan_cursor.h"
+#include "shm_listener.h"
 #include "threadsafe_map.h"
+#include "write_ahead_log.h"
 
 using grpc::Server;
 using grpc::ServerBuilder;
@@ -22,6 +44,12 @@ using grpc::ServerReader;
 using grpc::ServerReaderWriter;
 using grpc::ServerWriter;
 using grpc::Status;
+using kvstore::AppendReply;
+using kvstore::AppendRequest;
+using kvstore::BatchReply;
+using kvstore::BatchRequest;
+using kvstore::ConditionalPutReply;
+using kvstore::ConditionalPutRequest;
 using kvstore::GetReply;
 using kvstore::GetRequest;
 using kvstore::KeyValueStore;
@@ -29,18 +57,182 @@ using kvstore::PutReply;
 using kvstore::PutRequest;
 using kvstore::RemoveReply;
 using kvstore::RemoveRequest;
+using kvstore::ReplicateReply;
+using kvstore::ReplicateRequest;
+using kvstore::ScanReply;
+using kvstore::ScanRequest;
+using kvstore::SnapshotReply;
+using kvstore::SnapshotRequest;
 
 namespace cs499_fei {
+// Names of the in-memory storage engines
+const std::string kEngineThreadsafeMap = "threadsafe_map";
+const std::string kEngineLockFreeMap = "lockfree_map";
+const std::string kEngineLsm = "lsm";
+
+// Names of the file formats of the persistence model
+const std::string kStoreFormatCompressed = "compressed";
+const std::string kStoreFormatPartitioned = "partitioned";
+const std::string kStoreFormatBinary = "binary";
+const std::string kStoreFormatText = "text";
+
+// Define the flag for the address of the server
+DEFINE_string(address, "0.0.0.0:50000",
+              "Address the server listens on, so several servers run on one "
+              "host.");
+
 // Define the flag for the storage commandline
 DEFINE_string(store, "data_file",
               "Store the in-memory data in the specified file.");
 
+// Define the flag for the file format of the persistence model
+DEFINE_string(store_format, "partitioned",
+              "File format of the store: compressed (LZ-compressed blocks, "
+              "compressed on their own threads), partitioned (binary "
+              "partitions written and read in parallel, named by a manifest), "
+              "binary (one checksummed file, mmap-ed at startup) or text (the "
+              "original size#content format). Each format still reads the "
+              "files of the formats after it.");
+
+// Define the flag for the threads of the compressed format
+DEFINE_int32(codec_threads, 0,
+             "Number of threads compressing and decompressing the blocks of "
+             "the compressed format, 0 for half of the hardware threads.");
+
+// Define the flag for the number of partitions of a partitioned store
+DEFINE_int32(store_partitions, 0,
+             "Number of partition files of the partitioned format, each "
+             "written and read by its own thread, 0 for one per hardware "
+             "thread.");
+
+// Define the flags for the delta snapshots of the persistence model
+DEFINE_bool(store_deltas, false,
+            "Store only the keys written since the last store, as delta "
+            "files next to a base in the store format, and fold them into "
+            "the base in the background.");
+DEFINE_int32(fold_interval, 300,
+             "Seconds between two checks whether the deltas are folded into "
+             "a new base, 0 never folds while running.");
+DEFINE_int32(fold_min_deltas, 8,
+             "Number of deltas which have to wait before a check folds them.");
+
+// Define the flag for the periodic snapshots of the persistence model
+DEFINE_int32(snapshot_interval, 0,
+             "Seconds between two snapshots of the in-memory data into the "
+             "store, 0 only stores on shutdown and on the snapshot RPC.");
+
+// Define the flag for the in-memory storage engine
+DEFINE_string(engine, "threadsafe_map",
+              "In-memory storage engine: threadsafe_map (sharded hashmap with "
+              "reader-writer locks), lockfree_map (lock-free "
+              "open-addressing hashmap) or lsm (log-structured merge-tree "
+              "on disk, for more data than fits in memory).");
+
+// Define the flag for the number of slots of the lockfree_map engine
+DEFINE_int64(lockfree_capacity, LockFreeMap::kDefaultCapacity,
+             "Initial number of slots of the lockfree_map engine. The table "
+             "is rebuilt without its tombstones once 3/4 of the slots are "
+             "claimed, and doubled if more than half of them are live, so a "
+             "small table grows with its keys.");
+
+// Define the flags for the lsm engine
+DEFINE_string(lsm_directory, "lsm_data",
+              "Directory of the run files of the lsm engine. A directory "
+              "without runs starts with the pairs of --store, if set.");
+DEFINE_int64(lsm_memtable_bytes, 64 << 20,
+             "Bytes of keys and values the lsm engine keeps in memory before "
+             "it flushes them into a run.");
+DEFINE_int64(lsm_cache_bytes, 64 << 20,
+             "Bytes of run blocks the lsm engine caches in memory.");
+
+// Define the flag for the Bloom filters of the threadsafe_map and lsm engines
+DEFINE_int32(bloom_bits_per_key, BloomFilter::kDefaultBitsPerKey,
+             "Bits per key of the Bloom filters which answer lookups of "
+             "missing keys without the map shards or the run files, 0 "
+             "disables them.");
+
+// Define the flag for the number of independently locked map shards
+DEFINE_int32(shards, ThreadsafeMap::kDefaultShardCount,
+             "Split the in-memory key space into the specified number of "
+             "independently locked shards.");
+
+// Define the flag for the memory-bounded cache mode of the threadsafe_map
+// engine
+DEFINE_int64(max_memory, 0,
+             "Bytes of keys and values the threadsafe_map engine keeps before "
+             "it evicts cold entries, 0 keeps everything.");
+
+// Define the flag for the background compaction of the threadsafe_map engine
+DEFINE_int32(compact_interval, 60,
+             "Seconds between two compactions of the threadsafe_map arenas, "
+             "0 disables compaction.");
+
+// Define the flag for the periodic report of the engine counters
+DEFINE_int32(stats_interval, 60,
+             "Seconds between two logs of the counters of the threadsafe_map "
+             "and lsm engines: cache hits, misses, evictions and "
+             "expirations, and Bloom filter negatives and false positives. "
+             "0 disables them.");
+
+// Define the flags for the asynchronous server
+DEFINE_bool(async_server, false,
+            "Serve the calls from completion queues instead of a thread per "
+            "call, so an open get stream holds no thread while it waits for "
+            "the next request.");
+DEFINE_int32(async_threads, 0,
+             "Number of completion queues of the asynchronous server, each "
+             "polled by a thread pinned to its own core, 0 for one per "
+             "hardware thread.");
+
+// Define the flags for the shared-memory transport
+DEFINE_string(shm, "",
+              "Also serve the processes on this host through a shared-memory "
+              "segment of the specified name. Empty disables it.");
+DEFINE_int32(shm_slots, 16,
+             "Number of clients the shared-memory segment serves at once, "
+             "each slot with its own thread.");
+
+// Define the flags for the primary of a replication
+DEFINE_int64(replication_log_records, 0,
+             "Keep the specified number of recent writes in memory for "
+             "replicas to follow, 0 disables replication. A replica which "
+             "falls further behind gets a new snapshot.");
+DEFINE_int32(replication_heartbeat_ms, 100,
+             "Milliseconds without writes after which the primary tells its "
+             "replicas they are current.");
+
+// Define the flag for a replica
+DEFINE_string(replica_of, "",
+              "Run as a read-only replica of the primary kvstore_server at "
+              "the specified address, started with --replication_log_records. "
+              "Empty runs as a primary.");
+
+// Define the flag for the write-ahead log
+DEFINE_string(wal, "",
+              "Log every write to the specified file before it is "
+              "acknowledged, and replay the log at startup. Empty disables "
+              "the log.");
+
+// Define the flags for the group commit of the write-ahead log
+DEFINE_int32(wal_flush_interval_us, 1000,
+             "Microseconds the write-ahead log waits for more writes before "
+             "it syncs a batch, 0 syncs at once.");
+DEFINE_int32(wal_batch_size, 64,
+             "Number of writes after which the write-ahead log syncs a batch "
+             "without waiting for the flush interval.");
+
 // The implementation of gRPC service KeyValueStore.
 // Run as the server to handle gRPC requests for KeyValue Storage.
 class KeyValueStoreServiceImpl final : public KeyValueStore::Service {
  public:
+  // Number of locks the logged writes of a key are serialized on.
+  static constexpr size_t kKeyStripes = 64;
+
   // KeyValueStoreServiceImpl default constructor
   KeyValueStoreServiceImpl();
+
+  // Stop the periodic snapshots.
+  ~KeyValueStoreServiceImpl() override;
 //
 //  // KeyValueStoreServiceImpl constructor with the parameter of thread_safe_map
 //  KeyValueStoreServiceImpl(const PersistPtr &persist_ptr,
@@ -48,13 +240,22 @@ class KeyValueStoreServiceImpl final : public KeyValueStore::Service {
 //      : threadsafe_map_(ThreadsafeMap(persist_ptr, file_name)){};
 
   // Receive and process gRPC PutRequest for KeyValue Storage.
-  // Put the key-value pair in payload into the storage.
+  // Put the key-value pair in payload into the storage, expiring after the
+  // TTL of the request if it has one.
+  // Fail with RESOURCE_EXHAUSTED if the storage has no room left, and with
+  // UNIMPLEMENTED for a TTL the storage engine cannot expire.
   Status put(ServerContext *context, const PutRequest *request,
               PutReply *reply) override;
 
+  // Put the key-value pair into the storage as put does, for the asynchronous
+  // server which reads the fields in place from the request.
+  Status Put(const std::string &key, std::string_view value, uint64_t ttl_ms);
+
   // Receive and process gRPC GetRequest for KeyValue Storage.
   // Get the value from the storage based on the key in the request payload.
-  // Construct and return the GetReply with the value.
+  // Construct and return the GetReply with the value and its version.
+  // On a replica, fail with UNAVAILABLE before it holds a snapshot, or once
+  // it is staler than the max staleness of a request.
   Status get(ServerContext *context,
              ServerReaderWriter<GetReply, GetRequest> *stream) override;
 
@@ -64,12 +265,136 @@ class KeyValueStoreServiceImpl final : public KeyValueStore::Service {
   Status remove(ServerContext *context, const RemoveRequest *request,
                 RemoveReply *reply) override;
 
-  // Store the in-memory data into the file.
+  // Receive and process gRPC AppendRequest for KeyValue Storage.
+  // Append the separator and the suffix to the value of the key in one step,
+  // so concurrent appends to a list are never lost.
+  // Fail with RESOURCE_EXHAUSTED if the storage has no room left.
+  Status append(ServerContext *context, const AppendRequest *request,
+                AppendReply *reply) override;
+
+  // Receive and process gRPC ConditionalPutRequest for KeyValue Storage.
+  // Put the key-value pair only if the key is at the expected version, or
+  // does not exist for version 0. A version mismatch is not an error: the
+  // reply is not stored and carries the current version.
+  // Fail with RESOURCE_EXHAUSTED if the storage has no room left.
+  Status conditional_put(ServerContext *context,
+                         const ConditionalPutRequest *request,
+                         ConditionalPutReply *reply) override;
+
+  // Receive and process gRPC BatchRequest for KeyValue Storage.
+  // Run the get, put, remove and append operations of the request in order,
+  // and reply one result per operation.
+  Status batch(ServerContext *context, const BatchRequest *request,
+               BatchReply *reply) override;
+
+  // Receive and process gRPC ScanRequest for KeyValue Storage.
+  // Stream the pairs of the requested range or prefix in key order, after
+  // the cursor key if the request has one. The pairs are read from the
+  // storage in chunks of ScanCursor::kChunk, so no lock is held while
+  // streaming.
+  // Fail with UNIMPLEMENTED for a storage engine without scans.
+  Status scan(ServerContext *context, const ScanRequest *request,
+              ServerWriter<ScanReply> *writer) override;
+
+  // Receive and process gRPC SnapshotRequest for KeyValue Storage.
+  // Store a point-in-time snapshot of the storage into the file, while the
+  // storage keeps serving writes.
+  // Fail with FAILED_PRECONDITION in the in-memory model.
+  Status snapshot(ServerContext *context, const SnapshotRequest *request,
+                  SnapshotReply *reply) override;
+
+  // Store a point-in-time snapshot of the in-memory data into the file. With
+  // the persistence model, the records of the write-ahead log before the
+  // snapshot are dropped once the file holds their writes.
   void store();
 
+  // Receive and process gRPC ReplicateRequest for KeyValue Storage.
+  // Stream the writes of the replication log to a replica, after a
+  // snapshot if it needs one, until the replica goes away.
+  // Fail with FAILED_PRECONDITION if replication is disabled.
+  Status replicate(ServerContext *context, const ReplicateRequest *request,
+                   ServerWriter<ReplicateReply> *writer) override;
+
+  // Stop serving and following replication streams.
+  void StopReplication();
+
+  // The storage engine, for the asynchronous server which reads it without
+  // the streaming methods of the service.
+  KVMapPtr kv_map() const { return kv_map_; }
+
+  // Whether the writes wait for the write-ahead log to sync before they
+  // reply.
+  bool durable_writes() const { return wal_ != nullptr; }
+
  private:
-  // Threadsafe hashmap: KeyValue Storage in memory.
-  ThreadsafeMap threadsafe_map_;
+  // Run the write, and append its record to the write-ahead log and the
+  // value it left to the replication log if it succeeds. The writes of a key
+  // are logged in the order they are applied. A put with a TTL is logged
+  // with when it expires in both. An append is logged to the write-ahead log
+  // as a put of the value it produced, so a replay is idempotent.
+  // Set *sequence to the sequence number of the record, which is left as is
+  // without a write-ahead log or when the write fails. Return whether the
+  // write succeeded.
+  bool WriteLogged(const WriteAheadLog::Record &record,
+                   const std::function<bool()> &write, uint64_t *sequence);
+
+  // Wait until the logged writes up to sequence are durable.
+  void WaitDurable(uint64_t sequence);
+
+  // Fail with FAILED_PRECONDITION on a replica, which takes no writes.
+  Status CheckWritable() const;
+
+  // Fail with UNAVAILABLE on a replica which is still loading the snapshot
+  // of its primary, or has been behind it for longer than max_staleness_ms
+  // unless it is 0.
+  Status CheckReadable(uint64_t max_staleness_ms) const;
+
+  // Log the counters of the storage engine.
+  void LogStats() const;
+
+  // Threadsafe storage engine: KeyValue Storage in memory.
+  KVMapPtr kv_map_;
+
+  // The engine, when it is a threadsafe_map or an lsm, for its counters.
+  std::shared_ptr<ThreadsafeMap> threadsafe_map_;
+  std::shared_ptr<LsmMap> lsm_map_;
+
+  // Write-ahead log of the writes, null when it is disabled.
+  std::unique_ptr<WriteAheadLog> wal_;
+
+  // Replication log of the writes and the stream of it to the replicas, of
+  // a primary with replication enabled.
+  std::shared_ptr<ReplicationLog> replication_log_;
+  std::unique_ptr<ReplicationSource> replication_source_;
+
+  // Follows the primary, on a replica.
+  std::unique_ptr<ReplicaFollower> follower_;
+
+  // Whether store() writes a file, so the log can be emptied after it.
+  bool persistent_ = false;
+
+  // Logged writes hold it shared, store() holds it exclusively while it
+  // takes the snapshot, so the log records before the mark are exactly the
+  // writes the snapshot holds.
+  std::shared_mutex checkpoint_locker_;
+
+  // Serialize the snapshots of the periodic thread, the RPC and shutdown.
+  std::mutex store_locker_;
+
+  // Periodic snapshot thread, stopped through stop_snapshots_.
+  std::thread snapshot_thread_;
+  bool stop_snapshots_ = false;
+  std::mutex snapshot_locker_;
+  std::condition_variable snapshot_cv_;
+
+  // Periodic stats thread, stopped through stop_stats_.
+  std::thread stats_thread_;
+  bool stop_stats_ = false;
+  std::mutex stats_locker_;
+  std::condition_variable stats_cv_;
+
+  // Serialize the logged and replicated writes of a key, picked by its hash.
+  std::array<std::mutex, kKeyStripes> key_lockers_;
 };
 }  // namespace cs499_fei
 #endif  // CSCI499_FEI_SRC_KEYVALUESTORE_KEYVALUESTORE_SERVER_H_
@@ -0,0 +1,157 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_KVMAP_ABSTRACTION_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_KVMAP_ABSTRACTION_H_
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "persistence_abstraction.h"
+#include "slab_arena.h"
+
+namespace cs499_fei {
+using PersistPtr = std::shared_ptr<PersistenceAbstraction>;
+
+// An immutable value shared by the store and every reader holding it. Engines
+// which manage their own memory keep its bytes in their arenas.
+using ValuePtr = std::shared_ptr<const ArenaString>;
+using SharedKVMap = std::unordered_map<std::string, ValuePtr>;
+
+// Key-value pairs in key order, as returned by a scan.
+using ScanPairs = std::vector<std::pair<std::string, ValuePtr>>;
+
+// Writes a snapshot of a store, taken when the function was created, into
+// its file.
+using SnapshotWriter = std::function<void()>;
+
+// Helper function: Copy the bytes into a value held by the global allocator
+inline ValuePtr MakeValue(std::string_view value) {
+  return std::make_shared<const ArenaString>(value.data(), value.size());
+}
+
+// The Abstraction for the in-memory storage engine behind the KeyValueStore
+// service. Every implementation supports safe, concurrent access by multiple
+// callers.
+class KVMapAbstraction {
+ public:
+  // Version of a key which does not exist. Every write gives its key a new,
+  // higher version.
+  static constexpr uint64_t kNoVersion = 0;
+
+  // Result of ConditionalPut.
+  enum class PutStatus {
+    // The value is stored.
+    kStored,
+    // The key is not at the expected version.
+    kConflict,
+    // The store has no room left for the pair.
+    kFull,
+  };
+
+  KVMapAbstraction() = default;
+  virtual ~KVMapAbstraction() = default;
+
+  // Put a key-value pair to the store. The store shares the value instead of
+  // copying it.
+  // Return false if the store has no room left for the pair.
+  virtual bool PutShared(const std::string &key, ValuePtr value) = 0;
+
+  // Given the key, get the corresponding value from the store without copying
+  // it. Return nullptr if the key does not exist in the store.
+  virtual ValuePtr GetShared(const std::string &key) const = 0;
+
+  // Put a copy of the value to the store. Engines which manage their own
+  // memory override it to allocate the copy themselves. The value is a view,
+  // so bytes read in place from a request are copied only once.
+  // Return false if the store has no room left for the pair.
+  virtual bool Put(const std::string &key, std::string_view value) {
+    return PutShared(key, MakeValue(value));
+  }
+
+  // Whether the engine supports PutWithTtl.
+  virtual bool SupportsTtl() const { return false; }
+
+  // Put a copy of the value which expires ttl from now. An expired key is
+  // invisible to Get at once, and its memory is reclaimed later.
+  // Return false if the store has no room left for the pair, or does not
+  // support expiry.
+  virtual bool PutWithTtl(const std::string &key, std::string_view value,
+                          std::chrono::milliseconds ttl) {
+    return false;
+  }
+
+  // Given the key, get the corresponding value and set *ttl to the time it
+  // has left to live, or to zero if it does not expire.
+  // Return nullptr if the key does not exist in the store.
+  virtual ValuePtr GetWithTtl(const std::string &key,
+                              std::chrono::milliseconds *ttl) const {
+    *ttl = std::chrono::milliseconds::zero();
+    return GetShared(key);
+  }
+
+  // Whether the engine keeps its keys in order and supports Scan.
+  virtual bool SupportsScan() const { return false; }
+
+  // Return up to limit pairs with start <= key < end, in key order. An empty
+  // end scans to the last key.
+  // Return no pairs if the engine does not support scans.
+  virtual ScanPairs Scan(const std::string &start, const std::string &end,
+                         size_t limit) const {
+    return ScanPairs();
+  }
+
+  // Given the key, get a copy of the corresponding value from the store.
+  // Return std::nullopt if the key does not exist in the store.
+  std::optional<std::string> Get(const std::string &key) const {
+    ValuePtr value = GetShared(key);
+    if (!value) {
+      return std::nullopt;
+    }
+    return std::string(*value);
+  }
+
+  // Put a copy of the value only if the key is at expected_version, or does
+  // not exist when it is kNoVersion, as one atomic step.
+  // version is set to the new version of the key when the value is stored,
+  // and to its current version on a conflict.
+  virtual PutStatus ConditionalPut(const std::string &key,
+                                   const std::string &value,
+                                   uint64_t expected_version,
+                                   uint64_t *version) = 0;
+
+  // Given the key, get the corresponding value and its version.
+  // Return nullptr and set version to kNoVersion if the key does not exist.
+  virtual ValuePtr GetVersioned(const std::string &key,
+                                uint64_t *version) const = 0;
+
+  // Append the separator and the suffix to the value of the key, or put the
+  // suffix if the key does not exist. Concurrent appends to one key all take
+  // effect.
+  // Return false if the store has no room left for the result.
+  virtual bool Append(const std::string &key, const std::string &suffix,
+                      const std::string &separator) = 0;
+
+  // Given the key, remove the corresponding key-value pair from the store.
+  virtual void Remove(const std::string &key) = 0;
+
+  // Store the in-memory data into the file
+  virtual void Store(const std::string &file_name) = 0;
+
+  // Take a point-in-time snapshot of the in-memory data and return the
+  // function which stores it into the file. The function must be called
+  // once. Engines which support it exclude writers only while taking the
+  // snapshot, and leave the writes made after it out of the file. The default
+  // stores the data as it is when the function runs.
+  virtual SnapshotWriter Snapshot(const std::string &file_name) {
+    return [this, file_name] { Store(file_name); };
+  }
+};
+
+using KVMapPtr = std::shared_ptr<KVMapAbstraction>;
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_KVMAP_ABSTRACTION_H_
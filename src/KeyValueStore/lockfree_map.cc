@@ -0,0 +1,413 @@
+#include "lockfree_map.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+namespace cs499_fei {
+namespace {
+// Helper function: round up to the next power of two.
+size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+// Low bit of the value pointer of a slot of a frozen table.
+constexpr uintptr_t kFrozenBit = 1;
+}  // namespace
+
+LockFreeMap::Key *const LockFreeMap::kFrozenKey =
+    reinterpret_cast<LockFreeMap::Key *>(alignof(LockFreeMap::Key));
+
+LockFreeMap::Table::Table(size_t capacity)
+    : mask(RoundUpToPowerOfTwo(capacity) - 1), slots(new Slot[mask + 1]) {}
+
+LockFreeMap::Table::~Table() {
+  // A rebuilt table handed its pairs over to the next one, and retired the
+  // keys of its tombstones.
+  if (next.load(std::memory_order_acquire) != nullptr) {
+    return;
+  }
+  for (size_t i = 0; i <= mask; ++i) {
+    Key *key = slots[i].key.load();
+    if (key != kFrozenKey) {
+      delete key;
+    }
+    delete Thaw(slots[i].value.load());
+  }
+}
+
+LockFreeMap::LockFreeMap(size_t capacity) : table_(new Table(capacity)) {}
+
+// Constructor with persistence
+LockFreeMap::LockFreeMap(const PersistPtr &persist_ptr,
+                         const std::string &file_name, size_t capacity)
+    : LockFreeMap(capacity) {
+  persist_ptr_ = persist_ptr;
+  file_name_ = file_name;
+  persist_ptr_->load(file_name_,
+                     [this](std::string_view key, std::string_view value) {
+                       PutShared(std::string(key), MakeValue(value));
+                     });
+}
+
+LockFreeMap::~LockFreeMap() { delete table_.load(); }
+
+size_t LockFreeMap::Capacity() const {
+  EpochManager::Guard guard(epochs_);
+  return table_.load(std::memory_order_acquire)->mask + 1;
+}
+
+LockFreeMap::Value *LockFreeMap::Thaw(Value *value) {
+  return reinterpret_cast<Value *>(reinterpret_cast<uintptr_t>(value) &
+                                   ~kFrozenBit);
+}
+
+bool LockFreeMap::Frozen(const Value *value) {
+  return reinterpret_cast<uintptr_t>(value) & kFrozenBit;
+}
+
+LockFreeMap::Probe LockFreeMap::FindSlot(Table &table, const std::string &key,
+                                         size_t hash, bool claim,
+                                         Slot **slot) const {
+  // Allocated on the first empty slot, reused if another key wins the slot.
+  Key *new_key = nullptr;
+  for (size_t i = 0; i <= table.mask; ++i) {
+    Slot &candidate = table.slots[(hash + i) & table.mask];
+    Key *slot_key = candidate.key.load(std::memory_order_acquire);
+    if (slot_key == nullptr) {
+      // An empty slot ends the probe sequence of a key not in the table.
+      if (!claim) {
+        return Probe::kAbsent;
+      }
+      if (new_key == nullptr) {
+        new_key = new Key{hash, key};
+      }
+      if (candidate.key.compare_exchange_strong(slot_key, new_key,
+                                                std::memory_order_acq_rel)) {
+        table.claimed.fetch_add(1, std::memory_order_relaxed);
+        *slot = &candidate;
+        return Probe::kFound;
+      }
+      // Another caller claimed the slot first. slot_key now holds its key.
+    }
+    if (slot_key == kFrozenKey) {
+      delete new_key;
+      return claim ? Probe::kFrozen : Probe::kAbsent;
+    }
+    if (slot_key->hash == hash && slot_key->data == key) {
+      delete new_key;
+      *slot = &candidate;
+      return Probe::kFound;
+    }
+  }
+  delete new_key;
+  return claim ? Probe::kFull : Probe::kAbsent;
+}
+
+LockFreeMap::Table *LockFreeMap::WritableTable() {
+  Table *table = table_.load(std::memory_order_acquire);
+  if (table->claimed.load(std::memory_order_relaxed) * 4 >=
+      (table->mask + 1) * 3) {
+    Rebuild(table);
+    table = table_.load(std::memory_order_acquire);
+  }
+  return table;
+}
+
+void LockFreeMap::Rebuild(Table *table) {
+  size_t chunks = (table->mask + kRebuildChunk) / kRebuildChunk;
+  for (size_t chunk = table->next_freeze.fetch_add(1); chunk < chunks;
+       chunk = table->next_freeze.fetch_add(1)) {
+    table->live.fetch_add(FreezeChunk(*table, chunk),
+                          std::memory_order_relaxed);
+    // The writer which freezes the last chunk sizes the next table.
+    if (table->frozen_chunks.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+        chunks) {
+      size_t live = table->live.load(std::memory_order_relaxed);
+      size_t capacity = table->mask + 1;
+      while (live * 2 > capacity) {
+        capacity <<= 1;
+      }
+      auto *next = new Table(capacity);
+      next->claimed.store(live, std::memory_order_relaxed);
+      table->next.store(next, std::memory_order_release);
+    }
+  }
+
+  Table *next = table->next.load(std::memory_order_acquire);
+  while (next == nullptr) {
+    std::this_thread::yield();
+    next = table->next.load(std::memory_order_acquire);
+  }
+  for (size_t chunk = table->next_move.fetch_add(1); chunk < chunks;
+       chunk = table->next_move.fetch_add(1)) {
+    MoveChunk(*table, *next, chunk);
+    // The writer which moves the last chunk publishes the next table.
+    if (table->moved_chunks.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+        chunks) {
+      table_.store(next, std::memory_order_release);
+      epochs_.Retire(table);
+    }
+  }
+  WaitForRebuild(table);
+}
+
+size_t LockFreeMap::FreezeChunk(Table &table, size_t chunk) {
+  size_t live = 0;
+  size_t end = std::min((chunk + 1) * kRebuildChunk, table.mask + 1);
+  for (size_t i = chunk * kRebuildChunk; i < end; ++i) {
+    Slot &slot = table.slots[i];
+    Key *key = nullptr;
+    slot.key.compare_exchange_strong(key, kFrozenKey,
+                                     std::memory_order_acq_rel);
+    Value *value = slot.value.load(std::memory_order_acquire);
+    while (!slot.value.compare_exchange_weak(
+        value,
+        reinterpret_cast<Value *>(reinterpret_cast<uintptr_t>(value) |
+                                  kFrozenBit),
+        std::memory_order_acq_rel, std::memory_order_acquire)) {
+    }
+    if (value != nullptr) {
+      ++live;
+    }
+  }
+  return live;
+}
+
+void LockFreeMap::MoveChunk(const Table &table, Table &next, size_t chunk) {
+  size_t end = std::min((chunk + 1) * kRebuildChunk, table.mask + 1);
+  for (size_t i = chunk * kRebuildChunk; i < end; ++i) {
+    Key *key = table.slots[i].key.load(std::memory_order_acquire);
+    Value *value = Thaw(table.slots[i].value.load(std::memory_order_acquire));
+    if (key == kFrozenKey) {
+      continue;
+    }
+    // Readers of the frozen table may still compare against the key of a
+    // tombstone.
+    if (value == nullptr) {
+      epochs_.Retire(key);
+      continue;
+    }
+    // The live pairs move to the next table, which readers of the frozen
+    // one see as the same objects. The keys of the frozen table are
+    // distinct, so the moves only race for empty slots. The next table is
+    // published after the last move, so its slots need no ordering here.
+    size_t index = key->hash & next.mask;
+    Key *empty = nullptr;
+    while (!next.slots[index].key.compare_exchange_strong(
+        empty, key, std::memory_order_relaxed)) {
+      empty = nullptr;
+      index = (index + 1) & next.mask;
+    }
+    next.slots[index].value.store(value, std::memory_order_relaxed);
+  }
+}
+
+void LockFreeMap::WaitForRebuild(const Table *table) const {
+  while (table_.load(std::memory_order_acquire) == table) {
+    std::this_thread::yield();
+  }
+}
+
+LockFreeMap::Value *LockFreeMap::NewValue(ValuePtr data) {
+  return new Value{std::move(data),
+                   last_version_.fetch_add(1, std::memory_order_relaxed) + 1};
+}
+
+bool LockFreeMap::PutShared(const std::string &key, ValuePtr value) {
+  EpochManager::Guard guard(epochs_);
+  size_t hash = std::hash<std::string>{}(key);
+  Value *new_value = NewValue(std::move(value));
+  while (true) {
+    Table *table = WritableTable();
+    Slot *slot;
+    Probe probe = FindSlot(*table, key, hash, true, &slot);
+    if (probe == Probe::kFull) {
+      Rebuild(table);
+      continue;
+    }
+    Value *old_value = probe == Probe::kFound
+                           ? slot->value.load(std::memory_order_acquire)
+                           : reinterpret_cast<Value *>(kFrozenBit);
+    while (!Frozen(old_value) &&
+           !slot->value.compare_exchange_weak(old_value, new_value,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+    }
+    if (Frozen(old_value)) {
+      Rebuild(table);
+      continue;
+    }
+    if (old_value != nullptr) {
+      epochs_.Retire(old_value);
+    }
+    return true;
+  }
+}
+
+LockFreeMap::PutStatus LockFreeMap::ConditionalPut(
+    const std::string &key, const std::string &value,
+    uint64_t expected_version, uint64_t *version) {
+  EpochManager::Guard guard(epochs_);
+  size_t hash = std::hash<std::string>{}(key);
+  while (true) {
+    Table *table = WritableTable();
+    Slot *slot;
+    Probe probe = FindSlot(*table, key, hash, true, &slot);
+    if (probe == Probe::kFull) {
+      Rebuild(table);
+      continue;
+    }
+    Value *old_value = probe == Probe::kFound
+                           ? slot->value.load(std::memory_order_acquire)
+                           : reinterpret_cast<Value *>(kFrozenBit);
+    if (Frozen(old_value)) {
+      Rebuild(table);
+      continue;
+    }
+    uint64_t current = old_value ? old_value->version : kNoVersion;
+    if (current != expected_version) {
+      *version = current;
+      return PutStatus::kConflict;
+    }
+    // Versions are never reused, so the slot still holds the expected
+    // version exactly when it still holds old_value.
+    Value *new_value = NewValue(MakeValue(value));
+    if (!slot->value.compare_exchange_strong(old_value, new_value,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+      delete new_value;
+      if (Frozen(old_value)) {
+        Rebuild(table);
+        continue;
+      }
+      *version = old_value ? old_value->version : kNoVersion;
+      return PutStatus::kConflict;
+    }
+    if (old_value != nullptr) {
+      epochs_.Retire(old_value);
+    }
+    *version = new_value->version;
+    return PutStatus::kStored;
+  }
+}
+
+bool LockFreeMap::Append(const std::string &key, const std::string &suffix,
+                         const std::string &separator) {
+  EpochManager::Guard guard(epochs_);
+  size_t hash = std::hash<std::string>{}(key);
+  while (true) {
+    Table *table = WritableTable();
+    Slot *slot;
+    Probe probe = FindSlot(*table, key, hash, true, &slot);
+    if (probe == Probe::kFull) {
+      Rebuild(table);
+      continue;
+    }
+    Value *old_value = probe == Probe::kFound
+                           ? slot->value.load(std::memory_order_acquire)
+                           : reinterpret_cast<Value *>(kFrozenBit);
+    while (!Frozen(old_value)) {
+      ArenaString value;
+      if (old_value != nullptr) {
+        const ArenaString &old_data = *old_value->data;
+        value.reserve(old_data.size() + separator.size() + suffix.size());
+        value.append(old_data).append(separator);
+      }
+      value.append(suffix);
+      Value *new_value =
+          NewValue(std::make_shared<const ArenaString>(std::move(value)));
+      // Another writer changed the value in between: build on its value.
+      if (slot->value.compare_exchange_weak(old_value, new_value,
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+        if (old_value != nullptr) {
+          epochs_.Retire(old_value);
+        }
+        return true;
+      }
+      delete new_value;
+    }
+    Rebuild(table);
+  }
+}
+
+ValuePtr LockFreeMap::GetVersioned(const std::string &key,
+                                   uint64_t *version) const {
+  EpochManager::Guard guard(epochs_);
+  *version = kNoVersion;
+  // A frozen table still holds every pair until it is replaced.
+  Table *table = table_.load(std::memory_order_acquire);
+  Slot *slot;
+  if (FindSlot(*table, key, std::hash<std::string>{}(key), false, &slot) !=
+      Probe::kFound) {
+    return nullptr;
+  }
+  // The table's reference can not be reclaimed while the guard is alive, so
+  // it is safe to take another one.
+  Value *value = Thaw(slot->value.load(std::memory_order_acquire));
+  if (value == nullptr) {
+    return nullptr;
+  }
+  *version = value->version;
+  return value->data;
+}
+
+ValuePtr LockFreeMap::GetShared(const std::string &key) const {
+  uint64_t version;
+  return GetVersioned(key, &version);
+}
+
+void LockFreeMap::Remove(const std::string &key) {
+  EpochManager::Guard guard(epochs_);
+  size_t hash = std::hash<std::string>{}(key);
+  while (true) {
+    Table *table = table_.load(std::memory_order_acquire);
+    Slot *slot;
+    if (FindSlot(*table, key, hash, false, &slot) != Probe::kFound) {
+      return;
+    }
+    // Leave the key in the slot as a tombstone.
+    Value *old_value = slot->value.load(std::memory_order_acquire);
+    while (!Frozen(old_value) &&
+           !slot->value.compare_exchange_weak(old_value, nullptr,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire)) {
+    }
+    if (Frozen(old_value)) {
+      Rebuild(table);
+      continue;
+    }
+    if (old_value != nullptr) {
+      epochs_.Retire(old_value);
+    }
+    return;
+  }
+}
+
+void LockFreeMap::Store(const std::string &file_name) {
+  if (!persist_ptr_) {
+    return;
+  }
+
+  StringKVMap snapshot;
+  {
+    EpochManager::Guard guard(epochs_);
+    Table *table = table_.load(std::memory_order_acquire);
+    for (size_t i = 0; i <= table->mask; ++i) {
+      Key *key = table->slots[i].key.load(std::memory_order_acquire);
+      Value *value =
+          Thaw(table->slots[i].value.load(std::memory_order_acquire));
+      if (key != nullptr && key != kFrozenKey && value != nullptr) {
+        snapshot[key->data] = *value->data;
+      }
+    }
+  }
+  persist_ptr_->serialize(snapshot, file_name);
+}
+}  // namespace cs499_fei
@@ -0,0 +1,190 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_LOCKFREE_MAP_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_LOCKFREE_MAP_H_
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "epoch_manager.h"
+#include "kvmap_abstraction.h"
+#include "persistence_abstraction.h"
+
+namespace cs499_fei {
+// Lock-free open-addressing hashmap.
+// A slot is claimed for a key with a CAS and keeps that key for the lifetime
+// of its table, so probing never takes a lock and a descheduled writer never
+// stalls other callers. Remove leaves a tombstone (a claimed slot without a
+// value) which the same key reuses on its next Put. Replaced and removed
+// values are reclaimed through epochs once no reader can still see them.
+// Once keys and tombstones claim 3/4 of the slots, the table is frozen and
+// its live pairs are moved into a new one, twice as large if more than half
+// of the slots were live, so key churn never fills the map and a small
+// table grows with its keys. Every writer which needs the new table takes
+// its share of the work, a chunk of slots at a time, so a rebuild is not
+// left to one thread which may be descheduled; a writer waits only for the
+// chunks others are still on. Readers keep reading the frozen table
+// meanwhile.
+class LockFreeMap : public KVMapAbstraction {
+ public:
+  // Number of slots used when the caller does not specify one.
+  static constexpr size_t kDefaultCapacity = 1 << 12;
+
+  // Slots frozen or moved at a time by a writer taking part in a rebuild.
+  static constexpr size_t kRebuildChunk = 1024;
+
+  // Constructor with the initial number of slots, rounded up to a power of
+  // two.
+  explicit LockFreeMap(size_t capacity = kDefaultCapacity);
+
+  // Constructor with persistence
+  LockFreeMap(const PersistPtr &persist_ptr, const std::string &file_name,
+              size_t capacity = kDefaultCapacity);
+
+  // Delete every key and value still in the map.
+  ~LockFreeMap() override;
+
+  LockFreeMap(const LockFreeMap &) = delete;
+  LockFreeMap &operator=(const LockFreeMap &) = delete;
+
+  // Put a key-value pair to the store, sharing the value.
+  bool PutShared(const std::string &key, ValuePtr value) override;
+
+  // Put a copy of the value if the key is at expected_version, with a
+  // compare-and-swap on its slot.
+  PutStatus ConditionalPut(const std::string &key, const std::string &value,
+                           uint64_t expected_version,
+                           uint64_t *version) override;
+
+  // Given the key, get the corresponding value and its version.
+  ValuePtr GetVersioned(const std::string &key,
+                        uint64_t *version) const override;
+
+  // Append the separator and the suffix to the value of the key, or put the
+  // suffix if the key does not exist. A compare-and-swap on the slot retries
+  // when another writer wins, so no append is lost.
+  bool Append(const std::string &key, const std::string &suffix,
+              const std::string &separator) override;
+
+  // Given the key, get the corresponding value from the store without copying
+  // it. Return nullptr if the key does not exist in the store.
+  ValuePtr GetShared(const std::string &key) const override;
+
+  // Given the key, remove the corresponding key-value pair from the store.
+  void Remove(const std::string &key) override;
+
+  // Store the in-memory data into the file
+  void Store(const std::string &file_name) override;
+
+  // Number of slots of the current table.
+  size_t Capacity() const;
+
+ private:
+  // A key owned by a slot, with its hash to skip most string compares.
+  struct Key {
+    size_t hash;
+    std::string data;
+  };
+
+  // A value owned by a slot, with the version it was written at.
+  // Immutable once published, a write swaps in a new one.
+  struct Value {
+    ValuePtr data;
+    uint64_t version;
+  };
+
+  // Key of the empty slots of a frozen table, which ends a probe like an
+  // empty slot and can no longer be claimed. Never dereferenced.
+  static Key *const kFrozenKey;
+
+  // One slot of the open-addressing table.
+  // key goes from nullptr to a Key, or to kFrozenKey in a frozen table, once
+  // and never changes again.
+  // value is nullptr when the key has been removed (tombstone). Otherwise it
+  // holds the one reference of the value owned by the table. Its low bit is
+  // set once the table is frozen, after which it never changes.
+  struct Slot {
+    std::atomic<Key *> key{nullptr};
+    std::atomic<Value *> value{nullptr};
+  };
+
+  // An open-addressing table, which owns the keys and values of its slots
+  // until a rebuild moves them into the next one.
+  struct Table {
+    explicit Table(size_t capacity);
+    ~Table();
+
+    // Capacity - 1, to wrap slot indexes.
+    size_t mask;
+
+    std::unique_ptr<Slot[]> slots;
+
+    // Number of slots claimed by a key, tombstones included.
+    std::atomic<size_t> claimed{0};
+
+    // Progress of the rebuild: the next chunk to freeze and the number of
+    // frozen ones, the live pairs they held, then the next table, allocated
+    // once every chunk is frozen, the next chunk to move into it and the
+    // number of moved ones.
+    std::atomic<size_t> next_freeze{0};
+    std::atomic<size_t> frozen_chunks{0};
+    std::atomic<size_t> live{0};
+    std::atomic<Table *> next{nullptr};
+    std::atomic<size_t> next_move{0};
+    std::atomic<size_t> moved_chunks{0};
+  };
+
+  // Outcome of probing for a key.
+  enum class Probe { kFound, kAbsent, kFull, kFrozen };
+
+  // Probe the table for the slot holding the key, into *slot.
+  // When claim is true, claim the first empty slot for the key if it is not
+  // in the table yet.
+  Probe FindSlot(Table &table, const std::string &key, size_t hash,
+                 bool claim, Slot **slot) const;
+
+  // The table to write to, after rebuilding it if its keys and tombstones
+  // claim too many slots.
+  Table *WritableTable();
+
+  // Take part in replacing the table with one holding its live pairs, then
+  // wait until it has been replaced.
+  void Rebuild(Table *table);
+
+  // Freeze the slots of the chunk, so no write lands in them after they
+  // have been moved, and return the number of live pairs they hold.
+  static size_t FreezeChunk(Table &table, size_t chunk);
+
+  // Move the live pairs of the frozen chunk into the next table, and retire
+  // the keys of its tombstones.
+  void MoveChunk(const Table &table, Table &next, size_t chunk);
+
+  // Wait until a frozen table has been replaced.
+  void WaitForRebuild(const Table *table) const;
+
+  // Helper functions: the value of a slot without the frozen bit, and
+  // whether the bit is set.
+  static Value *Thaw(Value *value);
+  static bool Frozen(const Value *value);
+
+  // Create a value with a new version.
+  Value *NewValue(ValuePtr data);
+
+  // The current table. Replaced tables are reclaimed through epochs.
+  std::atomic<Table *> table_;
+
+  // Last version given to a value. One counter for all slots, so a key
+  // removed and put again never repeats a version.
+  std::atomic<uint64_t> last_version_{kNoVersion};
+
+  // Reclaims values which have been replaced or removed.
+  mutable EpochManager epochs_;
+
+  // Pointer to the persistence strategy
+  PersistPtr persist_ptr_;
+
+  // The local file to persist the data
+  std::string file_name_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_LOCKFREE_MAP_H_
@@ -0,0 +1,591 @@
+#include "lsm_map.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <experimental/filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include <glog/logging.h>
+
+namespace cs499_fei {
+constexpr char LsmMap::kManifestMagic[];
+
+namespace {
+namespace fs = std::experimental::filesystem;
+
+// Suffix of the run files.
+const std::string kRunSuffix = ".run";
+
+// Helper function: the number of a run file name, or 0 if it is not one.
+uint64_t RunNumber(const std::string &name) {
+  size_t digits = name.find_first_not_of("0123456789");
+  if (digits == 0 || digits == std::string::npos ||
+      name.compare(digits, kRunSuffix.size(), kRunSuffix) != 0) {
+    return 0;
+  }
+  return std::stoull(name.substr(0, digits));
+}
+}  // namespace
+
+LsmMap::LsmMap(const std::string &directory, const Options &options)
+    : directory_(directory),
+      options_(options),
+      cache_(options.cache_bytes),
+      memtable_(std::make_unique<Memtable>()) {
+  Recover();
+  background_thread_ = std::thread([this] { BackgroundLoop(); });
+}
+
+LsmMap::LsmMap(const PersistPtr &persist_ptr, const std::string &file_name,
+               const std::string &directory, const Options &options)
+    : LsmMap(directory, options) {
+  bool empty = std::all_of(version_->levels.begin(), version_->levels.end(),
+                           [](const std::vector<RunPtr> &level) {
+                             return level.empty();
+                           });
+  if (!empty) {
+    return;
+  }
+  // Only the first start on the directory imports the file, and stores it
+  // in runs at once.
+  persist_ptr->load(file_name,
+                    [this](std::string_view key, std::string_view value) {
+                      Put(std::string(key), value);
+                    });
+  Store(file_name);
+}
+
+LsmMap::~LsmMap() {
+  {
+    std::unique_lock<std::shared_mutex> lock(locker_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (background_thread_.joinable()) {
+    background_thread_.join();
+  }
+}
+
+std::string LsmMap::RunFileName(uint64_t number) const {
+  return directory_ + "/" + std::to_string(number) + kRunSuffix;
+}
+
+void LsmMap::Recover() {
+  fs::create_directories(directory_);
+  auto version = std::make_shared<Version>();
+  std::set<uint64_t> live;
+  std::ifstream manifest(directory_ + "/MANIFEST");
+  if (manifest.is_open()) {
+    std::string magic;
+    uint64_t next_file_number;
+    if (!std::getline(manifest, magic) || magic != kManifestMagic ||
+        !(manifest >> next_file_number >> last_version_)) {
+      LOG(FATAL) << "Corrupt manifest in " << directory_;
+    }
+    next_file_number_ = next_file_number;
+    size_t level;
+    uint64_t number;
+    while (manifest >> level >> number) {
+      if (level >= kLevels) {
+        LOG(FATAL) << "Corrupt manifest in " << directory_;
+      }
+      version->levels[level].push_back(SortedRun::Open(
+          number, RunFileName(number), &cache_, &lookup_read_bytes_));
+      live.insert(number);
+      next_file_number_ = std::max(next_file_number_, number + 1);
+    }
+  }
+  // Runs of a flush or a compaction which did not reach the manifest.
+  std::vector<fs::path> stale;
+  for (const auto &entry : fs::directory_iterator(directory_)) {
+    uint64_t number = RunNumber(entry.path().filename().string());
+    if (number != 0 && live.count(number) == 0) {
+      stale.push_back(entry.path());
+    }
+  }
+  for (const auto &path : stale) {
+    fs::remove(path);
+  }
+  version_ = version;
+}
+
+void LsmMap::WriteManifest(const Version &version, uint64_t last_version) {
+  std::ostringstream out;
+  out << kManifestMagic << "\n"
+      << next_file_number_ << " " << last_version << "\n";
+  for (size_t level = 0; level < kLevels; ++level) {
+    for (const auto &run : version.levels[level]) {
+      out << level << " " << run->number() << "\n";
+    }
+  }
+  std::string content = out.str();
+  std::string file_name = directory_ + "/MANIFEST";
+  std::string tmp_file = file_name + ".tmp";
+  int fd = open(tmp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || write(fd, content.data(), content.size()) !=
+                    static_cast<ssize_t>(content.size()) ||
+      fdatasync(fd) != 0 || close(fd) != 0 ||
+      std::rename(tmp_file.c_str(), file_name.c_str()) != 0) {
+    LOG(FATAL) << "Cannot store " << file_name << ": " << std::strerror(errno);
+  }
+}
+
+uint64_t LsmMap::LevelTarget(size_t level) const {
+  uint64_t target = options_.level1_bytes;
+  for (size_t i = 1; i < level; ++i) {
+    target *= kLevelMultiplier;
+  }
+  return target;
+}
+
+void LsmMap::SealLocked(std::unique_lock<std::shared_mutex> &lock) {
+  // Writers wait while the previous memtable is flushed, or level 0 is too
+  // deep for the lookups, so the background thread keeps up.
+  cv_.wait(lock, [this] {
+    return stop_ || (!immutable_ && version_->levels[0].size() <
+                                        options_.level0_stop_runs);
+  });
+  if (immutable_ || memtable_->empty()) {
+    return;
+  }
+  immutable_ = std::move(memtable_);
+  memtable_ = std::make_unique<Memtable>();
+  memtable_bytes_ = 0;
+  cv_.notify_all();
+}
+
+uint64_t LsmMap::WriteLocked(const std::string &key, ValuePtr value) {
+  size_t value_size = value ? value->size() : 0;
+  user_bytes_.fetch_add(key.size() + value_size, std::memory_order_relaxed);
+  // Release the replaced value after unlocking.
+  ValuePtr replaced;
+  std::unique_lock<std::shared_mutex> lock(locker_);
+  if (memtable_bytes_ >= options_.memtable_bytes) {
+    SealLocked(lock);
+  }
+  auto inserted = memtable_->try_emplace(key);
+  MemRecord &record = inserted.first->second;
+  if (inserted.second) {
+    memtable_bytes_ += kEntryOverhead + key.size();
+  } else if (record.value) {
+    memtable_bytes_ -= record.value->size();
+  }
+  memtable_bytes_ += value_size;
+  replaced = std::move(record.value);
+  record.value = std::move(value);
+  record.version = ++last_version_;
+  return record.version;
+}
+
+bool LsmMap::PutShared(const std::string &key, ValuePtr value) {
+  std::lock_guard<std::mutex> write_lock(write_locker_);
+  WriteLocked(key, std::move(value));
+  return true;
+}
+
+LsmMap::PutStatus LsmMap::ConditionalPut(const std::string &key,
+                                         const std::string &value,
+                                         uint64_t expected_version,
+                                         uint64_t *version) {
+  std::lock_guard<std::mutex> write_lock(write_locker_);
+  uint64_t current;
+  GetVersioned(key, &current);
+  if (current != expected_version) {
+    *version = current;
+    return PutStatus::kConflict;
+  }
+  *version = WriteLocked(key, MakeValue(value));
+  return PutStatus::kStored;
+}
+
+bool LsmMap::Append(const std::string &key, const std::string &suffix,
+                    const std::string &separator) {
+  std::lock_guard<std::mutex> write_lock(write_locker_);
+  ValuePtr old_value = GetShared(key);
+  ArenaString value;
+  if (old_value) {
+    value.reserve(old_value->size() + separator.size() + suffix.size());
+    value.append(*old_value).append(separator).append(suffix);
+  } else {
+    value.assign(suffix.data(), suffix.size());
+  }
+  WriteLocked(key, std::make_shared<const ArenaString>(std::move(value)));
+  return true;
+}
+
+void LsmMap::Remove(const std::string &key) {
+  std::lock_guard<std::mutex> write_lock(write_locker_);
+  WriteLocked(key, nullptr);
+}
+
+bool LsmMap::Find(const std::string &key, MemRecord *record) const {
+  std::shared_ptr<const Memtable> immutable;
+  std::shared_ptr<const Version> version;
+  {
+    std::shared_lock<std::shared_mutex> lock(locker_);
+    auto it = memtable_->find(key);
+    if (it != memtable_->end()) {
+      *record = it->second;
+      return true;
+    }
+    immutable = immutable_;
+    version = version_;
+  }
+  if (immutable) {
+    auto it = immutable->find(key);
+    if (it != immutable->end()) {
+      *record = it->second;
+      return true;
+    }
+  }
+
+  // the hash is computed once, for the filters of all runs.
+  uint64_t hash = BloomFilter::Hash(key);
+  auto found_in = [this, record, hash](const SortedRun &run,
+                                       const std::string &key) {
+    if (!run.MayContain(hash)) {
+      filter_negatives_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    auto found = run.Get(key);
+    if (!found) {
+      if (run.has_filter()) {
+        filter_false_positives_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return false;
+    }
+    record->version = found->version;
+    record->value = found->removed ? nullptr : MakeValue(found->value);
+    return true;
+  };
+  // the runs of level 0 may overlap, the newest holds the latest record.
+  for (const auto &run : version->levels[0]) {
+    if (run->Covers(key) && found_in(*run, key)) {
+      return true;
+    }
+  }
+  for (size_t level = 1; level < kLevels; ++level) {
+    const auto &runs = version->levels[level];
+    auto it = std::lower_bound(runs.begin(), runs.end(), key,
+                               [](const RunPtr &run, const std::string &key) {
+                                 return run->largest() < key;
+                               });
+    if (it != runs.end() && (*it)->Covers(key) && found_in(**it, key)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ValuePtr LsmMap::GetVersioned(const std::string &key,
+                              uint64_t *version) const {
+  lookups_.fetch_add(1, std::memory_order_relaxed);
+  MemRecord record;
+  if (!Find(key, &record) || !record.value) {
+    *version = kNoVersion;
+    return nullptr;
+  }
+  *version = record.version;
+  return record.value;
+}
+
+ValuePtr LsmMap::GetShared(const std::string &key) const {
+  uint64_t version;
+  return GetVersioned(key, &version);
+}
+
+void LsmMap::Store(const std::string &file_name) { Snapshot(file_name)(); }
+
+SnapshotWriter LsmMap::Snapshot(const std::string &file_name) {
+  const Memtable *sealed;
+  {
+    std::unique_lock<std::shared_mutex> lock(locker_);
+    SealLocked(lock);
+    sealed = immutable_.get();
+  }
+  if (sealed == nullptr) {
+    // nothing was written since the last flush.
+    return [] {};
+  }
+  return [this, sealed] {
+    std::unique_lock<std::shared_mutex> lock(locker_);
+    cv_.wait(lock, [this, sealed] {
+      return stop_ || immutable_.get() != sealed;
+    });
+  };
+}
+
+void LsmMap::WaitForCompactions() {
+  std::unique_lock<std::shared_mutex> lock(locker_);
+  Compaction compaction;
+  cv_.wait(lock, [this, &compaction] {
+    return stop_ || (!immutable_ && !compacting_ &&
+                     !PickCompaction(*version_, &compaction));
+  });
+}
+
+void LsmMap::BackgroundLoop() {
+  std::unique_lock<std::shared_mutex> lock(locker_);
+  while (true) {
+    Compaction compaction;
+    cv_.wait(lock, [this, &compaction] {
+      return stop_ || immutable_ || PickCompaction(*version_, &compaction);
+    });
+    if (stop_) {
+      return;
+    }
+    // a full memtable goes first, writers may be waiting for it.
+    compacting_ = true;
+    bool flush = immutable_ != nullptr;
+    lock.unlock();
+    if (flush) {
+      FlushImmutable();
+    } else {
+      RunCompaction(compaction);
+    }
+    lock.lock();
+    compacting_ = false;
+    cv_.notify_all();
+  }
+}
+
+void LsmMap::FlushImmutable() {
+  std::shared_ptr<const Memtable> immutable;
+  std::shared_ptr<const Version> base;
+  uint64_t last_version;
+  {
+    std::shared_lock<std::shared_mutex> lock(locker_);
+    immutable = immutable_;
+    base = version_;
+    last_version = last_version_;
+  }
+
+  uint64_t number = next_file_number_++;
+  SortedRun::Builder builder(RunFileName(number), options_.block_size,
+                             options_.bits_per_key);
+  for (const auto &p : *immutable) {
+    SortedRun::Record record;
+    record.key = p.first;
+    if (p.second.value) {
+      record.value = *p.second.value;
+    }
+    record.version = p.second.version;
+    record.removed = !p.second.value;
+    builder.Add(record);
+  }
+  flushed_bytes_.fetch_add(builder.Finish(), std::memory_order_relaxed);
+  auto next = std::make_shared<Version>(*base);
+  next->levels[0].insert(
+      next->levels[0].begin(),
+      SortedRun::Open(number, RunFileName(number), &cache_,
+                      &lookup_read_bytes_));
+  WriteManifest(*next, last_version);
+
+  std::unique_lock<std::shared_mutex> lock(locker_);
+  version_ = next;
+  immutable_.reset();
+}
+
+bool LsmMap::PickCompaction(const Version &version, Compaction *compaction) {
+  *compaction = Compaction();
+  const auto &levels = version.levels;
+  auto overlapping = [](const std::vector<RunPtr> &runs,
+                        const std::string &smallest,
+                        const std::string &largest) {
+    std::vector<RunPtr> overlaps;
+    for (const auto &run : runs) {
+      if (run->Overlaps(smallest, largest)) {
+        overlaps.push_back(run);
+      }
+    }
+    return overlaps;
+  };
+
+  // Level 0 is merged as a whole, its runs overlap each other.
+  if (levels[0].size() >= options_.level0_runs) {
+    compaction->level = 0;
+    compaction->inputs = levels[0];
+    std::string smallest = levels[0].front()->smallest();
+    std::string largest = levels[0].front()->largest();
+    for (const auto &run : levels[0]) {
+      smallest = std::min(smallest, run->smallest());
+      largest = std::max(largest, run->largest());
+    }
+    compaction->next_inputs = overlapping(levels[1], smallest, largest);
+    return true;
+  }
+
+  // The level most over its size merges one run, taken in turns across the
+  // key space, so every key is compacted as often.
+  double best_score = 1;
+  size_t best_level = 0;
+  for (size_t level = 1; level + 1 < kLevels; ++level) {
+    uint64_t bytes = 0;
+    for (const auto &run : levels[level]) {
+      bytes += run->file_size();
+    }
+    double score = static_cast<double>(bytes) / LevelTarget(level);
+    if (score > best_score) {
+      best_score = score;
+      best_level = level;
+    }
+  }
+  if (best_level == 0) {
+    return false;
+  }
+  const auto &runs = levels[best_level];
+  const std::string &pointer = compact_pointers_[best_level];
+  auto it = std::find_if(runs.begin(), runs.end(), [&pointer](const RunPtr &run) {
+    return run->smallest() > pointer;
+  });
+  RunPtr input = it == runs.end() ? runs.front() : *it;
+  compaction->level = best_level;
+  compaction->inputs = {input};
+  compaction->next_inputs =
+      overlapping(levels[best_level + 1], input->smallest(), input->largest());
+  return true;
+}
+
+void LsmMap::RunCompaction(const Compaction &compaction) {
+  std::shared_ptr<const Version> base;
+  uint64_t last_version;
+  {
+    std::shared_lock<std::shared_mutex> lock(locker_);
+    base = version_;
+    last_version = last_version_;
+  }
+  size_t output_level = compaction.level + 1;
+  // A tombstone merged into the deepest level holding data hides nothing.
+  bool bottom = true;
+  for (size_t level = output_level + 1; level < kLevels; ++level) {
+    bottom = bottom && base->levels[level].empty();
+  }
+
+  // The inputs are in order from the newest, so on equal keys the first
+  // iterator holds the record which wins.
+  std::vector<SortedRun::Iterator> iterators;
+  for (const auto *runs : {&compaction.inputs, &compaction.next_inputs}) {
+    for (const auto &run : *runs) {
+      iterators.emplace_back(run);
+      compaction_read_bytes_.fetch_add(run->file_size(),
+                                       std::memory_order_relaxed);
+    }
+  }
+
+  std::vector<RunPtr> outputs;
+  std::unique_ptr<SortedRun::Builder> builder;
+  uint64_t builder_number = 0;
+  auto finish = [&] {
+    compacted_bytes_.fetch_add(builder->Finish(), std::memory_order_relaxed);
+    outputs.push_back(SortedRun::Open(builder_number,
+                                      RunFileName(builder_number), &cache_,
+                                      &lookup_read_bytes_));
+    builder.reset();
+  };
+  std::string key;
+  while (true) {
+    SortedRun::Iterator *newest = nullptr;
+    for (auto &iterator : iterators) {
+      if (iterator.Valid() &&
+          (newest == nullptr || iterator.record().key < newest->record().key)) {
+        newest = &iterator;
+      }
+    }
+    if (newest == nullptr) {
+      break;
+    }
+    key.assign(newest->record().key);
+    if (!(newest->record().removed && bottom)) {
+      if (!builder) {
+        builder_number = next_file_number_++;
+        builder = std::make_unique<SortedRun::Builder>(
+            RunFileName(builder_number), options_.block_size,
+            options_.bits_per_key);
+      }
+      builder->Add(newest->record());
+      if (builder->FileSize() >= options_.run_bytes) {
+        finish();
+      }
+    }
+    // the older records of the key are shadowed.
+    for (auto &iterator : iterators) {
+      if (iterator.Valid() && iterator.record().key == key) {
+        iterator.Next();
+      }
+    }
+  }
+  if (builder && !builder->empty()) {
+    finish();
+  }
+
+  auto next = std::make_shared<Version>(*base);
+  auto remove_inputs = [](std::vector<RunPtr> *runs,
+                          const std::vector<RunPtr> &inputs) {
+    runs->erase(std::remove_if(runs->begin(), runs->end(),
+                               [&inputs](const RunPtr &run) {
+                                 return std::find(inputs.begin(), inputs.end(),
+                                                  run) != inputs.end();
+                               }),
+                runs->end());
+  };
+  remove_inputs(&next->levels[compaction.level], compaction.inputs);
+  remove_inputs(&next->levels[output_level], compaction.next_inputs);
+  auto &level = next->levels[output_level];
+  level.insert(level.end(), outputs.begin(), outputs.end());
+  std::sort(level.begin(), level.end(), [](const RunPtr &a, const RunPtr &b) {
+    return a->smallest() < b->smallest();
+  });
+  WriteManifest(*next, last_version);
+
+  {
+    std::unique_lock<std::shared_mutex> lock(locker_);
+    version_ = next;
+    compact_pointers_[compaction.level] = compaction.inputs.back()->largest();
+  }
+  // The files go once the last lookup still reading them is done.
+  for (const auto *runs : {&compaction.inputs, &compaction.next_inputs}) {
+    for (const auto &run : *runs) {
+      run->MarkObsolete();
+    }
+  }
+  compactions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+LsmMap::Stats LsmMap::GetStats() const {
+  Stats stats;
+  stats.user_bytes = user_bytes_.load(std::memory_order_relaxed);
+  stats.flushed_bytes = flushed_bytes_.load(std::memory_order_relaxed);
+  stats.compacted_bytes = compacted_bytes_.load(std::memory_order_relaxed);
+  stats.compaction_read_bytes =
+      compaction_read_bytes_.load(std::memory_order_relaxed);
+  stats.lookup_read_bytes = lookup_read_bytes_.load(std::memory_order_relaxed);
+  stats.lookups = lookups_.load(std::memory_order_relaxed);
+  stats.compactions = compactions_.load(std::memory_order_relaxed);
+  stats.filter_negatives = filter_negatives_.load(std::memory_order_relaxed);
+  stats.filter_false_positives =
+      filter_false_positives_.load(std::memory_order_relaxed);
+  std::shared_ptr<const Version> version;
+  {
+    std::shared_lock<std::shared_mutex> lock(locker_);
+    version = version_;
+  }
+  for (const auto &runs : version->levels) {
+    stats.level_runs.push_back(runs.size());
+    uint64_t bytes = 0;
+    for (const auto &run : runs) {
+      bytes += run->file_size();
+      stats.filter_bytes += run->filter_bytes();
+    }
+    stats.level_bytes.push_back(bytes);
+  }
+  stats.cache = cache_.GetStats();
+  return stats;
+}
+}  // namespace cs499_fei
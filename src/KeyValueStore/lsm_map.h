@@ -0,0 +1,290 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_LSM_MAP_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_LSM_MAP_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "block_cache.h"
+#include "bloom_filter.h"
+#include "kvmap_abstraction.h"
+#include "persistence_abstraction.h"
+#include "sorted_run.h"
+
+namespace cs499_fei {
+// Log-structured merge-tree engine, for more data than fits in memory.
+// Writes go to an in-memory, ordered memtable. A full memtable becomes
+// immutable and a background thread flushes it into a sorted run file of
+// level 0. Runs of level 0 may overlap each other. The runs of every deeper
+// level split the key space between them, and each level holds about
+// kLevelMultiplier times the bytes of the level above. The background thread
+// merges a level which outgrew its size into the runs of the next one it
+// overlaps, so a key is found in at most one run per level below 0.
+// A lookup reads the memtables, then the runs from the newest, and stops at
+// the first record of the key. A run whose Bloom filter rules the key out is
+// skipped; the data block it needs comes from the block cache or one read of
+// the file. A removal writes a tombstone record, dropped
+// once it is merged into the deepest level.
+// Writers are serialized, so Append and ConditionalPut read and write as one
+// step. The runs in use are listed by a MANIFEST file of the directory,
+// rewritten after each flush and compaction. The memtable is lost on a crash
+// unless it was stored, as are the writes to the in-memory engines.
+class LsmMap : public KVMapAbstraction {
+ public:
+  // Number of levels of runs.
+  static constexpr size_t kLevels = 7;
+
+  // Bytes of every level relative to the level above.
+  static constexpr size_t kLevelMultiplier = 10;
+
+  // Approximate bytes of bookkeeping per memtable entry.
+  static constexpr size_t kEntryOverhead = 96;
+
+  // First line of the manifest.
+  static constexpr char kManifestMagic[] = "KVSLSM01";
+
+  // Sizes of the engine.
+  struct Options {
+    // Bytes of keys and values the memtable holds before it is flushed.
+    size_t memtable_bytes = 64 << 20;
+
+    // Bytes of a data block of the runs.
+    size_t block_size = 4 << 10;
+
+    // Bytes after which a compaction starts a new run.
+    size_t run_bytes = 8 << 20;
+
+    // Bytes of level 1.
+    size_t level1_bytes = 64 << 20;
+
+    // Number of level 0 runs which triggers a compaction into level 1.
+    size_t level0_runs = 4;
+
+    // Number of level 0 runs at which writers wait for the compaction.
+    size_t level0_stop_runs = 12;
+
+    // Bytes of blocks the block cache keeps.
+    size_t cache_bytes = 64 << 20;
+
+    // Bits per key of the Bloom filter of every run, 0 writes runs without
+    // filters.
+    size_t bits_per_key = BloomFilter::kDefaultBitsPerKey;
+  };
+
+  // Counters of the engine.
+  struct Stats {
+    // Bytes of keys and values written by the callers.
+    uint64_t user_bytes = 0;
+
+    // Bytes of runs written by flushes and by compactions.
+    uint64_t flushed_bytes = 0;
+    uint64_t compacted_bytes = 0;
+
+    // Bytes of runs read by compactions, and of blocks read by lookups.
+    uint64_t compaction_read_bytes = 0;
+    uint64_t lookup_read_bytes = 0;
+
+    // Number of lookups and compactions.
+    uint64_t lookups = 0;
+    uint64_t compactions = 0;
+
+    // Runs a lookup skipped because their filter ruled the key out, and runs
+    // whose filter let through a key they did not hold.
+    uint64_t filter_negatives = 0;
+    uint64_t filter_false_positives = 0;
+
+    // Bytes of the filters of all runs, kept in memory.
+    uint64_t filter_bytes = 0;
+
+    // Number and bytes of the runs of every level.
+    std::vector<size_t> level_runs;
+    std::vector<uint64_t> level_bytes;
+
+    // Counters of the block cache.
+    BlockCache::Stats cache;
+
+    // Bytes written to disk per byte written by the callers.
+    double WriteAmplification() const {
+      return user_bytes == 0 ? 0
+                             : static_cast<double>(flushed_bytes +
+                                                   compacted_bytes) /
+                                   user_bytes;
+    }
+
+    // Bytes read from disk per lookup.
+    double ReadBytesPerLookup() const {
+      return lookups == 0 ? 0
+                          : static_cast<double>(lookup_read_bytes) / lookups;
+    }
+
+    // Fraction of the probes for keys a run did not hold which the filter
+    // let through.
+    double FilterFalsePositiveRate() const {
+      uint64_t absent = filter_negatives + filter_false_positives;
+      return absent == 0 ? 0
+                         : static_cast<double>(filter_false_positives) / absent;
+    }
+  };
+
+  // Open the engine on the directory, created if it does not exist, with the
+  // default sizes.
+  explicit LsmMap(const std::string &directory) : LsmMap(directory, Options()) {}
+
+  // Open the engine on the directory with the sizes.
+  LsmMap(const std::string &directory, const Options &options);
+
+  // Constructor with persistence: a directory without runs starts with the
+  // pairs of the file.
+  LsmMap(const PersistPtr &persist_ptr, const std::string &file_name,
+         const std::string &directory, const Options &options);
+
+  // Stop the background thread. The memtable is not flushed.
+  ~LsmMap() override;
+
+  LsmMap(const LsmMap &) = delete;
+  LsmMap &operator=(const LsmMap &) = delete;
+
+  // Put a key-value pair to the memtable, sharing the value.
+  bool PutShared(const std::string &key, ValuePtr value) override;
+
+  // Put a copy of the value if the key is at expected_version.
+  PutStatus ConditionalPut(const std::string &key, const std::string &value,
+                           uint64_t expected_version,
+                           uint64_t *version) override;
+
+  // Given the key, get the corresponding value and its version.
+  ValuePtr GetVersioned(const std::string &key,
+                        uint64_t *version) const override;
+
+  // Given the key, get the corresponding value from the store.
+  ValuePtr GetShared(const std::string &key) const override;
+
+  // Append the separator and the suffix to the value of the key, or put the
+  // suffix if the key does not exist.
+  bool Append(const std::string &key, const std::string &suffix,
+              const std::string &separator) override;
+
+  // Given the key, write a tombstone for it.
+  void Remove(const std::string &key) override;
+
+  // Flush the memtable into a run. The runs are the stored data, so the file
+  // is not written.
+  void Store(const std::string &file_name) override;
+
+  // Make the memtable immutable, and return the function which waits until
+  // it is flushed. Writes after the call go to the next memtable.
+  SnapshotWriter Snapshot(const std::string &file_name) override;
+
+  // Wait until the background thread has flushed every immutable memtable
+  // and no compaction is due.
+  void WaitForCompactions();
+
+  // Current counters.
+  Stats GetStats() const;
+
+ private:
+  // A value of the memtable and its version. nullptr is a tombstone.
+  struct MemRecord {
+    ValuePtr value;
+    uint64_t version = kNoVersion;
+  };
+  using Memtable = std::map<std::string, MemRecord>;
+  using RunPtr = std::shared_ptr<SortedRun>;
+
+  // The runs of every level: level 0 newest first, the other levels in key
+  // order. Replaced as a whole, never changed in place.
+  struct Version {
+    std::vector<std::vector<RunPtr>> levels =
+        std::vector<std::vector<RunPtr>>(kLevels);
+  };
+
+  // Runs merged by one compaction into level + 1.
+  struct Compaction {
+    size_t level = 0;
+    std::vector<RunPtr> inputs;
+    std::vector<RunPtr> next_inputs;
+  };
+
+  // Read the manifest and open its runs, and remove the files it does not
+  // list.
+  void Recover();
+
+  // Write a record of the key into the memtable, holding write_locker_, and
+  // return its version.
+  uint64_t WriteLocked(const std::string &key, ValuePtr value);
+
+  // Find the newest record of the key. Return false if no memtable or run
+  // holds one.
+  bool Find(const std::string &key, MemRecord *record) const;
+
+  // Make the memtable immutable, holding lock, once the previous one is
+  // flushed. An empty memtable stays.
+  void SealLocked(std::unique_lock<std::shared_mutex> &lock);
+
+  // Flush immutable memtables and compact until stopped.
+  void BackgroundLoop();
+
+  // Write the immutable memtable into a run of level 0.
+  void FlushImmutable();
+
+  // Pick the runs of the level which outgrew its size most, if any.
+  bool PickCompaction(const Version &version, Compaction *compaction);
+
+  // Merge the runs of the compaction into new runs of the next level.
+  void RunCompaction(const Compaction &compaction);
+
+  // Bytes level may hold before it is compacted.
+  uint64_t LevelTarget(size_t level) const;
+
+  // Write the version as the manifest.
+  void WriteManifest(const Version &version, uint64_t last_version);
+
+  // Name of the run file with the number.
+  std::string RunFileName(uint64_t number) const;
+
+  std::string directory_;
+  Options options_;
+  BlockCache cache_;
+
+  // Serializes the writers.
+  std::mutex write_locker_;
+
+  // Guards the memtables, the version and last_version_. Lookups take it
+  // shared only to copy their pointers.
+  mutable std::shared_mutex locker_;
+  std::condition_variable_any cv_;
+  std::unique_ptr<Memtable> memtable_;
+  size_t memtable_bytes_ = 0;
+  std::shared_ptr<const Memtable> immutable_;
+  std::shared_ptr<const Version> version_;
+  uint64_t last_version_ = kNoVersion;
+  bool compacting_ = false;
+  bool stop_ = false;
+
+  // Owned by the background thread after construction.
+  uint64_t next_file_number_ = 1;
+  std::vector<std::string> compact_pointers_ =
+      std::vector<std::string>(kLevels);
+
+  // Counters.
+  std::atomic<uint64_t> user_bytes_{0};
+  std::atomic<uint64_t> flushed_bytes_{0};
+  std::atomic<uint64_t> compacted_bytes_{0};
+  std::atomic<uint64_t> compaction_read_bytes_{0};
+  std::atomic<uint64_t> lookup_read_bytes_{0};
+  mutable std::atomic<uint64_t> lookups_{0};
+  mutable std::atomic<uint64_t> filter_negatives_{0};
+  mutable std::atomic<uint64_t> filter_false_positives_{0};
+  std::atomic<uint64_t> compactions_{0};
+
+  std::thread background_thread_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_LSM_MAP_H_
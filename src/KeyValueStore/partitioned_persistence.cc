@@ -0,0 +1,185 @@
+#include "partitioned_persistence.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <glog/logging.h>
+
+namespace cs499_fei {
+constexpr char PartitionedPersistence::kManifestMagic[];
+
+namespace {
+namespace fs = std::experimental::filesystem;
+
+// Helper function: the path of a partition file named in the manifest, which
+// lives next to it.
+std::string PartitionPath(const std::string &manifest,
+                          const std::string &partition) {
+  return (fs::path(manifest).parent_path() / partition).string();
+}
+
+// Helper function: visit the pairs of a partition, which must be the one the
+// manifest was written with.
+void ReadPartition(const std::string &manifest,
+                   const PartitionedPersistence::Partition &partition,
+                   const PairVisitor &visit) {
+  std::string path = PartitionPath(manifest, partition.file_name);
+  std::optional<BinaryPersistence::FileSummary> summary =
+      BinaryPersistence::ReadFile(path, visit);
+  if (!summary || summary->count != partition.summary.count ||
+      summary->body_size != partition.summary.body_size ||
+      summary->crc != partition.summary.crc) {
+    LOG(FATAL) << "Partition " << path << " does not match the manifest "
+               << manifest;
+  }
+}
+
+// Helper function: run task(0) ... task(count - 1), each on its own thread.
+void RunInParallel(size_t count, const std::function<void(size_t)> &task) {
+  std::vector<std::thread> threads;
+  threads.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    threads.emplace_back(task, i);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+// Helper function: write the manifest next to the store and rename it over
+// the store, so the store names a complete snapshot at any time.
+void WriteManifest(const PartitionedPersistence::Manifest &manifest,
+                   const std::string &to_file) {
+  std::string tmp_file = to_file + ".tmp";
+  FILE *file = std::fopen(tmp_file.c_str(), "w");
+  if (file == nullptr) {
+    LOG(FATAL) << "Cannot open " << tmp_file << ": " << std::strerror(errno);
+  }
+  std::fprintf(file, "%s\n%llu %zu\n", PartitionedPersistence::kManifestMagic,
+               static_cast<unsigned long long>(manifest.generation),
+               manifest.partitions.size());
+  for (const auto &partition : manifest.partitions) {
+    std::fprintf(file, "%s %llu %llu %u\n", partition.file_name.c_str(),
+                 static_cast<unsigned long long>(partition.summary.count),
+                 static_cast<unsigned long long>(partition.summary.body_size),
+                 partition.summary.crc);
+  }
+  if (std::fflush(file) != 0 || fdatasync(fileno(file)) != 0 ||
+      std::fclose(file) != 0 ||
+      std::rename(tmp_file.c_str(), to_file.c_str()) != 0) {
+    LOG(FATAL) << "Cannot store " << to_file << ": " << std::strerror(errno);
+  }
+}
+}  // namespace
+
+PartitionedPersistence::PartitionedPersistence(size_t partitions)
+    : partitions_(partitions > 0
+                      ? partitions
+                      : std::max(1u, std::thread::hardware_concurrency())) {}
+
+std::optional<PartitionedPersistence::Manifest>
+PartitionedPersistence::ReadManifest(const std::string &file_name) {
+  // only the magic is read from a store which is not a manifest.
+  std::ifstream infile(file_name);
+  char magic[sizeof(kManifestMagic)] = {};
+  infile.read(magic, sizeof(kManifestMagic) - 1);
+  if (!infile || std::strcmp(magic, kManifestMagic) != 0) {
+    return std::nullopt;
+  }
+
+  Manifest manifest;
+  size_t count = 0;
+  infile >> manifest.generation >> count;
+  manifest.partitions.resize(count);
+  for (auto &partition : manifest.partitions) {
+    infile >> partition.file_name >> partition.summary.count >>
+        partition.summary.body_size >> partition.summary.crc;
+  }
+  if (!infile) {
+    LOG(FATAL) << "Corrupt manifest " << file_name;
+  }
+  return manifest;
+}
+
+void PartitionedPersistence::serialize(const StringKVMap &kv_data,
+                                       const std::string &to_file) {
+  std::optional<Manifest> previous = ReadManifest(to_file);
+  Manifest manifest;
+  manifest.generation = previous ? previous->generation + 1 : 1;
+  manifest.partitions.resize(partitions_);
+
+  // Each thread writes a contiguous range of hash buckets, so the threads
+  // walk the map without coordinating.
+  size_t buckets = kv_data.bucket_count();
+  std::string base = fs::path(to_file).filename().string() + "." +
+                     std::to_string(manifest.generation) + ".";
+  RunInParallel(partitions_, [&](size_t i) {
+    Partition &partition = manifest.partitions[i];
+    partition.file_name = base + std::to_string(i);
+    size_t first = buckets * i / partitions_;
+    size_t last = buckets * (i + 1) / partitions_;
+    partition.summary = BinaryPersistence::WriteFile(
+        PartitionPath(to_file, partition.file_name),
+        [&](const PairVisitor &emit) {
+          for (size_t b = first; b < last; ++b) {
+            for (auto it = kv_data.begin(b); it != kv_data.end(b); ++it) {
+              emit(it->first, it->second);
+            }
+          }
+        });
+  });
+  WriteManifest(manifest, to_file);
+
+  if (previous) {
+    for (const auto &partition : previous->partitions) {
+      std::remove(PartitionPath(to_file, partition.file_name).c_str());
+    }
+  }
+}
+
+StringKVMap PartitionedPersistence::deserialize(const std::string &from_file) {
+  std::optional<Manifest> manifest = ReadManifest(from_file);
+  if (!manifest) {
+    return BinaryPersistence().deserialize(from_file);
+  }
+
+  // Read every partition into its own map, then move the nodes into one.
+  std::vector<StringKVMap> maps(manifest->partitions.size());
+  RunInParallel(maps.size(), [&](size_t i) {
+    StringKVMap &map = maps[i];
+    map.reserve(manifest->partitions[i].summary.count);
+    ReadPartition(from_file, manifest->partitions[i],
+                  [&map](std::string_view key, std::string_view value) {
+                    map.emplace(key, value);
+                  });
+  });
+  StringKVMap ret;
+  size_t total = 0;
+  for (const auto &partition : manifest->partitions) {
+    total += partition.summary.count;
+  }
+  ret.reserve(total);
+  for (auto &map : maps) {
+    ret.merge(map);
+  }
+  return ret;
+}
+
+void PartitionedPersistence::load(const std::string &from_file,
+                                  const PairVisitor &visit) {
+  std::optional<Manifest> manifest = ReadManifest(from_file);
+  if (!manifest) {
+    BinaryPersistence().load(from_file, visit);
+    return;
+  }
+
+  RunInParallel(manifest->partitions.size(), [&](size_t i) {
+    ReadPartition(from_file, manifest->partitions[i], visit);
+  });
+}
+}  // namespace cs499_fei
@@ -0,0 +1,66 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_PARTITIONED_PERSISTENCE_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_PARTITIONED_PERSISTENCE_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "binary_persistence.h"
+#include "persistence_abstraction.h"
+
+namespace cs499_fei {
+// Persistence strategy:
+// Split the key-value data into partition files in the binary format, each
+// written and read by its own thread, so storing and restarting a large store
+// is bound by the disk rather than by one core.
+//
+// The file named by the store is a text manifest:
+//   KVSMANIFEST1
+//   <generation> <partition count>
+//   <partition file> <pair count> <body bytes> <CRC-32>   (one per partition)
+// Partition files are named <store>.<generation>.<index>. A store writes the
+// partitions of the next generation, renames the manifest over the old one,
+// and only then removes the old partitions, so a crash at any point leaves a
+// complete snapshot. A store without a manifest is read as one binary or
+// text file, so existing stores upgrade on their next store.
+class PartitionedPersistence : public PersistenceAbstraction {
+ public:
+  // First line of a manifest.
+  static constexpr char kManifestMagic[] = "KVSMANIFEST1";
+
+  // One partition of a snapshot.
+  struct Partition {
+    std::string file_name;
+    BinaryPersistence::FileSummary summary;
+  };
+
+  // A snapshot: its generation and partitions.
+  struct Manifest {
+    uint64_t generation = 0;
+    std::vector<Partition> partitions;
+  };
+
+  // Split snapshots into partitions, 0 for one per hardware thread.
+  explicit PartitionedPersistence(size_t partitions = 0);
+
+  // Write the in-memory key-value data into the partitions and the manifest.
+  void serialize(const StringKVMap &kv_data, const std::string &to_file) override;
+
+  // Read the key-value data from the partitions to the memory.
+  StringKVMap deserialize(const std::string &from_file) override;
+
+  // Visit every key-value pair of the partitions, one thread per partition.
+  void load(const std::string &from_file, const PairVisitor &visit) override;
+
+  // Read the manifest of the store, or nullopt if it has none.
+  static std::optional<Manifest> ReadManifest(const std::string &file_name);
+
+  // Number of partitions of a snapshot.
+  size_t partitions() const { return partitions_; }
+
+ private:
+  size_t partitions_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_PARTITIONED_PERSISTENCE_H_
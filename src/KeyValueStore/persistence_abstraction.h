@@ -4,13 +4,21 @@
 #include <iostream>
 #include <experimental/filesystem>
 #include <fstream>
+#include <functional>
 #include <sstream>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 
 namespace cs499_fei {
 using StringKVMap = std::unordered_map<std::string, std::string>;
 
+// Called for every key-value pair read from a file. The views only live
+// during the call. Strategies which read in parallel call it from several
+// threads at once.
+using PairVisitor =
+    std::function<void(std::string_view key, std::string_view value)>;
+
 // The Abstraction for storage persistence strategy
 class PersistenceAbstraction {
  public:
@@ -23,6 +31,24 @@ class PersistenceAbstraction {
 
   // Read the key-value data from the file to the memory.
   virtual StringKVMap deserialize(const std::string &from_file) = 0;
+
+  // Visit every key-value pair of the file. Strategies which can read the
+  // pairs in place override it to skip building the whole map first.
+  virtual void load(const std::string &from_file, const PairVisitor &visit) {
+    for (const auto &p : deserialize(from_file)) {
+      visit(p.first, p.second);
+    }
+  }
+
+  // Whether the strategy stores the changes since the last store on top of
+  // the file, instead of the whole data every time.
+  virtual bool SupportsDeltas() const { return false; }
+
+  // Store only the pairs put and the keys removed since the last store into
+  // the file. Called only if SupportsDeltas.
+  virtual void serialize_delta(const StringKVMap &puts,
+                               const std::vector<std::string> &removed,
+                               const std::string &to_file) {}
 };
 }  // namespace cs499_fei
 #endif  // CSCI499_FEI_SRC_KEYVALUESTORE_PERSISTENCE_ABSTRACTION_H_
@@ -0,0 +1,283 @@
+#include "replication.h"
+
+#include <limits>
+#include <string>
+#include <utility>
+
+#include <glog/logging.h>
+
+#include "scan_cursor.h"
+
+using kvstore::ReplicatedWrite;
+using kvstore::ReplicateReply;
+using kvstore::ReplicateRequest;
+
+namespace cs499_fei {
+constexpr size_t ReplicationSource::kMaxWrites;
+constexpr std::chrono::milliseconds ReplicaFollower::kRetryInterval;
+
+namespace {
+// Helper function: steady clock nanoseconds now.
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Helper function: milliseconds of the time left to live, rounded up so a
+// value which has not expired yet is never sent without a TTL.
+uint64_t TtlMs(std::chrono::steady_clock::duration left) {
+  return std::chrono::ceil<std::chrono::milliseconds>(left).count();
+}
+}  // namespace
+
+ReplicationSource::ReplicationSource(KVMapPtr kv_map,
+                                     std::shared_ptr<ReplicationLog> log,
+                                     std::chrono::milliseconds heartbeat)
+    : kv_map_(std::move(kv_map)), log_(std::move(log)), heartbeat_(heartbeat) {}
+
+grpc::Status ReplicationSource::Serve(
+    grpc::ServerContext *context, const ReplicateRequest &request,
+    grpc::ServerWriter<ReplicateReply> *writer) {
+  uint64_t after = request.after_sequence();
+  bool snapshot = request.log_id() != log_->id();
+  std::vector<ReplicationLog::Entry> entries;
+  ReplicateReply reply;
+  while (!context->IsCancelled()) {
+    if (snapshot) {
+      if (!kv_map_->SupportsScan()) {
+        return grpc::Status(grpc::StatusCode::UNIMPLEMENTED,
+                            "The storage engine cannot snapshot a replica.");
+      }
+      // the writes after the sequence are replayed on top of the pairs,
+      // which may already hold some of them.
+      after = log_->LastSequence();
+      LOG(INFO) << "Sending a snapshot at sequence " << after
+                << " to replica " << context->peer();
+      if (!WriteSnapshot(after, writer)) {
+        return grpc::Status::OK;
+      }
+      snapshot = false;
+    }
+
+    entries.clear();
+    switch (log_->Read(after, kMaxWrites, heartbeat_, &entries)) {
+      case ReplicationLog::ReadStatus::kClosed:
+        return grpc::Status::OK;
+      case ReplicationLog::ReadStatus::kTruncated:
+        LOG(INFO) << "Replica " << context->peer() << " at sequence " << after
+                  << " fell behind the replication log";
+        snapshot = true;
+        continue;
+      case ReplicationLog::ReadStatus::kOk:
+        break;
+    }
+
+    reply.Clear();
+    reply.set_type(entries.empty() ? ReplicateReply::HEARTBEAT
+                                   : ReplicateReply::WRITES);
+    reply.set_log_id(log_->id());
+    auto now = std::chrono::steady_clock::now();
+    for (const auto &entry : entries) {
+      ReplicatedWrite *write = reply.add_writes();
+      write->set_key(entry.key);
+      if (!entry.value) {
+        write->set_removed(true);
+      } else if (entry.expires_at == std::chrono::steady_clock::time_point()) {
+        write->set_value(entry.value->data(), entry.value->size());
+      } else if (entry.expires_at > now) {
+        write->set_value(entry.value->data(), entry.value->size());
+        write->set_ttl_ms(TtlMs(entry.expires_at - now));
+      } else {
+        // the value expired while the replica was behind.
+        write->set_removed(true);
+      }
+    }
+    if (!entries.empty()) {
+      after = entries.back().sequence;
+    }
+    reply.set_sequence(after);
+    reply.set_primary_sequence(log_->LastSequence());
+    if (!writer->Write(reply)) {
+      return grpc::Status::OK;
+    }
+  }
+  return grpc::Status::OK;
+}
+
+bool ReplicationSource::WriteSnapshot(
+    uint64_t sequence, grpc::ServerWriter<ReplicateReply> *writer) {
+  ReplicateReply reply;
+  reply.set_type(ReplicateReply::RESET);
+  reply.set_log_id(log_->id());
+  reply.set_sequence(sequence);
+  if (!writer->Write(reply)) {
+    return false;
+  }
+
+  reply.set_type(ReplicateReply::SNAPSHOT);
+  ScanCursor cursor((kvstore::ScanRequest()));
+  ScanPairs pairs;
+  bool ttl = kv_map_->SupportsTtl();
+  while (cursor.Next(*kv_map_, &pairs)) {
+    reply.clear_writes();
+    for (const auto &pair : pairs) {
+      ValuePtr value = pair.second;
+      std::chrono::milliseconds left = std::chrono::milliseconds::zero();
+      if (ttl) {
+        // the value is read again along with its TTL. A newer value is
+        // fine, the writes after the sequence are replayed on top of it.
+        value = kv_map_->GetWithTtl(pair.first, &left);
+        if (!value) {
+          continue;
+        }
+      }
+      ReplicatedWrite *write = reply.add_writes();
+      write->set_key(pair.first);
+      write->set_value(value->data(), value->size());
+      write->set_ttl_ms(left.count());
+    }
+    if (!writer->Write(reply)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+ReplicaFollower::ReplicaFollower(std::shared_ptr<grpc::Channel> primary,
+                                 KVMapPtr kv_map)
+    : stub_(kvstore::KeyValueStore::NewStub(primary)),
+      kv_map_(std::move(kv_map)) {}
+
+ReplicaFollower::~ReplicaFollower() { Stop(); }
+
+void ReplicaFollower::Start() {
+  thread_ = std::thread([this] { Run(); });
+}
+
+void ReplicaFollower::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(follower_locker_);
+    stopping_ = true;
+    if (context_) {
+      context_->TryCancel();
+    }
+  }
+  stop_cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+std::chrono::milliseconds ReplicaFollower::Staleness() const {
+  if (!ready_) {
+    return std::chrono::milliseconds::max();
+  }
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::nanoseconds(NowNs() - caught_up_ns_));
+}
+
+void ReplicaFollower::Run() {
+  while (true) {
+    grpc::Status status = Follow();
+    std::unique_lock<std::mutex> lock(follower_locker_);
+    if (stopping_) {
+      return;
+    }
+    LOG(WARNING) << "Replication stream from the primary ended, "
+                 << status.error_code() << ": " << status.error_message()
+                 << ", reconnecting";
+    if (stop_cv_.wait_for(lock, kRetryInterval, [this] { return stopping_; })) {
+      return;
+    }
+  }
+}
+
+grpc::Status ReplicaFollower::Follow() {
+  grpc::ClientContext context;
+  {
+    std::lock_guard<std::mutex> lock(follower_locker_);
+    if (stopping_) {
+      return grpc::Status::CANCELLED;
+    }
+    context_ = &context;
+  }
+  ReplicateRequest request;
+  request.set_log_id(log_id_);
+  request.set_after_sequence(sequence_);
+  auto reader = stub_->replicate(&context, request);
+  ReplicateReply reply;
+  while (reader->Read(&reply)) {
+    Apply(reply);
+  }
+  grpc::Status status = reader->Finish();
+  std::lock_guard<std::mutex> lock(follower_locker_);
+  context_ = nullptr;
+  return status;
+}
+
+void ReplicaFollower::Apply(const ReplicateReply &reply) {
+  switch (reply.type()) {
+    case ReplicateReply::RESET:
+      LOG(INFO) << "Loading a snapshot of the primary at sequence "
+                << reply.sequence();
+      ready_ = false;
+      Clear();
+      log_id_ = reply.log_id();
+      sequence_ = reply.sequence();
+      return;
+    case ReplicateReply::SNAPSHOT:
+      for (const auto &write : reply.writes()) {
+        Put(write);
+      }
+      return;
+    case ReplicateReply::WRITES:
+      for (const auto &write : reply.writes()) {
+        if (write.removed()) {
+          kv_map_->Remove(write.key());
+        } else {
+          Put(write);
+        }
+      }
+      break;
+    default:
+      break;
+  }
+  // the primary sends writes or heartbeats only after a whole snapshot.
+  if (!ready_) {
+    LOG(INFO) << "Replica ready at sequence " << reply.sequence();
+  }
+  sequence_ = reply.sequence();
+  if (reply.sequence() >= reply.primary_sequence()) {
+    caught_up_ns_ = NowNs();
+  }
+  ready_ = true;
+}
+
+void ReplicaFollower::Put(const ReplicatedWrite &write) {
+  bool stored;
+  if (write.ttl_ms() == 0) {
+    stored = kv_map_->Put(write.key(), write.value());
+  } else if (kv_map_->SupportsTtl()) {
+    stored = kv_map_->PutWithTtl(write.key(), write.value(),
+                                 std::chrono::milliseconds(write.ttl_ms()));
+  } else {
+    LOG(WARNING) << "The storage engine cannot expire replicated Key: "
+                 << write.key() << ", keeping it without its TTL";
+    stored = kv_map_->Put(write.key(), write.value());
+  }
+  if (!stored) {
+    LOG(ERROR) << "No room left for replicated Key: " << write.key();
+  }
+}
+
+void ReplicaFollower::Clear() {
+  // the removed keys are gone from the next scan, so it starts over.
+  ScanPairs pairs;
+  while (!(pairs = kv_map_->Scan("", "", ScanCursor::kChunk)).empty()) {
+    for (const auto &pair : pairs) {
+      kv_map_->Remove(pair.first);
+    }
+  }
+}
+}  // namespace cs499_fei
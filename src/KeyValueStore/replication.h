@@ -0,0 +1,132 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_REPLICATION_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_REPLICATION_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <grpcpp/grpcpp.h>
+
+#include "KeyValueStore.grpc.pb.h"
+#include "kvmap_abstraction.h"
+#include "replication_log.h"
+
+namespace cs499_fei {
+// Serves the replicate method of a primary: streams the writes of its
+// replication log to a replica.
+// A replica of another log, or too far behind for the log, first gets a
+// snapshot: a RESET, then the pairs of the store, read in chunks with
+// ScanCursor so writers are not blocked, then the writes appended since the
+// snapshot started. As the entries hold the values the writes left, a pair
+// the scan read after a later write ends with the same value once that
+// write is applied. A value put with a TTL is sent with the time it has
+// left, so it expires on the replica too. While no write arrives, a
+// heartbeat tells the replica it is current.
+class ReplicationSource {
+ public:
+  // Most writes sent in one reply.
+  static constexpr size_t kMaxWrites = 256;
+
+  // Stream the writes of log over the pairs of kv_map, with a heartbeat
+  // after heartbeat without writes.
+  ReplicationSource(KVMapPtr kv_map, std::shared_ptr<ReplicationLog> log,
+                    std::chrono::milliseconds heartbeat);
+
+  // Stream the writes after the request to the writer, until the replica
+  // goes away or the log is closed.
+  // Fail with UNIMPLEMENTED if a snapshot is needed from a storage engine
+  // without scans.
+  grpc::Status Serve(grpc::ServerContext *context,
+                     const kvstore::ReplicateRequest &request,
+                     grpc::ServerWriter<kvstore::ReplicateReply> *writer);
+
+ private:
+  // Write a RESET and the pairs of the store, as of the sequence.
+  // Return false if the replica went away.
+  bool WriteSnapshot(uint64_t sequence,
+                     grpc::ServerWriter<kvstore::ReplicateReply> *writer);
+
+  KVMapPtr kv_map_;
+  std::shared_ptr<ReplicationLog> log_;
+  std::chrono::milliseconds heartbeat_;
+};
+
+// Keeps the store of a replica in step with its primary, from a thread
+// which follows the replication stream of the primary and reconnects when
+// the stream breaks.
+// The replica is ready once it holds a whole snapshot. It stays ready when
+// the primary goes away, but its staleness, the time since it last held
+// every write the primary had, keeps growing.
+class ReplicaFollower {
+ public:
+  // How long the follower waits before it reconnects.
+  static constexpr std::chrono::milliseconds kRetryInterval{500};
+
+  // Follow the primary of the channel into kv_map, which must support
+  // scans, so a snapshot can drop its keys first.
+  ReplicaFollower(std::shared_ptr<grpc::Channel> primary, KVMapPtr kv_map);
+
+  // Stop the follower if it is still running.
+  ~ReplicaFollower();
+
+  ReplicaFollower(const ReplicaFollower &) = delete;
+  ReplicaFollower &operator=(const ReplicaFollower &) = delete;
+
+  // Start following the primary.
+  void Start();
+
+  // Cancel the stream and join the thread.
+  void Stop();
+
+  // Whether the store holds a whole snapshot of the primary.
+  bool ready() const { return ready_; }
+
+  // Time since the store last held every write the primary had, as far as
+  // the replica knows. The maximum duration if it is not ready.
+  std::chrono::milliseconds Staleness() const;
+
+  // Sequence of the last write applied.
+  uint64_t sequence() const { return sequence_; }
+
+ private:
+  // Follow the primary until the follower is stopped.
+  void Run();
+
+  // Follow one replication stream until it ends.
+  grpc::Status Follow();
+
+  // Apply a reply of the stream to the store.
+  void Apply(const kvstore::ReplicateReply &reply);
+
+  // Put a replicated value, with the TTL it had left on the primary.
+  void Put(const kvstore::ReplicatedWrite &write);
+
+  // Remove every key of the store, before a snapshot.
+  void Clear();
+
+  std::unique_ptr<kvstore::KeyValueStore::Stub> stub_;
+  KVMapPtr kv_map_;
+
+  // Log of the primary the store follows, only used by the thread.
+  uint64_t log_id_ = 0;
+  std::atomic<uint64_t> sequence_{0};
+  std::atomic<bool> ready_{false};
+  // Steady clock nanoseconds when the store last held every write of the
+  // primary.
+  std::atomic<int64_t> caught_up_ns_{0};
+
+  // Guards stopping_ and context_, so Stop cancels the current stream.
+  std::mutex follower_locker_;
+  std::condition_variable stop_cv_;
+  bool stopping_ = false;
+  grpc::ClientContext *context_ = nullptr;
+
+  std::thread thread_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_REPLICATION_H_
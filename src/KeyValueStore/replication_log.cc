@@ -0,0 +1,74 @@
+#include "replication_log.h"
+
+#include <algorithm>
+#include <random>
+
+namespace cs499_fei {
+ReplicationLog::ReplicationLog(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)) {
+  std::random_device random;
+  std::mt19937_64 engine((static_cast<uint64_t>(random()) << 32) ^ random() ^
+                         std::chrono::steady_clock::now()
+                             .time_since_epoch()
+                             .count());
+  do {
+    id_ = engine();
+  } while (id_ == 0);
+}
+
+uint64_t ReplicationLog::Append(const std::string &key, ValuePtr value,
+                                std::chrono::milliseconds ttl) {
+  std::chrono::steady_clock::time_point expires_at;
+  if (ttl > std::chrono::milliseconds::zero()) {
+    expires_at = std::chrono::steady_clock::now() + ttl;
+  }
+  uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lock(log_locker_);
+    sequence = ++last_sequence_;
+    entries_.push_back(Entry{sequence, key, std::move(value), expires_at});
+    if (entries_.size() > capacity_) {
+      entries_.pop_front();
+    }
+  }
+  appended_cv_.notify_all();
+  return sequence;
+}
+
+uint64_t ReplicationLog::LastSequence() const {
+  std::lock_guard<std::mutex> lock(log_locker_);
+  return last_sequence_;
+}
+
+ReplicationLog::ReadStatus ReplicationLog::Read(
+    uint64_t after, size_t max, std::chrono::milliseconds timeout,
+    std::vector<Entry> *entries) const {
+  std::unique_lock<std::mutex> lock(log_locker_);
+  appended_cv_.wait_for(lock, timeout, [this, after] {
+    return closed_ || last_sequence_ != after;
+  });
+  if (closed_) {
+    return ReadStatus::kClosed;
+  }
+  // the entries are numbered without gaps, so the first one to read is
+  // found by its sequence.
+  uint64_t first = last_sequence_ - entries_.size() + 1;
+  if (after > last_sequence_ || after + 1 < first) {
+    return ReadStatus::kTruncated;
+  }
+  size_t begin = after + 1 - first;
+  size_t end = std::min(entries_.size(), begin + max);
+  for (size_t i = begin; i < end; ++i) {
+    entries->push_back(entries_[i]);
+  }
+  return ReadStatus::kOk;
+}
+
+void ReplicationLog::Close() {
+  {
+    std::lock_guard<std::mutex> lock(log_locker_);
+    closed_ = true;
+  }
+  appended_cv_.notify_all();
+}
+}  // namespace cs499_fei
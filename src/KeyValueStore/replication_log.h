@@ -0,0 +1,88 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_REPLICATION_LOG_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_REPLICATION_LOG_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "kvmap_abstraction.h"
+
+namespace cs499_fei {
+// In-memory log of the recent writes of a primary, which its replicas
+// follow.
+// An entry holds the value a write left for its key, shared with the
+// store, rather than the operation, so applying an entry twice or on top
+// of a snapshot taken after it leaves the same value. The entries of a key
+// are appended in the order its writes were applied. The log keeps the
+// last capacity entries; a replica which falls further behind gets a
+// snapshot instead.
+class ReplicationLog {
+ public:
+  // One write, numbered by its sequence from 1.
+  struct Entry {
+    uint64_t sequence;
+    std::string key;
+    // The value the write left, nullptr if it removed the key.
+    ValuePtr value;
+    // Steady clock time when the value expires, the epoch of the clock if
+    // it does not.
+    std::chrono::steady_clock::time_point expires_at;
+  };
+
+  // Result of Read.
+  enum class ReadStatus {
+    // The entries after the sequence, if any arrived in time, were read.
+    kOk,
+    // The entries after the sequence are no longer kept.
+    kTruncated,
+    // The log is closed.
+    kClosed,
+  };
+
+  // Keep the last capacity entries, at least one.
+  explicit ReplicationLog(size_t capacity);
+
+  ReplicationLog(const ReplicationLog &) = delete;
+  ReplicationLog &operator=(const ReplicationLog &) = delete;
+
+  // Random id of the log, so a replica tells a restarted primary, whose
+  // sequences start over, from the one it followed.
+  uint64_t id() const { return id_; }
+
+  // Append the value the write of the key left, nullptr for a removal, and
+  // return its sequence. A value put with a TTL expires ttl from now, zero
+  // meaning it does not. Called while the writes of the key are serialized.
+  uint64_t Append(const std::string &key, ValuePtr value,
+                  std::chrono::milliseconds ttl =
+                      std::chrono::milliseconds::zero());
+
+  // Sequence of the last appended entry, 0 before the first one.
+  uint64_t LastSequence() const;
+
+  // Append up to max entries after the sequence to entries, waiting up to
+  // timeout for the first one.
+  ReadStatus Read(uint64_t after, size_t max,
+                  std::chrono::milliseconds timeout,
+                  std::vector<Entry> *entries) const;
+
+  // Wake the readers and make every Read return kClosed.
+  void Close();
+
+ private:
+  uint64_t id_;
+  size_t capacity_;
+
+  // Guards everything below.
+  mutable std::mutex log_locker_;
+  mutable std::condition_variable appended_cv_;
+  std::deque<Entry> entries_;
+  uint64_t last_sequence_ = 0;
+  bool closed_ = false;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_REPLICATION_LOG_H_
@@ -0,0 +1,52 @@
+#include "scan_cursor.h"
+
+#include <algorithm>
+
+namespace cs499_fei {
+constexpr size_t ScanCursor::kChunk;
+
+namespace {
+// Helper function: the first key after every key with the prefix, or an
+// empty string if there is none.
+std::string PrefixEnd(std::string prefix) {
+  while (!prefix.empty() && static_cast<unsigned char>(prefix.back()) == 0xff) {
+    prefix.pop_back();
+  }
+  if (!prefix.empty()) {
+    prefix.back() = static_cast<char>(prefix.back() + 1);
+  }
+  return prefix;
+}
+}  // namespace
+
+ScanCursor::ScanCursor(const kvstore::ScanRequest &request)
+    : start_(request.start()),
+      end_(request.end()),
+      remaining_(request.limit() == 0 ? UINT64_MAX : request.limit()) {
+  if (!request.prefix().empty()) {
+    start_ = request.prefix();
+    end_ = PrefixEnd(request.prefix());
+  }
+  // the smallest key after the cursor.
+  std::string after_cursor = request.cursor() + '\0';
+  if (!request.cursor().empty() && start_ < after_cursor) {
+    start_ = after_cursor;
+  }
+}
+
+bool ScanCursor::Next(const KVMapAbstraction &kv_map, ScanPairs *pairs) {
+  pairs->clear();
+  if (done_) {
+    return false;
+  }
+  size_t chunk = std::min<uint64_t>(remaining_, kChunk);
+  *pairs = kv_map.Scan(start_, end_, chunk);
+  remaining_ -= pairs->size();
+  if (pairs->size() < chunk || remaining_ == 0) {
+    done_ = true;
+  } else {
+    start_ = pairs->back().first + '\0';
+  }
+  return !pairs->empty();
+}
+}  // namespace cs499_fei
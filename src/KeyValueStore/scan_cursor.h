@@ -0,0 +1,35 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_SCAN_CURSOR_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_SCAN_CURSOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "KeyValueStore.pb.h"
+#include "kvmap_abstraction.h"
+
+namespace cs499_fei {
+// Position of a scan of the storage, which reads the pairs of a ScanRequest
+// in chunks so no lock of the storage is held while they are streamed.
+// Shared by the synchronous and the asynchronous server.
+class ScanCursor {
+ public:
+  // Number of pairs read from the storage at a time.
+  static constexpr size_t kChunk = 256;
+
+  // Start a scan of the range or the prefix of the request, after its cursor
+  // key if it has one, of up to its limit pairs.
+  explicit ScanCursor(const kvstore::ScanRequest &request);
+
+  // Read the next chunk of pairs in key order into pairs. Return false once
+  // the scan has no pairs left.
+  bool Next(const KVMapAbstraction &kv_map, ScanPairs *pairs);
+
+ private:
+  std::string start_;
+  std::string end_;
+  uint64_t remaining_;
+  bool done_ = false;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_SCAN_CURSOR_H_
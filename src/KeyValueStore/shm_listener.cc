@@ -0,0 +1,173 @@
+#include "shm_listener.h"
+
+#include <glog/logging.h>
+
+#include "wire_format.h"
+
+namespace cs499_fei {
+constexpr std::chrono::milliseconds ShmListener::kPollInterval;
+constexpr std::chrono::seconds ShmListener::kFrameTimeout;
+constexpr size_t ShmListener::kMaxFrameBytes;
+
+ShmListener::ShmListener(const std::string &name, size_t slots,
+                         kvstore::KeyValueStore::Service *service,
+                         KVMapPtr kv_map)
+    : name_(name),
+      slot_count_(slots),
+      service_(service),
+      kv_map_(std::move(kv_map)) {}
+
+ShmListener::~ShmListener() { Shutdown(); }
+
+bool ShmListener::Start() {
+  segment_ = ShmSegment::Create(name_, slot_count_);
+  if (!segment_) {
+    return false;
+  }
+  for (size_t i = 0; i < slot_count_; ++i) {
+    ShmSlot *slot = &segment_->slot(i);
+    threads_.emplace_back([this, slot] { Serve(slot); });
+  }
+  return true;
+}
+
+void ShmListener::Shutdown() {
+  if (!segment_) {
+    return;
+  }
+  stopping_ = true;
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+  segment_.reset();
+}
+
+void ShmListener::Serve(ShmSlot *slot) {
+  // the unary methods never look at their context.
+  grpc::ServerContext context;
+  std::string payload;
+  std::string key;
+  std::string reply;
+  while (!stopping_) {
+    ShmFrameHeader header;
+    // a client writes a whole header at once, so none is read in part.
+    if (!slot->requests.Read(reinterpret_cast<char *>(&header),
+                             sizeof(header), ShmClock::now() + kPollInterval)) {
+      pid_t owner = slot->owner.load();
+      if (owner < 0) {
+        LOG(INFO) << "Freeing the shared-memory slot abandoned by process "
+                  << -owner;
+        Free(slot);
+      } else if (owner != 0 && !ProcessAlive(owner)) {
+        LOG(INFO) << "Freeing the shared-memory slot of exited process "
+                  << owner;
+        Free(slot);
+      }
+      continue;
+    }
+    if (header.size > kMaxFrameBytes) {
+      LOG(ERROR) << "Shared-memory request of " << header.size
+                 << " bytes exceeds the limit, dropping the client";
+      Free(slot);
+      continue;
+    }
+    payload.resize(header.size);
+    if (!slot->requests.Read(payload.data(), payload.size(),
+                             ShmClock::now() + kFrameTimeout) ||
+        !Respond(slot, static_cast<ShmMethod>(header.code), payload, &context,
+                 &key, &reply)) {
+      LOG(ERROR) << "Shared-memory client stopped responding, dropping it";
+      Free(slot);
+    }
+  }
+}
+
+bool ShmListener::Respond(ShmSlot *slot, ShmMethod method,
+                          std::string_view payload,
+                          grpc::ServerContext *context, std::string *key,
+                          std::string *reply) {
+  using Sync = kvstore::KeyValueStore::Service;
+  ShmDeadline deadline = ShmClock::now() + kFrameTimeout;
+  grpc::Status status;
+  switch (method) {
+    case ShmMethod::kGet: {
+      std::string_view key_bytes;
+      if (!ParseGetRequest(payload, &key_bytes)) {
+        status = grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                              "Cannot parse the GetRequest.");
+        break;
+      }
+      key->assign(key_bytes.data(), key_bytes.size());
+      uint64_t version = 0;
+      ValuePtr value = kv_map_->GetVersioned(*key, &version);
+      LOG(INFO) << "Received GetRequest. "
+                << " Key: " << *key;
+      // the value is copied once, from the store into the pipe.
+      std::string_view value_bytes = value ? *value : std::string_view();
+      char value_header[kMaxGetReplyFraming];
+      char value_trailer[kMaxGetReplyFraming];
+      size_t header_size = WriteGetReplyHeader(value_bytes.size(), value_header);
+      size_t trailer_size =
+          WriteGetReplyTrailer(value ? version : 0, value_trailer);
+      ShmFrameHeader frame{
+          static_cast<uint32_t>(header_size + value_bytes.size() +
+                                trailer_size),
+          grpc::StatusCode::OK};
+      return slot->replies.Write(
+          {frame.bytes(), std::string_view(value_header, header_size),
+           value_bytes, std::string_view(value_trailer, trailer_size)},
+          deadline);
+    }
+    case ShmMethod::kPut:
+      status = Run(&Sync::put, payload, context, reply);
+      break;
+    case ShmMethod::kRemove:
+      status = Run(&Sync::remove, payload, context, reply);
+      break;
+    case ShmMethod::kAppend:
+      status = Run(&Sync::append, payload, context, reply);
+      break;
+    case ShmMethod::kConditionalPut:
+      status = Run(&Sync::conditional_put, payload, context, reply);
+      break;
+    case ShmMethod::kBatch:
+      status = Run(&Sync::batch, payload, context, reply);
+      break;
+    default:
+      status = grpc::Status(grpc::StatusCode::UNIMPLEMENTED,
+                            "The method is not served over shared memory.");
+      break;
+  }
+  std::string_view body =
+      status.ok() ? std::string_view(*reply) : status.error_message();
+  ShmFrameHeader frame{static_cast<uint32_t>(body.size()),
+                       static_cast<uint32_t>(status.error_code())};
+  return slot->replies.Write({frame.bytes(), body}, deadline);
+}
+
+template <typename Request, typename Reply>
+grpc::Status ShmListener::Run(
+    grpc::Status (kvstore::KeyValueStore::Service::*method)(
+        grpc::ServerContext *, const Request *, Reply *),
+    std::string_view payload, grpc::ServerContext *context,
+    std::string *reply) {
+  Request request;
+  Reply message;
+  if (!request.ParseFromArray(payload.data(), payload.size())) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "Cannot parse the request.");
+  }
+  grpc::Status status = (service_->*method)(context, &request, &message);
+  if (status.ok()) {
+    message.SerializeToString(reply);
+  }
+  return status;
+}
+
+void ShmListener::Free(ShmSlot *slot) {
+  slot->requests.Reset();
+  slot->replies.Reset();
+  slot->owner.store(0);
+}
+}  // namespace cs499_fei
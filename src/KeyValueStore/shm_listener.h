@@ -0,0 +1,91 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_SHM_LISTENER_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_SHM_LISTENER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+
+#include "KeyValueStore.grpc.pb.h"
+#include "kvmap_abstraction.h"
+#include "shm_transport.h"
+
+namespace cs499_fei {
+// Serves the KeyValueStore methods to processes on the same host over a
+// shared-memory segment, next to the gRPC server.
+// Every slot of the segment is served by its own thread, which sleeps on
+// the request pipe of the slot while its client is idle. The writes run the
+// methods of the synchronous service, so they are logged and checked as
+// over gRPC; a get is read in place from its request and its value written
+// from the store straight into the reply pipe.
+// A slot whose client process exited or abandoned it is emptied and freed
+// for the next client.
+class ShmListener {
+ public:
+  // How long a thread sleeps before it checks the client of its slot and
+  // whether the listener is shut down.
+  static constexpr std::chrono::milliseconds kPollInterval{100};
+
+  // How long the rest of a request may take to arrive once its header did,
+  // and its reply to be read.
+  static constexpr std::chrono::seconds kFrameTimeout{5};
+
+  // Largest request a client may send.
+  static constexpr size_t kMaxFrameBytes = 64 << 20;
+
+  // Serve the writes with the methods of service and the gets from kv_map,
+  // over the segment of the name with slots slots.
+  ShmListener(const std::string &name, size_t slots,
+              kvstore::KeyValueStore::Service *service, KVMapPtr kv_map);
+
+  // Shut down the threads if they are still running.
+  ~ShmListener();
+
+  ShmListener(const ShmListener &) = delete;
+  ShmListener &operator=(const ShmListener &) = delete;
+
+  // Create the segment and start a thread per slot.
+  // Return false if the segment cannot be created.
+  bool Start();
+
+  // Stop the threads, which finish the request they are serving, and
+  // remove the segment.
+  void Shutdown();
+
+ private:
+  // Serve the requests of the slot until the listener is shut down.
+  void Serve(ShmSlot *slot);
+
+  // Run the request and write its reply frame to the slot, with *key and
+  // *reply as the buffers of the key of a get and of a serialized reply.
+  // Return false if the reply cannot be written.
+  bool Respond(ShmSlot *slot, ShmMethod method, std::string_view payload,
+               grpc::ServerContext *context, std::string *key,
+               std::string *reply);
+
+  // Empty the pipes of the slot and free it for the next client.
+  void Free(ShmSlot *slot);
+
+  // Run the request with the method of the synchronous service, and
+  // serialize its reply into *reply if it succeeds.
+  template <typename Request, typename Reply>
+  grpc::Status Run(grpc::Status (kvstore::KeyValueStore::Service::*method)(
+                       grpc::ServerContext *, const Request *, Reply *),
+                   std::string_view payload, grpc::ServerContext *context,
+                   std::string *reply);
+
+  std::string name_;
+  size_t slot_count_;
+  kvstore::KeyValueStore::Service *service_;
+  KVMapPtr kv_map_;
+  std::unique_ptr<ShmSegment> segment_;
+  std::vector<std::thread> threads_;
+  std::atomic<bool> stopping_{false};
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_SHM_LISTENER_H_
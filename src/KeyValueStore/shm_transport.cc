@@ -0,0 +1,272 @@
+#include "shm_transport.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <thread>
+
+namespace cs499_fei {
+constexpr size_t ShmPipe::kBytes;
+
+namespace {
+// Marks a fully initialized segment of this layout.
+constexpr uint64_t kSegmentMagic = 0x6b7673686d303031;  // "kvshm001"
+
+// Times a side checks for the other before it sleeps. A request served
+// from memory comes back within a few of them.
+constexpr int kSpins = 64;
+
+// Helper function: the name of the shared-memory object, which POSIX wants
+// to start with a slash.
+std::string ObjectName(const std::string &name) {
+  return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+// Helper function: sleep while *word holds expected, until woken or the
+// timeout. The futex is not private, so it works across processes.
+void FutexWait(std::atomic<uint32_t> *word, uint32_t expected,
+               std::chrono::nanoseconds timeout) {
+  auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+  timespec relative{static_cast<time_t>(seconds.count()),
+                    static_cast<long>((timeout - seconds).count())};
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected,
+          &relative, nullptr, 0);
+}
+
+// Helper function: wake the sleepers on *word.
+void FutexWake(std::atomic<uint32_t> *word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX,
+          nullptr, nullptr, 0);
+}
+
+// Helper function: bump *seq and wake the other side if it sleeps on it.
+void Signal(std::atomic<uint32_t> *seq, std::atomic<uint32_t> *waiting) {
+  seq->fetch_add(1);
+  if (waiting->load() != 0) {
+    FutexWake(seq);
+  }
+}
+
+// Helper function: wait until ready() or the deadline, yielding for a few
+// checks, then sleeping on *seq with *waiting set so the other side wakes
+// it. *seq is read before *waiting is set and ready() checked again, so a
+// signal in between makes the futex return at once.
+// Return whether ready() held.
+template <typename Ready>
+bool WaitFor(Ready ready, std::atomic<uint32_t> *seq,
+             std::atomic<uint32_t> *waiting, ShmDeadline deadline) {
+  for (int i = 0; i < kSpins; ++i) {
+    if (ready()) {
+      return true;
+    }
+    std::this_thread::yield();
+  }
+  while (true) {
+    uint32_t observed = seq->load();
+    waiting->store(1);
+    if (ready()) {
+      waiting->store(0);
+      return true;
+    }
+    ShmDeadline now = ShmClock::now();
+    if (now >= deadline) {
+      waiting->store(0);
+      return false;
+    }
+    FutexWait(seq, observed, deadline - now);
+    waiting->store(0);
+  }
+}
+}  // namespace
+
+void ShmPipe::Reset() {
+  head_.store(0);
+  tail_.store(0);
+  reader_waiting_.store(0);
+  writer_waiting_.store(0);
+}
+
+bool ShmPipe::Write(std::initializer_list<std::string_view> parts,
+                    ShmDeadline deadline) {
+  // only the writer moves the head.
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  uint64_t tail = tail_.load(std::memory_order_acquire);
+  for (std::string_view part : parts) {
+    while (!part.empty()) {
+      if (head - tail == kBytes) {
+        Publish(head);
+        if (!WaitFor(
+                [&] {
+                  tail = tail_.load(std::memory_order_acquire);
+                  return head - tail < kBytes;
+                },
+                &read_seq_, &writer_waiting_, deadline)) {
+          return false;
+        }
+      }
+      size_t offset = head % kBytes;
+      size_t size = std::min({part.size(), kBytes - (head - tail),
+                              kBytes - offset});
+      std::memcpy(data_ + offset, part.data(), size);
+      head += size;
+      part.remove_prefix(size);
+    }
+  }
+  Publish(head);
+  return true;
+}
+
+bool ShmPipe::Read(char *data, size_t size, ShmDeadline deadline) {
+  // only the reader moves the tail.
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  uint64_t head = head_.load(std::memory_order_acquire);
+  while (size > 0) {
+    if (head == tail &&
+        !WaitFor(
+            [&] {
+              head = head_.load(std::memory_order_acquire);
+              return head != tail;
+            },
+            &written_seq_, &reader_waiting_, deadline)) {
+      return false;
+    }
+    size_t offset = tail % kBytes;
+    size_t chunk = std::min({size, static_cast<size_t>(head - tail),
+                             kBytes - offset});
+    std::memcpy(data, data_ + offset, chunk);
+    data += chunk;
+    size -= chunk;
+    tail += chunk;
+    Consume(tail);
+  }
+  return true;
+}
+
+void ShmPipe::Publish(uint64_t head) {
+  head_.store(head);
+  Signal(&written_seq_, &reader_waiting_);
+}
+
+void ShmPipe::Consume(uint64_t tail) {
+  tail_.store(tail);
+  Signal(&read_seq_, &writer_waiting_);
+}
+
+struct ShmSegment::Header {
+  std::atomic<uint64_t> magic;
+  uint32_t slots;
+  int32_t server_pid;
+};
+
+namespace {
+// Helper function: the offset of the first slot, after the header.
+size_t SlotsOffset(size_t header_bytes) {
+  return (header_bytes + alignof(ShmSlot) - 1) / alignof(ShmSlot) *
+         alignof(ShmSlot);
+}
+}  // namespace
+
+std::unique_ptr<ShmSegment> ShmSegment::Create(const std::string &name,
+                                               size_t slots) {
+  std::string object = ObjectName(name);
+  shm_unlink(object.c_str());
+  int fd = shm_open(object.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return nullptr;
+  }
+  size_t bytes = SlotsOffset(sizeof(Header)) + slots * sizeof(ShmSlot);
+  void *address = MAP_FAILED;
+  if (ftruncate(fd, bytes) == 0) {
+    address =
+        mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (address == MAP_FAILED) {
+    shm_unlink(object.c_str());
+    return nullptr;
+  }
+  auto *header = new (address) Header();
+  header->slots = static_cast<uint32_t>(slots);
+  header->server_pid = getpid();
+  char *first = static_cast<char *>(address) + SlotsOffset(sizeof(Header));
+  for (size_t i = 0; i < slots; ++i) {
+    new (first + i * sizeof(ShmSlot)) ShmSlot();
+  }
+  // a client which maps the segment before this sees no magic and retries.
+  header->magic.store(kSegmentMagic, std::memory_order_release);
+  return std::unique_ptr<ShmSegment>(
+      new ShmSegment(object, address, bytes, true));
+}
+
+std::unique_ptr<ShmSegment> ShmSegment::Open(const std::string &name) {
+  std::string object = ObjectName(name);
+  int fd = shm_open(object.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat status;
+  void *address = MAP_FAILED;
+  if (fstat(fd, &status) == 0 &&
+      static_cast<size_t>(status.st_size) >= sizeof(Header)) {
+    address = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (address == MAP_FAILED) {
+    return nullptr;
+  }
+  std::unique_ptr<ShmSegment> segment(
+      new ShmSegment(object, address, status.st_size, false));
+  auto *header = static_cast<Header *>(address);
+  if (header->magic.load(std::memory_order_acquire) != kSegmentMagic ||
+      SlotsOffset(sizeof(Header)) + header->slots * sizeof(ShmSlot) >
+          segment->bytes_) {
+    return nullptr;
+  }
+  return segment;
+}
+
+ShmSegment::ShmSegment(std::string name, void *address, size_t bytes,
+                       bool owner)
+    : name_(std::move(name)), address_(address), bytes_(bytes),
+      owner_(owner) {}
+
+ShmSegment::~ShmSegment() {
+  if (owner_) {
+    static_cast<Header *>(address_)->magic.store(0);
+    shm_unlink(name_.c_str());
+  }
+  munmap(address_, bytes_);
+}
+
+size_t ShmSegment::slots() const {
+  return static_cast<const Header *>(address_)->slots;
+}
+
+ShmSlot &ShmSegment::slot(size_t i) {
+  char *first = static_cast<char *>(address_) + SlotsOffset(sizeof(Header));
+  return *reinterpret_cast<ShmSlot *>(first + i * sizeof(ShmSlot));
+}
+
+pid_t ShmSegment::server_pid() const {
+  return static_cast<const Header *>(address_)->server_pid;
+}
+
+bool ShmSegment::closed() const {
+  return static_cast<const Header *>(address_)->magic.load(
+             std::memory_order_acquire) != kSegmentMagic;
+}
+
+bool ProcessAlive(pid_t pid) { return kill(pid, 0) == 0 || errno != ESRCH; }
+}  // namespace cs499_fei
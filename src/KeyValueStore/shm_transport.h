@@ -0,0 +1,151 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_SHM_TRANSPORT_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_SHM_TRANSPORT_H_
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace cs499_fei {
+// Shared-memory transport of the KeyValueStore methods between processes on
+// the same host, instead of HTTP/2 over loopback TCP.
+// The server creates a segment of slots. A client claims a slot and sends
+// one request at a time through its request pipe; a thread of the server
+// serving the slot answers through its reply pipe. Both sides spin briefly
+// for the other, then sleep on a futex in the segment, so the kernel is
+// only entered when a side actually waits.
+
+using ShmClock = std::chrono::steady_clock;
+using ShmDeadline = ShmClock::time_point;
+
+// A byte pipe from one writer to one reader, in shared memory. The bytes
+// are a ring of kBytes, and a longer message streams through it as the
+// reader drains it.
+class ShmPipe {
+ public:
+  // Bytes the pipe buffers.
+  static constexpr size_t kBytes = 64 << 10;
+
+  // Empty the pipe, while neither side uses it.
+  void Reset();
+
+  // Write the parts in order, waiting for room while the reader drains the
+  // pipe. The reader sees the bytes once they are all written, or when the
+  // pipe is full.
+  // Return false if the deadline passed first.
+  bool Write(std::initializer_list<std::string_view> parts,
+             ShmDeadline deadline);
+
+  // Read size bytes into data, waiting for the writer.
+  // Return false if the deadline passed first; the bytes read so far are
+  // consumed.
+  bool Read(char *data, size_t size, ShmDeadline deadline);
+
+ private:
+  // Make the written bytes up to head visible and wake a sleeping reader.
+  void Publish(uint64_t head);
+
+  // Free the read bytes up to tail and wake a sleeping writer.
+  void Consume(uint64_t tail);
+
+  // Written by the writer: bytes written, bumped on every publish, and
+  // whether the reader sleeps on written_seq_.
+  alignas(64) std::atomic<uint64_t> head_{0};
+  std::atomic<uint32_t> written_seq_{0};
+  std::atomic<uint32_t> reader_waiting_{0};
+
+  // Written by the reader: bytes read, bumped on every consume, and whether
+  // the writer sleeps on read_seq_.
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  std::atomic<uint32_t> read_seq_{0};
+  std::atomic<uint32_t> writer_waiting_{0};
+
+  alignas(64) char data_[kBytes];
+};
+
+// The pipes of one client connection.
+struct ShmSlot {
+  // Pid of the client process using the slot, 0 while it is free, and
+  // negated once the client abandoned it, for the server to free it when
+  // the pipes are idle.
+  std::atomic<int32_t> owner{0};
+  ShmPipe requests;
+  ShmPipe replies;
+};
+
+// Methods a request frame carries. Scans and snapshots are not served.
+enum class ShmMethod : uint32_t {
+  kPut = 1,
+  kGet,
+  kRemove,
+  kAppend,
+  kConditionalPut,
+  kBatch,
+};
+
+// Header of every frame: the bytes of the payload which follows, and the
+// ShmMethod of a request or the gRPC status code of a reply. The payload is
+// the serialized request or reply message, or the error message of a
+// failed reply.
+struct ShmFrameHeader {
+  uint32_t size;
+  uint32_t code;
+
+  // The bytes of the header, as it is written to a pipe.
+  std::string_view bytes() const {
+    return std::string_view(reinterpret_cast<const char *>(this),
+                            sizeof(*this));
+  }
+};
+
+// A mapped segment of slots, named as a POSIX shared-memory object.
+class ShmSegment {
+ public:
+  // Create the segment of the name with slots slots, replacing one an
+  // earlier server left behind. The name is unlinked when the segment is
+  // destroyed.
+  // Return nullptr if it cannot be created.
+  static std::unique_ptr<ShmSegment> Create(const std::string &name,
+                                            size_t slots);
+
+  // Map the segment of the name a running server created.
+  // Return nullptr if there is none.
+  static std::unique_ptr<ShmSegment> Open(const std::string &name);
+
+  ~ShmSegment();
+
+  ShmSegment(const ShmSegment &) = delete;
+  ShmSegment &operator=(const ShmSegment &) = delete;
+
+  size_t slots() const;
+
+  ShmSlot &slot(size_t i);
+
+  // Pid of the server which created the segment.
+  pid_t server_pid() const;
+
+  // Whether the server destroyed the segment, so a client maps a new one.
+  bool closed() const;
+
+ private:
+  struct Header;
+
+  ShmSegment(std::string name, void *address, size_t bytes, bool owner);
+
+  std::string name_;
+  void *address_;
+  size_t bytes_;
+  // Whether this process created the segment and unlinks it.
+  bool owner_;
+};
+
+// Whether the process is still running.
+bool ProcessAlive(pid_t pid);
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_SHM_TRANSPORT_H_
@@ -0,0 +1,222 @@
+#include "slab_arena.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <new>
+
+namespace cs499_fei {
+namespace {
+// Chunk sizes of the size classes. Multiples of 8 keep every chunk aligned.
+constexpr size_t kClassSizes[] = {16,  24,  32,  40,  48,  56,  64,
+                                  80,  96,  112, 128, 160, 192, 224,
+                                  256, 320, 384, 448, 512};
+
+// Bytes reserved at the start of every slab for its header.
+constexpr size_t kHeaderSize = 64;
+
+// Size class index for every size in 8-byte steps, up to kMaxChunkSize.
+std::array<uint8_t, SlabArena::kMaxChunkSize / 8 + 1> BuildClassTable() {
+  std::array<uint8_t, SlabArena::kMaxChunkSize / 8 + 1> table{};
+  size_t size_class = 0;
+  for (size_t i = 0; i < table.size(); ++i) {
+    while (kClassSizes[size_class] < i * 8) {
+      ++size_class;
+    }
+    table[i] = static_cast<uint8_t>(size_class);
+  }
+  return table;
+}
+}  // namespace
+
+SlabArena::SlabArena() {
+  static_assert(sizeof(Slab) <= kHeaderSize, "Slab header does not fit.");
+  for (size_t chunk_size : kClassSizes) {
+    SizeClass size_class;
+    size_class.chunk_size = chunk_size;
+    classes_.push_back(std::move(size_class));
+  }
+}
+
+SlabArena::~SlabArena() {
+  for (Slab *slab : slabs_) {
+    std::free(slab);
+  }
+}
+
+size_t SlabArena::ClassFor(size_t size) {
+  static const auto table = BuildClassTable();
+  return table[(size + 7) / 8];
+}
+
+SlabArena::Slab *SlabArena::SlabOf(const void *p) {
+  return reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(p) &
+                                  ~(kSlabSize - 1));
+}
+
+bool SlabArena::InSlabs(const std::vector<uintptr_t> &slabs, const void *p) {
+  uintptr_t base = reinterpret_cast<uintptr_t>(p) & ~(kSlabSize - 1);
+  return std::binary_search(slabs.begin(), slabs.end(), base);
+}
+
+SlabArena::Slab *SlabArena::NewSlab(size_t size_class) {
+  void *memory = std::aligned_alloc(kSlabSize, kSlabSize);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  Slab *slab = static_cast<Slab *>(memory);
+  slab->size_class = static_cast<uint32_t>(size_class);
+  slab->capacity = static_cast<uint32_t>((kSlabSize - kHeaderSize) /
+                                         classes_[size_class].chunk_size);
+  slab->used = 0;
+  slab->bump = 0;
+  slab->free_list = nullptr;
+  slab->evacuating = false;
+  slab->in_partial = false;
+  slab->slabs_index = static_cast<uint32_t>(slabs_.size());
+  slabs_.push_back(slab);
+  AddPartial(slab);
+  ++classes_[size_class].slab_count;
+  return slab;
+}
+
+void SlabArena::ReleaseSlab(Slab *slab) {
+  if (slab->in_partial) {
+    RemovePartial(slab);
+  }
+  // the last slab takes the place of the released one.
+  Slab *last = slabs_.back();
+  slabs_[slab->slabs_index] = last;
+  last->slabs_index = slab->slabs_index;
+  slabs_.pop_back();
+  --classes_[slab->size_class].slab_count;
+  std::free(slab);
+}
+
+void SlabArena::AddPartial(Slab *slab) {
+  std::vector<Slab *> &partial = classes_[slab->size_class].partial;
+  slab->partial_index = static_cast<uint32_t>(partial.size());
+  slab->in_partial = true;
+  partial.push_back(slab);
+}
+
+void SlabArena::RemovePartial(Slab *slab) {
+  std::vector<Slab *> &partial = classes_[slab->size_class].partial;
+  Slab *last = partial.back();
+  partial[slab->partial_index] = last;
+  last->partial_index = slab->partial_index;
+  partial.pop_back();
+  slab->in_partial = false;
+}
+
+void *SlabArena::Allocate(size_t size) {
+  if (size > kMaxChunkSize) {
+    void *p = ::operator new(size);
+    std::lock_guard<std::mutex> lock(arena_locker_);
+    large_bytes_ += size;
+    return p;
+  }
+
+  std::lock_guard<std::mutex> lock(arena_locker_);
+  size_t index = ClassFor(size);
+  SizeClass &size_class = classes_[index];
+  Slab *slab =
+      size_class.partial.empty() ? NewSlab(index) : size_class.partial.back();
+
+  void *chunk;
+  if (slab->free_list != nullptr) {
+    chunk = slab->free_list;
+    slab->free_list = *static_cast<void **>(chunk);
+  } else {
+    chunk = reinterpret_cast<char *>(slab) + kHeaderSize +
+            static_cast<size_t>(slab->bump) * size_class.chunk_size;
+    ++slab->bump;
+  }
+  // a full slab stops serving allocations until a chunk is freed.
+  if (++slab->used == slab->capacity) {
+    RemovePartial(slab);
+  }
+  used_bytes_ += size_class.chunk_size;
+  return chunk;
+}
+
+void SlabArena::Deallocate(void *p, size_t size) {
+  if (size > kMaxChunkSize) {
+    ::operator delete(p);
+    std::lock_guard<std::mutex> lock(arena_locker_);
+    large_bytes_ -= size;
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(arena_locker_);
+  Slab *slab = SlabOf(p);
+  SizeClass &size_class = classes_[slab->size_class];
+  *static_cast<void **>(p) = slab->free_list;
+  slab->free_list = p;
+  --slab->used;
+  used_bytes_ -= size_class.chunk_size;
+
+  if (slab->evacuating) {
+    if (slab->used == 0) {
+      ReleaseSlab(slab);
+    }
+    return;
+  }
+  // keep the last slab of a class around, so a class does not allocate and
+  // release a slab on every other call.
+  if (slab->used == 0 && size_class.slab_count > 1) {
+    ReleaseSlab(slab);
+    return;
+  }
+  if (!slab->in_partial) {
+    AddPartial(slab);
+  }
+}
+
+std::vector<uintptr_t> SlabArena::BeginEvacuation(double max_occupancy) {
+  std::lock_guard<std::mutex> lock(arena_locker_);
+  // one pass over the slabs sorts the sparse ones by class.
+  std::vector<std::vector<Slab *>> sparse(classes_.size());
+  std::vector<size_t> free_chunks(classes_.size(), 0);
+  for (Slab *slab : slabs_) {
+    if (slab->evacuating) {
+      continue;
+    }
+    free_chunks[slab->size_class] += slab->capacity - slab->used;
+    if (slab->used < max_occupancy * slab->capacity) {
+      sparse[slab->size_class].push_back(slab);
+    }
+  }
+
+  std::vector<uintptr_t> evacuating;
+  for (size_t index = 0; index < classes_.size(); ++index) {
+    size_t capacity = (kSlabSize - kHeaderSize) / classes_[index].chunk_size;
+    // moving the chunks around only pays off if a whole slab can be freed.
+    if (sparse[index].size() < 2 || free_chunks[index] < capacity) {
+      continue;
+    }
+    for (Slab *slab : sparse[index]) {
+      if (slab->used == 0) {
+        ReleaseSlab(slab);
+        continue;
+      }
+      slab->evacuating = true;
+      if (slab->in_partial) {
+        RemovePartial(slab);
+      }
+      evacuating.push_back(reinterpret_cast<uintptr_t>(slab));
+    }
+  }
+  std::sort(evacuating.begin(), evacuating.end());
+  return evacuating;
+}
+
+SlabArena::Stats SlabArena::GetStats() const {
+  std::lock_guard<std::mutex> lock(arena_locker_);
+  Stats stats;
+  stats.slab_bytes = slabs_.size() * kSlabSize;
+  stats.used_bytes = used_bytes_;
+  stats.large_bytes = large_bytes_;
+  return stats;
+}
+}  // namespace cs499_fei
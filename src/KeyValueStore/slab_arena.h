@@ -0,0 +1,177 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_SLAB_ARENA_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_SLAB_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cs499_fei {
+// Size-classed slab allocator.
+// Small allocations are rounded up to a size class and carved out of 64 KiB
+// slabs which only hold chunks of that class, so millions of small keys,
+// values and map nodes share a few large blocks instead of paying malloc's
+// per-allocation header and fragmentation. Larger allocations go to the
+// global allocator.
+// Sparse slabs can be evacuated: the owner moves the live chunks elsewhere,
+// and the slab goes back to the system once its last chunk is freed.
+class SlabArena {
+ public:
+  // Size of one slab. Slabs are aligned to it, so the slab of a chunk is
+  // found by masking the chunk address.
+  static constexpr size_t kSlabSize = 64 * 1024;
+
+  // Largest allocation served from slabs.
+  static constexpr size_t kMaxChunkSize = 512;
+
+  // Memory usage of the arena.
+  struct Stats {
+    // Bytes of all slabs.
+    size_t slab_bytes = 0;
+
+    // Bytes of the chunks handed out, rounded up to their size class.
+    size_t used_bytes = 0;
+
+    // Bytes of the allocations too large for a slab.
+    size_t large_bytes = 0;
+  };
+
+  SlabArena();
+
+  // Return every slab to the system.
+  ~SlabArena();
+
+  SlabArena(const SlabArena &) = delete;
+  SlabArena &operator=(const SlabArena &) = delete;
+
+  // Allocate size bytes, aligned to 8 bytes.
+  void *Allocate(size_t size);
+
+  // Free memory returned by Allocate for the same size.
+  void Deallocate(void *p, size_t size);
+
+  // Mark every slab filled below max_occupancy as evacuating, in the classes
+  // where doing so frees at least one slab. Evacuating slabs serve no new
+  // allocations and go back to the system once empty.
+  // Return the sorted base addresses of the evacuating slabs.
+  std::vector<uintptr_t> BeginEvacuation(double max_occupancy);
+
+  // Whether p lies in one of the slabs returned by BeginEvacuation.
+  // p may point anywhere, also outside of the arena.
+  static bool InSlabs(const std::vector<uintptr_t> &slabs, const void *p);
+
+  // Current memory usage.
+  Stats GetStats() const;
+
+ private:
+  // Header at the start of every slab.
+  struct Slab {
+    uint32_t size_class;
+    uint32_t capacity;
+    uint32_t used;
+    uint32_t bump;
+    void *free_list;
+    bool evacuating;
+    bool in_partial;
+    // Positions of the slab in slabs_ and in the partial slabs of its class,
+    // so it is removed from them in constant time.
+    uint32_t slabs_index;
+    uint32_t partial_index;
+  };
+
+  // Slabs of one chunk size.
+  struct SizeClass {
+    size_t chunk_size;
+    size_t slab_count = 0;
+    // Slabs with free chunks which may serve allocations.
+    std::vector<Slab *> partial;
+  };
+
+  // Index of the size class serving size bytes.
+  static size_t ClassFor(size_t size);
+
+  // Return the slab holding p.
+  static Slab *SlabOf(const void *p);
+
+  // Allocate a new slab for the class.
+  Slab *NewSlab(size_t size_class);
+
+  // Return an empty slab to the system.
+  void ReleaseSlab(Slab *slab);
+
+  // Add the slab to, or remove it from, the partial slabs of its class.
+  void AddPartial(Slab *slab);
+  void RemovePartial(Slab *slab);
+
+  // Size classes, from small to large.
+  std::vector<SizeClass> classes_;
+
+  // Every slab of the arena.
+  std::vector<Slab *> slabs_;
+
+  // Chunk bytes in use, and bytes of large allocations.
+  size_t used_bytes_ = 0;
+  size_t large_bytes_ = 0;
+
+  // For thread safety, Use a mutex to avoid race condition.
+  // Values may be freed by any thread which drops the last reference.
+  mutable std::mutex arena_locker_;
+};
+
+// STL allocator backed by a SlabArena.
+// It shares ownership of the arena, so objects allocated in it (such as
+// values handed out to readers) keep the arena alive. A default-constructed
+// allocator has no arena and uses the global allocator.
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  ArenaAllocator() = default;
+
+  explicit ArenaAllocator(std::shared_ptr<SlabArena> arena)
+      : arena_(std::move(arena)) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) {}
+
+  T *allocate(size_t n) {
+    static_assert(alignof(T) <= 8, "SlabArena only aligns to 8 bytes.");
+    if (!arena_) {
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T *>(arena_->Allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T *p, size_t n) {
+    if (!arena_) {
+      ::operator delete(p);
+      return;
+    }
+    arena_->Deallocate(p, n * sizeof(T));
+  }
+
+  const std::shared_ptr<SlabArena> &arena() const { return arena_; }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U> &other) const {
+    return arena_ == other.arena();
+  }
+
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U> &other) const {
+    return arena_ != other.arena();
+  }
+
+ private:
+  std::shared_ptr<SlabArena> arena_;
+};
+
+// A string whose bytes live in a SlabArena, or in the global allocator when
+// built without one.
+using ArenaString =
+    std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_SLAB_ARENA_H_
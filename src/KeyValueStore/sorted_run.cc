@@ -0,0 +1,365 @@
+#include "sorted_run.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <glog/logging.h>
+
+#include "checksum.h"
+
+namespace cs499_fei {
+constexpr char SortedRun::kMagic[];
+constexpr size_t SortedRun::kFooterSize;
+constexpr uint8_t SortedRun::kPut;
+constexpr uint8_t SortedRun::kRemove;
+
+namespace {
+// Bytes of the magic, without its terminating zero.
+constexpr size_t kMagicSize = sizeof(SortedRun::kMagic) - 1;
+
+// Bytes of the type, sizes and version in front of every record.
+constexpr size_t kRecordHeaderSize = 1 + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+// Footer of a run file.
+struct Footer {
+  uint64_t index_offset;
+  uint64_t index_size;
+  uint64_t count;
+  uint32_t meta_crc;
+  uint32_t filter_size;
+  char magic[kMagicSize];
+};
+static_assert(sizeof(Footer) == SortedRun::kFooterSize,
+              "The footer has a fixed layout.");
+
+// Helper function: append a number to the buffer.
+template <typename T>
+void PutNumber(std::string *buffer, T n) {
+  buffer->append(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+// Helper function: read a number at position of the buffer and move past it.
+// Return false if the buffer is too short.
+template <typename T>
+bool GetNumber(const std::string &buffer, size_t *position, T *n) {
+  if (buffer.size() - *position < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(n, buffer.data() + *position, sizeof(T));
+  *position += sizeof(T);
+  return true;
+}
+
+// Helper function: read a u32-prefixed string at position of the buffer and
+// move past it. Return false if the buffer is too short.
+bool GetString(const std::string &buffer, size_t *position, std::string *s) {
+  uint32_t size;
+  if (!GetNumber(buffer, position, &size) ||
+      buffer.size() - *position < size) {
+    return false;
+  }
+  s->assign(buffer, *position, size);
+  *position += size;
+  return true;
+}
+
+// Helper function: write all the bytes at the offset.
+void WriteAt(int fd, const std::string &file_name, const char *data,
+             size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t n = pwrite(fd, data, size, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      LOG(FATAL) << "Cannot write " << file_name << ": "
+                 << std::strerror(errno);
+    }
+    data += n;
+    size -= n;
+    offset += n;
+  }
+}
+
+// Helper function: read size bytes at the offset. Return false if the file
+// is shorter.
+bool ReadAt(int fd, char *data, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t n = pread(fd, data, size, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+}  // namespace
+
+SortedRun::Builder::Builder(const std::string &file_name, size_t block_size,
+                            size_t bits_per_key)
+    : file_name_(file_name),
+      tmp_file_(file_name + ".tmp"),
+      block_size_(block_size),
+      bits_per_key_(bits_per_key) {
+  fd_ = open(tmp_file_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    LOG(FATAL) << "Cannot open " << tmp_file_ << ": " << std::strerror(errno);
+  }
+}
+
+SortedRun::Builder::~Builder() {
+  if (fd_ >= 0) {
+    close(fd_);
+    std::remove(tmp_file_.c_str());
+  }
+}
+
+void SortedRun::Builder::Add(const Record &record) {
+  if (count_ == 0) {
+    PutNumber(&index_, static_cast<uint32_t>(record.key.size()));
+    index_.append(record.key);
+  }
+  block_.push_back(static_cast<char>(record.removed ? kRemove : kPut));
+  PutNumber(&block_, static_cast<uint32_t>(record.key.size()));
+  PutNumber(&block_, static_cast<uint32_t>(record.value.size()));
+  PutNumber(&block_, record.version);
+  block_.append(record.key);
+  block_.append(record.value);
+  last_key_.assign(record.key);
+  if (bits_per_key_ > 0) {
+    hashes_.push_back(BloomFilter::Hash(record.key));
+  }
+  ++count_;
+  if (block_.size() >= block_size_) {
+    FlushBlock();
+  }
+}
+
+void SortedRun::Builder::FlushBlock() {
+  if (block_.empty()) {
+    return;
+  }
+  PutNumber(&index_, static_cast<uint32_t>(last_key_.size()));
+  index_.append(last_key_);
+  PutNumber(&index_, offset_);
+  PutNumber(&index_, static_cast<uint32_t>(block_.size()));
+  PutNumber(&index_, Crc32(block_.data(), block_.size()));
+  WriteAt(fd_, tmp_file_, block_.data(), block_.size(), offset_);
+  offset_ += block_.size();
+  block_.clear();
+}
+
+uint64_t SortedRun::Builder::Finish() {
+  FlushBlock();
+  // the filter is written right before the index, so both are read and
+  // checked at once.
+  std::string meta;
+  if (!hashes_.empty()) {
+    BloomFilter filter(hashes_.size(), bits_per_key_);
+    for (uint64_t hash : hashes_) {
+      filter.Add(hash);
+    }
+    meta = filter.Serialize();
+  }
+  Footer footer{};
+  footer.filter_size = meta.size();
+  meta.append(index_);
+  footer.index_offset = offset_ + footer.filter_size;
+  footer.index_size = index_.size();
+  footer.count = count_;
+  footer.meta_crc = Crc32(meta.data(), meta.size());
+  std::memcpy(footer.magic, kMagic, kMagicSize);
+  WriteAt(fd_, tmp_file_, meta.data(), meta.size(), offset_);
+  offset_ += meta.size();
+  WriteAt(fd_, tmp_file_, reinterpret_cast<const char *>(&footer),
+          sizeof(footer), offset_);
+  offset_ += sizeof(footer);
+  if (fdatasync(fd_) != 0 || close(fd_) != 0 ||
+      std::rename(tmp_file_.c_str(), file_name_.c_str()) != 0) {
+    LOG(FATAL) << "Cannot store " << file_name_ << ": "
+               << std::strerror(errno);
+  }
+  fd_ = -1;
+  return offset_;
+}
+
+std::shared_ptr<SortedRun> SortedRun::Open(uint64_t number,
+                                           const std::string &file_name,
+                                           BlockCache *cache,
+                                           std::atomic<uint64_t> *read_bytes) {
+  std::shared_ptr<SortedRun> run(new SortedRun());
+  run->number_ = number;
+  run->file_name_ = file_name;
+  run->cache_ = cache;
+  run->read_bytes_ = read_bytes;
+  run->fd_ = open(file_name.c_str(), O_RDONLY);
+  struct stat st;
+  if (run->fd_ < 0 || fstat(run->fd_, &st) != 0) {
+    LOG(FATAL) << "Cannot open run " << file_name << ": "
+               << std::strerror(errno);
+  }
+  run->file_size_ = st.st_size;
+
+  Footer footer;
+  if (run->file_size_ < kFooterSize ||
+      !ReadAt(run->fd_, reinterpret_cast<char *>(&footer), sizeof(footer),
+              run->file_size_ - kFooterSize) ||
+      std::memcmp(footer.magic, kMagic, kMagicSize) != 0 ||
+      footer.index_offset + footer.index_size + kFooterSize !=
+          run->file_size_ ||
+      footer.filter_size > footer.index_offset) {
+    LOG(FATAL) << "Corrupt run " << file_name;
+  }
+  std::string meta(footer.filter_size + footer.index_size, '\0');
+  if (!ReadAt(run->fd_, &meta[0], meta.size(),
+              footer.index_offset - footer.filter_size) ||
+      Crc32(meta.data(), meta.size()) != footer.meta_crc) {
+    LOG(FATAL) << "Corrupt run " << file_name;
+  }
+  if (footer.filter_size > 0) {
+    run->filter_ = BloomFilter::Deserialize(
+        std::string_view(meta).substr(0, footer.filter_size));
+    if (!run->filter_) {
+      LOG(FATAL) << "Corrupt filter of run " << file_name;
+    }
+  }
+  std::string index = meta.substr(footer.filter_size);
+  run->count_ = footer.count;
+
+  size_t position = 0;
+  if (footer.count > 0 && !GetString(index, &position, &run->smallest_)) {
+    LOG(FATAL) << "Corrupt run " << file_name;
+  }
+  while (position < index.size()) {
+    BlockHandle handle;
+    if (!GetString(index, &position, &handle.last_key) ||
+        !GetNumber(index, &position, &handle.offset) ||
+        !GetNumber(index, &position, &handle.size) ||
+        !GetNumber(index, &position, &handle.crc)) {
+      LOG(FATAL) << "Corrupt run " << file_name;
+    }
+    run->index_.push_back(std::move(handle));
+  }
+  if (!run->index_.empty()) {
+    run->largest_ = run->index_.back().last_key;
+  }
+  return run;
+}
+
+SortedRun::~SortedRun() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  if (obsolete_) {
+    std::remove(file_name_.c_str());
+    if (cache_ != nullptr) {
+      cache_->EraseFile(number_);
+    }
+  }
+}
+
+std::string SortedRun::ReadBlock(size_t i) const {
+  const BlockHandle &handle = index_[i];
+  std::string block(handle.size, '\0');
+  if (!ReadAt(fd_, &block[0], block.size(), handle.offset) ||
+      Crc32(block.data(), block.size()) != handle.crc) {
+    LOG(FATAL) << "Corrupt block at " << handle.offset << " of run "
+               << file_name_;
+  }
+  return block;
+}
+
+void SortedRun::ParseRecord(const std::string &block, size_t *position,
+                            Record *record) {
+  uint32_t sizes[2];
+  if (block.size() - *position < kRecordHeaderSize) {
+    LOG(FATAL) << "Corrupt record in a run block";
+  }
+  const char *p = block.data() + *position;
+  record->removed = static_cast<uint8_t>(p[0]) == kRemove;
+  std::memcpy(sizes, p + 1, sizeof(sizes));
+  std::memcpy(&record->version, p + 1 + sizeof(sizes),
+              sizeof(record->version));
+  p += kRecordHeaderSize;
+  if (block.size() - *position - kRecordHeaderSize <
+      static_cast<uint64_t>(sizes[0]) + sizes[1]) {
+    LOG(FATAL) << "Corrupt record in a run block";
+  }
+  record->key = std::string_view(p, sizes[0]);
+  record->value = std::string_view(p + sizes[0], sizes[1]);
+  *position += kRecordHeaderSize + sizes[0] + sizes[1];
+}
+
+std::optional<SortedRun::Found> SortedRun::Get(std::string_view key) const {
+  // The first block whose last key is not below the key is the only one
+  // which can hold it.
+  auto it = std::lower_bound(
+      index_.begin(), index_.end(), key,
+      [](const BlockHandle &handle, std::string_view key) {
+        return std::string_view(handle.last_key) < key;
+      });
+  if (it == index_.end() || key < smallest_) {
+    return std::nullopt;
+  }
+
+  BlockCache::BlockPtr block;
+  if (cache_ != nullptr) {
+    block = cache_->Lookup(number_, it->offset);
+  }
+  if (!block) {
+    block = std::make_shared<const std::string>(
+        ReadBlock(it - index_.begin()));
+    if (read_bytes_ != nullptr) {
+      read_bytes_->fetch_add(block->size(), std::memory_order_relaxed);
+    }
+    if (cache_ != nullptr) {
+      cache_->Insert(number_, it->offset, block);
+    }
+  }
+
+  size_t position = 0;
+  Record record;
+  while (position < block->size()) {
+    ParseRecord(*block, &position, &record);
+    if (record.key < key) {
+      continue;
+    }
+    if (record.key > key) {
+      break;
+    }
+    return Found{std::string(record.value), record.version, record.removed};
+  }
+  return std::nullopt;
+}
+
+SortedRun::Iterator::Iterator(std::shared_ptr<const SortedRun> run)
+    : run_(std::move(run)) {
+  Parse();
+}
+
+void SortedRun::Iterator::Next() { Parse(); }
+
+void SortedRun::Iterator::Parse() {
+  while (position_ >= block_.size()) {
+    if (block_index_ >= run_->index_.size()) {
+      valid_ = false;
+      return;
+    }
+    block_ = run_->ReadBlock(block_index_++);
+    position_ = 0;
+  }
+  ParseRecord(block_, &position_, &record_);
+  valid_ = true;
+}
+}  // namespace cs499_fei
@@ -0,0 +1,215 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_SORTED_RUN_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_SORTED_RUN_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "block_cache.h"
+#include "bloom_filter.h"
+
+namespace cs499_fei {
+// An immutable file of records in key order, written once by a flush of the
+// memtable or by a compaction of the LSM engine, with a block index kept in
+// memory, so a lookup reads at most one data block.
+//
+// File layout, in host (little-endian) byte order:
+//   data blocks: per record, u8 type (put or remove), u32 key size, u32 value
+//                size, u64 version, key bytes, value bytes. A block is cut
+//                after the record which fills it to the block size.
+//   filter:      the blocks of a Bloom filter of the keys, if any
+//   index:       u32 size and bytes of the smallest key, then per block, u32
+//                size and bytes of its last key, u64 offset, u32 bytes, u32
+//                CRC-32 of the block
+//   footer:      u64 index offset, u64 index bytes, u64 record count, u32
+//                CRC-32 of the filter and the index, u32 filter bytes (0
+//                without a filter), magic "KVSRUN01"
+//
+// A run holds every key at most once. The file is written next to its name
+// and renamed into place. A corrupt run is fatal. The filter and the index
+// stay in memory while the run is open.
+class SortedRun {
+ public:
+  // Identifies a run at the end of the file.
+  static constexpr char kMagic[] = "KVSRUN01";
+
+  // Bytes of the footer.
+  static constexpr size_t kFooterSize = 40;
+
+  // Types of the records.
+  static constexpr uint8_t kPut = 1;
+  static constexpr uint8_t kRemove = 2;
+
+  // A record of a run. The views live as long as the block or the builder
+  // argument they point into.
+  struct Record {
+    std::string_view key;
+    std::string_view value;
+    uint64_t version = 0;
+    bool removed = false;
+  };
+
+  // The state of a key found in a run.
+  struct Found {
+    std::string value;
+    uint64_t version = 0;
+    bool removed = false;
+  };
+
+  // Writes a run file from records added in key order.
+  class Builder {
+   public:
+    // Start the run file, cutting blocks of about block_size bytes, with a
+    // filter of bits_per_key bits per key, none if 0.
+    Builder(const std::string &file_name, size_t block_size,
+            size_t bits_per_key = BloomFilter::kDefaultBitsPerKey);
+
+    // Remove the unfinished file.
+    ~Builder();
+
+    Builder(const Builder &) = delete;
+    Builder &operator=(const Builder &) = delete;
+
+    // Append a record. Its key must be greater than every key added before.
+    void Add(const Record &record);
+
+    // Whether no record was added.
+    bool empty() const { return count_ == 0; }
+
+    // Bytes of the file so far.
+    uint64_t FileSize() const { return offset_ + block_.size(); }
+
+    // Write the filter, the index and the footer, sync the file and rename it
+    // into place. Return its size.
+    uint64_t Finish();
+
+   private:
+    // Write the block being built and index it.
+    void FlushBlock();
+
+    std::string file_name_;
+    std::string tmp_file_;
+    size_t block_size_;
+    size_t bits_per_key_;
+    int fd_ = -1;
+    uint64_t offset_ = 0;
+    uint64_t count_ = 0;
+    std::string block_;
+    std::string last_key_;
+    std::string index_;
+    std::vector<uint64_t> hashes_;
+  };
+
+  // Reads the records of a run in key order, one block at a time, bypassing
+  // the block cache.
+  class Iterator {
+   public:
+    explicit Iterator(std::shared_ptr<const SortedRun> run);
+
+    // Whether the iterator is on a record.
+    bool Valid() const { return valid_; }
+
+    // The current record, valid until Next.
+    const Record &record() const { return record_; }
+
+    // Move to the next record.
+    void Next();
+
+   private:
+    // Parse the record at the position, loading the next block as needed.
+    void Parse();
+
+    std::shared_ptr<const SortedRun> run_;
+    size_t block_index_ = 0;
+    std::string block_;
+    size_t position_ = 0;
+    Record record_;
+    bool valid_ = false;
+  };
+
+  // Open the run file with its number, reading its index. Blocks read by
+  // lookups go through the cache and are counted in read_bytes, if given.
+  static std::shared_ptr<SortedRun> Open(uint64_t number,
+                                         const std::string &file_name,
+                                         BlockCache *cache,
+                                         std::atomic<uint64_t> *read_bytes);
+
+  // Close the file, and delete it if the run is obsolete.
+  ~SortedRun();
+
+  SortedRun(const SortedRun &) = delete;
+  SortedRun &operator=(const SortedRun &) = delete;
+
+  // Find the record of the key. Return nullopt if the run does not hold it.
+  // The filter is not consulted, callers probe it first with MayContain.
+  std::optional<Found> Get(std::string_view key) const;
+
+  // Whether the run may hold the key with the BloomFilter::Hash. False means
+  // it does not. A run without a filter may hold any key.
+  bool MayContain(uint64_t hash) const {
+    return !filter_ || filter_->MayContain(hash);
+  }
+
+  // Whether the run has a filter.
+  bool has_filter() const { return filter_ != nullptr; }
+
+  // Bytes of the filter, 0 without one.
+  size_t filter_bytes() const { return filter_ ? filter_->bytes() : 0; }
+
+  // Whether the key is in the range of the run.
+  bool Covers(std::string_view key) const {
+    return key >= smallest_ && key <= largest_;
+  }
+
+  // Whether the run holds keys in [smallest, largest].
+  bool Overlaps(std::string_view smallest, std::string_view largest) const {
+    return !(largest_ < smallest || largest < smallest_);
+  }
+
+  // Delete the file once the last reader releases the run.
+  void MarkObsolete() { obsolete_ = true; }
+
+  uint64_t number() const { return number_; }
+  const std::string &smallest() const { return smallest_; }
+  const std::string &largest() const { return largest_; }
+  uint64_t file_size() const { return file_size_; }
+  uint64_t count() const { return count_; }
+
+ private:
+  // A data block of the index.
+  struct BlockHandle {
+    std::string last_key;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t crc;
+  };
+
+  SortedRun() = default;
+
+  // Read and check block i from the file.
+  std::string ReadBlock(size_t i) const;
+
+  // Parse the record at position of the block into record, and move position
+  // past it.
+  static void ParseRecord(const std::string &block, size_t *position,
+                          Record *record);
+
+  uint64_t number_ = 0;
+  std::string file_name_;
+  int fd_ = -1;
+  uint64_t file_size_ = 0;
+  uint64_t count_ = 0;
+  std::string smallest_;
+  std::string largest_;
+  std::vector<BlockHandle> index_;
+  std::unique_ptr<BloomFilter> filter_;
+  BlockCache *cache_ = nullptr;
+  std::atomic<uint64_t> *read_bytes_ = nullptr;
+  std::atomic<bool> obsolete_{false};
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_SORTED_RUN_H_
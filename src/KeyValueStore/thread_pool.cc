@@ -0,0 +1,49 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace cs499_fei {
+ThreadPool::ThreadPool(size_t threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  workers_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this] { WorkLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(pool_locker_);
+    stop_ = true;
+  }
+  pool_cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Enqueue(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(pool_locker_);
+    tasks_.push_back(std::move(task));
+  }
+  pool_cv_.notify_one();
+}
+
+void ThreadPool::WorkLoop() {
+  std::unique_lock<std::mutex> lock(pool_locker_);
+  while (true) {
+    pool_cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+    if (tasks_.empty()) {
+      return;
+    }
+    std::function<void()> task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+}  // namespace cs499_fei
@@ -0,0 +1,60 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_THREAD_POOL_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace cs499_fei {
+// Fixed set of worker threads which run submitted tasks in submission order.
+// Used for background CPU work, such as compressing snapshot blocks, so it
+// never runs on the threads serving requests.
+class ThreadPool {
+ public:
+  // Start the workers, 0 for one per hardware thread.
+  explicit ThreadPool(size_t threads);
+
+  // Run the tasks still queued, then stop the workers.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Queue the task and return the future of its result.
+  template <typename F>
+  std::future<std::invoke_result_t<F>> Submit(F task) {
+    using Result = std::invoke_result_t<F>;
+    // std::function needs a copyable task, so the packaged task is shared.
+    auto packaged =
+        std::make_shared<std::packaged_task<Result()>>(std::move(task));
+    std::future<Result> result = packaged->get_future();
+    Enqueue([packaged] { (*packaged)(); });
+    return result;
+  }
+
+  // Number of worker threads.
+  size_t Size() const { return workers_.size(); }
+
+ private:
+  // Add the task to the queue and wake a worker.
+  void Enqueue(std::function<void()> task);
+
+  // Run the queued tasks until the pool is destroyed.
+  void WorkLoop();
+
+  // Guards the queue and stop_.
+  std::mutex pool_locker_;
+  std::condition_variable pool_cv_;
+  std::deque<std::function<void()>> tasks_;
+  bool stop_ = false;
+
+  std::vector<std::thread> workers_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_THREAD_POOL_H_
@@ -1,61 +1,776 @@
 #include "threadsafe_map.h"
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 
+#include <glog/logging.h>
+
 namespace cs499_fei {
+namespace {
+// Milliseconds of the steady clock, the time base of the TTL deadlines.
+uint64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+}  // namespace
+
+ThreadsafeMap::Shard::Shard()
+    : arena(std::make_shared<SlabArena>()),
+      data(0, std::hash<std::string_view>{}, std::equal_to<std::string_view>{},
+           ArenaKVMap::allocator_type(arena)),
+      wheel(NowMs()) {}
+
+ThreadsafeMap::Shard::~Shard() { delete filter.load(); }
+
+// Constructor with the number of shards
+ThreadsafeMap::ThreadsafeMap(size_t shard_count) {
+  InitShards(shard_count);
+  SetFilterBitsPerKey(filter_bits_per_key_);
+}
+
 // Constructor with persistence flag
-ThreadsafeMap::ThreadsafeMap(const PersistPtr &persist_ptr, const std::string &file_name) {
+ThreadsafeMap::ThreadsafeMap(const PersistPtr &persist_ptr,
+                             const std::string &file_name, size_t shard_count) {
+  InitShards(shard_count);
   persist_ptr_ = persist_ptr;
   file_name_ = file_name;
-  data_ = persist_ptr_->deserialize(file_name_);
+  persist_ptr_->load(file_name_,
+                     [this](std::string_view key, std::string_view value) {
+                       Put(std::string(key), value);
+                     });
+  // the filters are built once every key is loaded, not grown along.
+  SetFilterBitsPerKey(filter_bits_per_key_);
+  // the loaded data is what the store holds, so only later writes are dirty.
+  if (persist_ptr_->SupportsDeltas()) {
+    for (auto &shard : shards_) {
+      shard->track_dirty = true;
+    }
+  }
 }
 
 // Copy constructor
-ThreadsafeMap::ThreadsafeMap(const ThreadsafeMap &other) {
-  std::lock_guard<std::mutex> lock(other.data_locker_);
-  data_ = other.data_;
-  file_name_ = other.file_name_;
-  persist_ptr_ = other.persist_ptr_;
-}
+ThreadsafeMap::ThreadsafeMap(const ThreadsafeMap &other) { CopyFrom(other); }
 
 // Move constructor
 ThreadsafeMap &ThreadsafeMap::operator=(const ThreadsafeMap &other) {
   if (&other != this) {
-    std::lock_guard<std::mutex> lock(other.data_locker_);
-    data_ = other.data_;
-    file_name_ = other.file_name_;
-    persist_ptr_ = other.persist_ptr_;
+    CopyFrom(other);
   }
   return *this;
 }
 
-bool ThreadsafeMap::Put(const std::string &key, const std::string &value) {
-  std::lock_guard<std::mutex> lock(data_locker_);
-  data_[key] = value;
+ThreadsafeMap::~ThreadsafeMap() {
+  {
+    std::lock_guard<std::mutex> lock(compaction_locker_);
+    stop_compaction_ = true;
+  }
+  compaction_cv_.notify_all();
+  if (compaction_thread_.joinable()) {
+    compaction_thread_.join();
+  }
+}
+
+void ThreadsafeMap::InitShards(size_t shard_count) {
+  shards_.clear();
+  // at least one shard is needed to hold any data.
+  shard_count = std::max<size_t>(shard_count, 1);
+  for (size_t i = 0; i < shard_count; ++i) {
+    shards_.push_back(std::make_unique<Shard>());
+    shards_.back()->epochs = &epochs_;
+  }
+}
+
+void ThreadsafeMap::CopyFrom(const ThreadsafeMap &other) {
+  InitShards(other.shards_.size());
+  // Both maps shard by the same hash, so shard i only receives the keys of
+  // the other's shard i. The values are shared, their arena stays alive as
+  // long as they are referenced.
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    std::shared_lock<std::shared_mutex> lock(other.shards_[i]->data_locker);
+    Shard &shard = *shards_[i];
+    shard.data.reserve(other.shards_[i]->data.size());
+    for (const auto &p : other.shards_[i]->data) {
+      InsertLocked(shard, p.first, p.second.value, p.second.expires_ms)
+          ->second.version = p.second.version;
+    }
+    shard.last_version = other.shards_[i]->last_version;
+    shard.track_dirty = other.shards_[i]->track_dirty;
+    shard.dirty = other.shards_[i]->dirty;
+  }
+  file_name_ = other.file_name_;
+  persist_ptr_ = other.persist_ptr_;
+  shard_budget_ = other.shard_budget_.load();
+  filter_bits_per_key_ = other.filter_bits_per_key_;
+  SetFilterBitsPerKey(filter_bits_per_key_);
+}
+
+ThreadsafeMap::Shard &ThreadsafeMap::ShardFor(const std::string &key) const {
+  // The shard hashmaps bucket on the same hash, so pick the shard from the
+  // high bits to keep the buckets inside each shard evenly used.
+  size_t hash = std::hash<std::string>{}(key);
+  size_t index = (hash >> 16) % shards_.size();
+  return *shards_[index];
+}
+
+std::string_view ThreadsafeMap::CopyKey(Shard &shard, std::string_view key) {
+  char *bytes = static_cast<char *>(shard.arena->Allocate(key.size()));
+  std::memcpy(bytes, key.data(), key.size());
+  return std::string_view(bytes, key.size());
+}
+
+bool ThreadsafeMap::Expired(const Entry &entry, uint64_t now_ms) {
+  return entry.expires_ms != 0 && entry.expires_ms <= now_ms;
+}
+
+ValuePtr ThreadsafeMap::NewValue(Shard &shard, std::string_view value) {
+  return std::allocate_shared<const ArenaString>(
+      ArenaAllocator<ArenaString>(shard.arena), value.data(), value.size(),
+      ArenaAllocator<char>(shard.arena));
+}
+
+size_t ThreadsafeMap::Charge(std::string_view key, const ValuePtr &value) {
+  return kEntryOverhead + key.size() + (value ? value->size() : 0);
+}
+
+ThreadsafeMap::ArenaKVMap::value_type *ThreadsafeMap::InsertLocked(
+    Shard &shard, std::string_view key, ValuePtr value, uint64_t expires_ms) {
+  shard.bytes += Charge(key, value);
+  auto it =
+      shard.data.emplace(CopyKey(shard, key), Entry(std::move(value))).first;
+  it->second.expires_ms = expires_ms;
+  it->second.version = ++shard.last_version;
+  if (expires_ms != 0) {
+    shard.wheel.Schedule(std::string(key), expires_ms);
+  }
+  // a new entry starts cold, so a scan over many new keys evicts itself
+  // before the entries which are read again.
+  it->second.clock_slot = shard.clock.size();
+  shard.clock.push_back(&*it);
+  shard.index.insert(it->first);
+  BloomFilter *filter = shard.filter.load(std::memory_order_relaxed);
+  if (filter != nullptr) {
+    if (++shard.filter_keys > filter->capacity()) {
+      RebuildFilterLocked(shard);
+    } else {
+      filter->Add(BloomFilter::Hash(key));
+    }
+  }
+  return &*it;
+}
+
+void ThreadsafeMap::RebuildFilterLocked(Shard &shard) {
+  BloomFilter *filter = nullptr;
+  if (shard.filter_bits_per_key > 0) {
+    filter = new BloomFilter(std::max(2 * shard.data.size(), kMinFilterKeys),
+                             shard.filter_bits_per_key);
+    for (const auto &p : shard.data) {
+      filter->Add(BloomFilter::Hash(p.first));
+    }
+  }
+  shard.filter_keys = shard.data.size();
+  // readers which loaded the old filter may still probe it.
+  BloomFilter *old = shard.filter.exchange(filter, std::memory_order_acq_rel);
+  if (old != nullptr) {
+    shard.epochs->Retire(old);
+  }
+}
+
+ValuePtr ThreadsafeMap::EraseLocked(Shard &shard, ArenaKVMap::iterator it) {
+  TrackWriteLocked(shard, it->first, &it->second);
+  ValuePtr value = std::move(it->second.value);
+  std::string_view key = it->first;
+  shard.bytes -= Charge(key, value);
+
+  // fill the hole in the clock with its last entry.
+  size_t slot = it->second.clock_slot;
+  shard.clock[slot] = shard.clock.back();
+  shard.clock[slot]->second.clock_slot = slot;
+  shard.clock.pop_back();
+
+  shard.index.erase(key);
+  shard.data.erase(it);
+  shard.arena->Deallocate(const_cast<char *>(key.data()), key.size());
+  return value;
+}
+
+void ThreadsafeMap::TrackWriteLocked(Shard &shard, std::string_view key,
+                                     const Entry *entry) {
+  if (shard.track_dirty) {
+    shard.dirty.emplace(key);
+  }
+  if (!shard.snapshot_pending) {
+    return;
+  }
+  // only the first write since the snapshot sees the value it holds.
+  ValuePtr value;
+  if (entry != nullptr && entry->expires_ms == 0) {
+    value = entry->value;
+  }
+  shard.frozen.try_emplace(std::string(key), std::move(value));
+}
+
+void ThreadsafeMap::EvictLocked(Shard &shard, size_t budget,
+                                const ArenaKVMap::value_type *keep,
+                                std::vector<ValuePtr> *evicted) {
+  // Every sweep of the hand takes one hit from the entries it passes, so the
+  // loop ends after at most kMaxClockHits + 1 sweeps.
+  while (shard.bytes > budget && !shard.clock.empty()) {
+    if (shard.hand >= shard.clock.size()) {
+      shard.hand = 0;
+    }
+    auto *entry = shard.clock[shard.hand];
+    if (entry == keep) {
+      ++shard.hand;
+      continue;
+    }
+    uint8_t hits = entry->second.hits.load(std::memory_order_relaxed);
+    if (hits > 0) {
+      entry->second.hits.store(hits - 1, std::memory_order_relaxed);
+      ++shard.hand;
+      continue;
+    }
+    // the last entry moves into the hand's slot, so the hand stays.
+    evicted->push_back(EraseLocked(shard, shard.data.find(entry->first)));
+    shard.evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void ThreadsafeMap::ExpireLocked(Shard &shard, uint64_t now_ms,
+                                 std::vector<ValuePtr> *expired) {
+  for (auto &timer : shard.wheel.Advance(now_ms)) {
+    auto it = shard.data.find(timer.key);
+    // the key was removed, or put again with another deadline.
+    if (it == shard.data.end() || it->second.expires_ms != timer.expires_ms) {
+      continue;
+    }
+    expired->push_back(EraseLocked(shard, it));
+    shard.expirations.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+uint64_t ThreadsafeMap::PutLocked(Shard &shard, const std::string &key,
+                                  ValuePtr value, uint64_t expires_ms,
+                                  size_t budget,
+                                  std::vector<ValuePtr> *released) {
+  // reclaim the expired keys while the lock is held anyway, before the
+  // write, so an entry written with a passed deadline is not erased under
+  // it.
+  uint64_t now_ms = NowMs();
+  if (shard.wheel.Behind(now_ms)) {
+    ExpireLocked(shard, now_ms, released);
+  }
+  ArenaKVMap::value_type *entry;
+  auto it = shard.data.find(key);
+  if (it != shard.data.end()) {
+    TrackWriteLocked(shard, key, &it->second);
+    entry = &*it;
+    shard.bytes += Charge(key, value);
+    shard.bytes -= Charge(key, it->second.value);
+    released->push_back(std::move(it->second.value));
+    it->second.value = std::move(value);
+    // the entry may be the hand's next victim, keep it in the cache.
+    if (it->second.hits.load(std::memory_order_relaxed) == 0) {
+      it->second.hits.store(1, std::memory_order_relaxed);
+    }
+    it->second.expires_ms = expires_ms;
+    it->second.version = ++shard.last_version;
+    if (expires_ms != 0) {
+      shard.wheel.Schedule(key, expires_ms);
+    }
+  } else {
+    TrackWriteLocked(shard, key, nullptr);
+    entry = InsertLocked(shard, key, std::move(value), expires_ms);
+  }
+  if (budget > 0) {
+    EvictLocked(shard, budget, entry, released);
+  }
+  return entry->second.version;
+}
+
+bool ThreadsafeMap::PutInShard(Shard &shard, const std::string &key,
+                               ValuePtr value, uint64_t expires_ms) {
+  size_t budget = shard_budget_.load(std::memory_order_relaxed);
+  if (budget > 0 && Charge(key, value) > budget) {
+    return false;
+  }
+
+  // Release the replaced and evicted values after unlocking, their last
+  // reference may free a large buffer.
+  std::vector<ValuePtr> released;
+  {
+    std::unique_lock<std::shared_mutex> lock(shard.data_locker);
+    PutLocked(shard, key, std::move(value), expires_ms, budget, &released);
+  }
   return true;
 }
 
-std::optional<std::string> ThreadsafeMap::Get(const std::string &key) const {
-  std::lock_guard<std::mutex> lock(data_locker_);
+bool ThreadsafeMap::PutShared(const std::string &key, ValuePtr value) {
+  return PutInShard(ShardFor(key), key, std::move(value), 0);
+}
+
+bool ThreadsafeMap::Put(const std::string &key, std::string_view value) {
+  Shard &shard = ShardFor(key);
+  ValuePtr shared = NewValue(shard, value);
+  return PutInShard(shard, key, std::move(shared), 0);
+}
+
+bool ThreadsafeMap::PutWithTtl(const std::string &key, std::string_view value,
+                               std::chrono::milliseconds ttl) {
+  Shard &shard = ShardFor(key);
+  ValuePtr shared = NewValue(shard, value);
+  // a deadline of 0 means no expiry, so expire at the earliest 1ms in.
+  uint64_t expires_ms = NowMs() + std::max<int64_t>(ttl.count(), 0);
+  return PutInShard(shard, key, std::move(shared),
+                    std::max<uint64_t>(expires_ms, 1));
+}
+
+bool ThreadsafeMap::Append(const std::string &key, const std::string &suffix,
+                           const std::string &separator) {
+  Shard &shard = ShardFor(key);
+  size_t budget = shard_budget_.load(std::memory_order_relaxed);
+  std::vector<ValuePtr> released;
+  {
+    // The read and the write happen under one exclusive lock, so concurrent
+    // appends to the same key never lose each other.
+    std::unique_lock<std::shared_mutex> lock(shard.data_locker);
+    auto it = shard.data.find(key);
+    uint64_t expires_ms = 0;
+    // the result is built in the arena, so it is copied only once.
+    ArenaString value{ArenaAllocator<char>(shard.arena)};
+    if (it != shard.data.end() && it->second.value &&
+        !Expired(it->second, NowMs())) {
+      // an appended list keeps the TTL of the list.
+      expires_ms = it->second.expires_ms;
+      const ArenaString &old_value = *it->second.value;
+      value.reserve(old_value.size() + separator.size() + suffix.size());
+      value.append(old_value).append(separator).append(suffix);
+    } else {
+      value.assign(suffix.data(), suffix.size());
+    }
+    ValuePtr shared = std::allocate_shared<const ArenaString>(
+        ArenaAllocator<ArenaString>(shard.arena), std::move(value));
+    if (budget > 0 && Charge(key, shared) > budget) {
+      return false;
+    }
+    PutLocked(shard, key, std::move(shared), expires_ms, budget, &released);
+  }
+  return true;
+}
+
+ThreadsafeMap::PutStatus ThreadsafeMap::ConditionalPut(
+    const std::string &key, const std::string &value,
+    uint64_t expected_version, uint64_t *version) {
+  Shard &shard = ShardFor(key);
+  size_t budget = shard_budget_.load(std::memory_order_relaxed);
+  ValuePtr shared = NewValue(shard, value);
+  if (budget > 0 && Charge(key, shared) > budget) {
+    return PutStatus::kFull;
+  }
+
+  std::vector<ValuePtr> released;
+  {
+    std::unique_lock<std::shared_mutex> lock(shard.data_locker);
+    auto it = shard.data.find(key);
+    // an expired key does not exist for writers either.
+    uint64_t current = kNoVersion;
+    if (it != shard.data.end() && !Expired(it->second, NowMs())) {
+      current = it->second.version;
+    }
+    if (current != expected_version) {
+      *version = current;
+      return PutStatus::kConflict;
+    }
+    *version = PutLocked(shard, key, std::move(shared), 0, budget, &released);
+  }
+  return PutStatus::kStored;
+}
+
+ValuePtr ThreadsafeMap::GetVersioned(const std::string &key,
+                                     uint64_t *version) const {
+  const Shard &shard = ShardFor(key);
+  *version = kNoVersion;
+  bool filtered = false;
+  if (shard.filter.load(std::memory_order_relaxed) != nullptr) {
+    EpochManager::Guard guard(epochs_);
+    const BloomFilter *filter = shard.filter.load(std::memory_order_acquire);
+    if (filter != nullptr) {
+      // a definite miss never touches the lock.
+      if (!filter->MayContain(BloomFilter::Hash(key))) {
+        shard.filter_negatives.fetch_add(1, std::memory_order_relaxed);
+        shard.misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      filtered = true;
+    }
+  }
+
+  std::shared_lock<std::shared_mutex> lock(shard.data_locker);
+  auto it = shard.data.find(key);
   // key does not exist.
-  if (!data_.count(key)) {
-    return std::nullopt;
+  if (it == shard.data.end()) {
+    if (filtered) {
+      shard.filter_false_positives.fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  const Entry &entry = it->second;
+  // an expired key is gone for readers, even before it is erased.
+  if (Expired(entry, NowMs())) {
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  shard.hits.fetch_add(1, std::memory_order_relaxed);
+  // racing readers may lose an increment, which CLOCK tolerates.
+  uint8_t hits = entry.hits.load(std::memory_order_relaxed);
+  if (hits < kMaxClockHits) {
+    entry.hits.store(hits + 1, std::memory_order_relaxed);
   }
 
   // return the value based on a key, if it exists in the hashmap.
-  return data_.at(key);
+  *version = entry.version;
+  return entry.value;
+}
+
+ValuePtr ThreadsafeMap::GetShared(const std::string &key) const {
+  uint64_t version;
+  return GetVersioned(key, &version);
+}
+
+ValuePtr ThreadsafeMap::GetWithTtl(const std::string &key,
+                                   std::chrono::milliseconds *ttl) const {
+  const Shard &shard = ShardFor(key);
+  *ttl = std::chrono::milliseconds::zero();
+  std::shared_lock<std::shared_mutex> lock(shard.data_locker);
+  auto it = shard.data.find(key);
+  if (it == shard.data.end()) {
+    return nullptr;
+  }
+  const Entry &entry = it->second;
+  uint64_t now_ms = NowMs();
+  if (Expired(entry, now_ms)) {
+    return nullptr;
+  }
+  if (entry.expires_ms != 0) {
+    *ttl = std::chrono::milliseconds(entry.expires_ms - now_ms);
+  }
+  return entry.value;
 }
 
 void ThreadsafeMap::Remove(const std::string &key) {
-  std::lock_guard<std::mutex> lock(data_locker_);
-  data_.erase(key);
+  Shard &shard = ShardFor(key);
+  // Release the removed value after unlocking.
+  ValuePtr old_value;
+  {
+    std::unique_lock<std::shared_mutex> lock(shard.data_locker);
+    auto it = shard.data.find(key);
+    if (it == shard.data.end()) {
+      return;
+    }
+    old_value = EraseLocked(shard, it);
+  }
 }
 
 void ThreadsafeMap::Store(const std::string &file_name) {
+  Snapshot(file_name)();
+}
+
+SnapshotWriter ThreadsafeMap::Snapshot(const std::string &file_name) {
   if (!persist_ptr_) {
+    return [] {};
+  }
+
+  // The lock moves into the writer, so the next snapshot waits until it has
+  // stored this one.
+  auto snapshot_lock =
+      std::make_shared<std::unique_lock<std::mutex>>(snapshot_locker_);
+  // The keys written up to the snapshot move out of the shards with the
+  // mark, the shards start tracking the next delta.
+  // A delta only extends the file the previous snapshots went to.
+  std::shared_ptr<std::vector<std::unordered_set<std::string>>> dirty;
+  if (persist_ptr_->SupportsDeltas() && file_name == file_name_) {
+    dirty = std::make_shared<std::vector<std::unordered_set<std::string>>>(
+        shards_.size());
+  }
+  // Mark every shard under one hold of all shard locks, so the snapshot is
+  // one point in time across shards. Nothing else holds two shard locks.
+  {
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    locks.reserve(shards_.size());
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      locks.emplace_back(shards_[i]->data_locker);
+      shards_[i]->snapshot_pending = true;
+      if (dirty) {
+        (*dirty)[i].swap(shards_[i]->dirty);
+      }
+    }
+  }
+  return [this, snapshot_lock, file_name, dirty] {
+    WriteSnapshot(file_name, dirty.get());
+    snapshot_lock->unlock();
+  };
+}
+
+void ThreadsafeMap::WriteSnapshot(
+    const std::string &file_name,
+    const std::vector<std::unordered_set<std::string>> *dirty) {
+  StringKVMap snapshot;
+  std::vector<std::string> removed;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    Shard &shard = *shards_[i];
+    // Gather references to the values, holding one shard lock at a time, and
+    // copy them out of the lock. nullptr marks a dirty key which is gone.
+    SharedKVMap shared;
+    {
+      std::shared_lock<std::shared_mutex> lock(shard.data_locker);
+      if (dirty) {
+        for (const auto &key : (*dirty)[i]) {
+          auto it = shard.data.find(key);
+          bool stored = it != shard.data.end() && it->second.expires_ms == 0;
+          shared.emplace(key, stored ? it->second.value : nullptr);
+        }
+      } else {
+        for (const auto &p : shard.data) {
+          if (p.second.expires_ms != 0) {
+            continue;
+          }
+          shared.emplace(std::string(p.first), p.second.value);
+        }
+      }
+    }
+    // The keys written since the snapshot was taken, up to now, go back to
+    // their values at that time. Writes after this point are not frozen.
+    std::unordered_map<std::string, ValuePtr> frozen;
+    {
+      std::unique_lock<std::shared_mutex> lock(shard.data_locker);
+      frozen.swap(shard.frozen);
+      shard.snapshot_pending = false;
+    }
+    for (auto &p : frozen) {
+      // a key first written after the snapshot belongs to the next delta.
+      if (dirty && (*dirty)[i].count(p.first) == 0) {
+        continue;
+      }
+      shared[p.first] = std::move(p.second);
+    }
+    for (const auto &p : shared) {
+      if (p.second) {
+        snapshot[p.first] = *p.second;
+      } else if (dirty) {
+        removed.push_back(p.first);
+      }
+    }
+  }
+  if (dirty) {
+    persist_ptr_->serialize_delta(snapshot, removed, file_name);
+  } else {
+    persist_ptr_->serialize(snapshot, file_name);
+  }
+}
+
+ScanPairs ThreadsafeMap::Scan(const std::string &start,
+                              const std::string &end, size_t limit) const {
+  ScanPairs pairs;
+  uint64_t now_ms = NowMs();
+  // The first limit pairs are among the first limit pairs of every shard.
+  for (const auto &shard : shards_) {
+    std::shared_lock<std::shared_mutex> lock(shard->data_locker);
+    size_t taken = 0;
+    for (auto key = shard->index.lower_bound(start);
+         key != shard->index.end() && taken < limit; ++key) {
+      if (!end.empty() && *key >= end) {
+        break;
+      }
+      const Entry &entry = shard->data.find(*key)->second;
+      if (Expired(entry, now_ms)) {
+        continue;
+      }
+      pairs.emplace_back(std::string(*key), entry.value);
+      ++taken;
+    }
+  }
+  std::sort(pairs.begin(), pairs.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+  if (pairs.size() > limit) {
+    pairs.resize(limit);
+  }
+  return pairs;
+}
+
+size_t ThreadsafeMap::CompactShard(Shard &shard, double max_occupancy) {
+  std::unique_lock<std::shared_mutex> lock(shard.data_locker);
+  // most keys of the filter were removed, which raises its false positives.
+  if (shard.filter.load(std::memory_order_relaxed) != nullptr &&
+      shard.filter_keys > kMinFilterKeys &&
+      shard.filter_keys > 2 * shard.data.size()) {
+    RebuildFilterLocked(shard);
+  }
+  std::vector<uintptr_t> slabs = shard.arena->BeginEvacuation(max_occupancy);
+  if (slabs.empty()) {
+    return 0;
+  }
+
+  size_t moved = 0;
+  // Values are copied in place. Nodes and keys are extracted first and
+  // inserted again after the walk, which keeps the iteration valid.
+  std::vector<std::pair<ArenaKVMap::node_type, bool>> nodes;
+  for (auto it = shard.data.begin(); it != shard.data.end();) {
+    ValuePtr &value = it->second.value;
+    // the payload of a value may lie in another slab than its control block.
+    if (value && (SlabArena::InSlabs(slabs, value.get()) ||
+                  SlabArena::InSlabs(slabs, value->data()))) {
+      value = NewValue(shard, *value);
+      ++moved;
+    }
+    bool node_moves = SlabArena::InSlabs(slabs, &*it);
+    bool key_moves = SlabArena::InSlabs(slabs, it->first.data());
+    if (!node_moves && !key_moves) {
+      ++it;
+      continue;
+    }
+    auto next = std::next(it);
+    nodes.emplace_back(shard.data.extract(it), node_moves);
+    it = next;
+  }
+
+  for (auto &[node, node_moves] : nodes) {
+    std::string_view key = node.key();
+    if (SlabArena::InSlabs(slabs, key.data())) {
+      node.key() = CopyKey(shard, key);
+      // point the index at the new bytes, reusing its tree node.
+      auto index_node = shard.index.extract(key);
+      index_node.value() = node.key();
+      shard.index.insert(std::move(index_node));
+      shard.arena->Deallocate(const_cast<char *>(key.data()), key.size());
+      ++moved;
+    }
+    if (node_moves) {
+      // a new node comes from a dense slab, the old one is freed with the
+      // node handle.
+      auto it = shard.data.emplace(node.key(), std::move(node.mapped())).first;
+      shard.clock[it->second.clock_slot] = &*it;
+      ++moved;
+    } else {
+      shard.data.insert(std::move(node));
+    }
+  }
+  return moved;
+}
+
+size_t ThreadsafeMap::Expire() {
+  size_t count = 0;
+  uint64_t now_ms = NowMs();
+  for (auto &shard : shards_) {
+    std::vector<ValuePtr> expired;
+    std::unique_lock<std::shared_mutex> lock(shard->data_locker);
+    ExpireLocked(*shard, now_ms, &expired);
+    count += expired.size();
+  }
+  return count;
+}
+
+size_t ThreadsafeMap::Compact(double max_occupancy) {
+  size_t moved = 0;
+  // One shard at a time, the other shards keep serving requests.
+  for (auto &shard : shards_) {
+    moved += CompactShard(*shard, max_occupancy);
+  }
+  return moved;
+}
+
+void ThreadsafeMap::StartCompaction(std::chrono::seconds interval) {
+  compaction_thread_ = std::thread([this, interval] {
+    std::unique_lock<std::mutex> lock(compaction_locker_);
+    while (!compaction_cv_.wait_for(lock, interval,
+                                    [this] { return stop_compaction_; })) {
+      lock.unlock();
+      size_t expired = Expire();
+      size_t moved = Compact();
+      MemoryStats stats = GetMemoryStats();
+      CacheStats cache = GetCacheStats();
+      FilterStats filters = GetFilterStats();
+      LOG(INFO) << "Compaction moved " << moved << " objects. Keys: "
+                << stats.keys << ", arena bytes: " << stats.arena_bytes
+                << ", bytes/key: " << stats.BytesPerKey()
+                << ". Hits: " << cache.hits << ", misses: " << cache.misses
+                << ", evictions: " << cache.evictions
+                << ", expired this pass: " << expired
+                << ". Filter negatives: " << filters.negatives
+                << ", false positive rate: " << filters.FalsePositiveRate();
+      lock.lock();
+    }
+  });
+}
+
+ThreadsafeMap::MemoryStats ThreadsafeMap::GetMemoryStats() const {
+  MemoryStats stats;
+  for (const auto &shard : shards_) {
+    {
+      std::shared_lock<std::shared_mutex> lock(shard->data_locker);
+      stats.keys += shard->data.size();
+    }
+    SlabArena::Stats arena_stats = shard->arena->GetStats();
+    stats.arena_bytes += arena_stats.slab_bytes + arena_stats.large_bytes;
+    stats.used_bytes += arena_stats.used_bytes + arena_stats.large_bytes;
+  }
+  return stats;
+}
+
+void ThreadsafeMap::SetMaxMemory(size_t max_memory) {
+  size_t budget = max_memory == 0 ? 0 : std::max<size_t>(
+                                            max_memory / shards_.size(), 1);
+  shard_budget_ = budget;
+  if (budget == 0) {
     return;
   }
-  persist_ptr_->serialize(data_,file_name_);
+  for (auto &shard : shards_) {
+    std::vector<ValuePtr> evicted;
+    std::unique_lock<std::shared_mutex> lock(shard->data_locker);
+    EvictLocked(*shard, budget, nullptr, &evicted);
+  }
+}
+
+ThreadsafeMap::CacheStats ThreadsafeMap::GetCacheStats() const {
+  CacheStats stats;
+  for (const auto &shard : shards_) {
+    stats.hits += shard->hits.load(std::memory_order_relaxed);
+    stats.misses += shard->misses.load(std::memory_order_relaxed);
+    stats.evictions += shard->evictions.load(std::memory_order_relaxed);
+    stats.expirations += shard->expirations.load(std::memory_order_relaxed);
+    std::shared_lock<std::shared_mutex> lock(shard->data_locker);
+    stats.bytes += shard->bytes;
+  }
+  return stats;
+}
+
+void ThreadsafeMap::SetFilterBitsPerKey(size_t bits_per_key) {
+  filter_bits_per_key_ = bits_per_key;
+  for (auto &shard : shards_) {
+    std::unique_lock<std::shared_mutex> lock(shard->data_locker);
+    shard->filter_bits_per_key = bits_per_key;
+    RebuildFilterLocked(*shard);
+  }
+}
+
+ThreadsafeMap::FilterStats ThreadsafeMap::GetFilterStats() const {
+  FilterStats stats;
+  for (const auto &shard : shards_) {
+    stats.negatives += shard->filter_negatives.load(std::memory_order_relaxed);
+    stats.false_positives +=
+        shard->filter_false_positives.load(std::memory_order_relaxed);
+    std::shared_lock<std::shared_mutex> lock(shard->data_locker);
+    const BloomFilter *filter = shard->filter.load(std::memory_order_relaxed);
+    if (filter != nullptr) {
+      stats.bytes += filter->bytes();
+    }
+  }
+  return stats;
 }
-}  // namespace cs499_fei
\ No newline at end of file
+}  // namespace cs499_fei
@@ -1,61 +1,464 @@
 #ifndef CSCI499_FEI_SRC_KEYVALUESTORE_THREADSAFE_MAP_H_
 #define CSCI499_FEI_SRC_KEYVALUESTORE_THREADSAFE_MAP_H_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <set>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "bloom_filter.h"
+#include "epoch_manager.h"
+#include "kvmap_abstraction.h"
 #include "persistence_abstraction.h"
 #include "persistence.h"
-#include "../Func/func_platform.h"
+#include "slab_arena.h"
+#include "timer_wheel.h"
 
 namespace cs499_fei {
-using PersistPtr = std::shared_ptr<PersistenceAbstraction>;
 // Threadsafe hashmap which supports safe, concurrent access by multiple
 // callers.
-class ThreadsafeMap {
+// The key space is split into shards by key hash. Each shard is a hashmap
+// guarded by its own reader-writer lock, so callers touching different shards
+// never contend on the same lock, and readers of one shard never block each
+// other.
+// Every shard allocates its hashmap nodes, key bytes and values from its own
+// SlabArena, and a background compaction moves them out of sparse slabs so
+// memory freed by removals goes back to the system.
+// With a memory limit the map works as a bounded cache: every shard evicts
+// its cold entries with a generalized CLOCK, and only ever walks its own
+// entries under its own lock.
+// Every shard also keeps its keys in an ordered index, so a scan walks each
+// shard in key order and merges them, holding one shard lock at a time.
+// Keys put with a TTL are filed in a timer wheel of their shard. They are
+// invisible to Get once expired, and erased the next time the shard is
+// written to or Expire runs.
+// A snapshot marks every shard at one point in time, then walks the shards
+// one at a time. Until the walk passes a shard, the first write to each of its
+// keys keeps the value the key had when the snapshot was taken, so the file
+// is consistent without holding writers off for the length of the dump.
+// With a persistence strategy which stores deltas, every shard also tracks
+// the keys written since the last snapshot, and a snapshot stores only those.
+// Every shard keeps a Bloom filter of its keys, which readers probe before
+// they take the shard lock, so a lookup of a missing key usually returns
+// without locking or probing the hashmap. A removed key stays in the filter
+// until it is rebuilt: when the shard outgrows it, when the compaction finds
+// most of its keys gone, and after the map is loaded from a file.
+class ThreadsafeMap : public KVMapAbstraction {
  public:
+  // Number of shards used when the caller does not specify one.
+  static constexpr size_t kDefaultShardCount = 16;
+
+  // Compaction evacuates slabs filled below this fraction.
+  static constexpr double kCompactOccupancy = 0.5;
+
+  // Highest hit count CLOCK keeps per entry. An entry read this often
+  // survives as many sweeps of the clock hand.
+  static constexpr uint8_t kMaxClockHits = 3;
+
+  // Fewest keys a shard filter is sized for, so small shards do not rebuild
+  // their filter on every few inserts.
+  static constexpr size_t kMinFilterKeys = 1024;
+
+  // Approximate bytes of bookkeeping per entry, charged against the memory
+  // limit on top of the key and value bytes: the hashmap node and bucket, the
+  // value control block and the clock slot.
+  static constexpr size_t kEntryOverhead = 144;
+
+  // Counters of the map used as a cache.
+  struct CacheStats {
+    // Get calls which found the key.
+    uint64_t hits = 0;
+
+    // Get calls which did not find the key.
+    uint64_t misses = 0;
+
+    // Entries removed to stay within the memory limit.
+    uint64_t evictions = 0;
+
+    // Entries removed because their TTL passed.
+    uint64_t expirations = 0;
+
+    // Bytes charged for all keys and values, bookkeeping included.
+    size_t bytes = 0;
+  };
+
+  // Counters of the shard filters.
+  struct FilterStats {
+    // Get calls the filters answered without the hashmap.
+    uint64_t negatives = 0;
+
+    // Get calls which passed the filter for a key not in the hashmap.
+    uint64_t false_positives = 0;
+
+    // Bytes of the filters.
+    size_t bytes = 0;
+
+    // Fraction of the Get calls for missing keys which the filters let
+    // through.
+    double FalsePositiveRate() const {
+      uint64_t absent = negatives + false_positives;
+      return absent == 0 ? 0 : static_cast<double>(false_positives) / absent;
+    }
+  };
+
+  // Memory usage of the map.
+  struct MemoryStats {
+    // Number of keys in the map.
+    size_t keys = 0;
+
+    // Bytes the shard arenas took from the system, for slabs and large
+    // allocations such as hashmap buckets.
+    size_t arena_bytes = 0;
+
+    // Bytes of the arena chunks in use.
+    size_t used_bytes = 0;
+
+    // Arena bytes per key, including the value payloads. Values put with
+    // PutShared are shared as they are and may live outside of the arena.
+    double BytesPerKey() const {
+      return keys == 0 ? 0 : static_cast<double>(arena_bytes) / keys;
+    }
+  };
+
   // Default constructor
-  ThreadsafeMap() : data_{}, data_locker_{} {};
+  ThreadsafeMap() : ThreadsafeMap(kDefaultShardCount){};
+
+  // Constructor with the number of shards.
+  // shard_count = 1 behaves as a single hashmap guarded by one mutex.
+  explicit ThreadsafeMap(size_t shard_count);
 
   // Constructor with persistence
-  ThreadsafeMap(const PersistPtr &persist_ptr, const std::string &file_name);
+  ThreadsafeMap(const PersistPtr &persist_ptr, const std::string &file_name,
+                size_t shard_count = kDefaultShardCount);
 
   // copy constructor
   ThreadsafeMap(const ThreadsafeMap&);
 
   // move constructor
+  // Must not be called while a background compaction runs.
   ThreadsafeMap &operator=(const ThreadsafeMap&);
 
-  // Put a key-value pair to the store.
-  bool Put(const std::string &key, const std::string &value);
+  // Stop the background compaction.
+  ~ThreadsafeMap() override;
+
+  // Put a key-value pair to the store, sharing the value.
+  // With a memory limit, evict cold entries of the key's shard to make room.
+  // Return false if the pair alone exceeds the limit of a shard.
+  bool PutShared(const std::string &key, ValuePtr value) override;
+
+  // Put a copy of the value, allocated in the arena of the key's shard.
+  bool Put(const std::string &key, std::string_view value) override;
+
+  // Expiry is supported.
+  bool SupportsTtl() const override { return true; }
+
+  // Put a copy of the value which expires ttl from now.
+  bool PutWithTtl(const std::string &key, std::string_view value,
+                  std::chrono::milliseconds ttl) override;
+
+  // Given the key, get the corresponding value and the time it has left to
+  // live. Unlike GetShared, the lookup is not counted as a hit or a miss.
+  ValuePtr GetWithTtl(const std::string &key,
+                      std::chrono::milliseconds *ttl) const override;
+
+  // Put a copy of the value if the key is at expected_version, checked and
+  // written under the lock of its shard.
+  PutStatus ConditionalPut(const std::string &key, const std::string &value,
+                           uint64_t expected_version,
+                           uint64_t *version) override;
+
+  // Given the key, get the corresponding value and its version.
+  ValuePtr GetVersioned(const std::string &key,
+                        uint64_t *version) const override;
+
+  // Append the separator and the suffix to the value of the key, or put the
+  // suffix if the key does not exist, as one atomic step.
+  // Return false if the result alone exceeds the limit of a shard.
+  bool Append(const std::string &key, const std::string &suffix,
+              const std::string &separator) override;
 
   // Given the key, get the corresponding value from the store.
-  // The return value std::optional<std::string>:
-  // Either contains a string value, if the key exists in the map.
-  // Or does not contain a value and is std::nullopt, if the key does not exist
-  // int the map
-  std::optional<std::string> Get(const std::string &key) const;
+  // Only a reference count is taken under the lock, the value is not copied.
+  // Return nullptr if the key does not exist in the map.
+  ValuePtr GetShared(const std::string &key) const override;
 
   // Given the key, remove the corresponding key-value pair from the store.
-  void Remove(const std::string &key);
+  void Remove(const std::string &key) override;
+
+  // Scans are supported.
+  bool SupportsScan() const override { return true; }
+
+  // Return up to limit pairs with start <= key < end, in key order. Each
+  // shard lock is held only while up to limit of its pairs are copied, and
+  // expired keys are skipped.
+  ScanPairs Scan(const std::string &start, const std::string &end,
+                 size_t limit) const override;
 
   // Store the in-memory data into the file
-  void Store(const std::string &file_name);
+  // Keys with a TTL are short-lived and left out.
+  void Store(const std::string &file_name) override;
+
+  // Take a point-in-time snapshot, holding every shard lock at once only to
+  // mark the shards, and return the function which stores it. Snapshots are
+  // taken one at a time: another one waits until the function has run.
+  // If the persistence strategy supports deltas and the file is the one the
+  // map was loaded from, only the keys written since the last snapshot are
+  // stored; any other file gets every key.
+  SnapshotWriter Snapshot(const std::string &file_name) override;
+
+  // Number of shards the key space is split into.
+  size_t ShardCount() const { return shards_.size(); }
+
+  // Move the keys, values and hashmap nodes out of slabs filled below
+  // max_occupancy, one shard at a time, and return the number of moved
+  // objects. Emptied slabs go back to the system.
+  size_t Compact(double max_occupancy = kCompactOccupancy);
+
+  // Erase the expired keys of every shard and return their number.
+  size_t Expire();
+
+  // Run Expire and Compact in a background thread every interval, until
+  // destruction.
+  void StartCompaction(std::chrono::seconds interval);
+
+  // Current memory usage of all shards.
+  MemoryStats GetMemoryStats() const;
+
+  // Bound the bytes charged for keys and values, split evenly between the
+  // shards, and evict down to it. 0 removes the bound.
+  void SetMaxMemory(size_t max_memory);
+
+  // Hit, miss and eviction counters of all shards.
+  CacheStats GetCacheStats() const;
+
+  // Rebuild the shard filters with bits_per_key bits per key. 0 drops them.
+  void SetFilterBitsPerKey(size_t bits_per_key);
+
+  // Counters of the shard filters.
+  FilterStats GetFilterStats() const;
 
  private:
-  // A hashmap to save <key, value> pair.
-  StringKVMap data_;
+  // A value in the hashmap with its CLOCK state.
+  struct Entry {
+    explicit Entry(ValuePtr value) : value(std::move(value)) {}
+
+    Entry(Entry &&other) noexcept
+        : value(std::move(other.value)),
+          hits(other.hits.load(std::memory_order_relaxed)),
+          clock_slot(other.clock_slot),
+          expires_ms(other.expires_ms),
+          version(other.version) {}
+
+    // The shared value.
+    ValuePtr value;
+
+    // Number of reads since the clock hand last passed, up to kMaxClockHits.
+    // Readers bump it under the shared lock.
+    mutable std::atomic<uint8_t> hits{0};
+
+    // Position of the entry in the clock of its shard.
+    size_t clock_slot = 0;
 
-  // For thread safety, Use a mutex to avoid race condition.
-  mutable std::mutex data_locker_;
+    // Deadline in milliseconds of the steady clock, 0 if the key never
+    // expires.
+    uint64_t expires_ms = 0;
+
+    // Version of the value. Taken from the shard counter, so a key removed
+    // and put again never repeats a version.
+    uint64_t version = kNoVersion;
+  };
+
+  // A hashmap whose nodes live in a shard arena. The keys are views of bytes
+  // allocated in the same arena.
+  using ArenaKVMap =
+      std::unordered_map<std::string_view, Entry, std::hash<std::string_view>,
+                         std::equal_to<std::string_view>,
+                         ArenaAllocator<std::pair<const std::string_view,
+                                                  Entry>>>;
+
+  // One independently locked part of the key space.
+  // Aligned to a cache line so neighbouring shard locks do not false-share.
+  struct alignas(64) Shard {
+    Shard();
+
+    // Free the filter.
+    ~Shard();
+
+    // Memory of the keys, values and hashmap nodes of this shard.
+    // Declared before data, so it outlives the hashmap.
+    std::shared_ptr<SlabArena> arena;
+
+    // A hashmap to save <key, value> pair.
+    ArenaKVMap data;
+
+    // Keys of data in order. The tree nodes live on the heap, so compaction
+    // only rewrites the views of the keys it moves.
+    std::set<std::string_view> index;
+
+    // Every entry of data in CLOCK order, and the position of the hand.
+    std::vector<ArenaKVMap::value_type *> clock;
+    size_t hand = 0;
+
+    // Bytes charged for the entries of data.
+    size_t bytes = 0;
+
+    // Deadlines of the keys with a TTL.
+    TimerWheel wheel;
+
+    // Last version given to an entry of this shard.
+    uint64_t last_version = kNoVersion;
+
+    // Whether a snapshot was taken and has not walked this shard yet.
+    bool snapshot_pending = false;
+
+    // Keys written since the snapshot was taken, with their value at that
+    // time: nullptr if the key did not exist or had a TTL.
+    std::unordered_map<std::string, ValuePtr> frozen;
+
+    // Whether the keys written are tracked for the next delta, and the keys
+    // written since the last snapshot.
+    bool track_dirty = false;
+    std::unordered_set<std::string> dirty;
+
+    // Bloom filter of the keys of data, nullptr without filters. Readers
+    // load it without the lock. It is replaced under the lock, and the old
+    // one is retired to epochs.
+    std::atomic<BloomFilter *> filter{nullptr};
+    size_t filter_bits_per_key = 0;
+    EpochManager *epochs = nullptr;
+
+    // Keys added to the filter since it was built, the removed ones
+    // included.
+    size_t filter_keys = 0;
+
+    // Filter counters, updated without the lock.
+    mutable std::atomic<uint64_t> filter_negatives{0};
+    mutable std::atomic<uint64_t> filter_false_positives{0};
+
+    // Cache counters, updated without the lock.
+    mutable std::atomic<uint64_t> hits{0};
+    mutable std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<uint64_t> expirations{0};
+
+    // For thread safety, Use a reader-writer lock to avoid race condition.
+    // Get takes it shared, everything that modifies data takes it exclusive.
+    mutable std::shared_mutex data_locker;
+  };
+
+  // Create shard_count empty shards.
+  void InitShards(size_t shard_count);
+
+  // Copy every shard of other into this map.
+  void CopyFrom(const ThreadsafeMap &other);
+
+  // Return the shard which owns the key.
+  Shard &ShardFor(const std::string &key) const;
+
+  // Put the value into the shard which owns the key, expiring at expires_ms
+  // unless it is 0.
+  // Return false if the pair alone exceeds the limit of the shard.
+  bool PutInShard(Shard &shard, const std::string &key, ValuePtr value,
+                  uint64_t expires_ms);
+
+  // Put the value into the shard, holding its lock, then expire and evict
+  // what is due, and return the new version of the key. The replaced,
+  // expired and evicted values are appended to released.
+  static uint64_t PutLocked(Shard &shard, const std::string &key, ValuePtr value,
+                        uint64_t expires_ms, size_t budget,
+                        std::vector<ValuePtr> *released);
+
+  // Whether the TTL of the entry passed by now_ms.
+  static bool Expired(const Entry &entry, uint64_t now_ms);
+
+  // Copy the bytes into a value held, with its payload, by the shard arena.
+  static ValuePtr NewValue(Shard &shard, std::string_view value);
+
+  // Bytes charged for an entry.
+  static size_t Charge(std::string_view key, const ValuePtr &value);
+
+  // Insert a new entry with a new version into the shard and its filter,
+  // holding its lock, and return it.
+  static ArenaKVMap::value_type *InsertLocked(Shard &shard,
+                                              std::string_view key,
+                                              ValuePtr value,
+                                              uint64_t expires_ms);
+
+  // Erase the entry from the shard, holding its lock, and return its value
+  // so the caller releases it after unlocking.
+  static ValuePtr EraseLocked(Shard &shard, ArenaKVMap::iterator it);
+
+  // Erase the keys of the shard which expired by now_ms, holding its lock.
+  // The values are appended to expired.
+  static void ExpireLocked(Shard &shard, uint64_t now_ms,
+                           std::vector<ValuePtr> *expired);
+
+  // Evict entries of the shard other than keep, holding its lock, until it
+  // fits into budget. The values are appended to evicted.
+  static void EvictLocked(Shard &shard, size_t budget,
+                          const ArenaKVMap::value_type *keep,
+                          std::vector<ValuePtr> *evicted);
+
+  // Called before every write of the key, holding the lock of the shard.
+  // Keep the value of the key for the pending snapshot of the shard, before
+  // its first write since the snapshot was taken, and mark the key dirty.
+  // entry is nullptr for a key which does not exist.
+  static void TrackWriteLocked(Shard &shard, std::string_view key,
+                               const Entry *entry);
+
+  // Store the snapshot taken by Snapshot into the file, one shard at a
+  // time. With dirty, store only the keys of dirty[i] of every shard i as a
+  // delta.
+  void WriteSnapshot(const std::string &file_name,
+                     const std::vector<std::unordered_set<std::string>> *dirty);
+
+  // Replace the filter of the shard by one sized for twice its keys,
+  // holding its lock.
+  static void RebuildFilterLocked(Shard &shard);
+
+  // Copy a key into the arena of the shard.
+  static std::string_view CopyKey(Shard &shard, std::string_view key);
+
+  // Move the objects of one shard out of the evacuating slabs.
+  static size_t CompactShard(Shard &shard, double max_occupancy);
+
+  // Reclaims the filters replaced while readers may still probe them.
+  mutable EpochManager epochs_;
+
+  // Bits per key of the shard filters, 0 without filters.
+  size_t filter_bits_per_key_ = BloomFilter::kDefaultBitsPerKey;
+
+  // Shards of the key space, indexed by key hash.
+  std::vector<std::unique_ptr<Shard>> shards_;
 
   // Pointer to the persistence strategy
   PersistPtr persist_ptr_;
 
   // The local file to persist the data
   std::string file_name_;
+
+  // Memory limit of every shard, 0 if unbounded.
+  std::atomic<size_t> shard_budget_{0};
+
+  // Held from taking a snapshot until it is stored.
+  std::mutex snapshot_locker_;
+
+  // Background compaction thread, stopped through stop_compaction_.
+  std::thread compaction_thread_;
+  bool stop_compaction_ = false;
+  std::mutex compaction_locker_;
+  std::condition_variable compaction_cv_;
 };
 }  // namespace cs499_fei
 #endif  // CSCI499_FEI_SRC_KEYVALUESTORE_THREADSAFE_MAP_H_
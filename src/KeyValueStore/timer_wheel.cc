@@ -0,0 +1,80 @@
+#include "timer_wheel.h"
+
+#include <utility>
+
+namespace cs499_fei {
+TimerWheel::TimerWheel(uint64_t now_ms) : tick_(now_ms / kTickMs) {
+  for (auto &level : slots_) {
+    level.resize(kSlots);
+  }
+}
+
+void TimerWheel::Schedule(std::string key, uint64_t expires_ms) {
+  ++size_;
+  File(Timer{std::move(key), expires_ms});
+}
+
+void TimerWheel::File(Timer timer) {
+  uint64_t tick = timer.expires_ms / kTickMs;
+  // an overdue timer fires on the next tick.
+  if (tick < tick_) {
+    tick = tick_;
+  }
+  uint64_t delta = tick - tick_;
+  int level = 0;
+  while (level < kLevels - 1 &&
+         delta >= (uint64_t{1} << (kSlotBits * (level + 1)))) {
+    ++level;
+  }
+  // a deadline beyond the last level waits in its farthest slot.
+  uint64_t range = uint64_t{1} << (kSlotBits * kLevels);
+  if (delta >= range) {
+    tick = tick_ + range - 1;
+  }
+  size_t slot = (tick >> (kSlotBits * level)) & (kSlots - 1);
+  slots_[level][slot].push_back(std::move(timer));
+}
+
+void TimerWheel::Cascade(int level) {
+  size_t slot = (tick_ >> (kSlotBits * level)) & (kSlots - 1);
+  // the level above comes around when this one starts a new turn.
+  if (slot == 0 && level + 1 < kLevels) {
+    Cascade(level + 1);
+  }
+  std::vector<Timer> timers = std::move(slots_[level][slot]);
+  slots_[level][slot].clear();
+  for (auto &timer : timers) {
+    File(std::move(timer));
+  }
+}
+
+std::vector<TimerWheel::Timer> TimerWheel::Advance(uint64_t now_ms) {
+  std::vector<Timer> due;
+  // Timers which are not due yet, filed again once the wheel moved past
+  // their current slot.
+  std::vector<Timer> later;
+  uint64_t now_tick = now_ms / kTickMs;
+  for (; tick_ <= now_tick; ++tick_) {
+    size_t slot = tick_ & (kSlots - 1);
+    if (slot == 0) {
+      Cascade(1);
+    }
+    std::vector<Timer> timers = std::move(slots_[0][slot]);
+    slots_[0][slot].clear();
+    for (auto &timer : timers) {
+      // deadlines beyond the range of the wheel go round again, and a
+      // deadline later within this tick waits for the next one.
+      if (timer.expires_ms > now_ms) {
+        later.push_back(std::move(timer));
+        continue;
+      }
+      --size_;
+      due.push_back(std::move(timer));
+    }
+  }
+  for (auto &timer : later) {
+    File(std::move(timer));
+  }
+  return due;
+}
+}  // namespace cs499_fei
@@ -0,0 +1,69 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_TIMER_WHEEL_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_TIMER_WHEEL_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cs499_fei {
+// Hierarchical timer wheel for key expiry.
+// Level 0 has one slot per tick, every higher level has one slot per full
+// turn of the level below. A timer is filed in the lowest level whose range
+// covers it, and cascades one level down each time its slot comes around,
+// so scheduling is O(1) and every timer is touched at most kLevels times
+// before it fires.
+// The wheel only files keys. Its owner checks on expiry whether the key still
+// carries the same deadline, so overwritten and removed keys need no
+// cancellation.
+class TimerWheel {
+ public:
+  // Length of one tick in milliseconds.
+  static constexpr uint64_t kTickMs = 100;
+
+  // Number of levels and slots per level. Together they cover 64^4 ticks,
+  // about 19 days. Later deadlines wait in the last level and are filed again
+  // when it comes around.
+  static constexpr int kLevels = 4;
+  static constexpr int kSlotBits = 6;
+  static constexpr uint64_t kSlots = 1 << kSlotBits;
+
+  // A key which expires at expires_ms.
+  struct Timer {
+    std::string key;
+    uint64_t expires_ms;
+  };
+
+  // Constructor with the current time in milliseconds.
+  explicit TimerWheel(uint64_t now_ms);
+
+  // File the key to expire at expires_ms.
+  void Schedule(std::string key, uint64_t expires_ms);
+
+  // Move the wheel forward to now_ms and return the timers whose deadline is
+  // at or before now_ms.
+  std::vector<Timer> Advance(uint64_t now_ms);
+
+  // Whether Advance(now_ms) has any tick to process.
+  bool Behind(uint64_t now_ms) const { return now_ms / kTickMs >= tick_; }
+
+  // Number of filed timers.
+  size_t Size() const { return size_; }
+
+ private:
+  // File the timer by its deadline, relative to the current tick.
+  void File(Timer timer);
+
+  // Empty the current slot of the level into the lower levels.
+  void Cascade(int level);
+
+  // The next tick to process. Every earlier tick has fired.
+  uint64_t tick_;
+
+  // Timers of each slot of each level.
+  std::vector<std::vector<Timer>> slots_[kLevels];
+
+  // Number of filed timers.
+  size_t size_ = 0;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_TIMER_WHEEL_H_
@@ -0,0 +1,197 @@
+#include "wire_format.h"
+
+#include <cstring>
+#include <vector>
+
+#include <grpc/slice.h>
+
+namespace cs499_fei {
+namespace {
+// Wire types of the protobuf encoding. Groups are deprecated and never
+// appear in the messages of the service, so they are rejected.
+enum WireType : uint32_t {
+  kVarint = 0,
+  kFixed64 = 1,
+  kLengthDelimited = 2,
+  kFixed32 = 5,
+};
+
+// Field numbers of the messages read and written here.
+constexpr uint32_t kKeyField = 1;
+constexpr uint32_t kValueField = 2;
+constexpr uint32_t kTtlField = 3;
+constexpr uint32_t kReplyValueField = 1;
+constexpr uint32_t kReplyVersionField = 2;
+
+// Largest field number protobuf allows.
+constexpr uint64_t kMaxFieldNumber = (1u << 29) - 1;
+
+// Helper function: read the varint at *pos of data and move *pos past it.
+// Return false if it is truncated or longer than kMaxVarintBytes.
+bool ReadVarint(std::string_view data, size_t *pos, uint64_t *value) {
+  uint64_t result = 0;
+  for (size_t i = 0; i < kMaxVarintBytes && *pos < data.size(); ++i) {
+    auto byte = static_cast<uint8_t>(data[(*pos)++]);
+    result |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Helper function: write value as a varint to out and return its bytes.
+size_t WriteVarint(uint64_t value, char *out) {
+  size_t bytes = 0;
+  while (value >= 0x80) {
+    out[bytes++] = static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  out[bytes++] = static_cast<char>(value);
+  return bytes;
+}
+
+// Helper function: call visit(field, wire_type, bytes, varint) on every
+// field of the message serialized in data, with the bytes of a
+// length-delimited field or the value of a varint. Fixed-size fields are
+// visited with neither.
+// Return false if data is not a valid message.
+template <typename Visitor>
+bool ForEachField(std::string_view data, Visitor visit) {
+  size_t pos = 0;
+  while (pos < data.size()) {
+    uint64_t tag;
+    if (!ReadVarint(data, &pos, &tag)) {
+      return false;
+    }
+    uint64_t field = tag >> 3;
+    auto wire_type = static_cast<uint32_t>(tag & 7);
+    if (field == 0 || field > kMaxFieldNumber) {
+      return false;
+    }
+    std::string_view bytes;
+    uint64_t varint = 0;
+    switch (wire_type) {
+      case kVarint:
+        if (!ReadVarint(data, &pos, &varint)) {
+          return false;
+        }
+        break;
+      case kFixed64:
+      case kFixed32: {
+        size_t size = wire_type == kFixed64 ? 8 : 4;
+        if (data.size() - pos < size) {
+          return false;
+        }
+        pos += size;
+        break;
+      }
+      case kLengthDelimited: {
+        uint64_t length;
+        if (!ReadVarint(data, &pos, &length) || length > data.size() - pos) {
+          return false;
+        }
+        bytes = data.substr(pos, length);
+        pos += length;
+        break;
+      }
+      default:
+        return false;
+    }
+    visit(static_cast<uint32_t>(field), wire_type, bytes, varint);
+  }
+  return true;
+}
+}  // namespace
+
+bool ParsePutRequest(std::string_view data, PutRequestView *request) {
+  *request = PutRequestView();
+  // a known field number with another wire type is an unknown field.
+  return ForEachField(data, [request](uint32_t field, uint32_t wire_type,
+                                      std::string_view bytes,
+                                      uint64_t varint) {
+    if (field == kKeyField && wire_type == kLengthDelimited) {
+      request->key = bytes;
+    } else if (field == kValueField && wire_type == kLengthDelimited) {
+      request->value = bytes;
+    } else if (field == kTtlField && wire_type == kVarint) {
+      request->ttl_ms = varint;
+    }
+  });
+}
+
+bool ParseGetRequest(std::string_view data, std::string_view *key) {
+  *key = std::string_view();
+  return ForEachField(
+      data, [key](uint32_t field, uint32_t wire_type, std::string_view bytes,
+                  uint64_t varint) {
+        if (field == kKeyField && wire_type == kLengthDelimited) {
+          *key = bytes;
+        }
+      });
+}
+
+size_t WriteGetReplyHeader(size_t value_size, char *out) {
+  // proto3 does not write fields at their default value.
+  if (value_size == 0) {
+    return 0;
+  }
+  out[0] = static_cast<char>(kReplyValueField << 3 | kLengthDelimited);
+  return 1 + WriteVarint(value_size, out + 1);
+}
+
+size_t WriteGetReplyTrailer(uint64_t version, char *out) {
+  if (version == 0) {
+    return 0;
+  }
+  out[0] = static_cast<char>(kReplyVersionField << 3 | kVarint);
+  return 1 + WriteVarint(version, out + 1);
+}
+
+bool MessageBytes(const grpc::ByteBuffer &buffer, grpc::Slice *slice,
+                  std::string *scratch, std::string_view *bytes) {
+  if (buffer.TrySingleSlice(slice).ok()) {
+    *bytes = std::string_view(reinterpret_cast<const char *>(slice->begin()),
+                              slice->size());
+    return true;
+  }
+  std::vector<grpc::Slice> slices;
+  if (!buffer.Dump(&slices).ok()) {
+    return false;
+  }
+  scratch->clear();
+  for (const grpc::Slice &part : slices) {
+    scratch->append(reinterpret_cast<const char *>(part.begin()), part.size());
+  }
+  *bytes = *scratch;
+  return true;
+}
+
+grpc::ByteBuffer GetReplyBuffer(const ValuePtr &value, uint64_t version) {
+  size_t value_size = value ? value->size() : 0;
+  char header[kMaxGetReplyFraming];
+  char trailer[kMaxGetReplyFraming];
+  size_t header_size = WriteGetReplyHeader(value_size, header);
+  size_t trailer_size = WriteGetReplyTrailer(value ? version : 0, trailer);
+  if (value_size >= kZeroCopyValueBytes) {
+    grpc::Slice slices[] = {
+        grpc::Slice(header, header_size),
+        grpc::Slice(
+            const_cast<char *>(value->data()), value_size,
+            [](void *held) { delete static_cast<ValuePtr *>(held); },
+            new ValuePtr(value)),
+        grpc::Slice(trailer, trailer_size)};
+    return grpc::ByteBuffer(slices, trailer_size == 0 ? 2 : 3);
+  }
+  grpc_slice reply = grpc_slice_malloc(header_size + value_size + trailer_size);
+  char *out = reinterpret_cast<char *>(GRPC_SLICE_START_PTR(reply));
+  std::memcpy(out, header, header_size);
+  if (value_size > 0) {
+    std::memcpy(out + header_size, value->data(), value_size);
+  }
+  std::memcpy(out + header_size + value_size, trailer, trailer_size);
+  grpc::Slice slice(reply, grpc::Slice::STEAL_REF);
+  return grpc::ByteBuffer(&slice, 1);
+}
+}  // namespace cs499_fei
@@ -0,0 +1,64 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_WIRE_FORMAT_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_WIRE_FORMAT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <grpcpp/grpcpp.h>
+
+#include "kvmap_abstraction.h"
+
+namespace cs499_fei {
+// Most bytes of a varint in the protobuf wire format.
+constexpr size_t kMaxVarintBytes = 10;
+
+// Most bytes WriteGetReplyHeader and WriteGetReplyTrailer write: a one byte
+// tag and a varint.
+constexpr size_t kMaxGetReplyFraming = 1 + kMaxVarintBytes;
+
+// Values at least this long are replied without a copy. A shorter one is
+// cheaper to copy than to hold a reference of its own while it is sent.
+constexpr size_t kZeroCopyValueBytes = 4096;
+
+// The fields of a serialized PutRequest, viewing the bytes they were read
+// from instead of copying them into a message.
+struct PutRequestView {
+  std::string_view key;
+  std::string_view value;
+  uint64_t ttl_ms = 0;
+};
+
+// Read the PutRequest serialized in data. As protobuf parses it, unknown
+// fields are skipped and the last occurrence of a field wins.
+// Return false if data is not a valid message.
+bool ParsePutRequest(std::string_view data, PutRequestView *request);
+
+// Read the key of the GetRequest serialized in data.
+// Return false if data is not a valid message.
+bool ParseGetRequest(std::string_view data, std::string_view *key);
+
+// A GetReply serializes as the header, the value, then the trailer, the
+// same bytes protobuf writes for it, so the value can be sent from where
+// the store keeps it.
+// Write the header of the reply of a value of value_size bytes to out, and
+// return the bytes written, none for an empty value.
+size_t WriteGetReplyHeader(size_t value_size, char *out);
+
+// Write the trailer of the reply of the version to out, and return the
+// bytes written, none for version 0.
+size_t WriteGetReplyTrailer(uint64_t version, char *out);
+
+// View the message received in buffer in place in its slice, which *slice
+// keeps alive, or copy it into *scratch if it spans several slices.
+// Return false if the buffer cannot be read.
+bool MessageBytes(const grpc::ByteBuffer &buffer, grpc::Slice *slice,
+                  std::string *scratch, std::string_view *bytes);
+
+// The serialized GetReply of the value at the version, or the empty reply
+// of a missing value. A value of kZeroCopyValueBytes or more is not copied:
+// its slice holds a reference to it until gRPC has sent it.
+grpc::ByteBuffer GetReplyBuffer(const ValuePtr &value, uint64_t version);
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_WIRE_FORMAT_H_
@@ -0,0 +1,327 @@
+#include "write_ahead_log.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <glog/logging.h>
+
+#include "checksum.h"
+
+namespace cs499_fei {
+namespace {
+// Bytes of the frame before every record: payload length and checksum.
+constexpr size_t kFrameHeaderSize = 8;
+
+// Seconds between two logs of the counters.
+constexpr std::chrono::seconds kStatsLogInterval(60);
+
+// Helper function: append a 32-bit number to the buffer.
+void PutUint32(std::string *buffer, uint32_t n) {
+  buffer->append(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+// Helper function: append a 64-bit number to the buffer.
+void PutUint64(std::string *buffer, uint64_t n) {
+  buffer->append(reinterpret_cast<const char *>(&n), sizeof(n));
+}
+
+// Helper function: append a string with its length to the buffer.
+void PutString(std::string *buffer, std::string_view s) {
+  PutUint32(buffer, static_cast<uint32_t>(s.size()));
+  buffer->append(s);
+}
+
+// Helper function: read a 32-bit number at *offset and move past it.
+// Return false if the data ends first.
+bool GetUint32(std::string_view data, size_t *offset, uint32_t *n) {
+  if (data.size() - *offset < sizeof(*n)) {
+    return false;
+  }
+  std::memcpy(n, data.data() + *offset, sizeof(*n));
+  *offset += sizeof(*n);
+  return true;
+}
+
+// Helper function: read a 64-bit number at *offset and move past it.
+// Return false if the data ends first.
+bool GetUint64(std::string_view data, size_t *offset, uint64_t *n) {
+  if (data.size() - *offset < sizeof(*n)) {
+    return false;
+  }
+  std::memcpy(n, data.data() + *offset, sizeof(*n));
+  *offset += sizeof(*n);
+  return true;
+}
+
+// Helper function: read a string with its length at *offset and move past
+// it. Return false if the data ends first.
+bool GetString(std::string_view data, size_t *offset, std::string_view *s) {
+  uint32_t size;
+  if (!GetUint32(data, offset, &size) || data.size() - *offset < size) {
+    return false;
+  }
+  *s = data.substr(*offset, size);
+  *offset += size;
+  return true;
+}
+
+// Helper function: append the framed record to the buffer.
+void EncodeRecord(const WriteAheadLog::Record &record, std::string *buffer) {
+  size_t frame = buffer->size();
+  // the header is filled in once the payload is in place.
+  buffer->append(kFrameHeaderSize, '\0');
+  buffer->push_back(static_cast<char>(record.type));
+  PutString(buffer, record.key);
+  PutString(buffer, record.value);
+  PutString(buffer, record.separator);
+  // records without a deadline keep the layout they had before it existed.
+  if (record.expires_at_ms != 0) {
+    PutUint64(buffer, record.expires_at_ms);
+  }
+  const char *payload = buffer->data() + frame + kFrameHeaderSize;
+  uint32_t header[2] = {
+      static_cast<uint32_t>(buffer->size() - frame - kFrameHeaderSize), 0};
+  header[1] = Crc32(payload, header[0]);
+  std::memcpy(&(*buffer)[frame], header, sizeof(header));
+}
+
+// Helper function: decode the payload of a record.
+// Return false if it is malformed.
+bool DecodeRecord(std::string_view payload, WriteAheadLog::Record *record) {
+  if (payload.empty()) {
+    return false;
+  }
+  auto type = static_cast<WriteAheadLog::RecordType>(payload[0]);
+  if (type != WriteAheadLog::RecordType::kPut &&
+      type != WriteAheadLog::RecordType::kRemove &&
+      type != WriteAheadLog::RecordType::kAppend) {
+    return false;
+  }
+  record->type = type;
+  record->expires_at_ms = 0;
+  size_t offset = 1;
+  if (!GetString(payload, &offset, &record->key) ||
+      !GetString(payload, &offset, &record->value) ||
+      !GetString(payload, &offset, &record->separator)) {
+    return false;
+  }
+  if (offset == payload.size()) {
+    return true;
+  }
+  return type == WriteAheadLog::RecordType::kPut &&
+         GetUint64(payload, &offset, &record->expires_at_ms) &&
+         record->expires_at_ms != 0 && offset == payload.size();
+}
+}  // namespace
+
+WriteAheadLog::WriteAheadLog(const std::string &file_name,
+                             std::chrono::microseconds flush_interval,
+                             size_t batch_size)
+    : file_name_(file_name),
+      flush_interval_(flush_interval),
+      batch_size_(std::max<size_t>(batch_size, 1)),
+      stats_logged_(std::chrono::steady_clock::now()) {
+  fd_ = open(file_name_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd_ < 0) {
+    LOG(FATAL) << "Cannot open the write-ahead log " << file_name_ << ": "
+               << std::strerror(errno);
+  }
+  file_size_ = lseek(fd_, 0, SEEK_END);
+  flusher_ = std::thread([this] { FlushLoop(); });
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  {
+    std::lock_guard<std::mutex> lock(wal_locker_);
+    stop_ = true;
+  }
+  flush_cv_.notify_all();
+  flusher_.join();
+  close(fd_);
+}
+
+size_t WriteAheadLog::Replay(const std::function<void(const Record &)> &apply) {
+  std::ifstream infile(file_name_, std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(infile)),
+                   std::istreambuf_iterator<char>());
+
+  size_t count = 0;
+  size_t offset = 0;
+  Record record;
+  while (offset < data.size()) {
+    size_t next = offset;
+    uint32_t size;
+    uint32_t crc;
+    if (!GetUint32(data, &next, &size) || !GetUint32(data, &next, &crc) ||
+        data.size() - next < size ||
+        Crc32(data.data() + next, size) != crc ||
+        !DecodeRecord(std::string_view(data).substr(next, size), &record)) {
+      break;
+    }
+    apply(record);
+    ++count;
+    offset = next + size;
+  }
+
+  if (offset < data.size()) {
+    LOG(WARNING) << "Cut " << data.size() - offset
+                 << " bytes of a torn record off the write-ahead log "
+                 << file_name_;
+    if (ftruncate(fd_, offset) != 0) {
+      LOG(FATAL) << "Cannot truncate the write-ahead log " << file_name_
+                 << ": " << std::strerror(errno);
+    }
+    file_size_ = offset;
+  }
+  return count;
+}
+
+uint64_t WriteAheadLog::Append(const Record &record) {
+  std::lock_guard<std::mutex> lock(wal_locker_);
+  EncodeRecord(record, &batch_);
+  append_times_.push_back(std::chrono::steady_clock::now());
+  // the flusher waits for the first record of a batch, and for a full one.
+  if (append_times_.size() == 1 || append_times_.size() >= batch_size_) {
+    flush_cv_.notify_one();
+  }
+  return ++appended_;
+}
+
+void WriteAheadLog::WaitDurable(uint64_t sequence) {
+  std::unique_lock<std::mutex> lock(wal_locker_);
+  durable_cv_.wait(lock, [this, sequence] { return durable_ >= sequence; });
+}
+
+void WriteAheadLog::Truncate() {
+  std::unique_lock<std::mutex> lock(wal_locker_);
+  durable_cv_.wait(lock,
+                   [this] { return durable_ == appended_ && !syncing_; });
+  if (ftruncate(fd_, 0) != 0 || fdatasync(fd_) != 0) {
+    LOG(FATAL) << "Cannot truncate the write-ahead log " << file_name_ << ": "
+               << std::strerror(errno);
+  }
+  file_size_ = 0;
+}
+
+uint64_t WriteAheadLog::Mark() const {
+  std::lock_guard<std::mutex> lock(wal_locker_);
+  // the pending batch goes to the end of the file.
+  return file_size_ + batch_.size();
+}
+
+void WriteAheadLog::DropBefore(uint64_t mark) {
+  std::unique_lock<std::mutex> lock(wal_locker_);
+  // Once the flusher is idle with the mark written, nothing moves the file.
+  durable_cv_.wait(lock,
+                   [this, mark] { return file_size_ >= mark && !syncing_; });
+  if (mark == 0) {
+    return;
+  }
+
+  // Copy the records after the mark into a new file and rename it over the
+  // log, so a crash leaves either log complete.
+  std::string tail(file_size_ - mark, '\0');
+  std::ifstream infile(file_name_, std::ios::binary);
+  infile.seekg(mark);
+  infile.read(&tail[0], tail.size());
+  if (!infile) {
+    LOG(FATAL) << "Cannot read the write-ahead log " << file_name_;
+  }
+  std::string tmp_file = file_name_ + ".tmp";
+  int fd = open(tmp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+                0644);
+  if (fd < 0 ||
+      write(fd, tail.data(), tail.size()) != static_cast<ssize_t>(tail.size()) ||
+      fdatasync(fd) != 0 ||
+      std::rename(tmp_file.c_str(), file_name_.c_str()) != 0) {
+    LOG(FATAL) << "Cannot rewrite the write-ahead log " << file_name_ << ": "
+               << std::strerror(errno);
+  }
+  close(fd_);
+  fd_ = fd;
+  file_size_ = tail.size();
+}
+
+WriteAheadLog::Stats WriteAheadLog::GetStats() const {
+  std::lock_guard<std::mutex> lock(wal_locker_);
+  return stats_;
+}
+
+void WriteAheadLog::FlushLoop() {
+  std::unique_lock<std::mutex> lock(wal_locker_);
+  while (true) {
+    flush_cv_.wait(lock, [this] { return stop_ || !batch_.empty(); });
+    // give the other writers the flush interval to join the batch.
+    if (!stop_ && flush_interval_.count() > 0) {
+      flush_cv_.wait_for(lock, flush_interval_, [this] {
+        return stop_ || append_times_.size() >= batch_size_;
+      });
+    }
+    if (batch_.empty()) {
+      if (stop_) {
+        return;
+      }
+      continue;
+    }
+
+    std::string batch;
+    batch.swap(batch_);
+    std::vector<std::chrono::steady_clock::time_point> append_times;
+    append_times.swap(append_times_);
+    uint64_t sequence = appended_;
+    file_size_ += batch.size();
+    syncing_ = true;
+    lock.unlock();
+
+    // Writers keep appending to the next batch in the meantime.
+    size_t written = 0;
+    while (written < batch.size()) {
+      ssize_t n = write(fd_, batch.data() + written, batch.size() - written);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        LOG(FATAL) << "Cannot write the write-ahead log " << file_name_
+                   << ": " << std::strerror(errno);
+      }
+      written += n;
+    }
+    if (fdatasync(fd_) != 0) {
+      LOG(FATAL) << "Cannot sync the write-ahead log " << file_name_ << ": "
+                 << std::strerror(errno);
+    }
+    auto now = std::chrono::steady_clock::now();
+
+    lock.lock();
+    syncing_ = false;
+    durable_ = sequence;
+    stats_.records += append_times.size();
+    stats_.bytes += batch.size();
+    ++stats_.syncs;
+    stats_.max_batch = std::max<uint64_t>(stats_.max_batch, append_times.size());
+    for (const auto &time : append_times) {
+      uint64_t us =
+          std::chrono::duration_cast<std::chrono::microseconds>(now - time)
+              .count();
+      stats_.total_commit_us += us;
+      stats_.max_commit_us = std::max(stats_.max_commit_us, us);
+    }
+    if (now - stats_logged_ >= kStatsLogInterval) {
+      stats_logged_ = now;
+      LOG(INFO) << "Write-ahead log: " << stats_.records << " records in "
+                << stats_.syncs << " syncs, " << stats_.RecordsPerSync()
+                << " records/sync (max " << stats_.max_batch
+                << "), commit latency avg " << stats_.AverageCommitUs()
+                << " us, max " << stats_.max_commit_us << " us";
+    }
+    durable_cv_.notify_all();
+  }
+}
+}  // namespace cs499_fei
@@ -0,0 +1,165 @@
+#ifndef CSCI499_FEI_SRC_KEYVALUESTORE_WRITE_AHEAD_LOG_H_
+#define CSCI499_FEI_SRC_KEYVALUESTORE_WRITE_AHEAD_LOG_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace cs499_fei {
+// Append-only write-ahead log of the KeyValueStore writes, with group commit.
+// Writers append their records to an in-memory batch and wait until it is
+// durable. A flusher thread writes the whole batch with one write and one
+// fdatasync, once the flush interval passed since its first record or as
+// soon as it holds batch_size records, so concurrent writers share a sync.
+// Every record is framed with its length and a checksum. Replay stops at the
+// first torn or corrupt record, which a crash in the middle of a write leaves
+// at the end of the file.
+class WriteAheadLog {
+ public:
+  // Operation of a record.
+  enum class RecordType : uint8_t { kPut = 1, kRemove = 2, kAppend = 3 };
+
+  // One logged write. It only views the bytes of the write, which are
+  // copied once, into the batch.
+  struct Record {
+    RecordType type;
+    std::string_view key;
+    // The value of a put, or the suffix of an append.
+    std::string_view value;
+    // The separator of an append.
+    std::string_view separator;
+    // Unix time in milliseconds when the key of a put with a TTL expires, 0
+    // for a put without one. Wall clock time, so it still holds after a
+    // restart.
+    uint64_t expires_at_ms = 0;
+  };
+
+  // Counters of the log since it was opened.
+  struct Stats {
+    // Records made durable.
+    uint64_t records = 0;
+
+    // Bytes written.
+    uint64_t bytes = 0;
+
+    // fdatasync calls, one per batch.
+    uint64_t syncs = 0;
+
+    // Most records made durable by one sync.
+    uint64_t max_batch = 0;
+
+    // Microseconds from the append of a record until it was durable, summed
+    // over all records, and the highest one.
+    uint64_t total_commit_us = 0;
+    uint64_t max_commit_us = 0;
+
+    // Average number of records per sync.
+    double RecordsPerSync() const {
+      return syncs == 0 ? 0 : static_cast<double>(records) / syncs;
+    }
+
+    // Average commit latency in microseconds.
+    double AverageCommitUs() const {
+      return records == 0 ? 0 : static_cast<double>(total_commit_us) / records;
+    }
+  };
+
+  // Open the log file, creating it if it does not exist, and start the
+  // flusher thread.
+  WriteAheadLog(const std::string &file_name,
+                std::chrono::microseconds flush_interval, size_t batch_size);
+
+  // Flush the pending records and stop the flusher thread.
+  ~WriteAheadLog();
+
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+  // Call apply for every record of the file, in order, and return their
+  // number. The record only lives during the call. A torn or corrupt tail is
+  // cut off the file. Must be called before the first Append.
+  size_t Replay(const std::function<void(const Record &)> &apply);
+
+  // Add the record to the next batch and return its sequence number.
+  uint64_t Append(const Record &record);
+
+  // Wait until every record up to sequence is durable.
+  void WaitDurable(uint64_t sequence);
+
+  // Append the record and wait until it is durable.
+  void Commit(const Record &record) { WaitDurable(Append(record)); }
+
+  // Wait until every appended record is durable, then drop all records from
+  // the file. Used once a snapshot holds their writes.
+  void Truncate();
+
+  // Return the position after the last appended record, to drop the records
+  // up to it once a snapshot taken now is stored. A mark is only valid until
+  // the next Truncate or DropBefore.
+  uint64_t Mark() const;
+
+  // Wait until the records before the mark are written, then drop them from
+  // the file and keep the ones after it. Appends wait while the records after
+  // the mark are copied, which are the writes since the snapshot.
+  void DropBefore(uint64_t mark);
+
+  // Counters since the log was opened.
+  Stats GetStats() const;
+
+ private:
+  // Write the batches until the log is destroyed.
+  void FlushLoop();
+
+  // Name of the log file.
+  std::string file_name_;
+
+  // File descriptor of the log, opened for appending.
+  int fd_;
+
+  // A batch is written this long after its first record, unless it fills up
+  // first.
+  std::chrono::microseconds flush_interval_;
+  size_t batch_size_;
+
+  // Guards everything below.
+  mutable std::mutex wal_locker_;
+
+  // Wakes the flusher: the first record of a batch, a full batch, or stop.
+  std::condition_variable flush_cv_;
+
+  // Wakes the writers waiting for a batch to be durable.
+  std::condition_variable durable_cv_;
+
+  // Encoded records of the next batch, and when each was appended.
+  std::string batch_;
+  std::vector<std::chrono::steady_clock::time_point> append_times_;
+
+  // Bytes of the file, including a batch being written.
+  uint64_t file_size_ = 0;
+
+  // Sequence number of the last appended record, and of the last durable
+  // one.
+  uint64_t appended_ = 0;
+  uint64_t durable_ = 0;
+
+  // Whether the flusher is writing a batch outside of the lock.
+  bool syncing_ = false;
+
+  // Set by the destructor to stop the flusher.
+  bool stop_ = false;
+
+  // Counters, and when they were last logged.
+  Stats stats_;
+  std::chrono::steady_clock::time_point stats_logged_;
+
+  // Writes the batches.
+  std::thread flusher_;
+};
+}  // namespace cs499_fei
+#endif  // CSCI499_FEI_SRC_KEYVALUESTORE_WRITE_AHEAD_LOG_H_
@@ -17,6 +17,16 @@ StringVector deserialize(const std::string &s, char delim) {
   return res;
 }
 
+StringVector WarbleService::DeserializeList(const std::string &list) const {
+  StringVector elements;
+  for (auto &element : deserialize(list, kListSeparator[0])) {
+    if (element != kInit) {
+      elements.push_back(std::move(element));
+    }
+  }
+  return elements;
+}
+
 PayloadOptional WarbleService::RegisterUser(const Payload &payload,
                                             const StoragePtr &kv_store) {
   RegisteruserRequest request;
@@ -30,23 +40,19 @@ PayloadOptional WarbleService::RegisterUser(const Payload &payload,
       kUserFollowersPrefix + kUserPrefix + user_name;
   std::string user_followings_key =
       kUserFollowingsPrefix + kUserPrefix + user_name;
-  StringVector keys_vector = {user_warbles_key};
-  StringOptional user_warbles = kv_store->Get(keys_vector).at(0);
 
-  bool is_user_exist =
-      (user_warbles.has_value()) && (!user_warbles.value().empty());
+  // The warble list claims the user name: only one of concurrent
+  // registrations puts it, in the same round trip as the check.
+  if (!kv_store->ConditionalPut(user_warbles_key, kInit, kNoVersion)) {
+    return PayloadOptional();
+  }
 
   RegisteruserReply reply;
   Payload reply_payload;
   reply_payload.PackFrom(reply);
 
-  if (is_user_exist) {
-    return PayloadOptional();
-  }
-
-  kv_store->Put(user_warbles_key, kInit);
-  kv_store->Put(user_followers_key, kInit);
-  kv_store->Put(user_followings_key, kInit);
+  kv_store->Batch({Operation::Put(user_followers_key, kInit),
+                   Operation::Put(user_followings_key, kInit)});
   return PayloadOptional(reply_payload);
 }
 
@@ -70,9 +76,6 @@ PayloadOptional WarbleService::Follow(const Payload &payload,
   StringOptional user_followings = value_vector.at(0);
   StringOptional to_follow_followers = value_vector.at(1);
 
-  std::string new_to_follow_followers = user_name;
-  std::string new_user_followings = to_follow;
-
   // Check if user_name and to_follow have been registered.
   bool is_user_name_registered =
       (user_followings != std::nullopt) && (!user_followings.value().empty());
@@ -85,17 +88,10 @@ PayloadOptional WarbleService::Follow(const Payload &payload,
     return PayloadOptional();
   }
 
-  if ((user_followings != std::nullopt) && (user_followings.value() != kInit)) {
-    new_user_followings = user_followings.value() + "," + new_user_followings;
-  }
-
-  if ((to_follow_followers != std::nullopt) && (to_follow_followers != kInit)) {
-    new_to_follow_followers =
-        to_follow_followers.value() + "," + new_to_follow_followers;
-  }
-
-  kv_store->Put(user_followings_key, new_user_followings);
-  kv_store->Put(to_follow_followers_key, new_to_follow_followers);
+  // Append on the server, so concurrent follows of one user are all kept.
+  kv_store->Batch(
+      {Operation::Append(user_followings_key, to_follow, kListSeparator),
+       Operation::Append(to_follow_followers_key, user_name, kListSeparator)});
 
   FollowReply reply;
   Payload reply_payload;
@@ -135,13 +131,8 @@ PayloadOptional WarbleService::ReadProfile(const Payload &payload,
 
   Profile profile;
 
-  if ((user_followings != std::nullopt) && (user_followings.value() != kInit)) {
-    profile.profile_followings = deserialize(user_followings.value(), ',');
-  }
-
-  if ((user_followers != std::nullopt) && (user_followers != kInit)) {
-    profile.profile_followers = deserialize(user_followers.value(), ',');
-  }
+  profile.profile_followings = DeserializeList(user_followings.value());
+  profile.profile_followers = DeserializeList(user_followers.value());
 
   ProfileReply reply;
   for (const auto &following : profile.profile_followings) {
@@ -171,14 +162,10 @@ PayloadOptional WarbleService::WarbleText(const Payload &payload,
 
   // Create key vector
   // 0: warble list for user_name
-  // 1: Optional. warble list for reply_to
+  // 1: Optional. the reply_to warble
   std::string user_warble_key = kUserWarblesPrefix + kUserPrefix + user_name;
   StringVector key_vector = {user_warble_key};
-  std::string warble_thread_key;
   if (reply_to != "") {
-    warble_thread_key = kWarbleThreadPrefix + kWarblePrefix + reply_to;
-    key_vector.push_back(warble_thread_key);
-
     // Used to check whether reply_to warble exists.
     std::string warble_key = kWarblePrefix + reply_to;
     key_vector.push_back(warble_key);
@@ -198,7 +185,7 @@ PayloadOptional WarbleService::WarbleText(const Payload &payload,
 
   // Check whether reply_to warble does exist.
   if (reply_to != "") {
-    StringOptional warble = value_vector.at(2);
+    StringOptional warble = value_vector.at(1);
 
     bool is_warble_exist =
         (warble != std::nullopt) && (!warble.value().empty());
@@ -219,40 +206,28 @@ PayloadOptional WarbleService::WarbleText(const Payload &payload,
   new_warble.mutable_timestamp()->set_seconds(time.tv_sec);
   new_warble.mutable_timestamp()->set_useconds(time.tv_usec);
 
+  // Store the warble and add it to its lists in one batch. The id lists are
+  // appended on the server, so concurrent warbles of one user, hashtag or
+  // thread are all kept.
   std::string warble_key = kWarblePrefix + current_warble_id;
-  kv_store->Put(warble_key, new_warble.SerializeAsString());
+  OperationVector operations = {
+      Operation::Put(warble_key, new_warble.SerializeAsString()),
+      Operation::Append(user_warble_key, current_warble_id, kListSeparator)};
 
-  std::string new_user_warbles = current_warble_id;
-  if ((user_warbles != std::nullopt) && (user_warbles.value() != kInit)) {
-    new_user_warbles = user_warbles.value() + "," + new_user_warbles;
-  }
-
-  kv_store->Put(user_warble_key, new_user_warbles);
-
-  // Put {hashtag, Warble} pair to kv_store
+  // Append the Warble to the list of each hashtag
   for (int i = 0; i < hashtag_list.size(); i++) {
     std::string hashtag_key = kHashtagPrefix + hashtag_list[i];
-    StringVector k = {hashtag_key};
-    StringOptionalVector v = kv_store->Get(k);
-    StringOptional value = std::nullopt;
-    if (v.size() > 0) {
-      value = v[0];
-    }
-    std::string id_list = current_warble_id;
-    if (value != std::nullopt && value.value() != "") {
-      id_list = value.value() + "," + id_list;
-    }
-    kv_store->Put(hashtag_key, id_list);
+    operations.push_back(
+        Operation::Append(hashtag_key, current_warble_id, kListSeparator));
   }
 
   if (reply_to != "") {
-    StringOptional warble_thread = value_vector.at(1);
-    std::string new_warble_thread = current_warble_id;
-    if ((warble_thread != std::nullopt) && (warble_thread.value() != "")) {
-      new_warble_thread = warble_thread.value() + "," + new_warble_thread;
-    }
-    kv_store->Put(warble_thread_key, new_warble_thread);
+    std::string warble_thread_key =
+        kWarbleThreadPrefix + kWarblePrefix + reply_to;
+    operations.push_back(Operation::Append(warble_thread_key,
+                                           current_warble_id, kListSeparator));
   }
+  kv_store->Batch(operations);
 
   WarbleReply reply;
   reply.mutable_warble()->CopyFrom(new_warble);
@@ -19,8 +19,12 @@ class WarbleService : public WarbleServiceAbstraction {
   const std::string kHashtagPrefix = "hashtag_";
 
   // The label to show the user's profile has been initialization.
+  // Appended lists keep it as their first element.
   const std::string kInit = "INIT";
 
+  // Separator of the elements of a list value.
+  const std::string kListSeparator = ",";
+
   // Constructor with the parameter of StoragePtr.
   explicit WarbleService(){};
 
@@ -49,6 +53,10 @@ class WarbleService : public WarbleServiceAbstraction {
                                  const StoragePtr &kv_store);
   // Get a list of hashtags contained in the warble text
   StringVector GetHashtagList(std::string text);
+
+ private:
+  // Split a list value into its elements, without the kInit label.
+  StringVector DeserializeList(const std::string &list) const;
 };
 }  // namespace cs499_fei
 #endif  // CSCI499_FEI_SRC_WARBLE_WARBLE_SERVICE_H_
\ No newline at end of file
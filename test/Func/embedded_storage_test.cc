@@ -0,0 +1,78 @@
+#include "embedded_storage.h"
+
+#include <cstdio>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "partitioned_persistence.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: remove the store and the partitions of its manifest.
+void RemoveStore(const std::string &file_name) {
+  if (auto manifest = PartitionedPersistence::ReadManifest(file_name)) {
+    for (const auto &partition : manifest->partitions) {
+      std::remove(partition.file_name.c_str());
+    }
+  }
+  std::remove(file_name.c_str());
+}
+}  // namespace
+
+// Test: put, append, get, conditional put, batch and remove in memory only
+// Expect: the same results as over gRPC, with missing keys read as empty
+// values by Get and as std::nullopt by a batch get
+TEST(EmbeddedStorage, ShouldServeStorageCallsInProcess) {
+  EmbeddedStorage storage;
+  storage.Put("warble_1", "hello");
+  storage.Append("hashtag_x", "1", ",");
+  storage.Append("hashtag_x", "2", ",");
+  auto values = storage.Get({"warble_1", "warble_2", "hashtag_x"});
+  ASSERT_EQ(3, values.size());
+  EXPECT_EQ("hello", values[0].value());
+  EXPECT_EQ("", values[1].value());
+  EXPECT_EQ("1,2", values[2].value());
+
+  VersionedValue versioned = storage.GetVersioned("warble_1");
+  EXPECT_EQ("hello", versioned.value);
+  EXPECT_NE(kNoVersion, versioned.version);
+  EXPECT_EQ(kNoVersion, storage.GetVersioned("warble_2").version);
+  EXPECT_FALSE(storage.ConditionalPut("warble_1", "stale", kNoVersion));
+  EXPECT_TRUE(storage.ConditionalPut("warble_1", "bye", versioned.version));
+
+  auto results = storage.Batch({Operation::Get("warble_1"),
+                                Operation::Get("warble_2"),
+                                Operation::Put("warble_2", "new"),
+                                Operation::Remove("hashtag_x")});
+  ASSERT_EQ(4, results.size());
+  EXPECT_EQ("bye", results[0].value());
+  EXPECT_FALSE(results[1].has_value());
+  EXPECT_EQ("", results[2].value());
+  EXPECT_EQ("", results[3].value());
+  EXPECT_EQ("new", storage.Get({"warble_2"})[0].value());
+  EXPECT_FALSE(storage.GetVersioned("hashtag_x").value.has_value());
+
+  storage.Remove("warble_1");
+  EXPECT_FALSE(storage.GetVersioned("warble_1").value.has_value());
+}
+
+// Test: store the embedded storage into a partitioned file and load it
+// again, as kvstore_server does with the same file
+// Expect: the loaded storage holds the stored pairs
+TEST(EmbeddedStorage, ShouldLoadTheStoredFile) {
+  std::string mock_file = "embedded_data";
+  {
+    EmbeddedStorage storage(std::make_shared<PartitionedPersistence>(2),
+                            mock_file);
+    storage.Put("warble_1", "hello");
+    storage.Put("warble_2", std::string("\0\n#", 3));
+    storage.Store();
+  }
+  EmbeddedStorage loaded(std::make_shared<PartitionedPersistence>(2),
+                         mock_file);
+  auto values = loaded.Get({"warble_1", "warble_2"});
+  EXPECT_EQ("hello", values[0].value());
+  EXPECT_EQ(std::string("\0\n#", 3), values[1].value());
+  RemoveStore(mock_file);
+}
+}  // namespace cs499_fei
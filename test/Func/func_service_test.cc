@@ -18,6 +18,12 @@ class MockStorage : public StorageAbstraction {
   MOCK_METHOD2(Put, void(const std::string &, const std::string &));
   MOCK_METHOD1(Get, StringOptionalVector(const StringVector &));
   MOCK_METHOD1(Remove, void(const std::string &));
+  MOCK_METHOD3(Append, void(const std::string &, const std::string &,
+                            const std::string &));
+  MOCK_METHOD1(GetVersioned, VersionedValue(const std::string &));
+  MOCK_METHOD3(ConditionalPut,
+               bool(const std::string &, const std::string &, uint64_t));
+  MOCK_METHOD1(Batch, StringOptionalVector(const OperationVector &));
 };
 
 // Mock Class of Warble
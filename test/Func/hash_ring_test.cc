@@ -0,0 +1,68 @@
+#include "hash_ring.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cs499_fei {
+// Test: spread 100000 keys over four nodes, on two rings of the same nodes
+// Expect: both rings agree on every owner, and every node holds within 20%
+// of a fair share
+TEST(HashRing, ShouldSpreadTheKeysEvenly) {
+  std::vector<std::string> nodes = {"kv1:50000", "kv2:50000", "kv3:50000",
+                                    "kv4:50000"};
+  HashRing ring(nodes);
+  HashRing other(nodes);
+  ASSERT_EQ(nodes, ring.nodes());
+  std::vector<size_t> counts(nodes.size());
+  constexpr size_t kKeys = 100000;
+  for (size_t i = 0; i < kKeys; ++i) {
+    std::string key = "warble_" + std::to_string(i);
+    size_t owner = ring.Owner(key);
+    ASSERT_EQ(owner, other.Owner(key));
+    ++counts[owner];
+  }
+  for (size_t count : counts) {
+    EXPECT_GT(count, kKeys / nodes.size() * 8 / 10);
+    EXPECT_LT(count, kKeys / nodes.size() * 12 / 10);
+  }
+}
+
+// Test: add a fifth node to a ring of four, then remove one of the four
+// Expect: only keys moving to the new node, or off the removed one, change
+// owner, about a fifth and a quarter of them
+TEST(HashRing, ShouldMoveOnlyTheKeysOfTheChangedNode) {
+  HashRing four({"kv1", "kv2", "kv3", "kv4"});
+  HashRing five({"kv1", "kv2", "kv3", "kv4", "kv5"});
+  HashRing three({"kv1", "kv3", "kv4"});
+  constexpr size_t kKeys = 20000;
+  size_t added = 0;
+  size_t removed = 0;
+  for (size_t i = 0; i < kKeys; ++i) {
+    std::string key = "user_" + std::to_string(i);
+    const std::string &before = four.nodes()[four.Owner(key)];
+    const std::string &grown = five.nodes()[five.Owner(key)];
+    if (grown != before) {
+      EXPECT_EQ("kv5", grown);
+      ++added;
+    }
+    const std::string &shrunk = three.nodes()[three.Owner(key)];
+    if (shrunk != before) {
+      EXPECT_EQ("kv2", before);
+      ++removed;
+    }
+  }
+  EXPECT_NEAR(kKeys / 5, added, kKeys / 20);
+  EXPECT_NEAR(kKeys / 4, removed, kKeys / 20);
+}
+
+// Test: build a ring with a repeated node, and an empty ring
+// Expect: the repeated node is kept once, and the empty ring has no nodes
+TEST(HashRing, ShouldIgnoreRepeatedNodes) {
+  HashRing ring({"kv1", "kv2", "kv1"}, 16);
+  EXPECT_EQ(std::vector<std::string>({"kv1", "kv2"}), ring.nodes());
+  EXPECT_LT(ring.Owner("warble_1"), 2);
+  EXPECT_TRUE(HashRing({}).empty());
+}
+}  // namespace cs499_fei
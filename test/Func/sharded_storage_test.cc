@@ -0,0 +1,175 @@
+#include "sharded_storage.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "embedded_storage.h"
+#include "gtest/gtest.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: shards held in memory, by address.
+struct Shards {
+  ShardedStorage::ShardFactory Factory() {
+    return [this](const std::string &address) {
+      auto &storage = storages[address];
+      if (!storage) {
+        storage = std::make_shared<EmbeddedStorage>();
+      }
+      return storage;
+    };
+  }
+
+  // Number of keys among the given ones that the shard holds.
+  size_t Holds(const std::string &address, size_t keys) {
+    size_t held = 0;
+    for (size_t i = 0; i < keys; ++i) {
+      if (storages[address]
+              ->GetVersioned("warble_" + std::to_string(i))
+              .value) {
+        ++held;
+      }
+    }
+    return held;
+  }
+
+  std::map<std::string, std::shared_ptr<EmbeddedStorage>> storages;
+};
+}  // namespace
+
+// Test: put 100 keys over three shards, then get them all in one call with
+// a missing key among them, and run a batch over several shards
+// Expect: every shard holds some of the keys and no key is held twice, the
+// values come back in the order of the keys, and the batch results in the
+// order of its operations
+TEST(ShardedStorage, ShouldSpreadTheKeysAndReassembleTheResults) {
+  Shards shards;
+  ShardedStorage storage({"kv1", "kv2", "kv3"}, shards.Factory(), 64, 2);
+  StringVector keys;
+  for (int i = 0; i < 100; ++i) {
+    keys.push_back("warble_" + std::to_string(i));
+    storage.Put(keys.back(), std::to_string(i));
+  }
+  size_t held = 0;
+  for (const auto &address : {"kv1", "kv2", "kv3"}) {
+    EXPECT_GT(shards.Holds(address, 100), 0);
+    held += shards.Holds(address, 100);
+  }
+  EXPECT_EQ(100, held);
+
+  keys.insert(keys.begin() + 50, "warble_missing");
+  auto values = storage.Get(keys);
+  ASSERT_EQ(101, values.size());
+  EXPECT_EQ("0", values[0].value());
+  EXPECT_EQ("", values[50].value());
+  EXPECT_EQ("50", values[51].value());
+  EXPECT_EQ("99", values[100].value());
+
+  storage.Append("hashtag_x", "1", ",");
+  auto results = storage.Batch({Operation::Get("warble_7"),
+                                Operation::Put("warble_7", "new"),
+                                Operation::Get("warble_7"),
+                                Operation::Get("warble_missing"),
+                                Operation::Append("hashtag_x", "2", ","),
+                                Operation::Remove("warble_8"),
+                                Operation::Get("hashtag_x")});
+  ASSERT_EQ(7, results.size());
+  EXPECT_EQ("7", results[0].value());
+  EXPECT_EQ("", results[1].value());
+  EXPECT_EQ("new", results[2].value());
+  EXPECT_FALSE(results[3].has_value());
+  EXPECT_EQ("", results[4].value());
+  EXPECT_EQ("", results[5].value());
+  EXPECT_EQ("1,2", results[6].value());
+
+  VersionedValue versioned = storage.GetVersioned("warble_9");
+  EXPECT_EQ("9", versioned.value);
+  EXPECT_TRUE(storage.ConditionalPut("warble_9", "x", versioned.version));
+  storage.Remove("warble_9");
+  EXPECT_FALSE(storage.GetVersioned("warble_9").value.has_value());
+}
+
+// Test: add a fourth shard at runtime, read every key, then remove all of
+// the shards
+// Expect: the kept shards keep their storage, every key reads as before and
+// is moved to the new shard when it owns it, no key is held twice, and with
+// no shards the calls fail without reaching a storage
+TEST(ShardedStorage, ShouldChangeTheShardsAtRuntime) {
+  Shards shards;
+  ShardedStorage storage({"kv1", "kv2", "kv3"}, shards.Factory());
+  for (int i = 0; i < 100; ++i) {
+    storage.Put("warble_" + std::to_string(i), std::to_string(i));
+  }
+  auto kv1 = shards.storages["kv1"];
+
+  storage.SetShards({"kv1", "kv2", "kv3", "kv4"});
+  EXPECT_EQ(StringVector({"kv1", "kv2", "kv3", "kv4"}), storage.Shards());
+  EXPECT_EQ(kv1, shards.storages["kv1"]);
+  EXPECT_EQ(0, shards.Holds("kv4", 100));
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "warble_" + std::to_string(i);
+    EXPECT_EQ(std::to_string(i), storage.Get({key})[0].value());
+  }
+  size_t moved = shards.Holds("kv4", 100);
+  EXPECT_GT(moved, 0);
+  EXPECT_LT(moved, 50);
+  size_t held = 0;
+  for (const auto &address : {"kv1", "kv2", "kv3", "kv4"}) {
+    held += shards.Holds(address, 100);
+  }
+  EXPECT_EQ(100, held);
+
+  storage.SetShards({});
+  EXPECT_TRUE(storage.Shards().empty());
+  EXPECT_FALSE(storage.Get({"warble_0"})[0].has_value());
+  EXPECT_FALSE(storage.ConditionalPut("warble_0", "x", kNoVersion));
+}
+
+// Test: remove a shard at runtime, then append to, conditionally put,
+// remove and batch over the keys it held, before they are read
+// Expect: every call sees the value the key had on the removed shard, a
+// removed key does not come back from it, and it no longer holds the keys
+TEST(ShardedStorage, ShouldMoveTheKeysOfAChangedShardAsTheyAreUsed) {
+  Shards shards;
+  ShardedStorage storage({"kv1", "kv2", "kv3"}, shards.Factory());
+  for (int i = 0; i < 100; ++i) {
+    storage.Put("warble_" + std::to_string(i), std::to_string(i));
+  }
+  StringVector keys;
+  for (int i = 0; i < 100 && keys.size() < 5; ++i) {
+    std::string key = "warble_" + std::to_string(i);
+    if (shards.storages["kv3"]->GetVersioned(key).value) {
+      keys.push_back(key);
+    }
+  }
+  ASSERT_EQ(5, keys.size());
+  std::string value_0 = *shards.storages["kv3"]->GetVersioned(keys[0]).value;
+  std::string value_2 = *shards.storages["kv3"]->GetVersioned(keys[2]).value;
+  std::string value_4 = *shards.storages["kv3"]->GetVersioned(keys[4]).value;
+
+  storage.SetShards({"kv1", "kv2"});
+  storage.Append(keys[0], "x", ",");
+  EXPECT_EQ(value_0 + ",x", storage.Get({keys[0]})[0].value());
+
+  EXPECT_FALSE(storage.ConditionalPut(keys[1], "x", kNoVersion));
+  VersionedValue versioned = storage.GetVersioned(keys[1]);
+  EXPECT_TRUE(storage.ConditionalPut(keys[1], "x", versioned.version));
+  EXPECT_EQ("x", storage.Get({keys[1]})[0].value());
+
+  storage.Remove(keys[2]);
+  EXPECT_EQ("", storage.Get({keys[2]})[0].value());
+  EXPECT_FALSE(shards.storages["kv3"]->GetVersioned(keys[2]).value);
+
+  auto results = storage.Batch({Operation::Get(keys[4]),
+                                Operation::Remove(keys[3]),
+                                Operation::Get(keys[3])});
+  ASSERT_EQ(3, results.size());
+  EXPECT_EQ(value_4, results[0].value());
+  EXPECT_FALSE(results[2].has_value());
+  EXPECT_EQ("", storage.Get({keys[3]})[0].value());
+  for (const auto &key : keys) {
+    EXPECT_FALSE(shards.storages["kv3"]->GetVersioned(key).value);
+  }
+}
+}  // namespace cs499_fei
@@ -0,0 +1,96 @@
+#include "binary_persistence.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "persistence.h"
+#include "threadsafe_map.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: a map with binary keys and values, and an empty one.
+StringKVMap MockMap() {
+  StringKVMap mock_map;
+  mock_map["1 is 1"] = "How are you?";
+  mock_map["2 is 2"] = "Fine, # thank you.";
+  mock_map[std::string("zero\0byte", 9)] = std::string("\0\xff\n#", 4);
+  mock_map["empty"] = "";
+  for (int i = 0; i < 1000; ++i) {
+    mock_map["key_" + std::to_string(i)] = std::string(i, 'v');
+  }
+  return mock_map;
+}
+}  // namespace
+
+// Test: deserialize a file that does not exist
+// Expect: return an empty map
+TEST(BinaryPersistence, ShouldGetEmptyMapWhenDeserializeAFileNotExist) {
+  BinaryPersistence p;
+  std::string mock_file = "binary_data_not_exist";
+  std::remove(mock_file.c_str());
+  EXPECT_TRUE(p.deserialize(mock_file).empty());
+}
+
+// Test: serialize a map to the file and then deserialize the file to the map.
+// Expect: return the map with same value as the original one
+TEST(BinaryPersistence, ShouldGetExpectedMapWhenSerializeAndDeserialize) {
+  BinaryPersistence p;
+  std::string mock_file = "binary_data";
+  StringKVMap mock_map = MockMap();
+  p.serialize(mock_map, mock_file);
+  EXPECT_EQ(mock_map, p.deserialize(mock_file));
+  std::remove(mock_file.c_str());
+}
+
+// Test: load a file written by the text format
+// Expect: return the map of the text file
+TEST(BinaryPersistence, ShouldReadTextFormatFile) {
+  std::string mock_file = "text_data_for_binary";
+  StringKVMap mock_map;
+  mock_map["1 is 1"] = "How are you?";
+  mock_map["2 is 2"] = "Fine, # thank you.";
+  Persistence().serialize(mock_map, mock_file);
+  EXPECT_EQ(mock_map, BinaryPersistence().deserialize(mock_file));
+  std::remove(mock_file.c_str());
+}
+
+// Test: restart a map on a binary store
+// Expect: the map holds every stored pair
+TEST(BinaryPersistence, ShouldRestoreThreadsafeMap) {
+  std::string mock_file = "binary_map_data";
+  std::remove(mock_file.c_str());
+  auto persist_ptr = std::make_shared<BinaryPersistence>();
+  StringKVMap mock_map = MockMap();
+  {
+    ThreadsafeMap m(persist_ptr, mock_file);
+    for (const auto &p : mock_map) {
+      m.Put(p.first, p.second);
+    }
+    m.Store(mock_file);
+  }
+  ThreadsafeMap restored(persist_ptr, mock_file);
+  for (const auto &p : mock_map) {
+    ASSERT_EQ(p.second, restored.Get(p.first).value());
+  }
+  std::remove(mock_file.c_str());
+}
+
+// Test: flip a byte of the body of a stored file
+// Expect: loading fails instead of returning partial data
+TEST(BinaryPersistenceDeathTest, ShouldFailOnCorruptFile) {
+  BinaryPersistence p;
+  std::string mock_file = "binary_data_corrupt";
+  p.serialize(MockMap(), mock_file);
+  {
+    std::fstream file(mock_file, std::ios::in | std::ios::out |
+                                     std::ios::binary);
+    file.seekp(BinaryPersistence::kHeaderSize + 10);
+    file.put('\x7f');
+  }
+  EXPECT_DEATH(p.deserialize(mock_file), "Corrupt binary store");
+  std::remove(mock_file.c_str());
+}
+}  // namespace cs499_fei
@@ -0,0 +1,67 @@
+#include "block_codec.h"
+
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: compress the input, decompress it again and return the
+// result, or "corrupt" if it does not decompress.
+std::string RoundTrip(const std::string &input, size_t *compressed_size) {
+  std::string block;
+  CompressBlock(input, &block);
+  EXPECT_LE(block.size(), CompressBound(input.size()));
+  *compressed_size = block.size();
+  std::string output;
+  if (!DecompressBlock(block, input.size(), &output)) {
+    return "corrupt";
+  }
+  return output;
+}
+}  // namespace
+
+// Test: compress and decompress empty, short, repetitive and random blocks
+// Expect: every block comes back unchanged, and repetitive ones shrink
+TEST(BlockCodec, ShouldRoundTripBlocks) {
+  size_t size;
+  EXPECT_EQ("", RoundTrip("", &size));
+  EXPECT_EQ("abc", RoundTrip("abc", &size));
+
+  // a run of one byte matches its own copy.
+  std::string run(100000, 'x');
+  EXPECT_EQ(run, RoundTrip(run, &size));
+  EXPECT_LT(size, run.size() / 50);
+
+  std::string keys;
+  for (int i = 0; i < 5000; ++i) {
+    keys += "user_followers_user_" + std::to_string(i * 7919) + ",";
+  }
+  EXPECT_EQ(keys, RoundTrip(keys, &size));
+  EXPECT_LT(size, keys.size() / 2);
+
+  std::mt19937 engine(7);
+  std::string noise(70000, '\0');
+  for (auto &c : noise) {
+    c = static_cast<char>(engine());
+  }
+  EXPECT_EQ(noise, RoundTrip(noise, &size));
+}
+
+// Test: decompress a truncated block, and a block with a wrong size
+// Expect: both are reported as corrupt
+TEST(BlockCodec, ShouldRejectCorruptBlocks) {
+  std::string input;
+  for (int i = 0; i < 1000; ++i) {
+    input += "warble_" + std::to_string(i);
+  }
+  std::string block;
+  CompressBlock(input, &block);
+  std::string output;
+  EXPECT_FALSE(
+      DecompressBlock(block.substr(0, block.size() / 2), input.size(), &output));
+  EXPECT_FALSE(DecompressBlock(block, input.size() + 1, &output));
+  EXPECT_FALSE(DecompressBlock(block, input.size() - 1, &output));
+}
+}  // namespace cs499_fei
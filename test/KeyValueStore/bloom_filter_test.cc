@@ -0,0 +1,74 @@
+#include "bloom_filter.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cs499_fei {
+// Test: add keys to a filter sized for them, then probe them and keys never
+// added
+// Expect: every added key may be contained, and about 1% of the others
+TEST(BloomFilter, ShouldHaveNoFalseNegativesAndFewFalsePositives) {
+  const int keys = 100000;
+  BloomFilter filter(keys, BloomFilter::kDefaultBitsPerKey);
+  for (int i = 0; i < keys; ++i) {
+    filter.Add(BloomFilter::Hash("user_" + std::to_string(i)));
+  }
+  for (int i = 0; i < keys; ++i) {
+    ASSERT_TRUE(
+        filter.MayContain(BloomFilter::Hash("user_" + std::to_string(i))));
+  }
+  int false_positives = 0;
+  for (int i = 0; i < keys; ++i) {
+    false_positives +=
+        filter.MayContain(BloomFilter::Hash("absent_" + std::to_string(i)));
+  }
+  EXPECT_LT(false_positives, keys / 50);
+  // the bits are rounded up to whole blocks.
+  EXPECT_GE(filter.bytes(), keys * BloomFilter::kDefaultBitsPerKey / 8);
+  EXPECT_LT(filter.bytes(),
+            keys * BloomFilter::kDefaultBitsPerKey / 8 + BloomFilter::kBlockBytes);
+}
+
+// Test: serialize a filter and read it back, and read back bytes which are
+// not whole blocks
+// Expect: the copy answers as the filter, the partial blocks are rejected
+TEST(BloomFilter, ShouldDeserializeSerializedFilter) {
+  BloomFilter filter(1000, BloomFilter::kDefaultBitsPerKey);
+  for (int i = 0; i < 1000; ++i) {
+    filter.Add(BloomFilter::Hash(std::to_string(i)));
+  }
+  std::string data = filter.Serialize();
+  EXPECT_EQ(filter.bytes(), data.size());
+  auto copy = BloomFilter::Deserialize(data);
+  ASSERT_NE(nullptr, copy);
+  for (int i = 0; i < 2000; ++i) {
+    uint64_t hash = BloomFilter::Hash(std::to_string(i));
+    EXPECT_EQ(filter.MayContain(hash), copy->MayContain(hash));
+  }
+  EXPECT_EQ(nullptr, BloomFilter::Deserialize(data.substr(1)));
+  EXPECT_EQ(nullptr, BloomFilter::Deserialize(""));
+}
+
+// Test: add keys from several threads at once
+// Expect: every key is contained once the threads are joined
+TEST(BloomFilter, ShouldAddConcurrently) {
+  BloomFilter filter(40000, BloomFilter::kDefaultBitsPerKey);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&filter, t] {
+      for (int i = 0; i < 10000; ++i) {
+        filter.Add(BloomFilter::Hash(std::to_string(t * 10000 + i)));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (int i = 0; i < 40000; ++i) {
+    ASSERT_TRUE(filter.MayContain(BloomFilter::Hash(std::to_string(i))));
+  }
+}
+}  // namespace cs499_fei
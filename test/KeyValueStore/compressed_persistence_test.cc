@@ -0,0 +1,93 @@
+#include "compressed_persistence.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "binary_persistence.h"
+#include "gtest/gtest.h"
+#include "threadsafe_map.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: a map of repetitive keys and values, spanning blocks.
+StringKVMap MockMap() {
+  StringKVMap mock_map;
+  mock_map[std::string("zero\0byte", 9)] = std::string("\0\xff\n#", 4);
+  mock_map["empty"] = "";
+  mock_map["large"] = std::string(CompressedPersistence::kBlockSize * 2, 'l');
+  for (int i = 0; i < 20000; ++i) {
+    mock_map["user_followers_user_" + std::to_string(i)] =
+        "user_" + std::to_string(i * 31) + ",user_" + std::to_string(i * 17);
+  }
+  return mock_map;
+}
+
+// Helper function: size of the file in bytes.
+size_t FileSize(const std::string &file_name) {
+  std::ifstream infile(file_name, std::ios::binary | std::ios::ate);
+  return infile.tellg();
+}
+}  // namespace
+
+// Test: serialize a map into a compressed file and then deserialize it.
+// Expect: return the map with same value as the original one, from a file
+// smaller than the binary format
+TEST(CompressedPersistence, ShouldGetExpectedMapWhenSerializeAndDeserialize) {
+  CompressedPersistence p(3);
+  std::string mock_file = "compressed_data";
+  StringKVMap mock_map = MockMap();
+  p.serialize(mock_map, mock_file);
+  EXPECT_EQ(mock_map, p.deserialize(mock_file));
+
+  std::string binary_file = "compressed_data_as_binary";
+  BinaryPersistence().serialize(mock_map, binary_file);
+  EXPECT_LT(FileSize(mock_file), FileSize(binary_file) / 2);
+  std::remove(mock_file.c_str());
+  std::remove(binary_file.c_str());
+}
+
+// Test: load a store written in the binary format
+// Expect: return the map of the binary file
+TEST(CompressedPersistence, ShouldReadBinaryFormatFile) {
+  std::string mock_file = "binary_data_for_compressed";
+  StringKVMap mock_map = {{"key", "value"}, {"other", "pair"}};
+  BinaryPersistence().serialize(mock_map, mock_file);
+  EXPECT_EQ(mock_map, CompressedPersistence(1).deserialize(mock_file));
+  std::remove(mock_file.c_str());
+}
+
+// Test: restart the map on a compressed store, and on a missing one
+// Expect: the map holds every stored pair, or nothing
+TEST(CompressedPersistence, ShouldRestoreThreadsafeMap) {
+  std::string mock_file = "compressed_map_data";
+  auto persist_ptr = std::make_shared<CompressedPersistence>(2);
+  StringKVMap mock_map = MockMap();
+  persist_ptr->serialize(mock_map, mock_file);
+  ThreadsafeMap map(persist_ptr, mock_file);
+  for (const auto &p : mock_map) {
+    ASSERT_EQ(p.second, map.Get(p.first).value());
+  }
+  std::remove(mock_file.c_str());
+
+  ThreadsafeMap empty(persist_ptr, mock_file);
+  EXPECT_EQ(std::nullopt, empty.Get("empty"));
+}
+
+// Test: flip a byte inside a block of a compressed file
+// Expect: loading fails instead of returning damaged pairs
+TEST(CompressedPersistenceDeathTest, ShouldFailOnCorruptBlock) {
+  std::string mock_file = "compressed_corrupt";
+  CompressedPersistence(1).serialize(MockMap(), mock_file);
+  {
+    std::fstream file(mock_file,
+                      std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(CompressedPersistence::kHeaderSize +
+               CompressedPersistence::kBlockHeaderSize + 10);
+    file.put('!');
+  }
+  EXPECT_DEATH(CompressedPersistence(1).deserialize(mock_file),
+               "Corrupt compressed store");
+  std::remove(mock_file.c_str());
+}
+}  // namespace cs499_fei
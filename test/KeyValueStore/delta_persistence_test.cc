@@ -0,0 +1,144 @@
+#include "delta_persistence.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "binary_persistence.h"
+#include "gtest/gtest.h"
+#include "threadsafe_map.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: remove the base and the deltas of the store.
+void RemoveStore(const std::string &file_name) {
+  for (const auto &delta : DeltaPersistence::ListDeltas(file_name)) {
+    std::remove(delta.file_name.c_str());
+  }
+  std::remove(file_name.c_str());
+}
+
+// Helper function: copy a file.
+void CopyFile(const std::string &from_file, const std::string &to_file) {
+  std::ifstream infile(from_file, std::ios::binary);
+  std::ofstream outfile(to_file, std::ios::binary);
+  outfile << infile.rdbuf();
+}
+}  // namespace
+
+// Test: store a base, then the changes to it as deltas, and load the store
+// Expect: the pairs of the base with the puts and removals of the deltas
+// applied in order, next to the base which is left alone
+TEST(DeltaPersistence, ShouldApplyDeltasOnTopOfBase) {
+  std::string mock_file = "delta_data";
+  auto base = std::make_shared<BinaryPersistence>();
+  base->serialize({{"kept", "1"}, {"replaced", "2"}, {"removed", "3"}},
+                  mock_file);
+  DeltaPersistence p(base);
+  p.serialize_delta({{"replaced", "4"}, {"added", "5"}}, {"removed"},
+                    mock_file);
+  p.serialize_delta({{"removed", "6"}, {"added", "7"}}, {"replaced"},
+                    mock_file);
+  EXPECT_EQ(2, DeltaPersistence::ListDeltas(mock_file).size());
+
+  StringKVMap expected = {{"kept", "1"}, {"removed", "6"}, {"added", "7"}};
+  EXPECT_EQ(expected, p.deserialize(mock_file));
+  EXPECT_EQ(3, base->deserialize(mock_file).size());
+  RemoveStore(mock_file);
+}
+
+// Test: store the whole data over a base and deltas, then a delta on top
+// Expect: the older base and deltas are ignored
+TEST(DeltaPersistence, ShouldReplaceEarlierStateWithFullDelta) {
+  std::string mock_file = "delta_full_data";
+  auto base = std::make_shared<BinaryPersistence>();
+  base->serialize({{"old", "1"}}, mock_file);
+  DeltaPersistence p(base);
+  p.serialize_delta({{"older", "2"}}, {}, mock_file);
+  p.serialize({{"whole", "3"}, {"data", "4"}}, mock_file);
+  p.serialize_delta({{"newer", "5"}}, {"data"}, mock_file);
+
+  StringKVMap expected = {{"whole", "3"}, {"newer", "5"}};
+  EXPECT_EQ(expected, p.deserialize(mock_file));
+  RemoveStore(mock_file);
+}
+
+// Test: fold the deltas into the base, then replay the folded deltas again
+// as after a crash before they were removed
+// Expect: the fold removes the deltas and keeps the data, and the replay
+// gives the same data
+TEST(DeltaPersistence, ShouldFoldDeltasIntoNewBase) {
+  std::string mock_file = "delta_fold_data";
+  auto base = std::make_shared<BinaryPersistence>();
+  DeltaPersistence p(base);
+  p.serialize({{"a", "1"}, {"b", "2"}}, mock_file);
+  p.serialize_delta({{"b", "3"}, {"c", "4"}}, {"a"}, mock_file);
+  p.serialize_delta({{"a", "5"}}, {"c"}, mock_file);
+  StringKVMap expected = {{"a", "5"}, {"b", "3"}};
+  auto deltas = DeltaPersistence::ListDeltas(mock_file);
+  for (const auto &delta : deltas) {
+    CopyFile(delta.file_name, delta.file_name + ".kept");
+  }
+
+  EXPECT_EQ(3, p.Fold(mock_file));
+  EXPECT_TRUE(DeltaPersistence::ListDeltas(mock_file).empty());
+  EXPECT_EQ(expected, base->deserialize(mock_file));
+  EXPECT_EQ(expected, p.deserialize(mock_file));
+  EXPECT_EQ(0, p.Fold(mock_file));
+
+  for (size_t i = 1; i < deltas.size(); ++i) {
+    std::rename((deltas[i].file_name + ".kept").c_str(),
+                deltas[i].file_name.c_str());
+  }
+  std::remove((deltas[0].file_name + ".kept").c_str());
+  EXPECT_EQ(expected, DeltaPersistence(base).deserialize(mock_file));
+  RemoveStore(mock_file);
+}
+
+// Test: store a map on deltas a few times, and restart it
+// Expect: every store after the first writes only the changed keys, and the
+// restarted map holds the last stored pairs
+TEST(DeltaPersistence, ShouldRestoreThreadsafeMap) {
+  std::string mock_file = "delta_map_data";
+  auto persist_ptr =
+      std::make_shared<DeltaPersistence>(std::make_shared<BinaryPersistence>());
+  {
+    ThreadsafeMap map(persist_ptr, mock_file);
+    for (int i = 0; i < 1000; ++i) {
+      map.Put("key_" + std::to_string(i), std::to_string(i));
+    }
+    map.Store(mock_file);
+    map.Put("key_1", "changed");
+    map.Remove("key_2");
+    map.Store(mock_file);
+  }
+  auto deltas = DeltaPersistence::ListDeltas(mock_file);
+  ASSERT_EQ(2, deltas.size());
+  std::ifstream last(deltas.back().file_name,
+                     std::ios::binary | std::ios::ate);
+  EXPECT_LT(static_cast<size_t>(last.tellg()), 100);
+
+  ThreadsafeMap map(persist_ptr, mock_file);
+  EXPECT_EQ("changed", map.Get("key_1").value());
+  EXPECT_EQ(std::nullopt, map.Get("key_2"));
+  EXPECT_EQ("999", map.Get("key_999").value());
+  RemoveStore(mock_file);
+}
+
+// Test: flip a byte inside a delta
+// Expect: loading fails instead of returning damaged pairs
+TEST(DeltaPersistenceDeathTest, ShouldFailOnCorruptDelta) {
+  std::string mock_file = "delta_corrupt";
+  DeltaPersistence p(std::make_shared<BinaryPersistence>());
+  p.serialize_delta({{"key", "value"}}, {}, mock_file);
+  std::string delta_file = DeltaPersistence::ListDeltas(mock_file)[0].file_name;
+  {
+    std::fstream file(delta_file,
+                      std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(DeltaPersistence::kHeaderSize + 10);
+    file.put('X');
+  }
+  EXPECT_DEATH(p.deserialize(mock_file), "Corrupt delta");
+  RemoveStore(mock_file);
+}
+}  // namespace cs499_fei
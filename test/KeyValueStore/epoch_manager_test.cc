@@ -0,0 +1,99 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../../src/KeyValueStore/epoch_manager.h"
+
+namespace cs499_fei {
+// Deleter which counts the deleted objects in the atomic<int> context.
+void CountingDelete(void *object, void *context) {
+  delete static_cast<int *>(object);
+  ++*static_cast<std::atomic<int> *>(context);
+}
+
+// Test: retire objects while no thread is in a critical section.
+// Expected: they are deleted after enough retirements advance the epoch.
+TEST(EpochManager, ShouldReclaimRetiredObjects) {
+  std::atomic<int> deleted{0};
+  EpochManager epochs;
+  for (size_t i = 0; i < 4 * EpochManager::kReclaimThreshold; ++i) {
+    epochs.Retire(new int(0), CountingDelete, &deleted);
+  }
+  EXPECT_GT(deleted.load(), 0);
+}
+
+// Test: retire objects while another thread stays in a critical section.
+// Expected: nothing is deleted until that thread leaves, and the manager
+//           deletes the rest when destroyed.
+TEST(EpochManager, ShouldNotReclaimWhileReaderIsActive) {
+  std::atomic<int> deleted{0};
+  {
+    EpochManager epochs;
+    std::atomic<bool> entered{false};
+    std::atomic<bool> leave{false};
+    std::thread reader([&] {
+      EpochManager::Guard guard(epochs);
+      entered = true;
+      while (!leave) {
+        std::this_thread::yield();
+      }
+    });
+    while (!entered) {
+      std::this_thread::yield();
+    }
+
+    const size_t count = 4 * EpochManager::kReclaimThreshold;
+    for (size_t i = 0; i < count; ++i) {
+      epochs.Retire(new int(0), CountingDelete, &deleted);
+    }
+    EXPECT_EQ(0, deleted.load());
+
+    leave = true;
+    reader.join();
+  }
+  EXPECT_EQ(4 * EpochManager::kReclaimThreshold, deleted.load());
+}
+
+// Test: run more threads one after the other than one segment has records,
+//       then more threads at once, each retiring objects inside a guard.
+// Expected: the records of the exited threads are reused, the concurrent
+//           threads get records of a new segment, and every object is
+//           deleted.
+TEST(EpochManager, ShouldServeThreadsBeyondOneSegment) {
+  std::atomic<int> deleted{0};
+  const int threads = EpochManager::kSegmentRecords + 64;
+  {
+    EpochManager epochs;
+    for (int t = 0; t < threads; ++t) {
+      std::thread([&] {
+        EpochManager::Guard guard(epochs);
+        epochs.Retire(new int(0), CountingDelete, &deleted);
+      }).join();
+    }
+
+    std::atomic<int> entered{0};
+    std::atomic<bool> leave{false};
+    std::vector<std::thread> concurrent;
+    for (int t = 0; t < threads; ++t) {
+      concurrent.emplace_back([&] {
+        EpochManager::Guard guard(epochs);
+        epochs.Retire(new int(0), CountingDelete, &deleted);
+        ++entered;
+        while (!leave) {
+          std::this_thread::yield();
+        }
+      });
+    }
+    while (entered < threads) {
+      std::this_thread::yield();
+    }
+    leave = true;
+    for (auto &thread : concurrent) {
+      thread.join();
+    }
+  }
+  EXPECT_EQ(2 * threads, deleted.load());
+}
+}  // namespace cs499_fei
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "../../src/KeyValueStore/lockfree_map.h"
+
+using ::testing::Return;
+
+namespace cs499_fei {
+// Mock class of PersistenceAbstraction
+// Used for dependency injection for LockFreeMap constructor
+class MockLockFreePersistence : public PersistenceAbstraction {
+ public:
+  MOCK_METHOD2(serialize,
+               void(const StringKVMap &kv_data, const std::string &to_file));
+  MOCK_METHOD1(deserialize, StringKVMap(const std::string &from_file));
+};
+
+// Test: construct an empty map
+// Expected: null when get some key
+TEST(LockFreeMap, DefaultConstructor) {
+  LockFreeMap m(16);
+  EXPECT_EQ(std::nullopt, m.Get("100"));
+  EXPECT_EQ(16, m.Capacity());
+}
+
+// Test: the capacity is rounded up to a power of two.
+// Expected: 100 slots become 128.
+TEST(LockFreeMap, CapacityIsPowerOfTwo) {
+  LockFreeMap m(100);
+  EXPECT_EQ(128, m.Capacity());
+}
+
+// Test: put, overwrite and remove a pair.
+// Expected: Get sees the latest value, then null after remove.
+TEST(LockFreeMap, PutOverwriteRemove) {
+  LockFreeMap m(16);
+  EXPECT_TRUE(m.Put("100", "value is 100"));
+  EXPECT_EQ("value is 100", m.Get("100"));
+
+  EXPECT_TRUE(m.Put("100", "new value"));
+  EXPECT_EQ("new value", m.Get("100"));
+
+  m.Remove("100");
+  EXPECT_EQ(std::nullopt, m.Get("100"));
+
+  // The tombstoned slot is reused by the same key.
+  EXPECT_TRUE(m.Put("100", "back again"));
+  EXPECT_EQ("back again", m.Get("100"));
+}
+
+// Test: get a value by reference, then overwrite and remove it.
+// Expected: the reader keeps a valid value after the map drops it.
+TEST(LockFreeMap, GetSharedReturnsTheStoredValue) {
+  LockFreeMap m(16);
+  ValuePtr value = MakeValue(std::string(1000, 'v'));
+  m.PutShared("100", value);
+
+  ValuePtr held = m.GetShared("100");
+  EXPECT_EQ(value.get(), held.get());
+
+  m.Put("100", "new value");
+  m.Remove("100");
+  EXPECT_EQ(nullptr, m.GetShared("100"));
+  EXPECT_EQ(std::string(1000, 'v'), std::string(*held));
+}
+
+// Test: put and remove far more distinct keys than the map has slots,
+// keeping a few of them live.
+// Expected: every put succeeds, the live keys keep their values, and the
+// capacity stays the same, as rebuilds drop the tombstones.
+TEST(LockFreeMap, ShouldReuseSlotsUnderKeyChurn) {
+  LockFreeMap m(16);
+  EXPECT_TRUE(m.Put("user", "kept"));
+  for (int i = 0; i < 10000; ++i) {
+    const auto key = "session_" + std::to_string(i);
+    ASSERT_TRUE(m.Put(key, key));
+    EXPECT_EQ(key, m.Get(key));
+    if (i >= 4) {
+      m.Remove("session_" + std::to_string(i - 4));
+    }
+  }
+  EXPECT_EQ("kept", m.Get("user"));
+  EXPECT_EQ("session_9999", m.Get("session_9999"));
+  EXPECT_EQ(std::nullopt, m.Get("session_9995"));
+  EXPECT_EQ(16, m.Capacity());
+}
+
+// Test: put more keys than the map has slots, and a version before that.
+// Expected: the map grows, every key keeps its value, and the version
+// survives the rebuilds.
+TEST(LockFreeMap, ShouldGrowWhenMostSlotsAreLive) {
+  LockFreeMap m(4);
+  uint64_t version;
+  ASSERT_EQ(LockFreeMap::PutStatus::kStored,
+            m.ConditionalPut("user", "1", LockFreeMap::kNoVersion, &version));
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(m.Put(std::to_string(i), std::to_string(i)));
+  }
+  EXPECT_GE(m.Capacity(), 1024);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(std::to_string(i), m.Get(std::to_string(i)));
+  }
+  uint64_t current;
+  EXPECT_EQ("1", *m.GetVersioned("user", &current));
+  EXPECT_EQ(version, current);
+}
+
+// Test: many threads put, append and remove their own short-lived keys in a
+// small map, so rebuilds run while they write.
+// Expected: no write is lost across the rebuilds.
+TEST(LockFreeMap, MultithreadsChurnAcrossRebuilds) {
+  LockFreeMap m(16);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&m, t] {
+      const auto list = "list_" + std::to_string(t);
+      for (int i = 0; i < 2000; ++i) {
+        const auto key = std::to_string(t) + "_" + std::to_string(i);
+        EXPECT_TRUE(m.Put(key, key));
+        EXPECT_TRUE(m.Append(list, "x", ""));
+        EXPECT_EQ(key, m.Get(key));
+        m.Remove(key);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < 8; ++t) {
+    EXPECT_EQ(std::string(2000, 'x'), m.Get("list_" + std::to_string(t)));
+  }
+}
+
+// Test: many threads put their own keys into a small map, until it spans
+// many rebuild chunks.
+// Expected: every key keeps its value across the rebuilds they share.
+TEST(LockFreeMap, MultithreadsGrowAcrossRebuildChunks) {
+  LockFreeMap m(16);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&m, t] {
+      for (int i = 0; i < 5000; ++i) {
+        const auto key = std::to_string(t) + "_" + std::to_string(i);
+        EXPECT_TRUE(m.Put(key, key));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_GE(m.Capacity(), 8 * LockFreeMap::kRebuildChunk);
+  for (int t = 0; t < 8; ++t) {
+    for (int i = 0; i < 5000; ++i) {
+      const auto key = std::to_string(t) + "_" + std::to_string(i);
+      ASSERT_EQ(key, m.Get(key));
+    }
+  }
+}
+
+// Test: many threads put, overwrite, get and remove the same keys.
+// Expected: no crash, and each key ends with a value some thread wrote.
+TEST(LockFreeMap, MultithreadsPutGetRemove) {
+  LockFreeMap m(1024);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&m, t] {
+      for (int round = 0; round < 200; ++round) {
+        for (int i = 0; i < 50; ++i) {
+          const auto key = std::to_string(i);
+          m.Put(key, key + "_" + std::to_string(t));
+          auto value = m.Get(key);
+          EXPECT_TRUE(value == std::nullopt || value->find(key + "_") == 0);
+          if (t % 2 && round % 3 == 0) {
+            m.Remove(key);
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (int i = 0; i < 50; ++i) {
+    const auto key = std::to_string(i);
+    m.Put(key, key);
+    EXPECT_EQ(key, m.Get(key));
+  }
+}
+
+// Test: many threads append to the same keys.
+// Expected: every appended element is in the list.
+TEST(LockFreeMap, MultithreadsAppendLosesNothing) {
+  LockFreeMap m(64);
+  EXPECT_TRUE(m.Append("list", "0", ","));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&m, t] {
+      for (int i = 0; i < 200; ++i) {
+        m.Append("list", std::to_string(t), ",");
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto value = m.Get("list");
+  ASSERT_TRUE(value.has_value());
+  EXPECT_EQ(8 * 200, std::count(value->begin(), value->end(), ','));
+  EXPECT_EQ('0', value->front());
+}
+
+// Test: put a key if absent, then at its version, then at a stale one.
+// Expected: only the puts at the current version succeed.
+TEST(LockFreeMap, ShouldPutIfVersionMatches) {
+  LockFreeMap m(64);
+  uint64_t version;
+  EXPECT_EQ(LockFreeMap::PutStatus::kStored,
+            m.ConditionalPut("user", "1", LockFreeMap::kNoVersion, &version));
+  uint64_t stored;
+  EXPECT_EQ(LockFreeMap::PutStatus::kStored,
+            m.ConditionalPut("user", "2", version, &stored));
+  uint64_t current;
+  EXPECT_EQ(LockFreeMap::PutStatus::kConflict,
+            m.ConditionalPut("user", "3", version, &current));
+  EXPECT_EQ(stored, current);
+  ValuePtr value = m.GetVersioned("user", &current);
+  EXPECT_EQ("2", *value);
+  EXPECT_EQ(stored, current);
+}
+
+// Test: load persisted data and store it back.
+// Expected: all pairs are loaded, removed pairs are not stored.
+TEST(LockFreeMap, ShouldLoadAndStoreData) {
+  std::shared_ptr<MockLockFreePersistence> mock_persist_ptr =
+      std::shared_ptr<MockLockFreePersistence>(new MockLockFreePersistence);
+  std::string mock_file = "data";
+  StringKVMap mock_data = {{"1", "one"}, {"2", "two"}, {"3", "three"}};
+
+  EXPECT_CALL(*mock_persist_ptr, deserialize(mock_file))
+      .WillOnce(Return(mock_data));
+  LockFreeMap map(mock_persist_ptr, mock_file, 16);
+  EXPECT_EQ("two", map.Get("2"));
+
+  map.Remove("3");
+  StringKVMap expected_data = {{"1", "one"}, {"2", "two"}};
+  EXPECT_CALL(*mock_persist_ptr, serialize(expected_data, mock_file));
+  map.Store(mock_file);
+}
+
+// Test: store the map into another file than the one it was loaded from.
+// Expected: the pairs are written to the given file.
+TEST(LockFreeMap, ShouldStoreIntoTheGivenFile) {
+  std::shared_ptr<MockLockFreePersistence> mock_persist_ptr =
+      std::shared_ptr<MockLockFreePersistence>(new MockLockFreePersistence);
+  std::string mock_file = "data";
+  std::string backup_file = "backup";
+  EXPECT_CALL(*mock_persist_ptr, deserialize(mock_file))
+      .WillOnce(Return(StringKVMap({{"loaded", "1"}})));
+  LockFreeMap map(mock_persist_ptr, mock_file, 16);
+  map.Put("added", "2");
+
+  EXPECT_CALL(*mock_persist_ptr,
+              serialize(StringKVMap({{"loaded", "1"}, {"added", "2"}}),
+                        backup_file));
+  map.Store(backup_file);
+}
+}  // namespace cs499_fei
@@ -0,0 +1,182 @@
+#include "lsm_map.h"
+
+#include <experimental/filesystem>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binary_persistence.h"
+#include "gtest/gtest.h"
+
+namespace cs499_fei {
+namespace {
+namespace fs = std::experimental::filesystem;
+
+// Helper function: sizes small enough to flush and compact a few thousand
+// keys through every level.
+LsmMap::Options SmallOptions() {
+  LsmMap::Options options;
+  options.memtable_bytes = 16 << 10;
+  options.block_size = 512;
+  options.run_bytes = 8 << 10;
+  options.level1_bytes = 32 << 10;
+  options.level0_runs = 2;
+  options.cache_bytes = 64 << 10;
+  return options;
+}
+}  // namespace
+
+// Test: put, replace and remove random keys through many flushes and
+// compactions, checking against a std::map
+// Expect: every lookup returns the latest value, and the data reaches the
+// deeper levels
+TEST(LsmMap, ShouldGetLatestValueThroughCompactions) {
+  std::string directory = "lsm_map_data";
+  fs::remove_all(directory);
+  std::map<std::string, std::string> expected;
+  {
+    LsmMap map(directory, SmallOptions());
+    std::mt19937 engine(7);
+    std::uniform_int_distribution<int> key_dist(0, 1999);
+    for (int i = 0; i < 20000; ++i) {
+      std::string key = "warble_" + std::to_string(key_dist(engine));
+      if (i % 7 == 0) {
+        map.Remove(key);
+        expected.erase(key);
+      } else {
+        std::string value = "value_" + std::to_string(i);
+        map.Put(key, value);
+        expected[key] = value;
+      }
+    }
+    map.WaitForCompactions();
+    for (int k = 0; k < 2000; ++k) {
+      std::string key = "warble_" + std::to_string(k);
+      auto it = expected.find(key);
+      if (it == expected.end()) {
+        EXPECT_EQ(std::nullopt, map.Get(key)) << key;
+      } else {
+        EXPECT_EQ(it->second, map.Get(key).value_or("<missing>")) << key;
+      }
+    }
+    LsmMap::Stats stats = map.GetStats();
+    EXPECT_GT(stats.compactions, 0);
+    EXPECT_GT(stats.level_runs[1] + stats.level_runs[2], 0);
+    EXPECT_GT(stats.WriteAmplification(), 1);
+  }
+  fs::remove_all(directory);
+}
+
+// Test: look up keys which were never written, inside the key range of the
+// runs, once the data is in runs
+// Expect: the run filters answer most lookups without reading a block
+TEST(LsmMap, ShouldSkipRunsRuledOutByFilters) {
+  std::string directory = "lsm_map_filter";
+  fs::remove_all(directory);
+  {
+    LsmMap map(directory, SmallOptions());
+    for (int i = 0; i < 5000; ++i) {
+      map.Put("user_" + std::to_string(i), "value");
+    }
+    map.Store(directory);
+    map.WaitForCompactions();
+    LsmMap::Stats before = map.GetStats();
+    for (int i = 0; i < 5000; ++i) {
+      EXPECT_EQ(std::nullopt,
+                map.Get("user_" + std::to_string(i) + "_absent"));
+    }
+    LsmMap::Stats stats = map.GetStats();
+    EXPECT_GT(stats.filter_bytes, 0);
+    EXPECT_GT(stats.filter_negatives, 0);
+    EXPECT_LT(stats.FilterFalsePositiveRate(), 0.05);
+    EXPECT_LT(stats.lookup_read_bytes - before.lookup_read_bytes,
+              5000 * SmallOptions().block_size / 10);
+  }
+  fs::remove_all(directory);
+}
+
+// Test: store the map, write more without storing, and reopen the directory
+// Expect: the reopened map holds the stored data and the stored removals,
+// and not the writes after the store
+TEST(LsmMap, ShouldRecoverStoredRuns) {
+  std::string directory = "lsm_map_recover";
+  fs::remove_all(directory);
+  {
+    LsmMap map(directory, SmallOptions());
+    for (int i = 0; i < 3000; ++i) {
+      map.Put("key_" + std::to_string(i), std::to_string(i));
+    }
+    map.Remove("key_5");
+    map.Store(directory);
+    map.Put("key_6", "unstored");
+  }
+  {
+    LsmMap map(directory, SmallOptions());
+    EXPECT_EQ("0", map.Get("key_0").value());
+    EXPECT_EQ(std::nullopt, map.Get("key_5"));
+    EXPECT_EQ("6", map.Get("key_6").value());
+    EXPECT_EQ("2999", map.Get("key_2999").value());
+    // versions keep growing after a restart.
+    uint64_t version;
+    map.GetVersioned("key_0", &version);
+    uint64_t new_version;
+    EXPECT_EQ(LsmMap::PutStatus::kStored,
+              map.ConditionalPut("key_0", "new", version, &new_version));
+    EXPECT_GT(new_version, version);
+  }
+  fs::remove_all(directory);
+}
+
+// Test: conditional puts and appends from several threads
+// Expect: versions detect conflicts, and no append is lost
+TEST(LsmMap, ShouldReadAndWriteAsOneStep) {
+  std::string directory = "lsm_map_rmw";
+  fs::remove_all(directory);
+  {
+    LsmMap map(directory, SmallOptions());
+    uint64_t version;
+    EXPECT_EQ(LsmMap::PutStatus::kStored,
+              map.ConditionalPut("user", "a", LsmMap::kNoVersion, &version));
+    uint64_t conflict;
+    EXPECT_EQ(LsmMap::PutStatus::kConflict,
+              map.ConditionalPut("user", "b", LsmMap::kNoVersion, &conflict));
+    EXPECT_EQ(version, conflict);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&map] {
+        for (int i = 0; i < 500; ++i) {
+          map.Append("list", "x", ",");
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    EXPECT_EQ(2000 * 2 - 1, map.Get("list").value().size());
+  }
+  fs::remove_all(directory);
+}
+
+// Test: open an empty directory with a stored snapshot file
+// Expect: the map starts with the pairs of the file
+TEST(LsmMap, ShouldImportSnapshotFile) {
+  std::string directory = "lsm_map_import";
+  std::string mock_file = "lsm_map_import_file";
+  fs::remove_all(directory);
+  auto persist_ptr = std::make_shared<BinaryPersistence>();
+  persist_ptr->serialize({{"user_1", "a"}, {"user_2", "b"}}, mock_file);
+  {
+    LsmMap map(persist_ptr, mock_file, directory, SmallOptions());
+    EXPECT_EQ("a", map.Get("user_1").value());
+  }
+  {
+    LsmMap map(directory);
+    EXPECT_EQ("b", map.Get("user_2").value());
+  }
+  fs::remove_all(directory);
+  std::remove(mock_file.c_str());
+}
+}  // namespace cs499_fei
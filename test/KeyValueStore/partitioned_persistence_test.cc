@@ -0,0 +1,123 @@
+#include "partitioned_persistence.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "lockfree_map.h"
+#include "threadsafe_map.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: a map with enough keys to fill every partition.
+StringKVMap MockMap() {
+  StringKVMap mock_map;
+  mock_map[std::string("zero\0byte", 9)] = std::string("\0\xff\n#", 4);
+  mock_map["empty"] = "";
+  for (int i = 0; i < 5000; ++i) {
+    mock_map["key_" + std::to_string(i)] = std::string(i % 100, 'v');
+  }
+  return mock_map;
+}
+
+// Helper function: whether the file exists.
+bool Exists(const std::string &file_name) {
+  return std::ifstream(file_name).good();
+}
+
+// Helper function: remove the store and the partitions of its manifest.
+void RemoveStore(const std::string &file_name) {
+  if (auto manifest = PartitionedPersistence::ReadManifest(file_name)) {
+    for (const auto &partition : manifest->partitions) {
+      std::remove(partition.file_name.c_str());
+    }
+  }
+  std::remove(file_name.c_str());
+}
+}  // namespace
+
+// Test: serialize a map into partitions and then deserialize them.
+// Expect: return the map with same value as the original one, with the
+// pairs spread over every partition of the manifest
+TEST(PartitionedPersistence, ShouldGetExpectedMapWhenSerializeAndDeserialize) {
+  PartitionedPersistence p(4);
+  std::string mock_file = "partitioned_data";
+  StringKVMap mock_map = MockMap();
+  p.serialize(mock_map, mock_file);
+
+  auto manifest = PartitionedPersistence::ReadManifest(mock_file);
+  ASSERT_TRUE(manifest.has_value());
+  ASSERT_EQ(4, manifest->partitions.size());
+  uint64_t count = 0;
+  for (const auto &partition : manifest->partitions) {
+    EXPECT_LT(0, partition.summary.count);
+    count += partition.summary.count;
+  }
+  EXPECT_EQ(mock_map.size(), count);
+  EXPECT_EQ(mock_map, p.deserialize(mock_file));
+  RemoveStore(mock_file);
+}
+
+// Test: serialize twice into the same store
+// Expect: the second generation replaces the partitions of the first
+TEST(PartitionedPersistence, ShouldRemovePreviousGeneration) {
+  PartitionedPersistence p(2);
+  std::string mock_file = "partitioned_generations";
+  p.serialize({{"old", "1"}}, mock_file);
+  auto first = PartitionedPersistence::ReadManifest(mock_file);
+  ASSERT_TRUE(first.has_value());
+
+  StringKVMap mock_map = {{"new", "2"}};
+  p.serialize(mock_map, mock_file);
+  auto second = PartitionedPersistence::ReadManifest(mock_file);
+  ASSERT_TRUE(second.has_value());
+  EXPECT_EQ(first->generation + 1, second->generation);
+  for (const auto &partition : first->partitions) {
+    EXPECT_FALSE(Exists(partition.file_name));
+  }
+  EXPECT_EQ(mock_map, p.deserialize(mock_file));
+  RemoveStore(mock_file);
+}
+
+// Test: load a store written in the binary format, without a manifest
+// Expect: return the map of the binary file
+TEST(PartitionedPersistence, ShouldReadBinaryFormatFile) {
+  std::string mock_file = "binary_data_for_partitioned";
+  StringKVMap mock_map = MockMap();
+  BinaryPersistence().serialize(mock_map, mock_file);
+  EXPECT_EQ(mock_map, PartitionedPersistence(4).deserialize(mock_file));
+  std::remove(mock_file.c_str());
+}
+
+// Test: restart both engines on a partitioned store, loaded in parallel
+// Expect: the maps hold every stored pair
+TEST(PartitionedPersistence, ShouldRestoreMapsInParallel) {
+  std::string mock_file = "partitioned_map_data";
+  auto persist_ptr = std::make_shared<PartitionedPersistence>(4);
+  StringKVMap mock_map = MockMap();
+  persist_ptr->serialize(mock_map, mock_file);
+
+  ThreadsafeMap threadsafe_map(persist_ptr, mock_file);
+  LockFreeMap lockfree_map(persist_ptr, mock_file);
+  for (const auto &p : mock_map) {
+    ASSERT_EQ(p.second, threadsafe_map.Get(p.first).value());
+    ASSERT_EQ(p.second, lockfree_map.Get(p.first).value());
+  }
+  RemoveStore(mock_file);
+}
+
+// Test: replace a partition with one of another snapshot
+// Expect: loading fails instead of mixing the snapshots
+TEST(PartitionedPersistenceDeathTest, ShouldFailOnMismatchedPartition) {
+  PartitionedPersistence p(2);
+  std::string mock_file = "partitioned_mismatch";
+  p.serialize(MockMap(), mock_file);
+  auto manifest = PartitionedPersistence::ReadManifest(mock_file);
+  ASSERT_TRUE(manifest.has_value());
+  BinaryPersistence().serialize({{"other", "snapshot"}},
+                                manifest->partitions[0].file_name);
+  EXPECT_DEATH(p.deserialize(mock_file), "does not match the manifest");
+  RemoveStore(mock_file);
+}
+}  // namespace cs499_fei
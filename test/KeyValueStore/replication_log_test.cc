@@ -0,0 +1,117 @@
+#include "replication_log.h"
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cs499_fei {
+namespace {
+using Entry = ReplicationLog::Entry;
+using ReadStatus = ReplicationLog::ReadStatus;
+
+// Helper function: a shared value.
+ValuePtr Value(const std::string &value) {
+  return MakeValue(value);
+}
+}  // namespace
+
+// Test: append puts and a removal, then read them in two parts
+// Expect: the entries in order with their sequences, values and removal
+TEST(ReplicationLog, ShouldReadTheEntriesAfterASequence) {
+  ReplicationLog log(16);
+  EXPECT_NE(0, log.id());
+  EXPECT_EQ(0, log.LastSequence());
+  EXPECT_EQ(1, log.Append("warble_1", Value("a")));
+  EXPECT_EQ(2, log.Append("warble_2", Value("b")));
+  EXPECT_EQ(3, log.Append("warble_1", nullptr));
+  EXPECT_EQ(3, log.LastSequence());
+
+  std::vector<Entry> entries;
+  ASSERT_EQ(ReadStatus::kOk,
+            log.Read(0, 2, std::chrono::milliseconds(0), &entries));
+  ASSERT_EQ(2, entries.size());
+  EXPECT_EQ(1, entries[0].sequence);
+  EXPECT_EQ("warble_1", entries[0].key);
+  EXPECT_EQ("a", *entries[0].value);
+  EXPECT_EQ("b", *entries[1].value);
+
+  entries.clear();
+  ASSERT_EQ(ReadStatus::kOk,
+            log.Read(2, 16, std::chrono::milliseconds(0), &entries));
+  ASSERT_EQ(1, entries.size());
+  EXPECT_EQ(3, entries[0].sequence);
+  EXPECT_EQ(nullptr, entries[0].value);
+}
+
+// Test: append a put with a TTL next to one without
+// Expect: the first entry expires the TTL after it was appended, the other
+// one never does
+TEST(ReplicationLog, ShouldKeepWhenAValueExpires) {
+  ReplicationLog log(16);
+  auto before = std::chrono::steady_clock::now();
+  log.Append("cursor", Value("a"), std::chrono::milliseconds(500));
+  auto after = std::chrono::steady_clock::now();
+  log.Append("user", Value("b"));
+
+  std::vector<Entry> entries;
+  ASSERT_EQ(ReadStatus::kOk,
+            log.Read(0, 16, std::chrono::milliseconds(0), &entries));
+  ASSERT_EQ(2, entries.size());
+  EXPECT_GE(entries[0].expires_at,
+            before + std::chrono::milliseconds(500));
+  EXPECT_LE(entries[0].expires_at, after + std::chrono::milliseconds(500));
+  EXPECT_EQ(std::chrono::steady_clock::time_point(), entries[1].expires_at);
+}
+
+// Test: append more entries than the log keeps
+// Expect: reading from before the kept entries, or past the last one, is
+// truncated; reading from the first kept one is not
+TEST(ReplicationLog, ShouldTruncateBeyondItsCapacity) {
+  ReplicationLog log(4);
+  for (int i = 0; i < 10; ++i) {
+    log.Append("warble_" + std::to_string(i), Value("v"));
+  }
+  std::vector<Entry> entries;
+  EXPECT_EQ(ReadStatus::kTruncated,
+            log.Read(5, 16, std::chrono::milliseconds(0), &entries));
+  EXPECT_EQ(ReadStatus::kTruncated,
+            log.Read(11, 16, std::chrono::milliseconds(0), &entries));
+  EXPECT_TRUE(entries.empty());
+  ASSERT_EQ(ReadStatus::kOk,
+            log.Read(6, 16, std::chrono::milliseconds(0), &entries));
+  ASSERT_EQ(4, entries.size());
+  EXPECT_EQ(7, entries[0].sequence);
+  EXPECT_EQ("warble_9", entries[3].key);
+}
+
+// Test: read while caught up, then append from another thread, then close
+// Expect: the read waits for the entry, an idle read returns no entries
+// after its timeout, and a closed log wakes the reader
+TEST(ReplicationLog, ShouldWaitForTheNextEntry) {
+  ReplicationLog log(16);
+  std::vector<Entry> entries;
+  EXPECT_EQ(ReadStatus::kOk,
+            log.Read(0, 16, std::chrono::milliseconds(10), &entries));
+  EXPECT_TRUE(entries.empty());
+
+  std::thread writer([&log] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    log.Append("warble_1", Value("a"));
+  });
+  EXPECT_EQ(ReadStatus::kOk,
+            log.Read(0, 16, std::chrono::seconds(10), &entries));
+  writer.join();
+  ASSERT_EQ(1, entries.size());
+
+  std::thread closer([&log] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    log.Close();
+  });
+  EXPECT_EQ(ReadStatus::kClosed,
+            log.Read(1, 16, std::chrono::seconds(10), &entries));
+  closer.join();
+}
+}  // namespace cs499_fei
@@ -0,0 +1,203 @@
+#include "replication.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "threadsafe_map.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: a primary whose replicate method streams the log.
+class PrimaryService : public kvstore::KeyValueStore::Service {
+ public:
+  PrimaryService(KVMapPtr kv_map, std::shared_ptr<ReplicationLog> log)
+      : source_(std::move(kv_map), std::move(log),
+                std::chrono::milliseconds(20)) {}
+
+  grpc::Status replicate(
+      grpc::ServerContext *context, const kvstore::ReplicateRequest *request,
+      grpc::ServerWriter<kvstore::ReplicateReply> *writer) override {
+    return source_.Serve(context, *request, writer);
+  }
+
+ private:
+  ReplicationSource source_;
+};
+
+// Helper function: a primary on a free local port, with its store and log.
+struct Primary {
+  explicit Primary(size_t log_capacity)
+      : kv_map(std::make_shared<ThreadsafeMap>()),
+        log(std::make_shared<ReplicationLog>(log_capacity)),
+        service(kv_map, log) {
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort("localhost:0", grpc::InsecureServerCredentials(),
+                             &port);
+    builder.RegisterService(&service);
+    server = builder.BuildAndStart();
+  }
+
+  ~Primary() {
+    log->Close();
+    server->Shutdown();
+  }
+
+  // Put or remove the key as the service of a primary does.
+  void Put(const std::string &key, const std::string &value) {
+    kv_map->Put(key, value);
+    log->Append(key, kv_map->GetShared(key));
+  }
+  void PutWithTtl(const std::string &key, const std::string &value,
+                  std::chrono::milliseconds ttl) {
+    kv_map->PutWithTtl(key, value, ttl);
+    std::chrono::milliseconds left;
+    ValuePtr stored = kv_map->GetWithTtl(key, &left);
+    log->Append(key, stored, left);
+  }
+  void Remove(const std::string &key) {
+    kv_map->Remove(key);
+    log->Append(key, nullptr);
+  }
+
+  std::shared_ptr<grpc::Channel> Channel() const {
+    return grpc::CreateChannel("localhost:" + std::to_string(port),
+                               grpc::InsecureChannelCredentials());
+  }
+
+  KVMapPtr kv_map;
+  std::shared_ptr<ReplicationLog> log;
+  PrimaryService service;
+  int port = 0;
+  std::unique_ptr<grpc::Server> server;
+};
+
+// Helper function: wait up to 10 seconds for done to hold.
+bool WaitUntil(const std::function<bool()> &done) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return true;
+}
+}  // namespace
+
+// Test: start a replica with a stale key after the primary holds data, then
+// write on the primary, then shut the primary down
+// Expect: the replica drops the stale key, loads the snapshot, applies the
+// later writes, and stays ready with a growing staleness once the primary
+// is gone
+TEST(Replication, ShouldFollowThePrimaryFromASnapshot) {
+  Primary primary(1024);
+  for (int i = 0; i < 1000; ++i) {
+    primary.Put("warble_" + std::to_string(i), std::to_string(i));
+  }
+  KVMapPtr replica_map = std::make_shared<ThreadsafeMap>();
+  replica_map->Put("stale", "x");
+  ReplicaFollower follower(primary.Channel(), replica_map);
+  EXPECT_FALSE(follower.ready());
+  EXPECT_EQ(std::chrono::milliseconds::max(), follower.Staleness());
+  follower.Start();
+
+  ASSERT_TRUE(WaitUntil([&] {
+    return follower.ready() &&
+           follower.sequence() == primary.log->LastSequence();
+  }));
+  EXPECT_EQ(nullptr, replica_map->GetShared("stale"));
+  EXPECT_EQ("999", *replica_map->GetShared("warble_999"));
+
+  primary.Put("warble_1", "new");
+  primary.Remove("warble_2");
+  primary.Put("warble_1000", "1000");
+  primary.kv_map->Append("warble_1000", "1001", ",");
+  primary.log->Append("warble_1000", primary.kv_map->GetShared("warble_1000"));
+  ASSERT_TRUE(WaitUntil(
+      [&] { return follower.sequence() == primary.log->LastSequence(); }));
+  EXPECT_EQ("new", *replica_map->GetShared("warble_1"));
+  EXPECT_EQ(nullptr, replica_map->GetShared("warble_2"));
+  EXPECT_EQ("1000,1001", *replica_map->GetShared("warble_1000"));
+  // the heartbeats keep an idle replica current.
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_LT(follower.Staleness(), std::chrono::milliseconds(1000));
+
+  primary.log->Close();
+  primary.server->Shutdown();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_TRUE(follower.ready());
+  EXPECT_GE(follower.Staleness(), std::chrono::milliseconds(100));
+  follower.Stop();
+}
+
+// Test: put keys with a TTL on the primary before a replica starts and
+// after it caught up, then wait until they expire
+// Expect: the replica holds both keys with no more time left than on the
+// primary, and they expire on the replica too
+TEST(Replication, ShouldReplicateTheTtlOfAPut) {
+  Primary primary(1024);
+  primary.PutWithTtl("cursor_1", "1", std::chrono::seconds(1));
+  primary.Put("user", "2");
+  KVMapPtr replica_map = std::make_shared<ThreadsafeMap>();
+  ReplicaFollower follower(primary.Channel(), replica_map);
+  follower.Start();
+  ASSERT_TRUE(WaitUntil([&] {
+    return follower.ready() &&
+           follower.sequence() == primary.log->LastSequence();
+  }));
+  primary.PutWithTtl("cursor_2", "3", std::chrono::seconds(1));
+  ASSERT_TRUE(WaitUntil(
+      [&] { return follower.sequence() == primary.log->LastSequence(); }));
+
+  std::chrono::milliseconds ttl;
+  ASSERT_NE(nullptr, replica_map->GetWithTtl("cursor_1", &ttl));
+  EXPECT_GT(ttl, std::chrono::milliseconds::zero());
+  EXPECT_LE(ttl, std::chrono::seconds(1));
+  ASSERT_NE(nullptr, replica_map->GetWithTtl("cursor_2", &ttl));
+  EXPECT_GT(ttl, std::chrono::milliseconds::zero());
+  EXPECT_LE(ttl, std::chrono::seconds(1));
+  EXPECT_EQ("2", *replica_map->GetWithTtl("user", &ttl));
+  EXPECT_EQ(std::chrono::milliseconds::zero(), ttl);
+
+  EXPECT_TRUE(WaitUntil([&] {
+    return replica_map->GetShared("cursor_1") == nullptr &&
+           replica_map->GetShared("cursor_2") == nullptr;
+  }));
+  EXPECT_EQ("2", *replica_map->GetShared("user"));
+  follower.Stop();
+}
+
+// Test: ask for the writes after a sequence the log no longer keeps
+// Expect: the primary sends a RESET and the snapshot before the writes
+TEST(Replication, ShouldSnapshotAReplicaBehindTheLog) {
+  Primary primary(4);
+  for (int i = 0; i < 10; ++i) {
+    primary.Put("warble_" + std::to_string(i), std::to_string(i));
+  }
+  auto stub = kvstore::KeyValueStore::NewStub(primary.Channel());
+  grpc::ClientContext context;
+  kvstore::ReplicateRequest request;
+  request.set_log_id(primary.log->id());
+  request.set_after_sequence(1);
+  auto reader = stub->replicate(&context, request);
+
+  kvstore::ReplicateReply reply;
+  ASSERT_TRUE(reader->Read(&reply));
+  EXPECT_EQ(kvstore::ReplicateReply::RESET, reply.type());
+  EXPECT_EQ(10, reply.sequence());
+  size_t pairs = 0;
+  while (reader->Read(&reply) &&
+         reply.type() == kvstore::ReplicateReply::SNAPSHOT) {
+    pairs += reply.writes_size();
+  }
+  EXPECT_EQ(10, pairs);
+  EXPECT_EQ(kvstore::ReplicateReply::HEARTBEAT, reply.type());
+  EXPECT_EQ(10, reply.primary_sequence());
+  context.TryCancel();
+  reader->Finish();
+}
+}  // namespace cs499_fei
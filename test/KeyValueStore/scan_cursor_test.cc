@@ -0,0 +1,57 @@
+#include "scan_cursor.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "threadsafe_map.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: the keys of every chunk of the scan of the request.
+std::vector<std::string> ScanAll(const KVMapAbstraction &kv_map,
+                                 const kvstore::ScanRequest &request,
+                                 int *chunks) {
+  ScanCursor cursor(request);
+  ScanPairs pairs;
+  std::vector<std::string> keys;
+  *chunks = 0;
+  while (cursor.Next(kv_map, &pairs)) {
+    ++*chunks;
+    for (const auto &pair : pairs) {
+      keys.push_back(pair.first);
+    }
+  }
+  return keys;
+}
+}  // namespace
+
+// Test: scan a prefix with more keys than a chunk, after a cursor key, and
+// with a limit
+// Expect: the keys of the prefix in order and in chunks, starting after the
+// cursor and stopping at the limit
+TEST(ScanCursor, ShouldReadPrefixInChunks) {
+  ThreadsafeMap kv_map;
+  const int keys = ScanCursor::kChunk * 2 + 10;
+  for (int i = 0; i < keys; ++i) {
+    kv_map.Put("user_" + std::to_string(1000 + i), "value");
+  }
+  kv_map.Put("usera", "outside the prefix");
+
+  kvstore::ScanRequest request;
+  request.set_prefix("user_");
+  int chunks;
+  std::vector<std::string> scanned = ScanAll(kv_map, request, &chunks);
+  ASSERT_EQ(keys, scanned.size());
+  EXPECT_EQ("user_1000", scanned.front());
+  EXPECT_EQ("user_" + std::to_string(1000 + keys - 1), scanned.back());
+  EXPECT_EQ(3, chunks);
+
+  request.set_cursor("user_1004");
+  request.set_limit(ScanCursor::kChunk);
+  scanned = ScanAll(kv_map, request, &chunks);
+  ASSERT_EQ(ScanCursor::kChunk, scanned.size());
+  EXPECT_EQ("user_1005", scanned.front());
+  EXPECT_EQ(1, chunks);
+}
+}  // namespace cs499_fei
@@ -0,0 +1,120 @@
+#include "shm_transport.h"
+
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "shm_listener.h"
+#include "shm_storage.h"
+#include "threadsafe_map.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: a KeyValueStore service whose writes go to the map.
+class MapService : public kvstore::KeyValueStore::Service {
+ public:
+  explicit MapService(KVMapPtr kv_map) : kv_map_(std::move(kv_map)) {}
+
+  grpc::Status put(grpc::ServerContext *context,
+                   const kvstore::PutRequest *request,
+                   kvstore::PutReply *reply) override {
+    kv_map_->Put(request->key(), request->value());
+    return grpc::Status::OK;
+  }
+
+  grpc::Status remove(grpc::ServerContext *context,
+                      const kvstore::RemoveRequest *request,
+                      kvstore::RemoveReply *reply) override {
+    kv_map_->Remove(request->key());
+    return grpc::Status::OK;
+  }
+
+ private:
+  KVMapPtr kv_map_;
+};
+}  // namespace
+
+// Test: stream a message many times the size of the pipe from a writer
+// thread, read in chunks of another size
+// Expect: the reader gets every byte in order
+TEST(ShmTransport, ShouldStreamMessagesLargerThanThePipe) {
+  auto pipe = std::make_unique<ShmPipe>();
+  std::string message(5 * ShmPipe::kBytes + 123, '\0');
+  for (size_t i = 0; i < message.size(); ++i) {
+    message[i] = static_cast<char>(i * 131 % 251);
+  }
+  ShmDeadline deadline = ShmClock::now() + std::chrono::seconds(10);
+  std::thread writer([&] {
+    std::string_view bytes(message);
+    EXPECT_TRUE(pipe->Write({bytes.substr(0, 7), bytes.substr(7)}, deadline));
+  });
+
+  std::string received(message.size(), '\0');
+  for (size_t offset = 0; offset < received.size(); offset += 40000) {
+    size_t size = std::min<size_t>(40000, received.size() - offset);
+    ASSERT_TRUE(pipe->Read(&received[offset], size, deadline));
+  }
+  writer.join();
+  EXPECT_EQ(message, received);
+}
+
+// Test: read from an empty pipe
+// Expect: the read gives up at its deadline
+TEST(ShmTransport, ShouldTimeOutReadingAnEmptyPipe) {
+  auto pipe = std::make_unique<ShmPipe>();
+  char byte;
+  auto start = ShmClock::now();
+  EXPECT_FALSE(pipe->Read(&byte, 1, start + std::chrono::milliseconds(50)));
+  EXPECT_GE(ShmClock::now() - start, std::chrono::milliseconds(50));
+}
+
+// Test: put, get, batch and remove through ShmStorage against a
+// ShmListener, and call once the listener is shut down
+// Expect: the same values as the map holds, versions of the map, and an
+// empty result without a server
+TEST(ShmTransport, ShouldServeStorageCallsOverSharedMemory) {
+  std::string name = "kvstore_shm_test_" + std::to_string(getpid());
+  KVMapPtr kv_map = std::make_shared<ThreadsafeMap>();
+  MapService service(kv_map);
+  ShmListener listener(name, 2, &service, kv_map);
+  ASSERT_TRUE(listener.Start());
+
+  ShmStorage storage(name, std::chrono::milliseconds(2000));
+  std::string large(3 * ShmPipe::kBytes, 'w');
+  storage.Put("warble_1", "hello");
+  storage.Put("warble_2", large);
+  EXPECT_EQ("hello", storage.Get({"warble_1"})[0].value());
+  auto values = storage.Get({"warble_2", "warble_3", "warble_1"});
+  ASSERT_EQ(3, values.size());
+  EXPECT_EQ(large, values[0].value());
+  EXPECT_EQ("", values[1].value());
+  EXPECT_EQ("hello", values[2].value());
+
+  uint64_t version = 0;
+  kv_map->GetVersioned("warble_1", &version);
+  VersionedValue versioned = storage.GetVersioned("warble_1");
+  EXPECT_EQ("hello", versioned.value);
+  EXPECT_EQ(version, versioned.version);
+  EXPECT_EQ(kNoVersion, storage.GetVersioned("warble_3").version);
+
+  // two threads need both slots at once.
+  std::thread other([&] {
+    for (int i = 0; i < 100; ++i) {
+      EXPECT_EQ("hello", storage.Get({"warble_1"})[0].value());
+    }
+  });
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(large, storage.Get({"warble_2"})[0].value());
+  }
+  other.join();
+
+  storage.Remove("warble_1");
+  EXPECT_EQ(nullptr, kv_map->GetShared("warble_1"));
+
+  listener.Shutdown();
+  EXPECT_FALSE(storage.Get({"warble_2"})[0].has_value());
+}
+}  // namespace cs499_fei
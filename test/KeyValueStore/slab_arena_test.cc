@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../../src/KeyValueStore/slab_arena.h"
+
+namespace cs499_fei {
+// Test: allocate chunks of different sizes and write into them.
+// Expected: chunks are 8-byte aligned, distinct, and counted as used until
+//           they are freed.
+TEST(SlabArena, AllocateAndDeallocate) {
+  SlabArena arena;
+  std::vector<std::pair<void *, size_t>> chunks;
+  for (size_t size = 1; size <= SlabArena::kMaxChunkSize; size += 7) {
+    void *p = arena.Allocate(size);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(p) % 8);
+    std::memset(p, 0xab, size);
+    chunks.emplace_back(p, size);
+  }
+  EXPECT_GT(arena.GetStats().used_bytes, 0);
+  EXPECT_EQ(0, arena.GetStats().large_bytes);
+
+  for (auto &chunk : chunks) {
+    arena.Deallocate(chunk.first, chunk.second);
+  }
+  EXPECT_EQ(0, arena.GetStats().used_bytes);
+}
+
+// Test: allocate more than kMaxChunkSize bytes.
+// Expected: the allocation bypasses the slabs.
+TEST(SlabArena, LargeAllocation) {
+  SlabArena arena;
+  void *p = arena.Allocate(4096);
+  EXPECT_EQ(4096, arena.GetStats().large_bytes);
+  EXPECT_EQ(0, arena.GetStats().slab_bytes);
+  arena.Deallocate(p, 4096);
+  EXPECT_EQ(0, arena.GetStats().large_bytes);
+}
+
+// Test: fill many slabs, free most of the chunks, and evacuate.
+// Expected: the sparse slabs are returned, and go back to the system once the
+//           remaining chunks are freed.
+TEST(SlabArena, ShouldReleaseEvacuatedSlabs) {
+  SlabArena arena;
+  std::vector<void *> chunks;
+  for (int i = 0; i < 20000; ++i) {
+    chunks.push_back(arena.Allocate(64));
+  }
+  size_t full_bytes = arena.GetStats().slab_bytes;
+
+  std::vector<void *> kept;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (i % 10 == 0) {
+      kept.push_back(chunks[i]);
+    } else {
+      arena.Deallocate(chunks[i], 64);
+    }
+  }
+  std::vector<uintptr_t> slabs = arena.BeginEvacuation(0.5);
+  EXPECT_FALSE(slabs.empty());
+  for (void *p : kept) {
+    EXPECT_TRUE(SlabArena::InSlabs(slabs, p));
+  }
+
+  // New chunks come from other slabs, the way the owner moves them.
+  std::vector<void *> moved;
+  for (size_t i = 0; i < kept.size(); ++i) {
+    moved.push_back(arena.Allocate(64));
+    EXPECT_FALSE(SlabArena::InSlabs(slabs, moved.back()));
+  }
+  for (void *p : kept) {
+    arena.Deallocate(p, 64);
+  }
+  EXPECT_LT(arena.GetStats().slab_bytes, full_bytes / 4);
+}
+
+// Test: fill many slabs of two classes, free every chunk in random order and
+// fill them again.
+// Expected: the emptied slabs go back to the system but one per class, and
+//           the arena serves the second round from tracked slabs.
+TEST(SlabArena, ShouldReleaseSlabsInAnyOrder) {
+  SlabArena arena;
+  std::vector<std::pair<void *, size_t>> chunks;
+  for (int i = 0; i < 20000; ++i) {
+    size_t size = i % 2 ? 48 : 200;
+    chunks.emplace_back(arena.Allocate(size), size);
+  }
+  std::shuffle(chunks.begin(), chunks.end(), std::mt19937(7));
+  for (size_t round = 0; round < 2; ++round) {
+    for (auto &chunk : chunks) {
+      arena.Deallocate(chunk.first, chunk.second);
+    }
+    EXPECT_EQ(0, arena.GetStats().used_bytes);
+    EXPECT_EQ(2 * SlabArena::kSlabSize, arena.GetStats().slab_bytes);
+    for (auto &chunk : chunks) {
+      chunk.first = arena.Allocate(chunk.second);
+      std::memset(chunk.first, 0xab, chunk.second);
+    }
+  }
+  for (auto &chunk : chunks) {
+    arena.Deallocate(chunk.first, chunk.second);
+  }
+}
+}  // namespace cs499_fei
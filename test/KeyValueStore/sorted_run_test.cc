@@ -0,0 +1,172 @@
+#include "sorted_run.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "block_cache.h"
+#include "gtest/gtest.h"
+
+namespace cs499_fei {
+namespace {
+// Helper function: key i, in order of i.
+std::string KeyOf(int i) {
+  std::string number = std::to_string(i);
+  return "key_" + std::string(6 - number.size(), '0') + number;
+}
+
+// Helper function: write a run of keys 0 to count - 1, every tenth removed.
+void WriteRun(const std::string &file_name, int count) {
+  SortedRun::Builder builder(file_name, 256);
+  for (int i = 0; i < count; ++i) {
+    std::string key = KeyOf(i);
+    std::string value = "value_" + std::to_string(i);
+    SortedRun::Record record;
+    record.key = key;
+    record.removed = i % 10 == 0;
+    if (!record.removed) {
+      record.value = value;
+    }
+    record.version = i + 1;
+    builder.Add(record);
+  }
+  builder.Finish();
+}
+}  // namespace
+
+// Test: write a run over many blocks, then look up every key, keys between
+// them and keys outside of it
+// Expect: every key is found with its value, version and tombstone, the
+// others are not
+TEST(SortedRun, ShouldFindEveryKeyOfTheRun) {
+  std::string mock_file = "sorted_run_data";
+  WriteRun(mock_file, 1000);
+  auto run = SortedRun::Open(1, mock_file, nullptr, nullptr);
+  EXPECT_EQ(1000, run->count());
+  EXPECT_EQ(KeyOf(0), run->smallest());
+  EXPECT_EQ(KeyOf(999), run->largest());
+  for (int i = 0; i < 1000; ++i) {
+    auto found = run->Get(KeyOf(i));
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(i % 10 == 0, found->removed);
+    EXPECT_EQ(i + 1, found->version);
+    if (!found->removed) {
+      EXPECT_EQ("value_" + std::to_string(i), found->value);
+    }
+  }
+  EXPECT_FALSE(run->Get(KeyOf(5) + "_between").has_value());
+  EXPECT_FALSE(run->Get("a").has_value());
+  EXPECT_FALSE(run->Get("z").has_value());
+  std::remove(mock_file.c_str());
+}
+
+// Test: iterate over a run
+// Expect: every record in key order
+TEST(SortedRun, ShouldIterateInKeyOrder) {
+  std::string mock_file = "sorted_run_iterate";
+  WriteRun(mock_file, 500);
+  SortedRun::Iterator it(SortedRun::Open(1, mock_file, nullptr, nullptr));
+  for (int i = 0; i < 500; ++i, it.Next()) {
+    ASSERT_TRUE(it.Valid());
+    EXPECT_EQ(KeyOf(i), it.record().key);
+  }
+  EXPECT_FALSE(it.Valid());
+  std::remove(mock_file.c_str());
+}
+
+// Test: look up a key of a run twice through a block cache
+// Expect: only the first lookup reads the block from the file
+TEST(SortedRun, ShouldReadBlocksThroughCache) {
+  std::string mock_file = "sorted_run_cached";
+  WriteRun(mock_file, 100);
+  BlockCache cache(1 << 20);
+  std::atomic<uint64_t> read_bytes{0};
+  auto run = SortedRun::Open(7, mock_file, &cache, &read_bytes);
+  EXPECT_TRUE(run->Get(KeyOf(42)).has_value());
+  uint64_t first = read_bytes;
+  EXPECT_GT(first, 0);
+  EXPECT_TRUE(run->Get(KeyOf(42)).has_value());
+  EXPECT_EQ(first, read_bytes);
+  EXPECT_EQ(1, cache.GetStats().hits);
+  EXPECT_EQ(1, cache.GetStats().misses);
+  std::remove(mock_file.c_str());
+}
+
+// Test: probe the filter of a run with its keys and with keys it does not
+// hold, and open a run written without a filter
+// Expect: the filter passes every key of the run and rules out most others,
+// the run without a filter may hold any key
+TEST(SortedRun, ShouldRuleOutKeysWithFilter) {
+  std::string mock_file = "sorted_run_filter";
+  WriteRun(mock_file, 1000);
+  auto run = SortedRun::Open(1, mock_file, nullptr, nullptr);
+  ASSERT_TRUE(run->has_filter());
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(run->MayContain(BloomFilter::Hash(KeyOf(i))));
+  }
+  int passed = 0;
+  for (int i = 1000; i < 2000; ++i) {
+    passed += run->MayContain(BloomFilter::Hash(KeyOf(i)));
+  }
+  EXPECT_LT(passed, 50);
+
+  {
+    SortedRun::Builder builder(mock_file, 256, 0);
+    SortedRun::Record record;
+    record.key = "key";
+    builder.Add(record);
+    builder.Finish();
+  }
+  run = SortedRun::Open(1, mock_file, nullptr, nullptr);
+  EXPECT_FALSE(run->has_filter());
+  EXPECT_TRUE(run->MayContain(BloomFilter::Hash("other")));
+  EXPECT_TRUE(run->Get("key").has_value());
+  std::remove(mock_file.c_str());
+}
+
+// Test: mark a run obsolete and release it
+// Expect: its file is deleted
+TEST(SortedRun, ShouldDeleteObsoleteRun) {
+  std::string mock_file = "sorted_run_obsolete";
+  WriteRun(mock_file, 10);
+  auto run = SortedRun::Open(1, mock_file, nullptr, nullptr);
+  run->MarkObsolete();
+  run.reset();
+  EXPECT_FALSE(std::ifstream(mock_file).is_open());
+}
+
+// Test: insert more blocks into a cache than it holds
+// Expect: the least recently used blocks are evicted
+TEST(BlockCache, ShouldEvictLeastRecentlyUsedBlocks) {
+  BlockCache cache(BlockCache::kShardCount * 1000);
+  auto block = std::make_shared<const std::string>(400, 'b');
+  // a block inserted twice is charged once.
+  cache.Insert(0, 0, block);
+  cache.Insert(0, 0, block);
+  EXPECT_EQ(400, cache.GetStats().bytes);
+  for (uint64_t file = 1; file < 200; ++file) {
+    cache.Insert(file, 0, block);
+  }
+  EXPECT_LE(cache.GetStats().bytes, BlockCache::kShardCount * 1000);
+  EXPECT_EQ(nullptr, cache.Lookup(0, 0));
+  EXPECT_NE(nullptr, cache.Lookup(199, 0));
+  cache.EraseFile(199);
+  EXPECT_EQ(nullptr, cache.Lookup(199, 0));
+}
+
+// Test: flip a byte inside a data block of a run
+// Expect: the lookup fails instead of returning damaged records
+TEST(SortedRunDeathTest, ShouldFailOnCorruptBlock) {
+  std::string mock_file = "sorted_run_corrupt";
+  WriteRun(mock_file, 100);
+  {
+    std::fstream file(mock_file,
+                      std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(20);
+    file.put('X');
+  }
+  auto run = SortedRun::Open(1, mock_file, nullptr, nullptr);
+  EXPECT_DEATH(run->Get(KeyOf(0)), "Corrupt block");
+  std::remove(mock_file.c_str());
+}
+}  // namespace cs499_fei
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <thread>
 
@@ -7,6 +9,7 @@
 #include "../../src/KeyValueStore/threadsafe_map.h"
 
 using ::testing::Return;
+using ::testing::UnorderedElementsAre;
 
 namespace cs499_fei {
 // Mock class of PersistenceAbstraction
@@ -18,6 +21,14 @@ class MockPersistence : public PersistenceAbstraction {
   MOCK_METHOD1(deserialize, StringKVMap(const std::string &from_file));
 };
 
+class MockDeltaPersistence : public MockPersistence {
+ public:
+  bool SupportsDeltas() const override { return true; }
+  MOCK_METHOD3(serialize_delta, void(const StringKVMap &puts,
+                                     const std::vector<std::string> &removed,
+                                     const std::string &to_file));
+};
+
 using OptionalVector = std::vector<std::optional<std::string>>;
 
 void thread_put_pairs(ThreadsafeMap &m, int i) {
@@ -158,4 +169,645 @@ TEST(KeyValueStore, ShouldStoreDataIntoTheFile) {
   EXPECT_CALL(*mock_persist_ptr, serialize(testing::_, mock_file));
   map.Store(mock_file);
 }
-}  // namespace cs499_fei
\ No newline at end of file
+
+// Test: many threads read the same key of a single-shard map at once.
+// Expected: every reader gets the value.
+TEST(KeyValueStore, MultithreadsGetSameKey) {
+  ThreadsafeMap m(1);
+  m.Put("7", "7");
+
+  std::vector<std::thread> threads(10);
+  OptionalVector results(10);
+  for (int i = 0; i < 10; ++i) {
+    threads[i] = std::thread([&m, &results, i] { results[i] = m.Get("7"); });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (const auto &ret : results) {
+    EXPECT_EQ("7", ret);
+  }
+}
+
+// Test: get a value twice by reference, then overwrite and remove it.
+// Expected: both readers share one buffer, which stays valid for them after
+//           the map drops it.
+TEST(KeyValueStore, GetSharedReturnsTheStoredValue) {
+  ThreadsafeMap m;
+  ValuePtr value = MakeValue(std::string(1000, 'v'));
+  m.PutShared("100", value);
+
+  ValuePtr first = m.GetShared("100");
+  ValuePtr second = m.GetShared("100");
+  EXPECT_EQ(value.get(), first.get());
+  EXPECT_EQ(first.get(), second.get());
+
+  m.Put("100", "new value");
+  m.Remove("100");
+  EXPECT_EQ(nullptr, m.GetShared("100"));
+  EXPECT_EQ(std::string(1000, 'v'), std::string(*first));
+}
+
+// Test: construct maps with different numbers of shards.
+// Expected: at least one shard, and the requested count otherwise.
+TEST(KeyValueStore, ShardCount) {
+  ThreadsafeMap default_map;
+  EXPECT_EQ(ThreadsafeMap::kDefaultShardCount, default_map.ShardCount());
+
+  ThreadsafeMap single_map(1);
+  EXPECT_EQ(1, single_map.ShardCount());
+
+  ThreadsafeMap zero_map(0);
+  EXPECT_EQ(1, zero_map.ShardCount());
+}
+
+// Test: multiple threads put, get and remove keys spread over many shards.
+// Expected: every key not removed can be read back from its shard.
+TEST(KeyValueStore, MultithreadsShardedPutGetRemove) {
+  ThreadsafeMap m(8);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&m, t] {
+      for (int i = t * 100; i < (t + 1) * 100; ++i) {
+        thread_put_pairs(m, i);
+        if (i % 2) {
+          thread_remove_pairs(m, i);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (int i = 0; i < 400; ++i) {
+    const auto key = std::to_string(i);
+    if (i % 2) {
+      EXPECT_EQ(std::nullopt, m.Get(key));
+    } else {
+      EXPECT_EQ(key, m.Get(key));
+    }
+  }
+}
+
+// Test: copy a sharded map.
+// Expected: the copy has the same shards and data, and is independent.
+TEST(KeyValueStore, CopyShardedMap) {
+  ThreadsafeMap m(4);
+  m.Put("1", "one");
+  m.Put("2", "two");
+
+  ThreadsafeMap copy = m;
+  m.Remove("1");
+  EXPECT_EQ(4, copy.ShardCount());
+  EXPECT_EQ("one", copy.Get("1"));
+  EXPECT_EQ("two", copy.Get("2"));
+  EXPECT_EQ(std::nullopt, m.Get("1"));
+}
+
+// Test: load persisted data into a sharded map and store it back.
+// Expected: every pair is found after loading and all of them are stored.
+TEST(KeyValueStore, ShouldLoadAndStoreAllShards) {
+  std::shared_ptr<MockPersistence> mock_persist_ptr =
+      std::shared_ptr<MockPersistence>(new MockPersistence);
+  std::string mock_file = "data";
+  StringKVMap mock_data;
+  for (int i = 0; i < 50; ++i) {
+    mock_data[std::to_string(i)] = "value " + std::to_string(i);
+  }
+
+  EXPECT_CALL(*mock_persist_ptr, deserialize(mock_file))
+      .WillOnce(Return(mock_data));
+  ThreadsafeMap map(mock_persist_ptr, mock_file, 8);
+  for (const auto &p : mock_data) {
+    EXPECT_EQ(p.second, map.Get(p.first));
+  }
+
+  EXPECT_CALL(*mock_persist_ptr, serialize(mock_data, mock_file));
+  map.Store(mock_file);
+}
+
+// Test: put many pairs, remove most of them and compact the map.
+// Expected: the remaining pairs are intact, and the arenas give back the
+//           memory of the removed ones.
+TEST(KeyValueStore, ShouldCompactSparseArenas) {
+  ThreadsafeMap m(4);
+  const int count = 20000;
+  for (int i = 0; i < count; ++i) {
+    m.Put("user_warbles_user_" + std::to_string(i), "value " + std::to_string(i));
+  }
+  ValuePtr held = m.GetShared("user_warbles_user_10");
+  ThreadsafeMap::MemoryStats full = m.GetMemoryStats();
+  EXPECT_EQ(count, full.keys);
+  EXPECT_GT(full.BytesPerKey(), 0);
+
+  for (int i = 0; i < count; ++i) {
+    if (i % 10) {
+      m.Remove("user_warbles_user_" + std::to_string(i));
+    }
+  }
+  EXPECT_GT(m.Compact(), 0);
+  ThreadsafeMap::MemoryStats compacted = m.GetMemoryStats();
+  EXPECT_EQ(count / 10, compacted.keys);
+  EXPECT_LT(compacted.arena_bytes, full.arena_bytes / 2);
+
+  for (int i = 0; i < count; i += 10) {
+    EXPECT_EQ("value " + std::to_string(i),
+              m.Get("user_warbles_user_" + std::to_string(i)));
+  }
+  EXPECT_EQ("value 10", *held);
+
+  // the moved entries are still in the clocks of their shards.
+  m.SetMaxMemory(1);
+  EXPECT_EQ(0, m.GetMemoryStats().keys);
+}
+
+// Test: put values too long to be stored inline in a string, some of them
+// too long for a slab, then compact the map.
+// Expected: the arenas hold the value payloads, and the values are intact.
+TEST(KeyValueStore, ShouldCountValuePayloadsInTheArenas) {
+  ThreadsafeMap m(4);
+  const int count = 1000;
+  size_t value_bytes = 0;
+  for (int i = 0; i < count; ++i) {
+    std::string value(i % 2 ? 200 : 2000, 'a' + i % 26);
+    value_bytes += value.size();
+    m.Put("warble_" + std::to_string(i), value);
+  }
+  ThreadsafeMap::MemoryStats stats = m.GetMemoryStats();
+  EXPECT_GT(stats.arena_bytes, value_bytes);
+  EXPECT_GT(stats.used_bytes, count / 2 * 200);
+
+  for (int i = 0; i < count; i += 2) {
+    m.Remove("warble_" + std::to_string(i));
+  }
+  m.Compact();
+  for (int i = 1; i < count; i += 2) {
+    EXPECT_EQ(std::string(200, 'a' + i % 26),
+              m.Get("warble_" + std::to_string(i)));
+  }
+}
+
+// Test: put far more data than the memory limit allows.
+// Expected: the charged bytes stay within the limit and entries are evicted.
+TEST(KeyValueStore, ShouldStayWithinMaxMemory) {
+  ThreadsafeMap m(4);
+  const size_t max_memory = 100 * (ThreadsafeMap::kEntryOverhead + 100);
+  m.SetMaxMemory(max_memory);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(m.Put("key_" + std::to_string(i), std::string(90, 'v')));
+  }
+  ThreadsafeMap::CacheStats stats = m.GetCacheStats();
+  EXPECT_LE(stats.bytes, max_memory);
+  EXPECT_GT(stats.evictions, 0);
+  EXPECT_EQ(1000 - stats.evictions, m.GetMemoryStats().keys);
+}
+
+// Test: read a hot set of keys, then scan through many new keys once.
+// Expected: the hot keys survive the scan.
+TEST(KeyValueStore, ShouldKeepHotEntriesDuringScan) {
+  ThreadsafeMap m(1);
+  m.SetMaxMemory(200 * (ThreadsafeMap::kEntryOverhead + 20));
+  for (int i = 0; i < 50; ++i) {
+    m.Put("hot_" + std::to_string(i), "value");
+    m.Get("hot_" + std::to_string(i));
+  }
+  for (int i = 0; i < 1000; ++i) {
+    m.Put("scan_" + std::to_string(i), "value");
+    if (i % 100 == 0) {
+      for (int j = 0; j < 50; ++j) {
+        m.Get("hot_" + std::to_string(j));
+      }
+    }
+  }
+  for (int i = 0; i < 50; ++i) {
+    EXPECT_EQ("value", m.Get("hot_" + std::to_string(i)));
+  }
+}
+
+// Test: put a pair which is larger than the limit of a shard.
+// Expected: the put fails and nothing is evicted.
+TEST(KeyValueStore, ShouldRejectPairOverMaxMemory) {
+  ThreadsafeMap m(2);
+  m.SetMaxMemory(2 * (ThreadsafeMap::kEntryOverhead + 100));
+  EXPECT_TRUE(m.Put("small", "value"));
+  EXPECT_FALSE(m.Put("large", std::string(1000, 'v')));
+  EXPECT_EQ(std::nullopt, m.Get("large"));
+  EXPECT_EQ("value", m.Get("small"));
+  EXPECT_EQ(0, m.GetCacheStats().evictions);
+}
+
+// Test: get existing and missing keys.
+// Expected: the hit and miss counters count them.
+TEST(KeyValueStore, ShouldCountHitsAndMisses) {
+  ThreadsafeMap m;
+  m.Put("1", "one");
+  m.Get("1");
+  m.Get("1");
+  m.Get("2");
+  ThreadsafeMap::CacheStats stats = m.GetCacheStats();
+  EXPECT_EQ(2, stats.hits);
+  EXPECT_EQ(1, stats.misses);
+  EXPECT_EQ(0, stats.evictions);
+}
+
+// Test: get missing keys of a map which grew past its first filters, and of
+// a map without filters.
+// Expected: the filters answer most misses and never hide a key; without
+//           filters every miss goes to the hashmap.
+TEST(KeyValueStore, ShouldAnswerMissesWithFilters) {
+  ThreadsafeMap m(4);
+  for (int i = 0; i < 20000; ++i) {
+    m.Put("user_" + std::to_string(i), "value");
+  }
+  for (int i = 0; i < 20000; ++i) {
+    ASSERT_EQ("value", m.Get("user_" + std::to_string(i)));
+    EXPECT_EQ(std::nullopt, m.Get("absent_" + std::to_string(i)));
+  }
+  ThreadsafeMap::FilterStats stats = m.GetFilterStats();
+  EXPECT_GT(stats.bytes, 0);
+  EXPECT_EQ(20000, stats.negatives + stats.false_positives);
+  EXPECT_LT(stats.FalsePositiveRate(), 0.05);
+  EXPECT_EQ(20000, m.GetCacheStats().misses);
+
+  m.SetFilterBitsPerKey(0);
+  EXPECT_EQ(std::nullopt, m.Get("absent"));
+  stats = m.GetFilterStats();
+  EXPECT_EQ(0, stats.bytes);
+  EXPECT_EQ(20000, stats.negatives + stats.false_positives);
+}
+
+// Test: remove most keys of a shard and compact it.
+// Expected: the filter is rebuilt for the remaining keys, which are found.
+TEST(KeyValueStore, ShouldRebuildFilterAfterRemovals) {
+  ThreadsafeMap m(1);
+  for (int i = 0; i < 10000; ++i) {
+    m.Put("key_" + std::to_string(i), "value");
+  }
+  size_t bytes = m.GetFilterStats().bytes;
+  for (int i = 100; i < 10000; ++i) {
+    m.Remove("key_" + std::to_string(i));
+  }
+  m.Compact();
+  EXPECT_LT(m.GetFilterStats().bytes, bytes);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ("value", m.Get("key_" + std::to_string(i)));
+  }
+}
+
+// Test: put keys with a short TTL next to keys without one.
+// Expected: the keys with a TTL disappear for Get once it passes, and are
+//           erased by Expire.
+TEST(KeyValueStore, ShouldExpireKeysWithTtl) {
+  ThreadsafeMap m(2);
+  EXPECT_TRUE(m.SupportsTtl());
+  EXPECT_TRUE(m.PutWithTtl("cursor", "1", std::chrono::milliseconds(50)));
+  EXPECT_TRUE(m.PutWithTtl("warble", "2", std::chrono::hours(1)));
+  m.Put("user", "3");
+  EXPECT_EQ("1", m.Get("cursor"));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  EXPECT_EQ(std::nullopt, m.Get("cursor"));
+  EXPECT_EQ("2", m.Get("warble"));
+  EXPECT_EQ("3", m.Get("user"));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(
+      TimerWheel::kTickMs));
+  EXPECT_EQ(1, m.Expire());
+  EXPECT_EQ(2, m.GetMemoryStats().keys);
+  EXPECT_EQ(1, m.GetCacheStats().expirations);
+}
+
+// Test: under a memory limit, put keys with a TTL of 0, each after the timer
+// wheel fell a tick behind.
+// Expected: the puts succeed, the keys read as expired, and they are erased
+//           by the following puts.
+TEST(KeyValueStore, ShouldPutWithElapsedTtlUnderMaxMemory) {
+  ThreadsafeMap m(1);
+  m.SetMaxMemory(100 * (ThreadsafeMap::kEntryOverhead + 20));
+  m.Put("user", "1");
+  for (int i = 0; i < 5; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(
+        TimerWheel::kTickMs));
+    std::string key = "cursor_" + std::to_string(i);
+    EXPECT_TRUE(m.PutWithTtl(key, "v", std::chrono::milliseconds(0)));
+    EXPECT_EQ(std::nullopt, m.Get(key));
+  }
+  EXPECT_EQ("1", m.Get("user"));
+  EXPECT_EQ(4, m.GetCacheStats().expirations);
+}
+
+// Test: get keys with and without a TTL along with the time they have left.
+// Expected: the TTL counts down from the one put, is zero for the key
+//           without one, and an expired key is not found.
+TEST(KeyValueStore, ShouldGetTimeLeftToLive) {
+  ThreadsafeMap m;
+  m.PutWithTtl("cursor", "1", std::chrono::hours(1));
+  m.PutWithTtl("warble", "2", std::chrono::milliseconds(10));
+  m.Put("user", "3");
+
+  std::chrono::milliseconds ttl;
+  EXPECT_EQ("1", *m.GetWithTtl("cursor", &ttl));
+  EXPECT_GT(ttl, std::chrono::minutes(59));
+  EXPECT_LE(ttl, std::chrono::hours(1));
+  EXPECT_EQ("3", *m.GetWithTtl("user", &ttl));
+  EXPECT_EQ(std::chrono::milliseconds::zero(), ttl);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(nullptr, m.GetWithTtl("warble", &ttl));
+  EXPECT_EQ(nullptr, m.GetWithTtl("tweet", &ttl));
+  EXPECT_EQ(0, m.GetCacheStats().hits + m.GetCacheStats().misses);
+}
+
+// Test: put a key with a TTL again without one.
+// Expected: the key no longer expires.
+TEST(KeyValueStore, ShouldClearTtlOnPut) {
+  ThreadsafeMap m;
+  m.PutWithTtl("1", "one", std::chrono::milliseconds(10));
+  m.Put("1", "uno");
+  std::this_thread::sleep_for(std::chrono::milliseconds(
+      2 * TimerWheel::kTickMs));
+  EXPECT_EQ(0, m.Expire());
+  EXPECT_EQ("uno", m.Get("1"));
+}
+
+// Test: store a map which holds keys with a TTL.
+// Expected: only the keys without one are written.
+TEST(KeyValueStore, ShouldNotStoreKeysWithTtl) {
+  std::shared_ptr<MockPersistence> mock_persist_ptr =
+      std::shared_ptr<MockPersistence>(new MockPersistence);
+  std::string mock_file = "data";
+  EXPECT_CALL(*mock_persist_ptr, deserialize(mock_file))
+      .WillOnce(Return(StringKVMap()));
+  ThreadsafeMap m(mock_persist_ptr, mock_file);
+  m.Put("user", "kept");
+  m.PutWithTtl("cursor", "dropped", std::chrono::hours(1));
+
+  StringKVMap expected = {{"user", "kept"}};
+  EXPECT_CALL(*mock_persist_ptr, serialize(expected, mock_file));
+  m.Store(mock_file);
+}
+
+// Test: take a snapshot, then put, replace, remove and expire keys before it
+//       is stored.
+// Expected: the file holds the data as it was when the snapshot was taken,
+//           and the next store holds the writes.
+TEST(KeyValueStore, ShouldStoreSnapshotAsOfWhenTaken) {
+  std::shared_ptr<MockPersistence> mock_persist_ptr =
+      std::shared_ptr<MockPersistence>(new MockPersistence);
+  std::string mock_file = "data";
+  EXPECT_CALL(*mock_persist_ptr, deserialize(mock_file))
+      .WillOnce(Return(StringKVMap()));
+  ThreadsafeMap m(mock_persist_ptr, mock_file, 4);
+  m.Put("replaced", "old");
+  m.Put("removed", "gone");
+  m.Put("kept", "same");
+  m.PutWithTtl("cursor", "short-lived", std::chrono::hours(1));
+
+  SnapshotWriter write_snapshot = m.Snapshot(mock_file);
+  m.Put("replaced", "new");
+  m.Put("replaced", "newer");
+  m.Remove("removed");
+  m.Put("added", "later");
+  m.Put("cursor", "now kept");
+
+  StringKVMap before = {
+      {"replaced", "old"}, {"removed", "gone"}, {"kept", "same"}};
+  EXPECT_CALL(*mock_persist_ptr, serialize(before, mock_file));
+  write_snapshot();
+
+  StringKVMap after = {{"replaced", "newer"},
+                       {"kept", "same"},
+                       {"added", "later"},
+                       {"cursor", "now kept"}};
+  EXPECT_CALL(*mock_persist_ptr, serialize(after, mock_file));
+  m.Store(mock_file);
+}
+
+// Test: write to a map on a strategy which stores deltas, take a snapshot,
+// write more, then store
+// Expect: the snapshot stores the keys written before it, with their values
+// at that time, the keys removed or put with a TTL as removed, and the store
+// only the keys written after the snapshot
+TEST(KeyValueStore, ShouldStoreOnlyKeysWrittenSinceLastSnapshot) {
+  std::shared_ptr<MockDeltaPersistence> mock_persist_ptr =
+      std::shared_ptr<MockDeltaPersistence>(new MockDeltaPersistence);
+  std::string mock_file = "data";
+  EXPECT_CALL(*mock_persist_ptr, deserialize(mock_file))
+      .WillOnce(Return(StringKVMap({{"loaded", "1"}, {"stale", "2"}})));
+  ThreadsafeMap m(mock_persist_ptr, mock_file, 4);
+  m.Put("replaced", "old");
+  m.Remove("stale");
+  m.PutWithTtl("cursor", "short-lived", std::chrono::hours(1));
+
+  SnapshotWriter write_snapshot = m.Snapshot(mock_file);
+  m.Put("replaced", "new");
+  m.Put("added", "later");
+
+  EXPECT_CALL(*mock_persist_ptr,
+              serialize_delta(StringKVMap({{"replaced", "old"}}),
+                              UnorderedElementsAre("stale", "cursor"),
+                              mock_file));
+  write_snapshot();
+
+  EXPECT_CALL(*mock_persist_ptr,
+              serialize_delta(StringKVMap({{"replaced", "new"},
+                                           {"added", "later"}}),
+                              std::vector<std::string>(), mock_file));
+  m.Store(mock_file);
+}
+
+// Test: on a strategy which stores deltas, store into another file than the
+// one the map was loaded from, then into the loaded file
+// Expect: the other file gets every key, and the loaded file still gets the
+// keys written since the map was loaded as a delta
+TEST(KeyValueStore, ShouldStoreIntoTheGivenFile) {
+  std::shared_ptr<MockDeltaPersistence> mock_persist_ptr =
+      std::shared_ptr<MockDeltaPersistence>(new MockDeltaPersistence);
+  std::string mock_file = "data";
+  std::string backup_file = "backup";
+  EXPECT_CALL(*mock_persist_ptr, deserialize(mock_file))
+      .WillOnce(Return(StringKVMap({{"loaded", "1"}})));
+  ThreadsafeMap m(mock_persist_ptr, mock_file, 4);
+  m.Put("added", "2");
+
+  EXPECT_CALL(*mock_persist_ptr,
+              serialize(StringKVMap({{"loaded", "1"}, {"added", "2"}}),
+                        backup_file));
+  m.Store(backup_file);
+
+  EXPECT_CALL(*mock_persist_ptr,
+              serialize_delta(StringKVMap({{"added", "2"}}),
+                              std::vector<std::string>(), mock_file));
+  m.Store(mock_file);
+}
+
+// Test: append to a missing key, then to the key.
+// Expected: the suffix becomes the value, then follows the separator.
+TEST(KeyValueStore, ShouldAppendWithSeparator) {
+  ThreadsafeMap m;
+  EXPECT_TRUE(m.Append("hashtag_cs499", "1", ","));
+  EXPECT_EQ("1", m.Get("hashtag_cs499"));
+  EXPECT_TRUE(m.Append("hashtag_cs499", "2", ","));
+  EXPECT_EQ("1,2", m.Get("hashtag_cs499"));
+}
+
+// Test: many threads append to the same keys.
+// Expected: every appended element is in the list.
+TEST(KeyValueStore, MultithreadsAppendLosesNothing) {
+  ThreadsafeMap m(2);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&m, t] {
+      for (int i = 0; i < 200; ++i) {
+        m.Append("list_" + std::to_string(i % 4), std::to_string(t), ",");
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (int i = 0; i < 4; ++i) {
+    auto value = m.Get("list_" + std::to_string(i));
+    ASSERT_TRUE(value.has_value());
+    EXPECT_EQ(8 * 50 - 1, std::count(value->begin(), value->end(), ','));
+  }
+}
+
+// Test: append to a key with a TTL, and to a key whose TTL passed.
+// Expected: the list keeps its TTL, the expired list starts over.
+TEST(KeyValueStore, ShouldAppendWithinTtl) {
+  ThreadsafeMap m;
+  m.PutWithTtl("cursor", "1", std::chrono::milliseconds(50));
+  m.PutWithTtl("thread", "1", std::chrono::hours(1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  EXPECT_TRUE(m.Append("cursor", "2", ","));
+  EXPECT_TRUE(m.Append("thread", "2", ","));
+  EXPECT_EQ("2", m.Get("cursor"));
+  EXPECT_EQ("1,2", m.Get("thread"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(
+      2 * TimerWheel::kTickMs));
+  EXPECT_EQ(0, m.Expire());
+}
+
+// Test: put a key only if it does not exist.
+// Expected: the first put wins, the second one sees its version.
+TEST(KeyValueStore, ShouldPutIfAbsent) {
+  ThreadsafeMap m;
+  uint64_t version;
+  EXPECT_EQ(ThreadsafeMap::PutStatus::kStored,
+            m.ConditionalPut("user", "first", ThreadsafeMap::kNoVersion,
+                             &version));
+  uint64_t conflict;
+  EXPECT_EQ(ThreadsafeMap::PutStatus::kConflict,
+            m.ConditionalPut("user", "second", ThreadsafeMap::kNoVersion,
+                             &conflict));
+  EXPECT_EQ(version, conflict);
+  EXPECT_EQ("first", m.Get("user"));
+}
+
+// Test: put a key at a version, after other writes and a removal.
+// Expected: only the put at the current version succeeds, and versions are
+//           never repeated.
+TEST(KeyValueStore, ShouldPutIfVersionMatches) {
+  ThreadsafeMap m;
+  m.Put("user", "1");
+  uint64_t first;
+  ASSERT_TRUE(m.GetVersioned("user", &first));
+  m.Put("user", "2");
+  uint64_t version;
+  EXPECT_EQ(ThreadsafeMap::PutStatus::kConflict,
+            m.ConditionalPut("user", "3", first, &version));
+  EXPECT_LT(first, version);
+  uint64_t stored;
+  EXPECT_EQ(ThreadsafeMap::PutStatus::kStored,
+            m.ConditionalPut("user", "3", version, &stored));
+  EXPECT_LT(version, stored);
+
+  m.Remove("user");
+  EXPECT_EQ(nullptr, m.GetVersioned("user", &version));
+  EXPECT_EQ(ThreadsafeMap::kNoVersion, version);
+  m.Put("user", "4");
+  m.GetVersioned("user", &version);
+  EXPECT_LT(stored, version);
+}
+
+// Test: many threads increment a counter with read and conditional put.
+// Expected: no increment is lost.
+TEST(KeyValueStore, MultithreadsConditionalPutLosesNothing) {
+  ThreadsafeMap m(2);
+  m.Put("counter", "0");
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&m] {
+      for (int i = 0; i < 100; ++i) {
+        uint64_t version;
+        uint64_t new_version;
+        ThreadsafeMap::PutStatus status;
+        do {
+          ValuePtr value = m.GetVersioned("counter", &version);
+          std::string next = std::to_string(std::stoi(std::string(*value)) + 1);
+          status = m.ConditionalPut("counter", next, version, &new_version);
+        } while (status != ThreadsafeMap::PutStatus::kStored);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ("800", m.Get("counter"));
+}
+
+// Helper function: the keys of the scanned pairs.
+std::vector<std::string> ScanKeys(const ThreadsafeMap &m,
+                                  const std::string &start,
+                                  const std::string &end, size_t limit) {
+  std::vector<std::string> keys;
+  for (const auto &pair : m.Scan(start, end, limit)) {
+    keys.push_back(pair.first);
+  }
+  return keys;
+}
+
+// Test: scan ranges of keys spread over the shards.
+// Expected: the keys in the range come back in order, up to the limit.
+TEST(KeyValueStore, ShouldScanInKeyOrder) {
+  ThreadsafeMap m(4);
+  for (const std::string key : {"hashtag_b", "user_warbles_user_a",
+                                "hashtag_a", "hashtag_c", "warble_1"}) {
+    m.Put(key, key + "_value");
+  }
+  EXPECT_TRUE(m.SupportsScan());
+  EXPECT_EQ(std::vector<std::string>({"hashtag_a", "hashtag_b", "hashtag_c"}),
+            ScanKeys(m, "hashtag_", "hashtag`", 10));
+  EXPECT_EQ(std::vector<std::string>({"hashtag_b", "hashtag_c"}),
+            ScanKeys(m, "hashtag_b", "", 2));
+  EXPECT_EQ(std::vector<std::string>({"user_warbles_user_a", "warble_1"}),
+            ScanKeys(m, "u", "", 10));
+  EXPECT_EQ("hashtag_a_value", *m.Scan("hashtag_a", "", 1).at(0).second);
+}
+
+// Test: scan after removals, expiry and a compaction which moves the keys.
+// Expected: only the live keys are scanned, with their moved bytes.
+TEST(KeyValueStore, ShouldScanAfterRemoveAndCompact) {
+  ThreadsafeMap m(1);
+  for (int i = 0; i < 20000; ++i) {
+    m.Put("key_" + std::to_string(100000 + i), "value");
+  }
+  for (int i = 0; i < 20000; ++i) {
+    if (i % 100 != 0) {
+      m.Remove("key_" + std::to_string(100000 + i));
+    }
+  }
+  m.PutWithTtl("key_000000", "gone", std::chrono::milliseconds(1));
+  EXPECT_LT(0, m.Compact());
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+  std::vector<std::string> keys = ScanKeys(m, "key_", "", 1000);
+  ASSERT_EQ(200, keys.size());
+  for (int i = 0; i < 200; ++i) {
+    EXPECT_EQ("key_" + std::to_string(100000 + i * 100), keys[i]);
+  }
+}
+}  // namespace cs499_fei
@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../../src/KeyValueStore/timer_wheel.h"
+
+namespace cs499_fei {
+// Helper function: the keys of the timers.
+std::vector<std::string> Keys(const std::vector<TimerWheel::Timer> &timers) {
+  std::vector<std::string> keys;
+  for (const auto &timer : timers) {
+    keys.push_back(timer.key);
+  }
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+
+// Test: schedule timers at every level and advance past each deadline.
+// Expected: every timer fires on the tick of its deadline, not before.
+TEST(TimerWheel, ShouldFireOnDeadline) {
+  const uint64_t start = 123456;
+  TimerWheel wheel(start);
+  const uint64_t tick = TimerWheel::kTickMs;
+  std::vector<uint64_t> delays = {0, 5 * tick, 70 * tick, 5000 * tick,
+                                  300000 * tick};
+  for (size_t i = 0; i < delays.size(); ++i) {
+    wheel.Schedule(std::to_string(i), start + delays[i]);
+  }
+  EXPECT_EQ(delays.size(), wheel.Size());
+
+  for (size_t i = 0; i < delays.size(); ++i) {
+    uint64_t deadline = start + delays[i];
+    if (deadline / tick > start / tick) {
+      EXPECT_TRUE(wheel.Advance(deadline - tick).empty());
+    }
+    EXPECT_EQ(std::vector<std::string>{std::to_string(i)},
+              Keys(wheel.Advance(deadline)));
+  }
+  EXPECT_EQ(0, wheel.Size());
+}
+
+// Test: schedule a timer beyond the range of the wheel.
+// Expected: it goes round the last level and fires on its deadline.
+TEST(TimerWheel, ShouldFireBeyondRange) {
+  TimerWheel wheel(0);
+  const uint64_t range = uint64_t{1} << (TimerWheel::kSlotBits *
+                                         TimerWheel::kLevels);
+  const uint64_t deadline = (range + 10) * TimerWheel::kTickMs;
+  wheel.Schedule("far", deadline);
+  EXPECT_TRUE(wheel.Advance(deadline - TimerWheel::kTickMs).empty());
+  EXPECT_EQ(std::vector<std::string>{"far"}, Keys(wheel.Advance(deadline)));
+}
+
+// Test: schedule a deadline which already passed.
+// Expected: it fires on the next advance.
+TEST(TimerWheel, ShouldFireOverdueTimer) {
+  TimerWheel wheel(10000);
+  wheel.Schedule("late", 500);
+  EXPECT_EQ(std::vector<std::string>{"late"}, Keys(wheel.Advance(10000)));
+}
+}  // namespace cs499_fei
@@ -0,0 +1,124 @@
+#include "wire_format.h"
+
+#include <memory>
+#include <string>
+
+#include "KeyValueStore.pb.h"
+#include "gtest/gtest.h"
+
+namespace cs499_fei {
+// Test: parse PutRequests serialized by protobuf, with a value long enough
+// for a two byte length, with unknown fields, with a repeated key, and
+// truncated
+// Expect: the fields protobuf reads, viewing the serialized bytes, and a
+// failure for the truncated message
+TEST(WireFormat, ShouldParsePutRequestLikeProtobuf) {
+  kvstore::PutRequest message;
+  message.set_key("warble_1");
+  message.set_value(std::string(300, 'v'));
+  message.set_ttl_ms(1ull << 40);
+  std::string data = message.SerializeAsString();
+
+  PutRequestView request;
+  ASSERT_TRUE(ParsePutRequest(data, &request));
+  EXPECT_EQ(message.key(), request.key);
+  EXPECT_EQ(message.value(), request.value);
+  EXPECT_EQ(message.ttl_ms(), request.ttl_ms);
+  EXPECT_GE(request.value.data(), data.data());
+  EXPECT_LE(request.value.data() + request.value.size(),
+            data.data() + data.size());
+
+  // field 9 as a varint, field 10 as a fixed32, the key field as a varint,
+  // then a second key, which wins.
+  kvstore::PutRequest second;
+  second.set_key("warble_2");
+  data += std::string("\x48\x01\x55\x01\x02\x03\x04\x08\x07", 9) +
+          second.SerializeAsString();
+  ASSERT_TRUE(message.ParseFromString(data));
+  ASSERT_TRUE(ParsePutRequest(data, &request));
+  EXPECT_EQ("warble_2", message.key());
+  EXPECT_EQ(message.key(), request.key);
+  EXPECT_EQ(message.value(), request.value);
+  EXPECT_EQ(message.ttl_ms(), request.ttl_ms);
+
+  std::string truncated = data.substr(0, 5);
+  EXPECT_FALSE(message.ParseFromString(truncated));
+  EXPECT_FALSE(ParsePutRequest(truncated, &request));
+}
+
+// Test: parse a GetRequest serialized by protobuf, and an empty one
+// Expect: its key, and an empty key
+TEST(WireFormat, ShouldParseGetRequestKey) {
+  kvstore::GetRequest message;
+  message.set_key("warble_1");
+  // the key is a view into the bytes, which must outlive it.
+  std::string bytes = message.SerializeAsString();
+  std::string_view key;
+  ASSERT_TRUE(ParseGetRequest(bytes, &key));
+  EXPECT_EQ("warble_1", key);
+  ASSERT_TRUE(ParseGetRequest("", &key));
+  EXPECT_TRUE(key.empty());
+}
+
+// Test: write GetReplies of empty, short and long values, at versions which
+// take one byte and several bytes
+// Expect: the same bytes protobuf serializes the reply to
+TEST(WireFormat, ShouldWriteGetReplyAsProtobuf) {
+  for (const std::string &value :
+       {std::string(), std::string("v"), std::string(200, 'v')}) {
+    for (uint64_t version : {0ull, 1ull, 1ull << 40}) {
+      kvstore::GetReply reply;
+      reply.set_value(value);
+      reply.set_version(version);
+      char header[kMaxGetReplyFraming];
+      char trailer[kMaxGetReplyFraming];
+      std::string data(header, WriteGetReplyHeader(value.size(), header));
+      data += value;
+      data.append(trailer, WriteGetReplyTrailer(version, trailer));
+      EXPECT_EQ(reply.SerializeAsString(), data);
+    }
+  }
+}
+
+// Test: read messages from a buffer of one slice and from a buffer of two,
+// then build the GetReply buffers of a short value and of a value long
+// enough to be sent without a copy
+// Expect: the bytes of the message, in place for one slice; replies
+// protobuf parses back, the long one holding a reference to its value until
+// the buffer is released
+TEST(WireFormat, ShouldReadAndWriteByteBuffers) {
+  grpc::Slice whole(std::string("warble"));
+  grpc::ByteBuffer single(&whole, 1);
+  // slices this long are not merged into one when added to a buffer.
+  const std::string first(100, 'a');
+  const std::string second(100, 'b');
+  grpc::Slice parts[] = {grpc::Slice(first), grpc::Slice(second)};
+  grpc::ByteBuffer split(parts, 2);
+  grpc::Slice slice;
+  std::string scratch;
+  std::string_view bytes;
+  ASSERT_TRUE(MessageBytes(single, &slice, &scratch, &bytes));
+  EXPECT_EQ("warble", bytes);
+  EXPECT_EQ(reinterpret_cast<const char *>(slice.begin()), bytes.data());
+  ASSERT_TRUE(MessageBytes(split, &slice, &scratch, &bytes));
+  EXPECT_EQ(first + second, bytes);
+  EXPECT_EQ(scratch.data(), bytes.data());
+
+  for (size_t size : {size_t(10), kZeroCopyValueBytes}) {
+    ValuePtr value = MakeValue(std::string(size, 'v'));
+    grpc::ByteBuffer buffer = GetReplyBuffer(value, 7);
+    EXPECT_EQ(size < kZeroCopyValueBytes ? 1 : 2, value.use_count());
+    ASSERT_TRUE(MessageBytes(buffer, &slice, &scratch, &bytes));
+    kvstore::GetReply reply;
+    ASSERT_TRUE(reply.ParseFromArray(bytes.data(), bytes.size()));
+    EXPECT_EQ(std::string(*value), reply.value());
+    EXPECT_EQ(7, reply.version());
+    slice = grpc::Slice();
+    buffer.Clear();
+    EXPECT_EQ(1, value.use_count());
+  }
+
+  grpc::ByteBuffer missing = GetReplyBuffer(nullptr, 7);
+  EXPECT_EQ(0, missing.Length());
+}
+}  // namespace cs499_fei
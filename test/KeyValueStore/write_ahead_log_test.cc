@@ -0,0 +1,187 @@
+#include "write_ahead_log.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cs499_fei {
+namespace {
+using Record = WriteAheadLog::Record;
+using RecordType = WriteAheadLog::RecordType;
+
+// Owned copy of a replayed record.
+struct Replayed {
+  RecordType type;
+  std::string key;
+  std::string value;
+  std::string separator;
+  uint64_t expires_at_ms;
+};
+
+// Helper function: replay the log file into owned records.
+std::vector<Replayed> ReplayAll(const std::string &file_name) {
+  WriteAheadLog wal(file_name, std::chrono::microseconds(0), 1);
+  std::vector<Replayed> records;
+  wal.Replay([&records](const Record &record) {
+    records.push_back({record.type, std::string(record.key),
+                       std::string(record.value),
+                       std::string(record.separator), record.expires_at_ms});
+  });
+  return records;
+}
+
+// Helper function: size of the file in bytes.
+size_t FileSize(const std::string &file_name) {
+  std::ifstream infile(file_name, std::ios::binary | std::ios::ate);
+  return infile.tellg();
+}
+}  // namespace
+
+// Test: commit records, then open the log again and replay it
+// Expect: every record comes back in commit order
+TEST(WriteAheadLog, ShouldReplayCommittedRecordsInOrder) {
+  std::string file_name = "wal_replay";
+  std::remove(file_name.c_str());
+  {
+    WriteAheadLog wal(file_name, std::chrono::microseconds(100), 8);
+    wal.Commit({RecordType::kPut, "key", "value"});
+    wal.Commit({RecordType::kAppend, "key", "more", ","});
+    wal.Commit({RecordType::kRemove, "other"});
+  }
+
+  std::vector<Replayed> records = ReplayAll(file_name);
+  ASSERT_EQ(3, records.size());
+  EXPECT_EQ(RecordType::kPut, records[0].type);
+  EXPECT_EQ("key", records[0].key);
+  EXPECT_EQ("value", records[0].value);
+  EXPECT_EQ(RecordType::kAppend, records[1].type);
+  EXPECT_EQ("more", records[1].value);
+  EXPECT_EQ(",", records[1].separator);
+  EXPECT_EQ(RecordType::kRemove, records[2].type);
+  EXPECT_EQ("other", records[2].key);
+  std::remove(file_name.c_str());
+}
+
+// Test: commit puts with and without a deadline, then replay the log
+// Expect: the deadline comes back with its put, and the other records have
+// none
+TEST(WriteAheadLog, ShouldReplayTheDeadlineOfAPut) {
+  std::string file_name = "wal_deadline";
+  std::remove(file_name.c_str());
+  {
+    WriteAheadLog wal(file_name, std::chrono::microseconds(100), 8);
+    wal.Commit({RecordType::kPut, "cursor", "1", "", 1700000000123});
+    wal.Commit({RecordType::kPut, "user", "2"});
+    wal.Commit({RecordType::kAppend, "cursor", "3", ","});
+  }
+
+  std::vector<Replayed> records = ReplayAll(file_name);
+  ASSERT_EQ(3, records.size());
+  EXPECT_EQ("cursor", records[0].key);
+  EXPECT_EQ("1", records[0].value);
+  EXPECT_EQ(1700000000123, records[0].expires_at_ms);
+  EXPECT_EQ(0, records[1].expires_at_ms);
+  EXPECT_EQ(",", records[2].separator);
+  EXPECT_EQ(0, records[2].expires_at_ms);
+  std::remove(file_name.c_str());
+}
+
+// Test: cut the last record in the middle, as a crash during a write does
+// Expect: the complete records are replayed and the torn tail is cut off
+TEST(WriteAheadLog, ShouldCutTornTailOnReplay) {
+  std::string file_name = "wal_torn";
+  std::remove(file_name.c_str());
+  {
+    WriteAheadLog wal(file_name, std::chrono::microseconds(0), 1);
+    wal.Commit({RecordType::kPut, "first", "1"});
+  }
+  size_t complete = FileSize(file_name);
+  {
+    WriteAheadLog wal(file_name, std::chrono::microseconds(0), 1);
+    wal.Commit({RecordType::kPut, "second", "2"});
+  }
+  ASSERT_EQ(0, truncate(file_name.c_str(), FileSize(file_name) - 3));
+
+  std::vector<Replayed> records = ReplayAll(file_name);
+  ASSERT_EQ(1, records.size());
+  EXPECT_EQ("first", records[0].key);
+  EXPECT_EQ(complete, FileSize(file_name));
+  std::remove(file_name.c_str());
+}
+
+// Test: commit from many threads at once
+// Expect: every record is durable, with fewer syncs than records
+TEST(WriteAheadLog, ShouldGroupConcurrentCommits) {
+  std::string file_name = "wal_group";
+  std::remove(file_name.c_str());
+  const int kThreads = 8;
+  const int kCommits = 50;
+  {
+    WriteAheadLog wal(file_name, std::chrono::microseconds(2000), 16);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < kThreads; ++t) {
+      writers.emplace_back([&wal, t] {
+        for (int i = 0; i < kCommits; ++i) {
+          std::string key = std::to_string(t) + "_" + std::to_string(i);
+          wal.Commit({RecordType::kPut, key, "v"});
+        }
+      });
+    }
+    for (auto &writer : writers) {
+      writer.join();
+    }
+    WriteAheadLog::Stats stats = wal.GetStats();
+    EXPECT_EQ(kThreads * kCommits, stats.records);
+    EXPECT_LT(stats.syncs, stats.records);
+    EXPECT_LE(stats.max_batch, 16);
+  }
+  EXPECT_EQ(kThreads * kCommits, ReplayAll(file_name).size());
+  std::remove(file_name.c_str());
+}
+
+// Test: truncate the log after commits, then commit again
+// Expect: only the records after the truncation are replayed
+TEST(WriteAheadLog, ShouldDropRecordsOnTruncate) {
+  std::string file_name = "wal_truncate";
+  std::remove(file_name.c_str());
+  {
+    WriteAheadLog wal(file_name, std::chrono::microseconds(0), 1);
+    wal.Commit({RecordType::kPut, "before", "1"});
+    wal.Truncate();
+    wal.Commit({RecordType::kPut, "after", "2"});
+  }
+
+  std::vector<Replayed> records = ReplayAll(file_name);
+  ASSERT_EQ(1, records.size());
+  EXPECT_EQ("after", records[0].key);
+  std::remove(file_name.c_str());
+}
+
+// Test: mark the log, commit more, then drop the records before the mark
+// Expect: only the records after the mark are replayed, and the log keeps
+// appending after them
+TEST(WriteAheadLog, ShouldDropRecordsBeforeMark) {
+  std::string file_name = "wal_mark";
+  std::remove(file_name.c_str());
+  {
+    WriteAheadLog wal(file_name, std::chrono::microseconds(100), 8);
+    wal.Commit({RecordType::kPut, "before", "1"});
+    uint64_t mark = wal.Mark();
+    wal.Commit({RecordType::kPut, "during", "2"});
+    wal.DropBefore(mark);
+    wal.Commit({RecordType::kPut, "after", "3"});
+  }
+
+  std::vector<Replayed> records = ReplayAll(file_name);
+  ASSERT_EQ(2, records.size());
+  EXPECT_EQ("during", records[0].key);
+  EXPECT_EQ("after", records[1].key);
+  std::remove(file_name.c_str());
+}
+}  // namespace cs499_fei
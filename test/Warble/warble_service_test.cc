@@ -11,7 +11,10 @@
 #include "random_generator.h"
 #include "storage_abstraction.h"
 
+using ::testing::ElementsAre;
+using ::testing::Field;
 using ::testing::Return;
+using ::testing::StartsWith;
 
 namespace cs499_fei {
 // Mock Class of StorageAbstraction
@@ -21,8 +24,20 @@ class MockStorage : public StorageAbstraction {
   MOCK_METHOD2(Put, void(const std::string &, const std::string &));
   MOCK_METHOD1(Get, StringOptionalVector(const StringVector &));
   MOCK_METHOD1(Remove, void(const std::string &));
+  MOCK_METHOD3(Append, void(const std::string &, const std::string &,
+                            const std::string &));
+  MOCK_METHOD1(GetVersioned, VersionedValue(const std::string &));
+  MOCK_METHOD3(ConditionalPut,
+               bool(const std::string &, const std::string &, uint64_t));
+  MOCK_METHOD1(Batch, StringOptionalVector(const OperationVector &));
 };
 
+// Helper function: match an operation by its key.
+template <typename KeyMatcher>
+testing::Matcher<const Operation &> OperationOn(KeyMatcher key) {
+  return Field(&Operation::key, key);
+}
+
 // Init the global variables for all the test cases in this test suite
 class WarbleTest : public ::testing::Test {
  public:
@@ -41,13 +56,13 @@ TEST_F(WarbleTest, shouldReturnPayloadWithValueWhenRegisterUserSuccessfully) {
   std::string mock_user_followers_key = "user_followers_user_Harry Potter";
   std::string mock_user_followings_key = "user_followings_user_Harry Potter";
 
-  StringVector mock_key_vector = {mock_user_warbles_key};
-  StringOptionalVector mock_user_warbles_value = {StringOptional()};
-  EXPECT_CALL(*mock_store_, Get(mock_key_vector))
-      .WillOnce(Return(mock_user_warbles_value));
-  EXPECT_CALL(*mock_store_, Put(mock_user_warbles_key, "INIT"));
-  EXPECT_CALL(*mock_store_, Put(mock_user_followers_key, "INIT"));
-  EXPECT_CALL(*mock_store_, Put(mock_user_followings_key, "INIT"));
+  EXPECT_CALL(*mock_store_,
+              ConditionalPut(mock_user_warbles_key, "INIT", kNoVersion))
+      .WillOnce(Return(true));
+  OperationVector expected_operations = {
+      Operation::Put(mock_user_followers_key, "INIT"),
+      Operation::Put(mock_user_followings_key, "INIT")};
+  EXPECT_CALL(*mock_store_, Batch(expected_operations));
 
   Payload mock_payload;
   RegisteruserRequest mock_request;
@@ -66,10 +81,10 @@ TEST_F(WarbleTest,
   std::string mock_user_followers_key = "user_followers_user_Harry Potter";
   std::string mock_user_followings_key = "user_followings_user_Harry Potter";
 
-  StringVector mock_key_vector = {mock_user_warbles_key};
-  StringOptionalVector mock_user_warbles_value = {"INIT"};
-  EXPECT_CALL(*mock_store_, Get(mock_key_vector))
-      .WillOnce(Return(mock_user_warbles_value));
+  EXPECT_CALL(*mock_store_,
+              ConditionalPut(mock_user_warbles_key, "INIT", kNoVersion))
+      .WillOnce(Return(false));
+  EXPECT_CALL(*mock_store_, Batch(testing::_)).Times(0);
 
   Payload mock_payload;
   RegisteruserRequest mock_request;
@@ -139,11 +154,10 @@ TEST_F(WarbleTest, shouldPayloadWithValueWhenCallFollowFirstTime) {
   EXPECT_CALL(*mock_store_, Get(mock_key_vector))
       .WillOnce(Return(mock_value_vector));
 
-  std::string mock_user_followings = "Lord Voldmort";
-  std::string mock_to_follow_followers = "Harry Potter";
-  EXPECT_CALL(*mock_store_, Put(user_followings_key, mock_user_followings));
-  EXPECT_CALL(*mock_store_,
-              Put(to_follow_followers_key, mock_to_follow_followers));
+  OperationVector expected_operations = {
+      Operation::Append(user_followings_key, "Lord Voldmort", ","),
+      Operation::Append(to_follow_followers_key, "Harry Potter", ",")};
+  EXPECT_CALL(*mock_store_, Batch(expected_operations));
 
   Payload mock_payload;
   FollowRequest request;
@@ -167,13 +181,10 @@ TEST_F(WarbleTest, shouldPayloadWithValueWhenCallFollow) {
   EXPECT_CALL(*mock_store_, Get(mock_key_vector))
       .WillOnce(Return(mock_value_vector));
 
-  std::string mock_user_followings =
-      "following1,following2,following3,Lord Voldmort";
-  std::string mock_to_follow_followers =
-      "follower1,follower2,follower3,Harry Potter";
-  EXPECT_CALL(*mock_store_, Put(user_followings_key, mock_user_followings));
-  EXPECT_CALL(*mock_store_,
-              Put(to_follow_followers_key, mock_to_follow_followers));
+  OperationVector expected_operations = {
+      Operation::Append(user_followings_key, "Lord Voldmort", ","),
+      Operation::Append(to_follow_followers_key, "Harry Potter", ",")};
+  EXPECT_CALL(*mock_store_, Batch(expected_operations));
 
   Payload mock_payload;
   FollowRequest request;
@@ -295,6 +306,37 @@ TEST_F(WarbleTest,
   }
 }
 
+// Test: Read user's profile whose lists were appended to the INIT label.
+// Expected: The INIT label is not part of the profile.
+TEST_F(WarbleTest, shouldDropInitLabelWhenReadProfileOfAppendedLists) {
+  std::string user_followings_key = "user_followings_user_Harry Potter";
+  std::string to_follow_followers_key = "user_followers_user_Harry Potter";
+
+  StringVector mock_key_vector = {user_followings_key, to_follow_followers_key};
+  StringOptionalVector mock_value_vector = {"INIT,following1,following2",
+                                            "INIT,follower1"};
+
+  EXPECT_CALL(*mock_store_, Get(mock_key_vector))
+      .WillOnce(Return(mock_value_vector));
+
+  Payload mock_payload;
+  ProfileRequest request;
+  request.set_username("Harry Potter");
+  mock_payload.PackFrom(request);
+  PayloadOptional reply_payload_opt =
+      warble_->ReadProfile(mock_payload, mock_store_);
+
+  ASSERT_TRUE(reply_payload_opt.has_value());
+  ProfileReply reply;
+  reply_payload_opt.value().UnpackTo(&reply);
+
+  ASSERT_EQ(2, reply.following().size());
+  EXPECT_EQ("following1", reply.following().Get(0));
+  EXPECT_EQ("following2", reply.following().Get(1));
+  ASSERT_EQ(1, reply.followers().size());
+  EXPECT_EQ("follower1", reply.followers().Get(0));
+}
+
 // Test: a user warbles a text, but this user does not exist.
 // Expected : return an empty PayloadOptional
 TEST_F(WarbleTest, shouldReturnEmptyPayloadWhenWarbleWithAUserNotExist) {
@@ -322,12 +364,10 @@ TEST_F(WarbleTest, shouldReturnEmptyPayloadWhenWarbleWithAUserNotExist) {
 // warble does not exist. Expected : return an empty PayloadOptional
 TEST_F(WarbleTest, shouldReturnEmptyPayloadWhenReplyToNotExist) {
   std::string mock_user_warbles_key = "user_warbles_user_Harry Potter";
-  std::string mock_warble_thread_key = "warble_thread_warble_5";
   std::string mock_reply_to_warble_key = "warble_5";
-  StringVector key_vector = {mock_user_warbles_key, mock_warble_thread_key,
-                             mock_reply_to_warble_key};
+  StringVector key_vector = {mock_user_warbles_key, mock_reply_to_warble_key};
 
-  StringOptionalVector mock_value_vector = {"1,2,3", "", ""};
+  StringOptionalVector mock_value_vector = {"1,2,3", ""};
   EXPECT_CALL(*mock_store_, Get(key_vector))
       .WillOnce(Return(mock_value_vector));
 
@@ -359,8 +399,9 @@ TEST_F(WarbleTest,
 
   std::string text = "It's my first warble.";
 
-  EXPECT_CALL(*mock_store_, Put(testing::_, testing::_));
-  EXPECT_CALL(*mock_store_, Put(mock_user_warbles_key, testing::_));
+  EXPECT_CALL(*mock_store_,
+              Batch(ElementsAre(OperationOn(StartsWith("warble_")),
+                                OperationOn(mock_user_warbles_key))));
 
   WarbleRequest request;
   request.set_username("Harry Potter");
@@ -395,19 +436,19 @@ TEST_F(WarbleTest,
   std::string mock_user_warbles_key = "user_warbles_user_Harry Potter";
   std::string mock_warble_thread_key = "warble_thread_warble_3";
   std::string mock_warble_key = "warble_3";
-  StringVector key_vector = {mock_user_warbles_key, mock_warble_thread_key,
-                             mock_warble_key};
+  StringVector key_vector = {mock_user_warbles_key, mock_warble_key};
 
-  StringOptionalVector mock_value_vector = {"1", StringOptional(),
+  StringOptionalVector mock_value_vector = {"1",
                                             "It's the No. 3 warble string"};
   EXPECT_CALL(*mock_store_, Get(key_vector))
       .WillOnce(Return(mock_value_vector));
 
   std::string text = "It's my second warble.";
 
-  EXPECT_CALL(*mock_store_, Put(testing::_, testing::_));
-  EXPECT_CALL(*mock_store_, Put(mock_user_warbles_key, testing::_));
-  EXPECT_CALL(*mock_store_, Put(mock_warble_thread_key, testing::_));
+  EXPECT_CALL(*mock_store_,
+              Batch(ElementsAre(OperationOn(StartsWith("warble_")),
+                                OperationOn(mock_user_warbles_key),
+                                OperationOn(mock_warble_thread_key))));
 
   WarbleRequest request;
   request.set_username("Harry Potter");
@@ -442,19 +483,18 @@ TEST_F(WarbleTest,
   std::string mock_user_warbles_key = "user_warbles_user_Harry Potter";
   std::string mock_warble_thread_key = "warble_thread_warble_3";
   std::string mock_warble_key = "warble_3";
-  StringVector key_vector = {mock_user_warbles_key, mock_warble_thread_key,
-                             mock_warble_key};
+  StringVector key_vector = {mock_user_warbles_key, mock_warble_key};
 
-  StringOptionalVector mock_value_vector = {"1", "4,5,6",
-                                            "It's No.3 warble string"};
+  StringOptionalVector mock_value_vector = {"1", "It's No.3 warble string"};
   EXPECT_CALL(*mock_store_, Get(key_vector))
       .WillOnce(Return(mock_value_vector));
 
   std::string text = "It's my second warble.";
 
-  EXPECT_CALL(*mock_store_, Put(testing::_, testing::_));
-  EXPECT_CALL(*mock_store_, Put(mock_user_warbles_key, testing::_));
-  EXPECT_CALL(*mock_store_, Put(mock_warble_thread_key, testing::_));
+  EXPECT_CALL(*mock_store_,
+              Batch(ElementsAre(OperationOn(StartsWith("warble_")),
+                                OperationOn(mock_user_warbles_key),
+                                OperationOn(mock_warble_thread_key))));
 
   WarbleRequest request;
   request.set_username("Harry Potter");
@@ -486,16 +526,15 @@ TEST_F(WarbleTest, shouldPutHashtagtoKvstoreWhenExists) {
   std::string mock_user_warbles_key = "user_warbles_user_Harry Potter";
   StringVector key_vector = {mock_user_warbles_key};
   std::string hashtag_key = "hashtag_haha";
-  StringVector hashtag_key_vector = {hashtag_key};
 
   StringOptionalVector mock_value_vector = {StringOptional("INIT")};
   EXPECT_CALL(*mock_store_, Get(key_vector))
       .WillOnce(Return(mock_value_vector));
 
-  EXPECT_CALL(*mock_store_, Put(testing::_, testing::_));
-  EXPECT_CALL(*mock_store_, Put(mock_user_warbles_key, testing::_));
-  EXPECT_CALL(*mock_store_, Get(hashtag_key_vector));
-  EXPECT_CALL(*mock_store_, Put(hashtag_key, testing::_));
+  EXPECT_CALL(*mock_store_,
+              Batch(ElementsAre(OperationOn(StartsWith("warble_")),
+                                OperationOn(mock_user_warbles_key),
+                                OperationOn(hashtag_key))));
 
   WarbleRequest request;
   request.set_username("Harry Potter");